@@ -12,6 +12,10 @@ list(APPEND Caffe_LINKER_LIBS PUBLIC ${Boost_LIBRARIES})
 # ---[ Threads
 find_package(Threads REQUIRED)
 list(APPEND Caffe_LINKER_LIBS PRIVATE ${CMAKE_THREAD_LIBS_INIT})
+# shm_open for the shared memory batch ring (in libc from glibc 2.34)
+if(UNIX AND NOT APPLE)
+  list(APPEND Caffe_LINKER_LIBS PRIVATE rt)
+endif()
 
 # ---[ OpenMP
 if(USE_OPENMP)
@@ -66,6 +70,22 @@ if(USE_LEVELDB)
   list(APPEND Caffe_DEFINITIONS PUBLIC -DUSE_LEVELDB)
 endif()
 
+# ---[ LZ4
+if(USE_LZ4)
+  find_package(LZ4 REQUIRED)
+  list(APPEND Caffe_INCLUDE_DIRS PRIVATE ${LZ4_INCLUDE_DIR})
+  list(APPEND Caffe_LINKER_LIBS PRIVATE ${LZ4_LIBRARIES})
+  list(APPEND Caffe_DEFINITIONS PUBLIC -DUSE_LZ4)
+endif()
+
+# ---[ Zstd
+if(USE_ZSTD)
+  find_package(Zstd REQUIRED)
+  list(APPEND Caffe_INCLUDE_DIRS PRIVATE ${Zstd_INCLUDE_DIR})
+  list(APPEND Caffe_LINKER_LIBS PRIVATE ${Zstd_LIBRARIES})
+  list(APPEND Caffe_DEFINITIONS PUBLIC -DUSE_ZSTD)
+endif()
+
 # ---[ Snappy
 if(USE_LEVELDB)
   find_package(Snappy REQUIRED)
@@ -0,0 +1,15 @@
+# Try to find the lz4 libraries and headers
+#  LZ4_FOUND - system has lz4 lib
+#  LZ4_INCLUDE_DIR - the lz4 include directory
+#  LZ4_LIBRARIES - Libraries needed to use lz4
+
+find_path(LZ4_INCLUDE_DIR NAMES lz4.h PATHS "$ENV{LZ4_DIR}/include")
+find_library(LZ4_LIBRARIES NAMES lz4 PATHS "$ENV{LZ4_DIR}/lib")
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LZ4 DEFAULT_MSG LZ4_INCLUDE_DIR LZ4_LIBRARIES)
+
+if(LZ4_FOUND)
+  message(STATUS "Found lz4     (include: ${LZ4_INCLUDE_DIR}, library: ${LZ4_LIBRARIES})")
+  mark_as_advanced(LZ4_INCLUDE_DIR LZ4_LIBRARIES)
+endif()
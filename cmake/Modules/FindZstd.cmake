@@ -0,0 +1,15 @@
+# Try to find the zstd libraries and headers
+#  Zstd_FOUND - system has zstd lib
+#  Zstd_INCLUDE_DIR - the zstd include directory
+#  Zstd_LIBRARIES - Libraries needed to use zstd
+
+find_path(Zstd_INCLUDE_DIR NAMES zstd.h PATHS "$ENV{ZSTD_DIR}/include")
+find_library(Zstd_LIBRARIES NAMES zstd PATHS "$ENV{ZSTD_DIR}/lib")
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Zstd DEFAULT_MSG Zstd_INCLUDE_DIR Zstd_LIBRARIES)
+
+if(ZSTD_FOUND)
+  message(STATUS "Found zstd    (include: ${Zstd_INCLUDE_DIR}, library: ${Zstd_LIBRARIES})")
+  mark_as_advanced(Zstd_INCLUDE_DIR Zstd_LIBRARIES)
+endif()
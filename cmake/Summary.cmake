@@ -118,6 +118,8 @@ function(caffe_print_configuration_summary)
   caffe_status("  USE_LEVELDB       :   ${USE_LEVELDB}")
   caffe_status("  USE_LMDB          :   ${USE_LMDB}")
   caffe_status("  USE_NCCL          :   ${USE_NCCL}")
+  caffe_status("  USE_LZ4           :   ${USE_LZ4}")
+  caffe_status("  USE_ZSTD          :   ${USE_ZSTD}")
   caffe_status("  ALLOW_LMDB_NOLOCK :   ${ALLOW_LMDB_NOLOCK}")
   caffe_status("")
   caffe_status("Dependencies:")
@@ -133,6 +135,12 @@ function(caffe_print_configuration_summary)
     caffe_status("  LevelDB           : " LEVELDB_FOUND THEN  "Yes (ver. ${LEVELDB_VERSION})" ELSE "No")
     caffe_status("  Snappy            : " SNAPPY_FOUND THEN "Yes (ver. ${Snappy_VERSION})" ELSE "No" )
   endif()
+  if(USE_LZ4)
+    caffe_status("  LZ4               : " LZ4_FOUND THEN "Yes" ELSE "No")
+  endif()
+  if(USE_ZSTD)
+    caffe_status("  Zstd              : " ZSTD_FOUND THEN "Yes" ELSE "No")
+  endif()
   if(USE_OPENCV)
     caffe_status("  OpenCV            :   Yes (ver. ${OpenCV_VERSION})")
   endif()
@@ -11,6 +11,10 @@
 
 const int kMaxBlobAxes = 32;
 
+namespace google { namespace protobuf { namespace io {
+class CodedInputStream;
+} } }  // namespace google::protobuf::io
+
 namespace caffe {
 
 /**
@@ -74,6 +78,26 @@ class Blob {
   inline int num_axes() const { return shape_.size(); }
   inline int count() const { return count_; }
 
+  /**
+   * @brief Returns the number of elements between two consecutive indices
+   *        of an axis: count(index + 1) unless this Blob is a strided view
+   *        (see ShareView).
+   */
+  inline int stride(int index) const {
+    const int axis = CanonicalAxisIndex(index);
+    return strides_.empty() ? count(axis + 1) : strides_[axis];
+  }
+  /// @brief Returns the stride of every axis.
+  inline vector<int> strides() const {
+    vector<int> strides(num_axes());
+    for (int i = 0; i < num_axes(); ++i) {
+      strides[i] = stride(i);
+    }
+    return strides;
+  }
+  /// @brief Returns whether the elements are stored densely, in order.
+  inline bool is_contiguous() const { return strides_.empty(); }
+
   /**
    * @brief Compute the volume of a slice; i.e., the product of dimensions
    *        among a range of axes.
@@ -160,11 +184,28 @@ class Blob {
     CHECK_LE(h, height());
     CHECK_GE(width(), 0);
     CHECK_LE(w, width());
+    if (!strides_.empty()) {
+      const int indices[] = {n, c, h, w};
+      int offset = 0;
+      for (int i = 0; i < num_axes() && i < 4; ++i) {
+        offset += indices[i] * strides_[i];
+      }
+      return offset;
+    }
     return ((n * channels() + c) * height() + h) * width() + w;
   }
 
   inline int offset(const vector<int>& indices) const {
     CHECK_LE(indices.size(), num_axes());
+    if (!strides_.empty()) {
+      int offset = 0;
+      for (int i = 0; i < indices.size(); ++i) {
+        CHECK_GE(indices[i], 0);
+        CHECK_LT(indices[i], shape(i));
+        offset += indices[i] * strides_[i];
+      }
+      return offset;
+    }
     int offset = 0;
     for (int i = 0; i < num_axes(); ++i) {
       offset *= shape(i);
@@ -229,6 +270,16 @@ class Blob {
   Dtype* mutable_gpu_diff();
   void Update();
   void FromProto(const BlobProto& proto, bool reshape = true);
+  /**
+   * @brief Copies a serialized BlobProto from input straight into the data
+   *        (and diff, if present) of this blob, without materializing it.
+   *
+   * input must be limited to the message. The shape read is stored in
+   * header. If it differs from the shape of this blob, returns false, and
+   * the values of the blob are left unspecified.
+   */
+  bool FromCodedStream(google::protobuf::io::CodedInputStream* input,
+                       BlobProto* header);
   void ToProto(BlobProto* proto, bool write_diff = false) const;
 
   /// @brief Compute the sum of absolute values (L1 norm) of the data.
@@ -252,6 +303,7 @@ class Blob {
    *
    * This deallocates the SyncedMemory holding this Blob's data_, as
    * shared_ptr calls its destructor when reset with the "=" operator.
+   * A strided view (see ShareView) becomes contiguous again.
    */
   void ShareData(const Blob& other);
   /**
@@ -261,8 +313,32 @@ class Blob {
    *
    * This deallocates the SyncedMemory holding this Blob's diff_, as
    * shared_ptr calls its destructor when reset with the "=" operator.
+   * A strided view (see ShareView) becomes contiguous again.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to a view of the count() elements of the
+   *        data_ of Blob other from offset on, so that writing either one
+   *        writes both.
+   *
+   * The view is dropped for fresh memory if a Reshape changes the shape.
+   */
+  void ShareDataRange(const Blob& other, int offset);
+  /// @brief Set the diff_ shared_ptr to a view of a range of other's diff_,
+  ///        as ShareDataRange does for the data.
+  void ShareDiffRange(const Blob& other, int offset);
+  /**
+   * @brief Make the data_ and diff_ of this Blob views of those of Blob
+   *        other, with the element at indices @f$ i @f$ at
+   *        @f$ offset + \sum_k i_k strides_k @f$ in other, e.g. a crop or a
+   *        slice of other along an inner axis.
+   *
+   * The elements are then not contiguous, and only code going through offset
+   * or strides reads them right: Layer%s taking such bottoms say so with
+   * AllowStridedBottom, and CopyFrom and ToProto refuse them. The view is
+   * dropped for fresh memory if a Reshape changes the shape.
+   */
+  void ShareView(const Blob& other, int offset, const vector<int>& strides);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -271,6 +347,8 @@ class Blob {
   shared_ptr<SyncedMemory> diff_;
   shared_ptr<SyncedMemory> shape_data_;
   vector<int> shape_;
+  /// The stride of each axis if this Blob is a strided view, else empty.
+  vector<int> strides_;
   int count_;
   int capacity_;
 
@@ -166,6 +166,9 @@ class Caffe {
   inline static bool multiprocess() { return Get().multiprocess_; }
   inline static void set_multiprocess(bool val) { Get().multiprocess_ = val; }
   inline static bool root_solver() { return Get().solver_rank_ == 0; }
+  // The NUMA node this thread works for, or -1 (see caffe/util/numa.hpp).
+  inline static int numa_node() { return Get().numa_node_; }
+  inline static void set_numa_node(int val) { Get().numa_node_ = val; }
 
  protected:
 #ifndef CPU_ONLY
@@ -180,6 +183,7 @@ class Caffe {
   int solver_count_;
   int solver_rank_;
   bool multiprocess_;
+  int numa_node_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
@@ -0,0 +1,77 @@
+#ifndef CAFFE_DISTRIBUTED_HPP_
+#define CAFFE_DISTRIBUTED_HPP_
+
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+#include "caffe/solver.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/collectives.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Data-parallel training across processes, e.g. on several CPU hosts,
+ *        with collectives over a Transport.
+ *
+ * Every process runs its own solver on its share of the data (set
+ * Caffe::solver_count and solver_rank before creating the solvers, so
+ * that data layers skip the other ranks' records and only rank 0 tests and
+ * snapshots). Rank 0's weights are broadcast once, and gradients are averaged
+ * over all ranks before every update.
+ *
+ * With layer_wise_reduce, the gradients of each layer are allreduced on a
+ * background thread as soon as its Backward is done, overlapping
+ * communication with the Backward of the layers below. Layers are reduced in
+ * backward order on every rank whatever order they finish in.
+ */
+template <typename Dtype>
+class DistributedSync : public Solver<Dtype>::Callback,
+                        public Net<Dtype>::Callback,
+                        public InternalThread {
+ public:
+  DistributedSync(shared_ptr<Solver<Dtype> > solver,
+                  shared_ptr<Transport> transport);
+  virtual ~DistributedSync();
+
+  /// @brief Copies the weights of rank 0 to the other ranks.
+  void Broadcast();
+
+  /**
+   * @brief Installs the callbacks, broadcasts the weights and trains until
+   *        max_iter. Rank 0 runs Solve, the other ranks just Step.
+   */
+  void Run();
+
+ protected:
+  void on_start() {}
+  void on_gradients_ready();
+  void run(int layer);  // Net callback
+  virtual void InternalThreadEntry();
+  /// @brief Averages the gradients stored in diff_[offset, offset + count).
+  void Reduce(size_t offset, size_t count);
+
+  shared_ptr<Solver<Dtype> > solver_;
+  Collectives<Dtype> collectives_;
+  /// Gradients of all learnable params in one contiguous buffer.
+  shared_ptr<SyncedMemory> diff_;
+  size_t size_;
+  bool layer_wise_;
+  /// Layers with params, in the order they are reduced, and their ranges of
+  /// diff_.
+  vector<int> reduce_layers_;
+  vector<pair<size_t, size_t> > reduce_ranges_;
+  /// Layers whose Backward is done; -1 marks the end of the pass.
+  BlockingQueue<int> ready_;
+  BlockingQueue<int> reduced_;
+
+DISABLE_COPY_AND_ASSIGN(DistributedSync);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DISTRIBUTED_HPP_
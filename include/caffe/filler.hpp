@@ -5,7 +5,10 @@
 #ifndef CAFFE_FILLER_HPP
 #define CAFFE_FILLER_HPP
 
+#include <boost/thread/tss.hpp>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/proto/caffe.pb.h"
@@ -53,8 +56,9 @@ class UniformFiller : public Filler<Dtype> {
       : Filler<Dtype>(param) {}
   virtual void Fill(Blob<Dtype>* blob) {
     CHECK(blob->count());
-    caffe_rng_uniform<Dtype>(blob->count(), Dtype(this->filler_param_.min()),
-        Dtype(this->filler_param_.max()), blob->mutable_cpu_data());
+    caffe_philox_uniform<Dtype>(blob->count(),
+        Dtype(this->filler_param_.min()), Dtype(this->filler_param_.max()),
+        blob->mutable_cpu_data());
     CHECK_EQ(this->filler_param_.sparse(), -1)
          << "Sparsity not supported by this Filler.";
   }
@@ -69,8 +73,9 @@ class GaussianFiller : public Filler<Dtype> {
   virtual void Fill(Blob<Dtype>* blob) {
     Dtype* data = blob->mutable_cpu_data();
     CHECK(blob->count());
-    caffe_rng_gaussian<Dtype>(blob->count(), Dtype(this->filler_param_.mean()),
-        Dtype(this->filler_param_.std()), blob->mutable_cpu_data());
+    caffe_philox_gaussian<Dtype>(blob->count(),
+        Dtype(this->filler_param_.mean()), Dtype(this->filler_param_.std()),
+        blob->mutable_cpu_data());
     int sparse = this->filler_param_.sparse();
     CHECK_GE(sparse, -1);
     if (sparse >= 0) {
@@ -83,7 +88,7 @@ class GaussianFiller : public Filler<Dtype> {
       Dtype non_zero_probability = Dtype(sparse) / Dtype(num_outputs);
       rand_vec_.reset(new SyncedMemory(blob->count() * sizeof(int)));
       int* mask = reinterpret_cast<int*>(rand_vec_->mutable_cpu_data());
-      caffe_rng_bernoulli(blob->count(), non_zero_probability, mask);
+      caffe_philox_bernoulli(blob->count(), non_zero_probability, mask);
       for (int i = 0; i < blob->count(); ++i) {
         data[i] *= mask[i];
       }
@@ -105,7 +110,8 @@ class PositiveUnitballFiller : public Filler<Dtype> {
   virtual void Fill(Blob<Dtype>* blob) {
     Dtype* data = blob->mutable_cpu_data();
     DCHECK(blob->count());
-    caffe_rng_uniform<Dtype>(blob->count(), 0, 1, blob->mutable_cpu_data());
+    caffe_philox_uniform<Dtype>(blob->count(), 0, 1,
+        blob->mutable_cpu_data());
     // We expect the filler to not be called very frequently, so we will
     // just use a simple implementation
     int dim = blob->count() / blob->shape(0);
@@ -161,7 +167,7 @@ class XavierFiller : public Filler<Dtype> {
       n = fan_out;
     }
     Dtype scale = sqrt(Dtype(3) / n);
-    caffe_rng_uniform<Dtype>(blob->count(), -scale, scale,
+    caffe_philox_uniform<Dtype>(blob->count(), -scale, scale,
         blob->mutable_cpu_data());
     CHECK_EQ(this->filler_param_.sparse(), -1)
          << "Sparsity not supported by this Filler.";
@@ -206,7 +212,7 @@ class MSRAFiller : public Filler<Dtype> {
       n = fan_out;
     }
     Dtype std = sqrt(Dtype(2) / n);
-    caffe_rng_gaussian<Dtype>(blob->count(), Dtype(0), std,
+    caffe_philox_gaussian<Dtype>(blob->count(), Dtype(0), std,
         blob->mutable_cpu_data());
     CHECK_EQ(this->filler_param_.sparse(), -1)
          << "Sparsity not supported by this Filler.";
@@ -267,6 +273,82 @@ class BilinearFiller : public Filler<Dtype> {
   }
 };
 
+/**
+ * @brief Records the fills requested, on the thread that creates it, through
+ *        the fillers GetFiller returns while it is active, instead of running
+ *        them.
+ *
+ * Net uses it to skip filling the params it is about to load from weights
+ * files: the fills of the blobs that get loaded are cancelled, and only the
+ * rest are run. Blobs are not touched until then, so a loaded blob is
+ * allocated and written only once.
+ */
+template <typename Dtype>
+class DeferredFills {
+ public:
+  DeferredFills() : previous_(current()) {
+    instance().reset(this);
+  }
+  ~DeferredFills() { Deactivate(); }
+
+  /// @brief The instance recording fills on this thread, if any.
+  static DeferredFills* current() { return instance().get(); }
+  /// @brief Stops recording fills on this thread.
+  void Deactivate() {
+    if (current() == this) {
+      instance().reset(previous_);
+    }
+  }
+
+  void Add(Blob<Dtype>* blob, shared_ptr<Filler<Dtype> > filler) {
+    fills_.push_back(std::make_pair(blob, filler));
+  }
+  /// @brief Drops the fills of blob, e.g. once its values have been loaded.
+  void Cancel(const Blob<Dtype>* blob) {
+    for (int i = 0; i < fills_.size(); ++i) {
+      if (fills_[i].first == blob) {
+        fills_[i].first = NULL;
+      }
+    }
+  }
+  /// @brief Runs the fills that were not cancelled, in the order requested.
+  void Fill() {
+    for (int i = 0; i < fills_.size(); ++i) {
+      if (fills_[i].first) {
+        fills_[i].second->Fill(fills_[i].first);
+      }
+    }
+    fills_.clear();
+  }
+
+ private:
+  static void NoCleanup(DeferredFills*) {}
+  static boost::thread_specific_ptr<DeferredFills>& instance() {
+    static boost::thread_specific_ptr<DeferredFills> instance_(&NoCleanup);
+    return instance_;
+  }
+
+  DeferredFills* previous_;
+  vector<std::pair<Blob<Dtype>*, shared_ptr<Filler<Dtype> > > > fills_;
+
+  DISABLE_COPY_AND_ASSIGN(DeferredFills);
+};
+
+/// @brief Hands the fills of another Filler over to DeferredFills.
+template <typename Dtype>
+class DeferredFiller : public Filler<Dtype> {
+ public:
+  DeferredFiller(Filler<Dtype>* filler, DeferredFills<Dtype>* fills)
+      : Filler<Dtype>(FillerParameter()), filler_(filler), fills_(fills) {}
+  virtual void Fill(Blob<Dtype>* blob) {
+    fills_->Add(blob, filler_);
+  }
+
+ protected:
+  shared_ptr<Filler<Dtype> > filler_;
+  DeferredFills<Dtype>* fills_;
+};
+
 /**
  * @brief Get a specific filler from the specification given in FillerParameter.
  *
@@ -276,24 +358,26 @@ class BilinearFiller : public Filler<Dtype> {
 template <typename Dtype>
 Filler<Dtype>* GetFiller(const FillerParameter& param) {
   const std::string& type = param.type();
+  Filler<Dtype>* filler = NULL;
   if (type == "constant") {
-    return new ConstantFiller<Dtype>(param);
+    filler = new ConstantFiller<Dtype>(param);
   } else if (type == "gaussian") {
-    return new GaussianFiller<Dtype>(param);
+    filler = new GaussianFiller<Dtype>(param);
   } else if (type == "positive_unitball") {
-    return new PositiveUnitballFiller<Dtype>(param);
+    filler = new PositiveUnitballFiller<Dtype>(param);
   } else if (type == "uniform") {
-    return new UniformFiller<Dtype>(param);
+    filler = new UniformFiller<Dtype>(param);
   } else if (type == "xavier") {
-    return new XavierFiller<Dtype>(param);
+    filler = new XavierFiller<Dtype>(param);
   } else if (type == "msra") {
-    return new MSRAFiller<Dtype>(param);
+    filler = new MSRAFiller<Dtype>(param);
   } else if (type == "bilinear") {
-    return new BilinearFiller<Dtype>(param);
+    filler = new BilinearFiller<Dtype>(param);
   } else {
     CHECK(false) << "Unknown filler name: " << param.type();
   }
-  return (Filler<Dtype>*)(NULL);
+  DeferredFills<Dtype>* deferred = DeferredFills<Dtype>::current();
+  return deferred ? new DeferredFiller<Dtype>(filler, deferred) : filler;
 }
 
 }  // namespace caffe
@@ -24,7 +24,8 @@ class InternalThread {
   /**
    * Caffe's thread local state will be initialized using the current
    * thread values, e.g. device id, solver index etc. The random seed
-   * is initialized using caffe_rng_rand.
+   * is initialized using caffe_rng_rand. The thread is pinned to its NUMA
+   * node as the NumaPolicy says for prefetch threads.
    */
   void StartInternalThread();
 
@@ -43,7 +44,7 @@ class InternalThread {
 
  private:
   void entry(int device, Caffe::Brew mode, int rand_seed,
-      int solver_count, int solver_rank, bool multiprocess);
+      int solver_count, int solver_rank, bool multiprocess, int numa_node);
 
   shared_ptr<boost::thread> thread_;
 };
@@ -69,6 +69,7 @@ class Layer {
     CheckBlobCounts(bottom, top);
     LayerSetUp(bottom, top);
     Reshape(bottom, top);
+    RecordReshape(bottom, top);
     SetLossWeights(top);
   }
 
@@ -269,6 +270,71 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether the layer can take a strided view (see
+   *        Blob::ShareView) as a given bottom blob index, reading its data
+   *        and writing its diff through Blob::offset or Blob::strides.
+   *
+   * If so, Net may make the tops of Slice and Crop layers feeding it strided
+   * views of their inputs rather than copies (see NetParameter.strided_views).
+   */
+  virtual inline bool AllowStridedBottom(const int bottom_index) const {
+    return false;
+  }
+
+  /**
+   * @brief Return the offset in bottom[0] from which a given top blob index
+   *        is a part of bottom[0] with the same strides, or -1.
+   *
+   * Net may make such a top a strided view of bottom[0] and skip the copy;
+   * the layer must then leave it in place.
+   */
+  virtual inline int StridedTopOffset(const int top_index) const {
+    return -1;
+  }
+
+  /**
+   * @brief Return whether Forward may run again on the same bottoms before
+   *        Backward, giving the same tops and leaving the same state.
+   *
+   * Net recomputes the tops of such layers in Backward rather than keeping
+   * them when checkpointing (see NetParameter.gradient_checkpointing). Layers
+   * that draw random numbers or update their state in Forward, e.g. Dropout
+   * in training, return false.
+   */
+  virtual inline bool AllowRecompute() const { return true; }
+
+  /**
+   * @brief Return whether Reshape depends only on the shapes and memory of
+   *        the bottom and top blobs.
+   *
+   * If so, ReshapeIfChanged skips Reshape while they are the same as after
+   * the last one. Layers that read the data of their bottoms to shape their
+   * tops, e.g. Filter, return false.
+   */
+  virtual inline bool AllowSkipReshape() const { return true; }
+
+  /**
+   * @brief Reshapes the layer as Reshape, unless the bottom and top blobs
+   *        have the same shapes and memory as after its last Reshape, by
+   *        SetUp, Forward or this method. Returns whether it reshaped.
+   *
+   * Forward and Net::Reshape call it, so that a net fed inputs of the same
+   * shape does not walk the shape logic of its layers again, and a net
+   * reshaped to new inputs only reshapes the layers whose bottoms changed.
+   * The internal buffers of layers, like all blobs, keep the largest
+   * capacity they were reshaped to.
+   */
+  bool ReshapeIfChanged(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    if (AllowSkipReshape() && SameAsReshaped(bottom, top)) {
+      return false;
+    }
+    Reshape(bottom, top);
+    RecordReshape(bottom, top);
+    return true;
+  }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -403,6 +469,48 @@ class Layer {
   }
 
  private:
+  /// The memory of the data and diff of a blob, without allocating it.
+  static inline const void* BlobMemory(const Blob<Dtype>& blob, bool diff) {
+    if (blob.count() == 0) { return NULL; }
+    return diff ? blob.diff().get() : blob.data().get();
+  }
+
+  /// Records the shapes and memory of the blobs after Reshape.
+  void RecordReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    const int num_blobs = bottom.size() + top.size();
+    reshaped_shapes_.resize(num_blobs);
+    reshaped_memory_.resize(2 * num_blobs);
+    for (int i = 0; i < num_blobs; ++i) {
+      const Blob<Dtype>& blob = i < bottom.size() ? *bottom[i] :
+          *top[i - bottom.size()];
+      reshaped_shapes_[i] = blob.shape();
+      reshaped_memory_[2 * i] = BlobMemory(blob, false);
+      reshaped_memory_[2 * i + 1] = BlobMemory(blob, true);
+    }
+  }
+
+  bool SameAsReshaped(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    const int num_blobs = bottom.size() + top.size();
+    if (reshaped_shapes_.size() != num_blobs) { return false; }
+    for (int i = 0; i < num_blobs; ++i) {
+      const Blob<Dtype>& blob = i < bottom.size() ? *bottom[i] :
+          *top[i - bottom.size()];
+      if (blob.shape() != reshaped_shapes_[i] ||
+          BlobMemory(blob, false) != reshaped_memory_[2 * i] ||
+          BlobMemory(blob, true) != reshaped_memory_[2 * i + 1]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// The shapes of the bottom and top blobs after the last Reshape, and the
+  /// memory of their data and diff.
+  vector<vector<int> > reshaped_shapes_;
+  vector<const void*> reshaped_memory_;
+
   DISABLE_COPY_AND_ASSIGN(Layer);
 };  // class Layer
 
@@ -413,7 +521,7 @@ template <typename Dtype>
 inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   Dtype loss = 0;
-  Reshape(bottom, top);
+  ReshapeIfChanged(bottom, top);
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Forward_cpu(bottom, top);
@@ -0,0 +1,95 @@
+#ifndef CAFFE_ADAPTIVE_SOFTMAX_LOSS_LAYER_HPP_
+#define CAFFE_ADAPTIVE_SOFTMAX_LOSS_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/loss_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Computes the softmax loss of an inner product over a large number of
+ *        classes with a two-level hierarchy of softmaxes (Grave et al.,
+ *        "Efficient softmax approximation for GPUs", 2017).
+ *
+ * The classes, sorted by decreasing frequency, are split by cutoff into a head
+ * of frequent classes and tail clusters. The head softmax scores the head
+ * classes and one entry per cluster for every example; a cluster's softmax,
+ * over its own classes, is only computed for the examples whose label is in
+ * it, and @f$ p(c) = p_{head}(cluster(c)) p_{cluster}(c) @f$. The probabilities
+ * over all classes still sum to one, for a cost per example of the head plus
+ * one cluster instead of all the classes.
+ *
+ * The layer owns, in this order, the @f$ N \times K @f$ class weights and
+ * @f$ N @f$ biases, in the layout of InnerProductLayer, then the
+ * @f$ T \times K @f$ weights and @f$ T @f$ biases of the T clusters.
+ *
+ * @param bottom input Blob vector (length 2)
+ *   -# @f$ (M \times K) @f$ the features @f$ x @f$, with the axes from 1 on
+ *      flattened as by InnerProductLayer
+ *   -# @f$ (M) @f$ the labels @f$ l @f$
+ * @param top output Blob vector (length 1-2)
+ *   -# @f$ (1) @f$ the loss
+ *   -# @f$ (1) @f$ optionally, the top_k accuracy. Only the head and the
+ *      eval_clusters clusters with the highest head probability are searched,
+ *      so a label outside of these counts as a miss.
+ */
+template <typename Dtype>
+class AdaptiveSoftmaxWithLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit AdaptiveSoftmaxWithLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "AdaptiveSoftmaxWithLoss"; }
+  virtual inline int ExactNumTopBlobs() const { return -1; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// @brief Computes the approximate top_k accuracy from head_prob_.
+  Dtype TopKAccuracy(const vector<Blob<Dtype>*>& bottom);
+  /// @brief Replaces the rows of logits by their softmax.
+  void Softmax(int rows, int cols, Dtype* logits);
+  Dtype get_normalizer(int valid_count) const;
+
+  /// The indices of the cluster weights and biases in blobs_.
+  int cluster_weight_index() const { return bias_term_ ? 2 : 1; }
+
+  int M_;
+  int K_;
+  int N_;
+  int head_size_;
+  bool bias_term_;
+  bool has_ignore_label_;
+  int ignore_label_;
+  LossParameter_NormalizationMode normalization_;
+  Dtype normalizer_;
+  /// The first class of each cluster, and N_.
+  vector<int> cluster_start_;
+  /// The weights of the head classes and of the clusters, side by side.
+  Blob<Dtype> head_weight_;
+  /// The head softmax output, M_ x (head classes + clusters).
+  Blob<Dtype> head_prob_;
+  /// For each cluster, the examples with a label in it, their features and
+  /// the softmax over the cluster's classes.
+  vector<vector<int> > cluster_examples_;
+  vector<shared_ptr<Blob<Dtype> > > cluster_x_;
+  vector<shared_ptr<Blob<Dtype> > > cluster_prob_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_ADAPTIVE_SOFTMAX_LOSS_LAYER_HPP_
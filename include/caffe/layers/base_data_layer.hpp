@@ -8,7 +8,7 @@
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/lock_free_ring.hpp"
 
 namespace caffe {
 
@@ -46,7 +46,31 @@ class BaseDataLayer : public Layer<Dtype> {
 template <typename Dtype>
 class Batch {
  public:
+  Batch() : load_ms_(0) {}
   Blob<Dtype> data_, label_;
+  // The time the prefetch thread took to load the batch.
+  double load_ms_;
+};
+
+/**
+ * @brief Counters of the prefetch queue of a BasePrefetchingDataLayer,
+ *        summed over the batches it has output.
+ */
+struct PrefetchStats {
+  PrefetchStats()
+      : batches(0), depth(0), ready(0), wait_ms(0), load_ms(0),
+        compute_ms(0) {}
+  int batches;
+  // The batches in flight now, the one output included.
+  int depth;
+  // The batches found loaded and waiting at each Forward.
+  double ready;
+  // The time Forward waited for a batch to be loaded.
+  double wait_ms;
+  // The time the prefetch thread took to load the batches.
+  double load_ms;
+  // The time the net took between two Forwards of the layer.
+  double compute_ms;
 };
 
 template <typename Dtype>
@@ -65,14 +89,30 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  const PrefetchStats& prefetch_stats() const { return prefetch_stats_; }
+
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Hands the current batch back and waits for the next one to be current.
+  void NextBatch();
+  // Sets the number of batches in flight from the last window of batches.
+  void AdaptPrefetch();
 
   vector<shared_ptr<Batch<Dtype> > > prefetch_;
-  BlockingQueue<Batch<Dtype>*> prefetch_free_;
-  BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  LockFreeRing<Batch<Dtype>*> prefetch_free_;
+  LockFreeRing<Batch<Dtype>*> prefetch_full_;
   Batch<Dtype>* prefetch_current_;
+  // The number of batches to keep in flight, and its bound when it adapts,
+  // or 0.
+  int prefetch_target_;
+  int max_prefetch_;
+  PrefetchStats prefetch_stats_;
+  // The counters since the depth was last adapted, the fewest batches found
+  // waiting over that window, and when the last Forward got its batch.
+  PrefetchStats window_;
+  int window_min_ready_;
+  double last_batch_ms_;
 
   Blob<Dtype> transformed_data_;
 };
@@ -9,6 +9,8 @@
 
 namespace caffe {
 
+class TaskGraphExecutor;
+
 /**
  * @brief Normalizes the input to have 0-mean and/or unit (1) variance across
  *        the batch.
@@ -49,6 +51,8 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "BatchNorm"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  // Forward updates the moving averages unless it uses them.
+  virtual inline bool AllowRecompute() const { return use_global_stats_; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -60,6 +64,9 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // In CPU mode, variance_ holds sqrt(var(X) + eps) after Forward, and
+  // x_norm_ the normalized data only when computing in place, as Backward
+  // can recompute it from the bottom otherwise; temp_ is for GPU mode only.
   Blob<Dtype> mean_, variance_, temp_, x_norm_;
   bool use_global_stats_;
   Dtype moving_average_fraction_;
@@ -71,6 +78,9 @@ class BatchNormLayer : public Layer<Dtype> {
   Blob<Dtype> batch_sum_multiplier_;
   Blob<Dtype> num_by_chans_;
   Blob<Dtype> spatial_sum_multiplier_;
+
+  // Runs the CPU kernels of several channels at once, if num_threads > 1.
+  shared_ptr<TaskGraphExecutor> executor_;
 };
 
 }  // namespace caffe
@@ -26,6 +26,10 @@ class ConcatLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Concat"; }
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// Strided bottoms are gathered into the top; a single bottom is shared.
+  virtual inline bool AllowStridedBottom(const int bottom_index) const {
+    return this->layer_param_.bottom_size() > 1;
+  }
 
  protected:
   /**
@@ -30,6 +30,13 @@ class CropLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Crop"; }
   virtual inline int ExactNumBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  /// Only the shape of the second bottom is read.
+  virtual inline bool AllowStridedBottom(const int bottom_index) const {
+    return bottom_index == 1;
+  }
+  virtual inline int StridedTopOffset(const int top_index) const {
+    return top_offset_;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -44,6 +51,11 @@ class CropLayer : public Layer<Dtype> {
   Blob<int> offsets;
   Blob<int> src_strides_;
   Blob<int> dest_strides_;
+  /// The offset of the crop in bottom[0].
+  int top_offset_;
+  /// The top diff, set aside while Backward zeroes the bottom diff under it
+  /// if the top is a view (see StridedTopOffset).
+  Blob<Dtype> view_diff_;
 
  private:
   // Recursive copy function.
@@ -9,6 +9,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/compression.hpp"
 #include "caffe/util/db.hpp"
 
 namespace caffe {
@@ -29,10 +30,28 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   void Next();
   bool Skip();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Keeps a transformed item while the cache is being filled.
+  void CacheItem(const Blob<Dtype>& item, Dtype label);
 
   shared_ptr<db::DB> db_;
   shared_ptr<db::Cursor> cursor_;
+  // Restores compressed Datums; used by the prefetch thread only.
+  DatumCodec codec_;
   uint64_t offset_;
+
+  // A transformed item of the source and its label.
+  struct CachedItem {
+    vector<int> shape;
+    vector<Dtype> data;
+    Dtype label;
+  };
+  // Whether the cache is being filled, or complete and replayed.
+  bool caching_;
+  bool cache_complete_;
+  vector<CachedItem> cache_;
+  size_t cache_bytes_;
+  // Index of the cursor's record in the source.
+  size_t position_;
 };
 
 }  // namespace caffe
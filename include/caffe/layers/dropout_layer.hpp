@@ -39,6 +39,8 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  // The mask is drawn anew in each training Forward.
+  virtual inline bool AllowRecompute() const { return this->phase_ != TRAIN; }
 
  protected:
   /**
@@ -28,6 +28,8 @@ class FilterLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Filter"; }
   virtual inline int MinBottomBlobs() const { return 2; }
   virtual inline int MinTopBlobs() const { return 1; }
+  // The shapes of the tops depend on the data of the selector.
+  virtual inline bool AllowSkipReshape() const { return false; }
 
  protected:
   /**
@@ -18,8 +18,9 @@ template <typename Dtype> class RecurrentLayer;
 
 /**
  * @brief Processes sequential inputs using a "Long Short-Term Memory" (LSTM)
- *        [1] style recurrent neural network (RNN). Implemented by unrolling
- *        the LSTM computation through time.
+ *        [1] style recurrent neural network (RNN). Implemented either by
+ *        unrolling the LSTM computation through time, or by a fused kernel
+ *        running all timesteps on the CPU (see RecurrentParameter.engine).
  *
  * The specific architecture used in this implementation is as described in
  * "Learning to Execute" [2], reproduced below:
@@ -48,7 +49,13 @@ template <typename Dtype>
 class LSTMLayer : public RecurrentLayer<Dtype> {
  public:
   explicit LSTMLayer(const LayerParameter& param)
-      : RecurrentLayer<Dtype>(param) {}
+      : RecurrentLayer<Dtype>(param), fused_(false) {}
+
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reset();
 
   virtual inline const char* type() const { return "LSTM"; }
 
@@ -58,6 +65,40 @@ class LSTMLayer : public RecurrentLayer<Dtype> {
   virtual void RecurrentOutputBlobNames(vector<string>* names) const;
   virtual void RecurrentInputShapes(vector<BlobShape>* shapes) const;
   virtual void OutputBlobNames(vector<string>* names) const;
+
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /**
+   * @brief Whether the fused kernel is used instead of the unrolled net.
+   *
+   * The fused kernel keeps the params of the unrolled net, in the same order
+   * (W_xc, b_c, W_xc_static if there is a static input, W_hc), so the two
+   * are interchangeable in saved models.
+   */
+  bool fused_;
+  /// @brief The hidden dimension D, the input dimension and the static input
+  ///        dimension.
+  int hidden_dim_;
+  int input_dim_;
+  int static_dim_;
+  /// @brief The gate activations [i, f, o, g] of all timesteps (T x N x 4D).
+  Blob<Dtype> gates_;
+  /// @brief The cell states c_t of all timesteps (T x N x D).
+  Blob<Dtype> cell_;
+  /// @brief The previous hidden states times cont_t of all timesteps
+  ///        (T x N x D), the input of the recurrent inner product.
+  Blob<Dtype> h_conted_;
+  /// @brief W_xc_static * x_static, added to the gate inputs of each timestep.
+  Blob<Dtype> static_gates_;
+  Blob<Dtype> bias_multiplier_;
+  /// @brief The hidden and cell states before the first and after the last
+  ///        timestep (1 x N x D).
+  Blob<Dtype> h_0_, c_0_, h_T_, c_T_;
 };
 
 /**
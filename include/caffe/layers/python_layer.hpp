@@ -35,6 +35,9 @@ class PythonLayer : public Layer<Dtype> {
   }
 
   virtual inline const char* type() const { return "Python"; }
+  // Nothing is known of what forward and reshape do.
+  virtual inline bool AllowRecompute() const { return false; }
+  virtual inline bool AllowSkipReshape() const { return false; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -1,6 +1,7 @@
 #ifndef CAFFE_RECURRENT_LAYER_HPP_
 #define CAFFE_RECURRENT_LAYER_HPP_
 
+#include <map>
 #include <string>
 #include <utility>
 #include <vector>
@@ -21,6 +22,12 @@ template <typename Dtype> class RecurrentLayer;
  *        unrolled network.  This Layer type cannot be instantiated -- instead,
  *        you should use one of its implementations which defines the recurrent
  *        architecture, such as RNNLayer or LSTMLayer.
+ *
+ * The number of timesteps may change between batches: a net is unrolled for
+ * each number of timesteps seen, and kept for reuse. Unless expose_hidden is
+ * set, the hidden state at the last timestep is carried over to the next
+ * batch (with cont = 1), so a stream can also be processed one timestep per
+ * Forward; call Reset to start over.
  */
 template <typename Dtype>
 class RecurrentLayer : public Layer<Dtype> {
@@ -59,6 +66,10 @@ class RecurrentLayer : public Layer<Dtype> {
     return bottom_index != 1;
   }
 
+  // Without exposed hidden state, Forward carries the last timestep's state
+  // over to the next call.
+  virtual inline bool AllowRecompute() const { return expose_hidden_; }
+
  protected:
   /**
    * @brief Fills net_param with the recurrent network architecture.  Subclasses
@@ -147,15 +158,25 @@ class RecurrentLayer : public Layer<Dtype> {
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /**
+   * @brief Sets unrolled_net_ to the net unrolled for T_ timesteps, creating
+   *        it if needed, and points the input and output blobs into it.
+   */
+  void UnrollNet(const vector<Blob<Dtype>*>& bottom);
+  /// @brief Makes the params of unrolled_net_ use this layer's blobs.
+  void ShareParams();
+
   /// @brief A Net to implement the Recurrent functionality.
   shared_ptr<Net<Dtype> > unrolled_net_;
+  /// @brief The nets unrolled so far, by number of timesteps.
+  map<int, shared_ptr<Net<Dtype> > > unrolled_nets_;
 
   /// @brief The number of independent streams to process simultaneously.
   int N_;
 
   /**
-   * @brief The number of timesteps in the layer's input, and the number of
-   *        timesteps over which to backpropagate through time.
+   * @brief The number of timesteps in the layer's current input, and the
+   *        number of timesteps over which to backpropagate through time.
    */
   int T_;
 
@@ -0,0 +1,94 @@
+#ifndef CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
+#define CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/loss_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Computes the softmax loss of an inner product over a large number of
+ *        classes, scoring in TRAIN only the true class and a sample of
+ *        negative classes (Jean et al., "On Using Very Large Target Vocabulary
+ *        for Neural Machine Translation", 2015).
+ *
+ * The layer owns the weights of the final inner product, in the layout of
+ * InnerProductLayer (@f$ N \times K @f$ weights and @f$ N @f$ biases), so that
+ * they can be shared with an InnerProduct + Softmax deploy net. Each TRAIN
+ * forward draws @f$ S @f$ classes @f$ s_j @f$ with replacement from the
+ * sampler @f$ Q @f$ and computes the softmax loss of example @f$ n @f$ over
+ * the logits @f$ w_c^\top x_n + b_c - \log(S Q(c)) @f$ of
+ * @f$ c \in \{l_n, s_1, ..., s_S\} @f$. Subtracting the log expected count
+ * corrects for the sampler, so that the gradients approach those of the full
+ * softmax loss as S grows, at a cost of @f$ O(M S K) @f$ instead of
+ * @f$ O(M N K) @f$. In TEST the full softmax loss is computed.
+ *
+ * @param bottom input Blob vector (length 2-3)
+ *   -# @f$ (M \times K) @f$ the features @f$ x @f$, with the axes from 1 on
+ *      flattened as by InnerProductLayer
+ *   -# @f$ (M) @f$ the labels @f$ l @f$
+ *   -# @f$ (S) @f$ optional sampled classes to use instead of drawing them,
+ *      e.g. to share a sample between layers
+ * @param top output Blob vector (length 1)
+ *   -# @f$ (1) @f$ the loss
+ */
+template <typename Dtype>
+class SampledSoftmaxWithLossLayer : public LossLayer<Dtype> {
+ public:
+  explicit SampledSoftmaxWithLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "SampledSoftmaxWithLoss"; }
+  virtual inline int ExactNumBottomBlobs() const { return -1; }
+  virtual inline int MinBottomBlobs() const { return 2; }
+  virtual inline int MaxBottomBlobs() const { return 3; }
+  virtual inline bool AllowForceBackward(const int bottom_index) const {
+    return bottom_index == 0;
+  }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// @brief Returns @f$ \log(S Q(c)) @f$, the log expected count of class c.
+  Dtype LogExpectedCount(int c) const;
+  /// @brief Fills sampled_ with num_sampled_ draws from the sampler.
+  void Sample();
+  Dtype get_normalizer(int valid_count) const;
+
+  int M_;
+  int K_;
+  int N_;
+  int num_sampled_;
+  bool bias_term_;
+  bool remove_accidental_hits_;
+  bool has_ignore_label_;
+  int ignore_label_;
+  LossParameter_NormalizationMode normalization_;
+  Dtype normalizer_;
+  /// Whether the last forward only scored the sampled classes.
+  bool sampled_mode_;
+  /// The sampled classes.
+  vector<int> sampled_;
+  /// The weights of the sampled classes, gathered, and their gradients.
+  Blob<Dtype> sampled_weight_;
+  /// The probabilities of the scored classes, per example: all classes, or
+  /// the sampled ones in sampled mode, the true class being in true_prob_.
+  Blob<Dtype> prob_;
+  Blob<Dtype> true_prob_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_SAMPLED_SOFTMAX_LOSS_LAYER_HPP_
@@ -0,0 +1,53 @@
+#ifndef CAFFE_SHARED_MEMORY_DATA_LAYER_HPP_
+#define CAFFE_SHARED_MEMORY_DATA_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/shm_ring.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Provides batches published to a shared memory ring by the
+ *        data_loader tool, which reads, decodes and transforms them once
+ *        for all the training processes on a host.
+ *
+ * The tops point straight into the ring's slot: the batch is not copied
+ * (except to convert it when Dtype is double) and the slot is held until
+ * the next Forward. Whether each process gets every batch or a shard of
+ * them is up to the loader. In broadcast mode the slot is shared between
+ * processes, so layers must not compute in place on these tops.
+ */
+template <typename Dtype>
+class SharedMemoryDataLayer : public Layer<Dtype> {
+ public:
+  explicit SharedMemoryDataLayer(const LayerParameter& param)
+      : Layer<Dtype>(param), reading_(false) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  // Data layers have no bottoms, so reshaping is trivial.
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {}
+
+  virtual inline const char* type() const { return "SharedMemoryData"; }
+  virtual inline int ExactNumBottomBlobs() const { return 0; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+
+  shared_ptr<ShmBatchRing> ring_;
+  // Whether the tops point into a slot of the ring.
+  bool reading_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_SHARED_MEMORY_DATA_LAYER_HPP_
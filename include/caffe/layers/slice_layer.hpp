@@ -28,6 +28,9 @@ class SliceLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Slice"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int StridedTopOffset(const int top_index) const {
+    return top_index < top_offsets_.size() ? top_offsets_[top_index] : -1;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -44,6 +47,8 @@ class SliceLayer : public Layer<Dtype> {
   int slice_size_;
   int slice_axis_;
   vector<int> slice_point_;
+  /// The offset of each top in the bottom, if there are several.
+  vector<int> top_offsets_;
 };
 
 }  // namespace caffe
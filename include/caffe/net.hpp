@@ -14,6 +14,9 @@
 
 namespace caffe {
 
+class TaskGraphExecutor;
+template <typename Dtype> class DeferredFills;
+
 /**
  * @brief Connects Layer%s together into a directed acyclic graph (DAG)
  *        specified by a NetParameter.
@@ -23,13 +26,21 @@ namespace caffe {
 template <typename Dtype>
 class Net {
  public:
-  explicit Net(const NetParameter& param);
+  explicit Net(const NetParameter& param,
+      const vector<string>* weights = NULL);
   explicit Net(const string& param_file, Phase phase,
-      const int level = 0, const vector<string>* stages = NULL);
+      const int level = 0, const vector<string>* stages = NULL,
+      const vector<string>* weights = NULL);
   virtual ~Net() {}
 
-  /// @brief Initialize a network with a NetParameter.
-  void Init(const NetParameter& param);
+  /**
+   * @brief Initialize a network with a NetParameter.
+   *
+   * If weights files are given, they are loaded in order, as by
+   * CopyTrainedLayersFrom, as part of the initialization. The params they
+   * supply are then not filled first; only the others are.
+   */
+  void Init(const NetParameter& param, const vector<string>* weights = NULL);
 
   /**
    * @brief Run Forward and return the result.
@@ -54,6 +65,15 @@ class Net {
   Dtype ForwardFromTo(int start, int end);
   Dtype ForwardFrom(int start);
   Dtype ForwardTo(int end);
+  /**
+   * @brief Runs only the layers the given blobs depend on, and returns the
+   *        loss of those layers.
+   *
+   * Layers that none of the blobs need, such as the loss and accuracy layers
+   * past a feature blob, are skipped. The layers to run are worked out from
+   * the blob dependency graph once for each set of blob names.
+   */
+  Dtype ForwardBlobs(const vector<string>& blob_names);
   /// @brief DEPRECATED; set input blobs then use Forward() instead.
   const vector<Blob<Dtype>*>& Forward(const vector<Blob<Dtype>* > & bottom,
       Dtype* loss = NULL);
@@ -216,6 +236,18 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  /**
+   * @brief Sets the number of threads used to run independent branches of
+   *        the net concurrently in CPU mode.
+   *
+   * With more than one thread, Forward and Backward schedule each layer as
+   * soon as the layers it depends on are done, rather than in the order the
+   * layers are specified. Callbacks are then invoked from the worker threads,
+   * one at a time.
+   */
+  void set_branch_threads(const int num_threads);
+  inline int branch_threads() const { return branch_threads_; }
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -265,6 +297,40 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /// @brief Helper for CopyTrainedLayersFromBinaryProto: copies the blobs
+  ///        of one serialized LayerParameter, read from input.
+  void CopyTrainedLayerFromStream(
+      google::protobuf::io::CodedInputStream* input);
+
+  /// @brief Builds the layer dependency graphs used to run branches
+  ///        concurrently.
+  void InitBranchGraph();
+  /// @brief Runs the Forward of the given layers, in order.
+  Dtype ForwardLayers(const vector<int>& layer_ids);
+  /// @brief Runs ForwardLayers on the branch scheduler.
+  Dtype ForwardBranches(const vector<int>& layer_ids);
+  /// @brief Runs BackwardFromTo on the branch scheduler.
+  void BackwardBranches(int start, int end);
+  class BranchTask;
+  /// @brief Makes the inputs of Concat layers and the outputs of Slice
+  ///        layers views of their parts of the concatenated blobs, where
+  ///        nothing else writes them, so that these layers copy nothing;
+  ///        with strided_views, also strided views of the tops of Slice
+  ///        and Crop layers read only by layers that take them.
+  void ShareViews();
+  /// @brief Gives back their own memory to the blobs ShareViews made views.
+  void UnshareViews();
+  /// @brief Records the view ShareViews made of the data or diff of a blob,
+  ///        and shares it with the blobs of the same root.
+  void RecordView(const int blob_id, const bool diff,
+                  const vector<int>& root);
+  /// @brief Splits the layers into the segments of gradient checkpointing.
+  void InitSegments(const NetParameter& param);
+  /// @brief Helper for ShareViews: makes the blobs recomputed in Backward
+  ///        views of checkpoint_pool_, given the roots ShareViews found.
+  void ShareCheckpointPool(const vector<int>& data_root,
+      const vector<int>& diff_root, const vector<int>& creator,
+      const vector<int>& last_write);
 
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
@@ -335,6 +401,26 @@ class Net {
   vector<Callback*> after_forward_;
   vector<Callback*> before_backward_;
   vector<Callback*> after_backward_;
+  /// Number of threads used to run independent branches concurrently.
+  int branch_threads_;
+  shared_ptr<TaskGraphExecutor> branch_executor_;
+  /// For each layer, the layers whose Forward must wait for its Forward.
+  vector<vector<int> > forward_successors_;
+  /// For each layer, the layers whose Backward must wait for its Backward.
+  vector<vector<int> > backward_successors_;
+  /// The layers ForwardBlobs runs, by the sorted ids of the blobs requested.
+  map<vector<int>, vector<int> > forward_plans_;
+  /// The fills still pending while Init loads the weights files.
+  DeferredFills<Dtype>* deferred_fills_;
+  /// Which views ShareViews makes, and the (blob, is diff) it made.
+  bool zero_copy_concat_;
+  bool strided_views_;
+  vector<pair<Blob<Dtype>*, bool> > views_;
+  /// With gradient checkpointing, the last layer of each segment, the layers
+  /// each segment runs again in Backward, and the memory their tops share.
+  vector<int> segment_ends_;
+  vector<vector<int> > recompute_layers_;
+  Blob<Dtype> checkpoint_pool_;
 
 DISABLE_COPY_AND_ASSIGN(Net);
 };
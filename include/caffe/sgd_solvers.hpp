@@ -144,6 +144,60 @@ class AdamSolver : public SGDSolver<Dtype> {
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
 
+/**
+ * @brief LARSSolver, SGD with momentum where the rate of each param is
+ *        scaled by the ratio of its norm to the norm of its gradient, for
+ *        training with very large batches. Described in [1].
+ *
+ * The ratio is lars_eta ||w|| / ||g||, where g includes the weight decay;
+ * it is 1 for a param or gradient of zero norm.
+ *
+ * [1] Y. You, I. Gitman and B. Ginsburg, "Large Batch Training of
+ *     Convolutional Networks." arXiv preprint arXiv:1708.03888 (2017).
+ */
+template <typename Dtype>
+class LARSSolver : public SGDSolver<Dtype> {
+ public:
+  explicit LARSSolver(const SolverParameter& param)
+      : SGDSolver<Dtype>(param) {}
+  explicit LARSSolver(const string& param_file)
+      : SGDSolver<Dtype>(param_file) {}
+  virtual inline const char* type() const { return "LARS"; }
+
+ protected:
+  virtual void ComputeUpdateValue(int param_id, Dtype rate);
+
+  DISABLE_COPY_AND_ASSIGN(LARSSolver);
+};
+
+/**
+ * @brief LAMBSolver, Adam with decoupled weight decay where the update of
+ *        each param is scaled by the ratio of the param's norm to the
+ *        update's norm. Described in [1].
+ *
+ * The weight decay is added to the Adam step rather than to the gradient,
+ * so only L2 regularization applies.
+ *
+ * [1] Y. You et al., "Large Batch Optimization for Deep Learning: Training
+ *     BERT in 76 minutes." arXiv preprint arXiv:1904.00962 (2019).
+ */
+template <typename Dtype>
+class LAMBSolver : public SGDSolver<Dtype> {
+ public:
+  explicit LAMBSolver(const SolverParameter& param)
+      : SGDSolver<Dtype>(param) { LAMBPreSolve(); }
+  explicit LAMBSolver(const string& param_file)
+      : SGDSolver<Dtype>(param_file) { LAMBPreSolve(); }
+  virtual inline const char* type() const { return "LAMB"; }
+
+ protected:
+  void LAMBPreSolve();
+  virtual void Regularize(int param_id) {}
+  virtual void ComputeUpdateValue(int param_id, Dtype rate);
+
+  DISABLE_COPY_AND_ASSIGN(LAMBSolver);
+};
+
 }  // namespace caffe
 
 #endif  // CAFFE_SGD_SOLVERS_HPP_
@@ -8,6 +8,7 @@
 #endif
 
 #include "caffe/common.hpp"
+#include "caffe/util/numa.hpp"
 
 namespace caffe {
 
@@ -16,6 +17,8 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// Otherwise large allocations may be mapped on their own, on huge pages and
+// the NUMA node of the thread, as the NumaPolicy says.
 inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
@@ -24,6 +27,11 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
     return;
   }
 #endif
+  *ptr = NumaMapHost(size);
+  if (*ptr) {
+    *use_cuda = false;
+    return;
+  }
 #ifdef USE_MKL
   *ptr = mkl_malloc(size ? size:1, 64);
 #else
@@ -40,6 +48,9 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
     return;
   }
 #endif
+  if (NumaUnmapHost(ptr)) {
+    return;
+  }
 #ifdef USE_MKL
   mkl_free(ptr);
 #else
@@ -52,12 +63,16 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
  * @brief Manages memory allocation and synchronization between the host (CPU)
  *        and device (GPU).
  *
- * TODO(dox): more thorough description.
+ * A SyncedMemory can also be a view of a range of another one, its base: it
+ * then owns nothing, and its data are the base's from a byte offset, synced
+ * along with the rest of the base.
  */
 class SyncedMemory {
  public:
   SyncedMemory();
   explicit SyncedMemory(size_t size);
+  SyncedMemory(const shared_ptr<SyncedMemory>& base, size_t offset,
+               size_t size);
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -66,8 +81,11 @@ class SyncedMemory {
   void* mutable_cpu_data();
   void* mutable_gpu_data();
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
-  SyncedHead head() const { return head_; }
+  SyncedHead head() const { return base_ ? base_->head() : head_; }
   size_t size() const { return size_; }
+  /// @brief The memory this is a view of, or NULL.
+  const shared_ptr<SyncedMemory>& base() const { return base_; }
+  size_t offset() const { return offset_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -86,6 +104,8 @@ class SyncedMemory {
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int device_;
+  shared_ptr<SyncedMemory> base_;
+  size_t offset_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
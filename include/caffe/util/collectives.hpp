@@ -0,0 +1,99 @@
+#ifndef CAFFE_UTIL_COLLECTIVES_HPP_
+#define CAFFE_UTIL_COLLECTIVES_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Reliable, ordered point-to-point byte transport between the
+ *        processes (ranks) of a distributed job.
+ */
+class Transport {
+ public:
+  Transport() { }
+  virtual ~Transport() { }
+  virtual int rank() const = 0;
+  virtual int size() const = 0;
+  virtual void Send(int peer, const void* data, size_t bytes) = 0;
+  virtual void Recv(int peer, void* data, size_t bytes) = 0;
+  /**
+   * @brief Sends to dst while receiving from src. Unlike Send followed by
+   *        Recv, this does not deadlock when all ranks call it at once,
+   *        e.g. to shift data around a ring.
+   */
+  virtual void SendRecv(int dst, const void* send_data, size_t send_bytes,
+      int src, void* recv_data, size_t recv_bytes) = 0;
+
+  DISABLE_COPY_AND_ASSIGN(Transport);
+};
+
+/**
+ * @brief Transport over TCP sockets between every pair of ranks.
+ *
+ * Rank 0 listens on address ("host:port"). The other ranks register with it
+ * there, get the addresses of their peers back and connect to each other.
+ * The constructor returns once all ranks are connected.
+ */
+class TCPTransport : public Transport {
+ public:
+  TCPTransport(int rank, int size, const string& address);
+  virtual ~TCPTransport();
+  virtual int rank() const { return rank_; }
+  virtual int size() const { return sockets_.size(); }
+  virtual void Send(int peer, const void* data, size_t bytes);
+  virtual void Recv(int peer, void* data, size_t bytes);
+  virtual void SendRecv(int dst, const void* send_data, size_t send_bytes,
+      int src, void* recv_data, size_t recv_bytes);
+
+ private:
+  int socket(int peer) const;
+
+  int rank_;
+  vector<int> sockets_;
+};
+
+/**
+ * @brief Collective operations over a Transport: sum-allreduce, broadcast
+ *        and barrier. All ranks must call the same collectives, with the
+ *        same counts, in the same order.
+ *
+ * Large allreduces use the bandwidth-optimal ring algorithm (reduce-scatter
+ * then allgather, each rank moving 2 (p - 1) / p of the data), small ones a
+ * binomial tree reduce and broadcast, which takes 2 log(p) steps instead of
+ * 2 (p - 1). Every rank ends up with bitwise identical results.
+ */
+template <typename Dtype>
+class Collectives {
+ public:
+  explicit Collectives(shared_ptr<Transport> transport,
+      size_t tree_threshold = 16384);
+
+  inline int rank() const { return transport_->rank(); }
+  inline int size() const { return transport_->size(); }
+
+  /// @brief Replaces data on every rank by its sum over all ranks.
+  void AllReduce(Dtype* data, size_t count);
+  /// @brief Copies data from root to every other rank.
+  void Broadcast(Dtype* data, size_t count, int root = 0);
+  /// @brief Returns once every rank has entered the barrier.
+  void Barrier();
+
+ protected:
+  void RingAllReduce(Dtype* data, size_t count);
+  void TreeAllReduce(Dtype* data, size_t count);
+
+  shared_ptr<Transport> transport_;
+  /// Allreduces of up to this many elements use the tree algorithm.
+  size_t tree_threshold_;
+  vector<Dtype> buffer_;
+
+DISABLE_COPY_AND_ASSIGN(Collectives);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_COLLECTIVES_HPP_
@@ -0,0 +1,257 @@
+#ifndef CAFFE_UTIL_COMPILED_NET_HPP_
+#define CAFFE_UTIL_COMPILED_NET_HPP_
+
+// The kernels that nets compiled by compile_net call. They depend on nothing
+// but the standard library, so that a compiled net builds without Caffe:
+// copy this header along with the generated files.
+//
+// Every shape is a template parameter, either an int or a struct of enum
+// constants, so that the compiler sees the loop bounds of each layer. All
+// blobs are float and row-major, as in Caffe.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace caffe {
+namespace compiled {
+
+// The activation applied to the output of a kernel.
+enum ActivationType { kIdentity, kReLU, kSigmoid, kTanH };
+enum PoolMethod { kMaxPool, kAvePool };
+enum EltwiseOp { kProd, kSum, kMax };
+
+template <int A>
+inline float Activate(float x, float slope) {
+  switch (A) {
+  case kReLU:
+    return x > 0 ? x : x * slope;
+  case kSigmoid:
+    return 0.5f * std::tanh(0.5f * x) + 0.5f;
+  case kTanH:
+    return std::tanh(x);
+  default:
+    return x;
+  }
+}
+
+// y = A(x), y may be x.
+template <int Count, int A>
+inline void Activation(const float* x, float slope, float* y) {
+  for (int i = 0; i < Count; ++i) {
+    y[i] = Activate<A>(x[i], slope);
+  }
+}
+
+// C = A * B + bias, with A M x K, B K x N and C M x N. The bias, if any, is
+// one value per row of C.
+template <int M, int N, int K, int A>
+inline void Gemm(const float* a, const float* b, const float* bias,
+    float slope, float* c) {
+  for (int m = 0; m < M; ++m) {
+    float* c_row = c + m * N;
+    const float init = bias ? bias[m] : 0.f;
+    for (int n = 0; n < N; ++n) {
+      c_row[n] = init;
+    }
+    for (int k = 0; k < K; ++k) {
+      const float a_mk = a[m * K + k];
+      const float* b_row = b + k * N;
+      for (int n = 0; n < N; ++n) {
+        c_row[n] += a_mk * b_row[n];
+      }
+    }
+    if (A != kIdentity) {
+      Activation<N, A>(c_row, slope, c_row);
+    }
+  }
+}
+
+// y = x * W^T + bias, with x M x K and W N x K, or x * W with W K x N if
+// Transpose.
+template <int M, int N, int K, bool Transpose, int A>
+inline void InnerProduct(const float* x, const float* w, const float* bias,
+    float slope, float* y) {
+  for (int m = 0; m < M; ++m) {
+    const float* x_row = x + m * K;
+    float* y_row = y + m * N;
+    if (Transpose) {
+      for (int n = 0; n < N; ++n) {
+        y_row[n] = bias ? bias[n] : 0.f;
+      }
+      for (int k = 0; k < K; ++k) {
+        const float x_k = x_row[k];
+        const float* w_row = w + k * N;
+        for (int n = 0; n < N; ++n) {
+          y_row[n] += x_k * w_row[n];
+        }
+      }
+    } else {
+      for (int n = 0; n < N; ++n) {
+        const float* w_row = w + n * K;
+        float sum = 0;
+        for (int k = 0; k < K; ++k) {
+          sum += x_row[k] * w_row[k];
+        }
+        y_row[n] = bias ? sum + bias[n] : sum;
+      }
+    }
+    if (A != kIdentity) {
+      Activation<N, A>(y_row, slope, y_row);
+    }
+  }
+}
+
+// Lays out the patches of one image as columns, as im2col_cpu.
+template <class S>
+inline void Im2col(const float* x, float* col) {
+  for (int c = 0; c < S::C; ++c, x += S::H * S::W) {
+    for (int kh = 0; kh < S::KH; ++kh) {
+      for (int kw = 0; kw < S::KW; ++kw) {
+        for (int oh = 0; oh < S::OH; ++oh) {
+          const int h = oh * S::SH - S::PH + kh * S::DH;
+          if (h < 0 || h >= S::H) {
+            std::fill(col, col + S::OW, 0.f);
+            col += S::OW;
+            continue;
+          }
+          for (int ow = 0; ow < S::OW; ++ow) {
+            const int w = ow * S::SW - S::PW + kw * S::DW;
+            *(col++) = w >= 0 && w < S::W ? x[h * S::W + w] : 0.f;
+          }
+        }
+      }
+    }
+  }
+}
+
+// A 2D convolution of the N x C x H x W input into N x K x OH x OW, with
+// the kernel KH x KW, stride SH x SW, padding PH x PW, dilation DH x DW and
+// G groups of S. The column buffer holds C * KH * KW * OH * OW values, and
+// is not used for 1x1 convolutions with stride 1 and no padding.
+template <class S, int A>
+inline void Convolution(const float* x, const float* w, const float* bias,
+    float slope, float* col, float* y) {
+  const bool is_1x1 = S::KH == 1 && S::KW == 1 && S::SH == 1 &&
+      S::SW == 1 && S::PH == 0 && S::PW == 0;
+  const int kColumns = S::OH * S::OW;
+  const int kPatch = S::C / S::G * S::KH * S::KW;
+  for (int n = 0; n < S::N; ++n) {
+    const float* x_n = x + n * S::C * S::H * S::W;
+    if (!is_1x1) {
+      Im2col<S>(x_n, col);
+    }
+    const float* columns = is_1x1 ? x_n : col;
+    for (int g = 0; g < S::G; ++g) {
+      Gemm<S::K / S::G, S::OH * S::OW, S::C / S::G * S::KH * S::KW, A>(
+          w + g * (S::K / S::G) * kPatch, columns + g * kPatch * kColumns,
+          bias ? bias + g * (S::K / S::G) : bias, slope,
+          y + (n * S::K + g * (S::K / S::G)) * kColumns);
+    }
+  }
+}
+
+// Pools the N x C x H x W input into N x C x OH x OW, as PoolingLayer.
+template <class S, int Method>
+inline void Pooling(const float* x, float* y) {
+  for (int nc = 0; nc < S::N * S::C; ++nc, x += S::H * S::W) {
+    for (int oh = 0; oh < S::OH; ++oh) {
+      for (int ow = 0; ow < S::OW; ++ow) {
+        int hstart = oh * S::SH - S::PH;
+        int wstart = ow * S::SW - S::PW;
+        int hend = std::min(hstart + S::KH, S::H + S::PH);
+        int wend = std::min(wstart + S::KW, S::W + S::PW);
+        const int pool_size = (hend - hstart) * (wend - wstart);
+        hstart = std::max(hstart, 0);
+        wstart = std::max(wstart, 0);
+        hend = std::min<int>(hend, S::H);
+        wend = std::min<int>(wend, S::W);
+        float value = Method == kMaxPool ? -FLT_MAX : 0.f;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            if (Method == kMaxPool) {
+              value = std::max(value, x[h * S::W + w]);
+            } else {
+              value += x[h * S::W + w];
+            }
+          }
+        }
+        *(y++) = Method == kMaxPool ? value : value / pool_size;
+      }
+    }
+  }
+}
+
+// Softmax over the middle axis of an Outer x C x Inner blob, y may be x.
+template <int Outer, int C, int Inner>
+inline void Softmax(const float* x, float* y) {
+  for (int o = 0; o < Outer; ++o, x += C * Inner, y += C * Inner) {
+    for (int i = 0; i < Inner; ++i) {
+      float max = x[i];
+      for (int c = 1; c < C; ++c) {
+        max = std::max(max, x[c * Inner + i]);
+      }
+      float sum = 0;
+      for (int c = 0; c < C; ++c) {
+        y[c * Inner + i] = std::exp(x[c * Inner + i] - max);
+        sum += y[c * Inner + i];
+      }
+      for (int c = 0; c < C; ++c) {
+        y[c * Inner + i] /= sum;
+      }
+    }
+  }
+}
+
+// y = A(scale * x + shift) over the middle axis of an Outer x C x Inner
+// blob, as ScaleLayer, BiasLayer and BatchNormLayer with global statistics.
+// Either of scale and shift may be null, and y may be x.
+template <int Outer, int C, int Inner, int A>
+inline void ChannelAffine(const float* x, const float* scale,
+    const float* shift, float slope, float* y) {
+  for (int o = 0; o < Outer; ++o) {
+    for (int c = 0; c < C; ++c, x += Inner, y += Inner) {
+      const float a = scale ? scale[c] : 1.f;
+      const float b = shift ? shift[c] : 0.f;
+      for (int i = 0; i < Inner; ++i) {
+        y[i] = Activate<A>(a * x[i] + b, slope);
+      }
+    }
+  }
+}
+
+// y = A(op(ca * a, cb * b)), where the coefficients only apply to sums, as
+// EltwiseLayer on two inputs. y may be a or b.
+template <int Count, int Op, int A>
+inline void Eltwise(const float* a, float ca, const float* b, float cb,
+    float slope, float* y) {
+  for (int i = 0; i < Count; ++i) {
+    float value;
+    switch (Op) {
+    case kProd:
+      value = a[i] * b[i];
+      break;
+    case kSum:
+      value = ca * a[i] + cb * b[i];
+      break;
+    default:
+      value = std::max(a[i], b[i]);
+    }
+    y[i] = Activate<A>(value, slope);
+  }
+}
+
+// Copies an Outer x SrcInner input into the Outer x DstInner output, whose
+// rows y points into, as ConcatLayer.
+template <int Outer, int SrcInner, int DstInner>
+inline void Concat(const float* x, float* y) {
+  for (int o = 0; o < Outer; ++o) {
+    std::memcpy(y + o * DstInner, x + o * SrcInner, SrcInner * sizeof(float));
+  }
+}
+
+}  // namespace compiled
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_COMPILED_NET_HPP_
@@ -0,0 +1,52 @@
+#ifndef CAFFE_UTIL_COMPRESSION_HPP_
+#define CAFFE_UTIL_COMPRESSION_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Compresses and restores Datum payloads with LZ4 or Zstd.
+ *
+ * The payload is the data bytes, or the float_data values as raw floats.
+ * A codec keeps its dictionary and codec contexts across records, so keep
+ * one per reading or writing thread; it is not thread safe.
+ */
+class DatumCodec {
+ public:
+  DatumCodec();
+
+  // Use a Zstd dictionary, e.g. from TrainDatumDictionary, both ways.
+  void set_dictionary(const string& dictionary);
+  void ReadDictionary(const string& filename);
+  const string& dictionary() const { return dictionary_; }
+
+  // Compresses the payload of datum in place. level 0 picks the codec's
+  // default; for LZ4 a positive level selects LZ4HC.
+  void Compress(Datum_Compression type, int level, Datum* datum);
+  // Restores the payload of datum. Returns false if it was not compressed.
+  bool Decompress(Datum* datum);
+
+ protected:
+  // Codec contexts, kept out of the header so that the codec libraries
+  // are private to libcaffe.
+  class contexts;
+
+  string dictionary_;
+  string buffer_;
+  shared_ptr<contexts> contexts_;
+
+DISABLE_COPY_AND_ASSIGN(DatumCodec);
+};
+
+// Trains a Zstd dictionary of at most dict_size bytes on the payloads of
+// samples. Small records of similar content compress much better with one.
+string TrainDatumDictionary(const vector<Datum>& samples, size_t dict_size);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_COMPRESSION_HPP_
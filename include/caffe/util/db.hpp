@@ -41,6 +41,12 @@ class DB {
   virtual void Close() = 0;
   virtual Cursor* NewCursor() = 0;
   virtual Transaction* NewTransaction() = 0;
+  // A transaction for bulk loading keys that are Put in ascending order,
+  // with room set aside for about expected_bytes of data in total.
+  // Backends without a faster path hand out an ordinary transaction.
+  virtual Transaction* NewBulkTransaction(size_t expected_bytes) {
+    return NewTransaction();
+  }
 
   DISABLE_COPY_AND_ASSIGN(DB);
 };
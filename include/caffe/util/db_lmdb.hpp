@@ -55,15 +55,19 @@ class LMDBCursor : public Cursor {
 
 class LMDBTransaction : public Transaction {
  public:
-  explicit LMDBTransaction(MDB_env* mdb_env)
-    : mdb_env_(mdb_env) { }
+  explicit LMDBTransaction(MDB_env* mdb_env, bool append = false)
+    : mdb_env_(mdb_env), append_(append) { }
   virtual void Put(const string& key, const string& value);
   virtual void Commit();
 
  private:
   MDB_env* mdb_env_;
+  // Put with MDB_APPEND, which skips the B-tree search and fills pages
+  // completely; cleared if a key turns out to be out of order.
+  bool append_;
   vector<string> keys, values;
 
+  void ReserveMapSize();
   void DoubleMapSize();
 
   DISABLE_COPY_AND_ASSIGN(LMDBTransaction);
@@ -71,11 +75,16 @@ class LMDBTransaction : public Transaction {
 
 class LMDB : public DB {
  public:
-  LMDB() : mdb_env_(NULL) { }
+  LMDB() : mdb_env_(NULL), bulk_(false) { }
   virtual ~LMDB() { Close(); }
   virtual void Open(const string& source, Mode mode);
   virtual void Close() {
     if (mdb_env_ != NULL) {
+      if (bulk_) {
+        // Bulk commits only start an asynchronous flush.
+        MDB_CHECK(mdb_env_sync(mdb_env_, 1));
+        bulk_ = false;
+      }
       mdb_dbi_close(mdb_env_, mdb_dbi_);
       mdb_env_close(mdb_env_);
       mdb_env_ = NULL;
@@ -83,10 +92,12 @@ class LMDB : public DB {
   }
   virtual LMDBCursor* NewCursor();
   virtual LMDBTransaction* NewTransaction();
+  virtual LMDBTransaction* NewBulkTransaction(size_t expected_bytes);
 
  private:
   MDB_env* mdb_env_;
   MDB_dbi mdb_dbi_;
+  bool bulk_;
 };
 
 }  // namespace db
@@ -16,6 +16,10 @@
 #define CAFFE_TMP_DIR_RETRIES 100
 #endif
 
+namespace google { namespace protobuf { namespace io {
+class CodedInputStream;
+} } }  // namespace google::protobuf::io
+
 namespace caffe {
 
 using ::google::protobuf::Message;
@@ -68,6 +72,9 @@ inline void WriteProtoToTextFile(const Message& proto, const string& filename) {
   WriteProtoToTextFile(proto, filename.c_str());
 }
 
+/// @brief Lets input read up to 2 GB, protobuf's hard limit, per message.
+void SetProtoReadBytesLimit(google::protobuf::io::CodedInputStream* input);
+
 bool ReadProtoFromBinaryFile(const char* filename, Message* proto);
 
 inline bool ReadProtoFromBinaryFile(const string& filename, Message* proto) {
@@ -0,0 +1,48 @@
+#ifndef CAFFE_UTIL_LOCK_FREE_RING_HPP_
+#define CAFFE_UTIL_LOCK_FREE_RING_HPP_
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A bounded multi-producer multi-consumer queue that takes no lock.
+ *
+ * Each slot of the ring carries a sequence number telling producers and
+ * consumers whose turn it is, so that pushing or popping is one
+ * compare-and-swap on the shared position in the common case. The capacity
+ * is rounded up to a power of two.
+ *
+ * The blocking push and pop spin, then yield, then sleep for short spells
+ * while they wait; they are boost interruption points, so that a thread
+ * waiting on the ring can be stopped like one waiting on a BlockingQueue.
+ */
+template <typename T>
+class LockFreeRing {
+ public:
+  explicit LockFreeRing(int capacity);
+
+  bool try_push(const T& t);
+  bool try_pop(T* t);
+  void push(const T& t);
+  T pop();
+
+  /// The number of elements, exact only when no thread is using the ring.
+  int size() const;
+  int capacity() const;
+
+ protected:
+  /**
+   The slots and positions, kept out of the header like the synchronization
+   of BlockingQueue, as boost/atomic does not go through NVCC everywhere.
+   */
+  class slots;
+
+  shared_ptr<slots> slots_;
+
+DISABLE_COPY_AND_ASSIGN(LockFreeRing);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_LOCK_FREE_RING_HPP_
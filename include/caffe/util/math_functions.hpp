@@ -36,6 +36,37 @@ void caffe_cpu_axpby(const int N, const Dtype alpha, const Dtype* X,
 template <typename Dtype>
 void caffe_copy(const int N, const Dtype *X, Dtype *Y);
 
+// Copies an array of the given shape between two layouts, given by the
+// stride of each axis in elements (see Blob::strides).
+template <typename Dtype>
+void caffe_copy_strided(const vector<int>& shape, const Dtype* X,
+    const vector<int>& x_strides, Dtype* Y, const vector<int>& y_strides);
+
+// Broadcasts and reductions along the middle axis of an array viewed as
+// (outer, dim, inner), e.g. a per-channel bias over N x C x (H * W). These
+// replace gemm/gemv calls against vectors of ones.
+
+// Y[o][d][i] = X[o][d][i] + alpha * b[d]; Y may be X.
+template <typename Dtype>
+void caffe_cpu_broadcast_add(const int outer, const int dim, const int inner,
+    const Dtype* X, const Dtype alpha, const Dtype* b, Dtype* Y);
+
+// Y[o][d][i] = X[o][d][i] * b[d]; Y may be X.
+template <typename Dtype>
+void caffe_cpu_broadcast_mul(const int outer, const int dim, const int inner,
+    const Dtype* X, const Dtype* b, Dtype* Y);
+
+// y[d] = alpha * sum_{o,i} X[o][d][i] + beta * y[d]
+template <typename Dtype>
+void caffe_cpu_reduce_sum(const int outer, const int dim, const int inner,
+    const Dtype alpha, const Dtype* X, const Dtype beta, Dtype* y);
+
+// y[d] = alpha * sum_{o,i} X[o][d][i] * Z[o][d][i] + beta * y[d]
+template <typename Dtype>
+void caffe_cpu_reduce_dot(const int outer, const int dim, const int inner,
+    const Dtype alpha, const Dtype* X, const Dtype* Z, const Dtype beta,
+    Dtype* y);
+
 template <typename Dtype>
 void caffe_set(const int N, const Dtype alpha, Dtype *X);
 
@@ -88,6 +119,26 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r);
 template <typename Dtype>
 void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r);
 
+// Bulk versions of the above using the counter-based Philox generator (see
+// caffe/util/philox.hpp), keyed by a draw from caffe_rng() so that they
+// follow Caffe::set_random_seed. They are much faster than drawing through
+// boost distributions, and their ranges can be split across threads.
+template <typename Dtype>
+void caffe_philox_uniform(const int n, const Dtype a, const Dtype b, Dtype* r);
+
+template <typename Dtype>
+void caffe_philox_gaussian(const int n, const Dtype mu, const Dtype sigma,
+                           Dtype* r);
+
+template <typename Dtype>
+void caffe_philox_bernoulli(const int n, const Dtype p, int* r);
+
+template <typename Dtype>
+void caffe_philox_bernoulli(const int n, const Dtype p, unsigned int* r);
+
+/// @brief Returns a fresh 64-bit key for a Philox stream from caffe_rng().
+uint64_t caffe_philox_key();
+
 template <typename Dtype>
 void caffe_exp(const int n, const Dtype* a, Dtype* y);
 
@@ -171,6 +222,10 @@ void caffe_gpu_axpby(const int N, const Dtype alpha, const Dtype* X,
 
 void caffe_gpu_memcpy(const size_t N, const void *X, void *Y);
 
+template <typename Dtype>
+void caffe_gpu_copy_strided(const vector<int>& shape, const Dtype* X,
+    const vector<int>& x_strides, Dtype* Y, const vector<int>& y_strides);
+
 template <typename Dtype>
 void caffe_gpu_set(const int N, const Dtype alpha, Dtype *X);
 
@@ -0,0 +1,97 @@
+#ifndef CAFFE_UTIL_NET_COMPILER_HPP_
+#define CAFFE_UTIL_NET_COMPILER_HPP_
+
+#include <ostream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Compiles a deploy Net into C++ source that runs its forward pass
+ *        without Caffe.
+ *
+ * The net is compiled with the shapes it was reshaped to, which become
+ * template parameters of the kernels of caffe/util/compiled_net.hpp. Batch
+ * normalization, scale and bias layers are folded into the weights of the
+ * convolution or inner product before them, and activations are fused into
+ * the layer before them; reshapes, splits and dropout cost nothing. All
+ * blobs live in one static arena, in which blobs whose lifetimes do not
+ * overlap share memory, and the weights are constant arrays of the
+ * generated source.
+ *
+ * Layers other than Input, Convolution, InnerProduct, Pooling, ReLU,
+ * Sigmoid, TanH, Softmax, BatchNorm, Scale, Bias, Eltwise, Concat, Reshape,
+ * Flatten, Split and Dropout cannot be compiled.
+ */
+class NetCompiler {
+ public:
+  explicit NetCompiler(const Net<float>& net);
+
+  /**
+   * @brief Writes the header and source of the compiled net.
+   *
+   * @param name the namespace of the generated functions, also the name the
+   *     header is included by, name.hpp.
+   */
+  void Write(const string& name, std::ostream* header,
+      std::ostream* source) const;
+
+  /// The number of kernels Forward runs, once layers are fused.
+  int num_steps() const { return steps_.size(); }
+  /// The number of floats of the arena holding all blobs.
+  int arena_size() const { return arena_size_; }
+
+ private:
+  // A blob at some point of the forward pass: in-place layers make new
+  // values of the same blob.
+  struct Value {
+    string name;
+    vector<int> shape;
+    // The value whose memory this one shares, as reshapes do, or itself.
+    int root;
+    // The steps reading the value or the values sharing its memory.
+    int consumers;
+    int offset;
+  };
+  struct Step {
+    // The kernel: Convolution, InnerProduct, Pooling, Activation, Softmax,
+    // Affine, Eltwise or Concat.
+    string type;
+    // The names of the layers the step runs, fused into the first.
+    vector<string> layers;
+    LayerParameter param;
+    // The axis the layer works along, canonical.
+    int axis;
+    vector<int> bottoms;
+    vector<int> tops;
+    // The weights and bias, or the scale and shift of affine layers.
+    vector<float> weight;
+    vector<float> bias;
+    string activation;
+    float slope;
+    // The column buffer of convolutions, as a value, or -1.
+    int scratch;
+  };
+
+  int AddValue(const string& name, const vector<int>& shape, int root);
+  void AddStep(Layer<float>* layer, const vector<int>& bottoms,
+      const vector<int>& tops);
+  void Fuse();
+  void PlanMemory();
+
+  vector<Value> values_;
+  vector<Step> steps_;
+  vector<int> inputs_;
+  vector<int> outputs_;
+  int arena_size_;
+
+DISABLE_COPY_AND_ASSIGN(NetCompiler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NET_COMPILER_HPP_
@@ -0,0 +1,107 @@
+#ifndef CAFFE_UTIL_NUMA_HPP_
+#define CAFFE_UTIL_NUMA_HPP_
+
+#include <cstddef>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The NUMA nodes of the host and the CPUs of each, read once from
+ *        sysfs.
+ *
+ * Nodes are numbered as by the kernel, which numbers them from 0 on. Hosts
+ * without NUMA, and systems other than Linux, are seen as a single node
+ * holding all the CPUs.
+ */
+class NumaTopology {
+ public:
+  static const NumaTopology& Get();
+
+  int num_nodes() const { return cpus_.size(); }
+  const vector<int>& cpus(int node) const;
+  /// The node the given GPU is attached to, or -1 if unknown.
+  int device_node(int device) const;
+
+ private:
+  NumaTopology();
+
+  vector<vector<int> > cpus_;
+
+DISABLE_COPY_AND_ASSIGN(NumaTopology);
+};
+
+/// How the threads of a role are pinned to the CPUs of their node.
+enum ThreadAffinity {
+  AFFINITY_NONE,  // left to the scheduler
+  AFFINITY_NODE,  // any CPU of the node
+  AFFINITY_CORE   // one CPU of the node each
+};
+
+/// The threads Caffe runs, as far as placing them goes.
+enum ThreadRole {
+  SOLVER_THREAD,    // runs a solver, and is worker 0 of its executors
+  PREFETCH_THREAD,  // an InternalThread, e.g. prefetching batches
+  WORKER_THREAD     // an intra-op worker of a TaskGraphExecutor
+};
+
+/**
+ * @brief Where Caffe places its threads and large host allocations, set once
+ *        at startup (see the NUMA flags of `caffe train`).
+ *
+ * Each thread works for the node of Caffe::numa_node(), which its threads
+ * inherit. Nothing is placed by default.
+ */
+struct NumaPolicy {
+  NumaPolicy();
+
+  /// The node of the solvers, kNoNode or kAutoNode, resolved by SolverNode.
+  int node;
+  static const int kNoNode = -1;
+  /// Each solver gets the node of its GPU, or solver rank modulo the number
+  /// of nodes on CPU.
+  static const int kAutoNode = -2;
+  ThreadAffinity solver_affinity;
+  ThreadAffinity prefetch_affinity;
+  ThreadAffinity worker_affinity;
+  /// Host allocations of at least this many bytes are mapped on their own,
+  /// backed by transparent huge pages and placed on the node of the thread
+  /// allocating them. 0 leaves all of them to malloc.
+  size_t huge_page_bytes;
+};
+
+void SetNumaPolicy(const NumaPolicy& policy);
+const NumaPolicy& GetNumaPolicy();
+
+/// The node of the policy for the solver of the current rank, on the given
+/// GPU in GPU mode; -1 for none.
+int SolverNode(int device);
+
+/**
+ * @brief Pins the calling thread to the CPUs of node Caffe::numa_node(), as
+ *        the policy says for its role. Returns whether it was pinned.
+ *
+ * With AFFINITY_CORE, the solver and worker threads of index i get the i-th
+ * CPU of the node, so each executor is worker 0 and its pool spreads from
+ * there; prefetch threads count down from the last CPU in the order they
+ * start.
+ */
+bool PinThread(ThreadRole role, int index);
+
+/**
+ * @brief Maps a host allocation on its own if the policy says so for its
+ *        size, or returns NULL to leave it to malloc.
+ *
+ * The pages are placed on Caffe::numa_node() when they are first touched,
+ * whichever thread touches them.
+ */
+void* NumaMapHost(size_t size);
+/// Unmaps memory of NumaMapHost and returns true, or returns false if ptr
+/// was not mapped by it.
+bool NumaUnmapHost(void* ptr);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NUMA_HPP_
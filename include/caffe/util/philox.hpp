@@ -0,0 +1,92 @@
+#ifndef CAFFE_UTIL_PHILOX_HPP_
+#define CAFFE_UTIL_PHILOX_HPP_
+
+#include <stdint.h>
+
+namespace caffe {
+
+/**
+ * @brief The Philox4x32-10 counter-based random number generator
+ *        (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", 2011).
+ *
+ * Output i of the stream with a given key is a pure function of (key, i),
+ * computed by ten rounds of multiply-xor on a 128-bit counter, four 32-bit
+ * words at a time. Any range of the stream can thus be generated directly
+ * and independently of the others, so splitting a fill across threads, or
+ * filling it in pieces, gives the same numbers as filling it at once.
+ */
+class Philox {
+ public:
+  explicit Philox(uint64_t key, uint64_t offset = 0)
+      : key_(key), offset_(offset), cached_block_(offset / 4 + 1) {}
+
+  /// @brief Returns the next 32-bit output of the stream.
+  inline uint32_t operator()() {
+    const uint64_t block = offset_ / 4;
+    if (block != cached_block_) {
+      Block(key_, block, cache_);
+      cached_block_ = block;
+    }
+    return cache_[offset_++ % 4];
+  }
+
+  inline uint64_t key() const { return key_; }
+  /// @brief The index in the stream of the next output.
+  inline uint64_t offset() const { return offset_; }
+
+  /// @brief Computes outputs [4 * block, 4 * block + 4) of the stream of key.
+  static inline void Block(uint64_t key, uint64_t block, uint32_t out[4]) {
+    uint32_t c0 = static_cast<uint32_t>(block);
+    uint32_t c1 = static_cast<uint32_t>(block >> 32);
+    uint32_t c2 = 0;
+    uint32_t c3 = 0;
+    uint32_t k0 = static_cast<uint32_t>(key);
+    uint32_t k1 = static_cast<uint32_t>(key >> 32);
+    for (int round = 0; round < 10; ++round) {
+      const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+      const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+      c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c1 = static_cast<uint32_t>(p1);
+      c3 = static_cast<uint32_t>(p0);
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+  }
+
+ private:
+  uint64_t key_;
+  uint64_t offset_;
+  uint64_t cached_block_;
+  uint32_t cache_[4];
+};
+
+// Bulk generation of outputs [offset, offset + n) of the Philox stream of
+// key, mapped to the given distribution. Element i of r only depends on key
+// and offset + i, so threads can fill disjoint pieces of a range in any
+// order. Uniform values are in [a, b]; gaussians come in Box-Muller pairs
+// from the two halves of each block.
+
+template <typename Dtype>
+void philox_uniform(uint64_t key, uint64_t offset, const int n,
+                    const Dtype a, const Dtype b, Dtype* r);
+
+template <typename Dtype>
+void philox_gaussian(uint64_t key, uint64_t offset, const int n,
+                     const Dtype mu, const Dtype sigma, Dtype* r);
+
+template <typename Dtype>
+void philox_bernoulli(uint64_t key, uint64_t offset, const int n,
+                      const Dtype p, int* r);
+
+template <typename Dtype>
+void philox_bernoulli(uint64_t key, uint64_t offset, const int n,
+                      const Dtype p, unsigned int* r);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PHILOX_HPP_
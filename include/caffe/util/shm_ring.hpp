@@ -0,0 +1,78 @@
+#ifndef CAFFE_UTIL_SHM_RING_HPP_
+#define CAFFE_UTIL_SHM_RING_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A ring of batches in POSIX shared memory, written by one producer
+ *        process and read by any number of consumer processes.
+ *
+ * Each slot holds a data batch followed by its labels, as floats. In
+ * broadcast mode every consumer attached when a batch is published reads it;
+ * in shard mode each batch goes to exactly one consumer. A slot is reused
+ * once all its readers have released it, so slow consumers hold up the
+ * producer rather than miss batches.
+ *
+ * A consumer killed while it holds the ring's lock or unread batches stalls
+ * the ring; restart the producer, which recreates it.
+ */
+class ShmBatchRing {
+ public:
+  // Creates the ring as its producer, replacing any earlier one of the name.
+  ShmBatchRing(const string& name, int slots, const vector<int>& data_shape,
+      const vector<int>& label_shape, bool broadcast);
+  // Attaches to the ring as a consumer.
+  explicit ShmBatchRing(const string& name);
+  ~ShmBatchRing();
+
+  const vector<int>& data_shape() const { return data_shape_; }
+  const vector<int>& label_shape() const { return label_shape_; }
+  int data_count() const { return data_count_; }
+  bool broadcast() const;
+
+  // Producer: waits until the next slot is free and there is a consumer,
+  // then returns the slot to fill and publish with EndWrite().
+  float* BeginWrite();
+  void EndWrite();
+  // Producer: wakes up the consumers to fail rather than wait for batches.
+  void Close();
+
+  // Consumer: waits for the next batch and returns it. It stays valid until
+  // EndRead(), which hands the slot back.
+  const float* BeginRead();
+  void EndRead();
+
+ protected:
+  struct Header;
+  struct Slot;
+  // The shared memory object and its mapping, kept out of the header to
+  // keep boost/interprocess out of the rest of Caffe.
+  class region;
+
+  Slot* slot(uint64_t seq);
+  float* slot_data(uint64_t seq);
+
+  const string name_;
+  const bool producer_;
+  shared_ptr<region> region_;
+  Header* header_;
+  vector<int> data_shape_, label_shape_;
+  int data_count_;
+  // Consumer: the next batch to read in broadcast mode, and the batch held.
+  uint64_t next_seq_;
+  uint64_t reading_seq_;
+  bool reading_;
+
+DISABLE_COPY_AND_ASSIGN(ShmBatchRing);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SHM_RING_HPP_
@@ -0,0 +1,59 @@
+#ifndef CAFFE_UTIL_TASK_GRAPH_HPP_
+#define CAFFE_UTIL_TASK_GRAPH_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Runs a directed acyclic graph of tasks on a pool of threads.
+ *
+ * Each worker owns a deque of ready tasks. Tasks made ready by a worker are
+ * pushed onto its own deque and popped LIFO, so chains of dependent tasks
+ * stay on one thread; idle workers steal from the other end of the deques
+ * of busy ones. The calling thread takes part as worker 0, so a pool of
+ * num_threads spawns num_threads - 1 threads, which persist between runs.
+ *
+ * Caffe's thread local state (mode, solver rank...) of the pool threads is
+ * refreshed from the calling thread at the start of every run. The threads
+ * stay on the NUMA node of the thread that created the pool, pinned as the
+ * NumaPolicy says for workers.
+ */
+class TaskGraphExecutor {
+ public:
+  class Task {
+   public:
+    virtual ~Task() {}
+    /// Executes task id. May be called concurrently for independent tasks.
+    virtual void run(int id) = 0;
+  };
+
+  explicit TaskGraphExecutor(int num_threads);
+  ~TaskGraphExecutor();
+
+  /**
+   * @brief Executes the given tasks, and returns once all of them are done.
+   *
+   * @param tasks the ids of the tasks to run.
+   * @param successors for each task id, the ids of the tasks that may only
+   *     start once it has finished. Successors that are not in tasks are
+   *     ignored, so a subset of a larger graph can be run.
+   * @param task the functor invoked for every task id.
+   */
+  void Run(const vector<int>& tasks, const vector<vector<int> >& successors,
+      Task* task);
+
+  int num_threads() const;
+
+ private:
+  class Impl;
+  shared_ptr<Impl> impl_;
+
+DISABLE_COPY_AND_ASSIGN(TaskGraphExecutor);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TASK_GRAPH_HPP_
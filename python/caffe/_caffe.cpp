@@ -119,17 +119,18 @@ shared_ptr<Net<Dtype> > Net_Init(string network_file, int phase,
     }
   }
 
-  // Initialize net
-  shared_ptr<Net<Dtype> > net(new Net<Dtype>(network_file,
-        static_cast<Phase>(phase), level, &stages_vector));
-
-  // Load weights
+  // Weights are loaded as the net is initialized
+  vector<string> weights_vector;
   if (!weights.is_none()) {
     std::string weights_file_str = bp::extract<std::string>(weights);
     CheckFile(weights_file_str);
-    net->CopyTrainedLayersFrom(weights_file_str);
+    weights_vector.push_back(weights_file_str);
   }
 
+  // Initialize net
+  shared_ptr<Net<Dtype> > net(new Net<Dtype>(network_file,
+        static_cast<Phase>(phase), level, &stages_vector, &weights_vector));
+
   return net;
 }
 
@@ -144,12 +145,20 @@ shared_ptr<Net<Dtype> > Net_Init_Load(
   CheckFile(param_file);
   CheckFile(pretrained_param_file);
 
+  const vector<string> weights(1, pretrained_param_file);
   shared_ptr<Net<Dtype> > net(new Net<Dtype>(param_file,
-      static_cast<Phase>(phase)));
-  net->CopyTrainedLayersFrom(pretrained_param_file);
+      static_cast<Phase>(phase), 0, NULL, &weights));
   return net;
 }
 
+Dtype Net_ForwardBlobs(Net<Dtype>* net, bp::list blob_names) {
+  vector<string> blob_names_vector;
+  for (int i = 0; i < len(blob_names); i++) {
+    blob_names_vector.push_back(bp::extract<string>(blob_names[i]));
+  }
+  return net->ForwardBlobs(blob_names_vector);
+}
+
 void Net_Save(const Net<Dtype>& net, string filename) {
   NetParameter net_param;
   net.ToProto(&net_param, false);
@@ -412,6 +421,7 @@ BOOST_PYTHON_MODULE(_caffe) {
     // Legacy constructor
     .def("__init__", bp::make_constructor(&Net_Init_Load))
     .def("_forward", &Net<Dtype>::ForwardFromTo)
+    .def("_forward_blobs", &Net_ForwardBlobs)
     .def("_backward", &Net<Dtype>::BackwardFromTo)
     .def("reshape", &Net<Dtype>::Reshape)
     .def("clear_param_diffs", &Net<Dtype>::ClearParamDiffs)
@@ -85,7 +85,8 @@ def _Net_outputs(self):
     return self._output_list
 
 
-def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
+def _Net_forward(self, blobs=None, start=None, end=None, prune=False,
+                 **kwargs):
     """
     Forward pass: prepare inputs and run the net forward.
 
@@ -98,6 +99,9 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
     start : optional name of layer at which to begin the forward pass
     end : optional name of layer at which to finish the forward pass
           (inclusive)
+    prune : if True, run only the layers the returned blobs depend on,
+            skipping e.g. the loss layers past the blobs to extract
+            (cannot be combined with start)
 
     Returns
     -------
@@ -128,7 +132,12 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
                 raise Exception('Input is not batch sized')
             self.blobs[in_].data[...] = blob
 
-    self._forward(start_ind, end_ind)
+    if prune:
+        if start is not None:
+            raise Exception('Cannot prune a forward pass given its start.')
+        self._forward_blobs(list(outputs))
+    else:
+        self._forward(start_ind, end_ind)
 
     # Unpack blobs to extract
     return {out: self.blobs[out].data for out in outputs}
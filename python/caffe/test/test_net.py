@@ -89,6 +89,13 @@ class TestNet(unittest.TestCase):
 
         np.testing.assert_allclose(ip_blob.data,manual_forward,rtol=1e-3,atol=1e-5)
 
+    def test_forward_prune(self):
+        self.net.blobs['loss'].data[...] = -1
+        forward_blob = self.net.forward(blobs=['conv'], end='conv', prune=True)
+        self.assertEqual(list(forward_blob.keys()), ['conv'])
+        # the layers past the conv did not run
+        self.assertEqual(self.net.blobs['loss'].data, -1)
+
     def test_backward_start_end(self):
         conv_blob=self.net.blobs['conv']
         ip_blob=self.net.blobs['ip_blob']
@@ -1,3 +1,7 @@
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include <algorithm>
 #include <climits>
 #include <vector>
 
@@ -8,6 +12,9 @@
 
 namespace caffe {
 
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
     const int width) {
@@ -22,6 +29,10 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const vector<int>& shape) {
   CHECK_LE(shape.size(), kMaxBlobAxes);
+  // Views of other blobs (see ShareDataRange and ShareView) only hold the
+  // shape they were made for, so they are dropped when it changes.
+  const bool stale_view = shape != shape_ &&
+      ((data_ && data_->base()) || (diff_ && diff_->base()));
   count_ = 1;
   shape_.resize(shape.size());
   if (!shape_data_ || shape_data_->size() < shape.size() * sizeof(int)) {
@@ -37,10 +48,11 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     shape_[i] = shape[i];
     shape_data[i] = shape[i];
   }
-  if (count_ > capacity_) {
+  if (count_ > capacity_ || stale_view) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    strides_.clear();
   }
 }
 
@@ -155,13 +167,61 @@ Dtype* Blob<Dtype>::mutable_gpu_diff() {
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK(other.is_contiguous()) << "Cannot share the data of a strided view.";
   data_ = other.data();
+  strides_.clear();
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
+  CHECK(other.is_contiguous()) << "Cannot share the diff of a strided view.";
   diff_ = other.diff();
+  strides_.clear();
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDataRange(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  data_.reset(new SyncedMemory(other.data(), offset * sizeof(Dtype),
+                               count_ * sizeof(Dtype)));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffRange(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  diff_.reset(new SyncedMemory(other.diff(), offset * sizeof(Dtype),
+                               count_ * sizeof(Dtype)));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareView(const Blob& other, int offset,
+    const vector<int>& strides) {
+  CHECK_EQ(strides.size(), num_axes());
+  CHECK_GE(offset, 0);
+  // The elements spanned, from the first to the last.
+  int span = count_ > 0 ? 1 : 0;
+  bool contiguous = true;
+  for (int i = 0; i < num_axes(); ++i) {
+    CHECK_GE(strides[i], 0);
+    if (count_ > 0) {
+      span += (shape_[i] - 1) * strides[i];
+    }
+    contiguous &= shape_[i] == 1 || strides[i] == count(i + 1);
+  }
+  CHECK_LE((offset + span) * sizeof(Dtype), other.data()->size())
+      << "View out of the range of the other blob.";
+  data_.reset(new SyncedMemory(other.data(), offset * sizeof(Dtype),
+                               span * sizeof(Dtype)));
+  diff_.reset(new SyncedMemory(other.diff(), offset * sizeof(Dtype),
+                               span * sizeof(Dtype)));
+  if (contiguous) {
+    strides_.clear();
+  } else {
+    strides_ = strides;
+  }
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -431,6 +491,8 @@ bool Blob<Dtype>::ShapeEquals(const BlobProto& other) {
 
 template <typename Dtype>
 void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
+  CHECK(source.is_contiguous() && is_contiguous())
+      << "Cannot copy strided views.";
   if (source.count() != count_ || source.shape() != shape_) {
     if (reshape) {
       ReshapeLike(source);
@@ -513,8 +575,109 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
 }
 
+// Reads one field of float (or, if is_double, double) values, packed or not,
+// into values[*filled, ...), converting them to Dtype. Packed values are
+// decoded in chunks from a small buffer. Values that would not fit in count
+// are skipped, and false returned.
+template <typename Dtype>
+static bool ReadValues(CodedInputStream* input, uint32_t tag, bool is_double,
+    Dtype* values, int* filled, int count) {
+  const int width = is_double ? sizeof(double) : sizeof(float);
+  int num_values = 1;
+  if (WireFormatLite::GetTagWireType(tag) ==
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+    uint32_t length;
+    CHECK(input->ReadVarint32(&length));
+    CHECK_EQ(length % width, 0) << "Truncated blob values";
+    num_values = length / width;
+  }
+  if (*filled + num_values > count) {
+    CHECK(input->Skip(num_values * width)) << "Truncated blob values";
+    return false;
+  }
+  const int kChunkValues = 4096;
+  uint8_t buffer[kChunkValues * sizeof(double)];
+  while (num_values > 0) {
+    const int chunk = std::min(num_values, kChunkValues);
+    CHECK(input->ReadRaw(buffer, chunk * width)) << "Truncated blob values";
+    Dtype* out = values + *filled;
+    if (is_double) {
+      for (int i = 0; i < chunk; ++i) {
+        google::protobuf::uint64 bits;
+        CodedInputStream::ReadLittleEndian64FromArray(buffer + i * width,
+                                                      &bits);
+        out[i] = WireFormatLite::DecodeDouble(bits);
+      }
+    } else {
+      for (int i = 0; i < chunk; ++i) {
+        google::protobuf::uint32 bits;
+        CodedInputStream::ReadLittleEndian32FromArray(buffer + i * width,
+                                                      &bits);
+        out[i] = WireFormatLite::DecodeFloat(bits);
+      }
+    }
+    *filled += chunk;
+    num_values -= chunk;
+  }
+  return true;
+}
+
+template <typename Dtype>
+bool Blob<Dtype>::FromCodedStream(CodedInputStream* input,
+    BlobProto* header) {
+  header->Clear();
+  // Serializers write the fields in order of number, so the values come
+  // before a BlobShape, and are read in place as long as they fit; the shape
+  // is checked at the end.
+  bool fits = true;
+  int data_filled = 0;
+  int diff_filled = 0;
+  for (uint32_t tag = input->ReadTag(); tag; tag = input->ReadTag()) {
+    const int field = WireFormatLite::GetTagFieldNumber(tag);
+    const bool is_double = field == BlobProto::kDoubleDataFieldNumber ||
+        field == BlobProto::kDoubleDiffFieldNumber;
+    if (field == BlobProto::kDataFieldNumber ||
+        field == BlobProto::kDoubleDataFieldNumber) {
+      fits &= ReadValues(input, tag, is_double, mutable_cpu_data(),
+                         &data_filled, count_);
+    } else if (field == BlobProto::kDiffFieldNumber ||
+               field == BlobProto::kDoubleDiffFieldNumber) {
+      fits &= ReadValues(input, tag, is_double, mutable_cpu_diff(),
+                         &diff_filled, count_);
+    } else if (field == BlobProto::kShapeFieldNumber) {
+      uint32_t length;
+      CHECK(input->ReadVarint32(&length));
+      const CodedInputStream::Limit limit = input->PushLimit(length);
+      CHECK(header->mutable_shape()->MergeFromCodedStream(input));
+      input->PopLimit(limit);
+    } else if (field >= BlobProto::kNumFieldNumber &&
+               field <= BlobProto::kWidthFieldNumber) {
+      google::protobuf::uint32 dim;
+      CHECK(input->ReadVarint32(&dim));
+      const int value = static_cast<int>(dim);
+      switch (field) {
+      case BlobProto::kNumFieldNumber: header->set_num(value); break;
+      case BlobProto::kChannelsFieldNumber: header->set_channels(value); break;
+      case BlobProto::kHeightFieldNumber: header->set_height(value); break;
+      default: header->set_width(value); break;
+      }
+    } else {
+      CHECK(WireFormatLite::SkipField(input, tag));
+    }
+  }
+  if (!fits || !ShapeEquals(*header)) {
+    return false;
+  }
+  CHECK_EQ(count_, data_filled) << "Missing blob data";
+  if (diff_filled > 0) {
+    CHECK_EQ(count_, diff_filled) << "Missing blob diff";
+  }
+  return true;
+}
+
 template <>
 void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
+  CHECK(is_contiguous()) << "Cannot serialize a strided view.";
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
@@ -535,6 +698,7 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
 
 template <>
 void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
+  CHECK(is_contiguous()) << "Cannot serialize a strided view.";
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
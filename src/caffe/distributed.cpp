@@ -0,0 +1,139 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "caffe/distributed.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+DistributedSync<Dtype>::DistributedSync(shared_ptr<Solver<Dtype> > solver,
+    shared_ptr<Transport> transport)
+    : solver_(solver), collectives_(transport), size_(0),
+      layer_wise_(solver->param().layer_wise_reduce()) {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU)
+      << "DistributedSync runs in CPU mode; use NCCL for multiple GPUs.";
+  Net<Dtype>& net = *solver_->net();
+  const vector<Blob<Dtype>*>& params = net.learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    size_ += params[i]->count();
+  }
+  // Replace the diffs of the params by ranges of one buffer, so that the
+  // gradients of a layer, or of the whole net, can be reduced in one call.
+  diff_.reset(new SyncedMemory(std::max<size_t>(size_, 1) * sizeof(Dtype)));
+  Dtype* base = static_cast<Dtype*>(diff_->mutable_cpu_data());
+  Dtype* ptr = base;
+  for (int i = 0; i < params.size(); ++i) {
+    caffe_copy(params[i]->count(), params[i]->cpu_diff(), ptr);
+    params[i]->diff()->set_cpu_data(ptr);
+    ptr += params[i]->count();
+  }
+  if (layer_wise_ && solver_->param().iter_size() > 1) {
+    LOG_IF(INFO, Caffe::root_solver()) << "Layer-wise reduce is disabled "
+        << "with iter_size > 1; gradients are reduced once accumulated.";
+    layer_wise_ = false;
+  }
+  if (layer_wise_) {
+    CHECK_EQ(net.params().size(), net.learnable_params().size())
+        << "Layer-wise reduce is not supported for nets with shared weights.";
+    for (int layer_id = net.layers().size() - 1; layer_id >= 0; --layer_id) {
+      const vector<shared_ptr<Blob<Dtype> > >& blobs =
+          net.layers()[layer_id]->blobs();
+      if (blobs.empty()) { continue; }
+      const size_t offset = blobs[0]->cpu_diff() - base;
+      size_t count = 0;
+      for (int i = 0; i < blobs.size(); ++i) {
+        CHECK_EQ(blobs[i]->cpu_diff(), base + offset + count)
+            << "Params of layer " << net.layer_names()[layer_id]
+            << " are not contiguous.";
+        count += blobs[i]->count();
+      }
+      reduce_layers_.push_back(layer_id);
+      reduce_ranges_.push_back(make_pair(offset, count));
+    }
+  }
+}
+
+template <typename Dtype>
+DistributedSync<Dtype>::~DistributedSync() {
+  StopInternalThread();
+}
+
+template <typename Dtype>
+void DistributedSync<Dtype>::Broadcast() {
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  for (int i = 0; i < params.size(); ++i) {
+    collectives_.Broadcast(params[i]->mutable_cpu_data(), params[i]->count());
+  }
+}
+
+template <typename Dtype>
+void DistributedSync<Dtype>::Reduce(size_t offset, size_t count) {
+  Dtype* data = static_cast<Dtype*>(diff_->mutable_cpu_data()) + offset;
+  collectives_.AllReduce(data, count);
+  caffe_scal<Dtype>(count, Dtype(1) / collectives_.size(), data);
+}
+
+template <typename Dtype>
+void DistributedSync<Dtype>::run(int layer) {
+  ready_.push(layer);
+}
+
+template <typename Dtype>
+void DistributedSync<Dtype>::InternalThreadEntry() {
+  vector<bool> done(solver_->net()->layers().size(), false);
+  int next = 0;
+  try {
+    while (!must_stop()) {
+      const int layer = ready_.pop();
+      if (layer >= 0) { done[layer] = true; }
+      // Backward may finish layers out of order when branches run
+      // concurrently, but every rank must reduce them in the same order.
+      while (next < reduce_layers_.size() && done[reduce_layers_[next]]) {
+        Reduce(reduce_ranges_[next].first, reduce_ranges_[next].second);
+        done[reduce_layers_[next]] = false;
+        ++next;
+      }
+      if (layer < 0) {
+        CHECK_EQ(next, reduce_layers_.size())
+            << "Backward did not go through all layers with params.";
+        next = 0;
+        reduced_.push(layer);
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void DistributedSync<Dtype>::on_gradients_ready() {
+  if (layer_wise_) {
+    ready_.push(-1);
+    reduced_.pop("Waiting for layer-wise gradient reduction");
+  } else {
+    Reduce(0, size_);
+  }
+}
+
+template <typename Dtype>
+void DistributedSync<Dtype>::Run() {
+  solver_->add_callback(this);
+  if (layer_wise_) {
+    solver_->net()->add_after_backward(this);
+    StartInternalThread();
+  }
+  Broadcast();
+  if (Caffe::root_solver()) {
+    solver_->Solve();
+  } else {
+    solver_->Step(solver_->param().max_iter() - solver_->iter());
+  }
+  collectives_.Barrier();
+}
+
+INSTANTIATE_CLASS(DistributedSync);
+
+}  // namespace caffe
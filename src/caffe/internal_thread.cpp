@@ -3,6 +3,7 @@
 
 #include "caffe/internal_thread.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/numa.hpp"
 
 namespace caffe {
 
@@ -30,17 +31,18 @@ void InternalThread::StartInternalThread() {
   int solver_count = Caffe::solver_count();
   int solver_rank = Caffe::solver_rank();
   bool multiprocess = Caffe::multiprocess();
+  int numa_node = Caffe::numa_node();
 
   try {
     thread_.reset(new boost::thread(&InternalThread::entry, this, device, mode,
-          rand_seed, solver_count, solver_rank, multiprocess));
+          rand_seed, solver_count, solver_rank, multiprocess, numa_node));
   } catch (std::exception& e) {
     LOG(FATAL) << "Thread exception: " << e.what();
   }
 }
 
 void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
-    int solver_count, int solver_rank, bool multiprocess) {
+    int solver_count, int solver_rank, bool multiprocess, int numa_node) {
 #ifndef CPU_ONLY
   CUDA_CHECK(cudaSetDevice(device));
 #endif
@@ -49,6 +51,8 @@ void InternalThread::entry(int device, Caffe::Brew mode, int rand_seed,
   Caffe::set_solver_count(solver_count);
   Caffe::set_solver_rank(solver_rank);
   Caffe::set_multiprocess(multiprocess);
+  Caffe::set_numa_node(numa_node);
+  PinThread(PREFETCH_THREAD, 0);
 
   InternalThreadEntry();
 }
@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/adaptive_softmax_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void AdaptiveSoftmaxWithLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  const AdaptiveSoftmaxParameter& param =
+      this->layer_param_.adaptive_softmax_param();
+  N_ = param.num_output();
+  CHECK_GT(param.cutoff_size(), 0) << "At least one cutoff is required.";
+  cluster_start_.clear();
+  for (int i = 0; i < param.cutoff_size(); ++i) {
+    CHECK(i == 0 || param.cutoff(i) > param.cutoff(i - 1))
+        << "The cutoffs must be increasing.";
+    cluster_start_.push_back(param.cutoff(i));
+  }
+  CHECK_LT(cluster_start_.back(), N_)
+      << "The cutoffs must be smaller than num_output.";
+  cluster_start_.push_back(N_);
+  const int num_clusters = param.cutoff_size();
+  head_size_ = cluster_start_[0] + num_clusters;
+  CHECK_GT(param.top_k(), 0);
+  CHECK_GT(param.eval_clusters(), 0);
+  bias_term_ = param.bias_term();
+  K_ = bottom[0]->count(1);
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    this->blobs_.resize(bias_term_ ? 4 : 2);
+    shared_ptr<Filler<Dtype> > weight_filler(
+        GetFiller<Dtype>(param.weight_filler()));
+    vector<int> weight_shape(2);
+    weight_shape[0] = N_;
+    weight_shape[1] = K_;
+    this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+    weight_filler->Fill(this->blobs_[0].get());
+    weight_shape[0] = num_clusters;
+    this->blobs_[cluster_weight_index()].reset(new Blob<Dtype>(weight_shape));
+    weight_filler->Fill(this->blobs_[cluster_weight_index()].get());
+    if (bias_term_) {
+      shared_ptr<Filler<Dtype> > bias_filler(
+          GetFiller<Dtype>(param.bias_filler()));
+      this->blobs_[1].reset(new Blob<Dtype>(vector<int>(1, N_)));
+      bias_filler->Fill(this->blobs_[1].get());
+      this->blobs_[3].reset(new Blob<Dtype>(vector<int>(1, num_clusters)));
+      bias_filler->Fill(this->blobs_[3].get());
+    }
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  cluster_examples_.resize(num_clusters);
+  cluster_x_.resize(num_clusters);
+  cluster_prob_.resize(num_clusters);
+  for (int t = 0; t < num_clusters; ++t) {
+    cluster_x_[t].reset(new Blob<Dtype>());
+    cluster_prob_[t].reset(new Blob<Dtype>());
+  }
+
+  has_ignore_label_ = this->layer_param_.loss_param().has_ignore_label();
+  if (has_ignore_label_) {
+    ignore_label_ = this->layer_param_.loss_param().ignore_label();
+  }
+  if (!this->layer_param_.loss_param().has_normalization() &&
+      this->layer_param_.loss_param().has_normalize()) {
+    normalization_ = this->layer_param_.loss_param().normalize() ?
+                     LossParameter_NormalizationMode_VALID :
+                     LossParameter_NormalizationMode_BATCH_SIZE;
+  } else {
+    normalization_ = this->layer_param_.loss_param().normalization();
+  }
+}
+
+template <typename Dtype>
+void AdaptiveSoftmaxWithLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  CHECK_EQ(K_, bottom[0]->count(1))
+      << "Input size incompatible with the weights.";
+  M_ = bottom[0]->shape(0);
+  CHECK_EQ(M_, bottom[1]->count())
+      << "There must be one label per example.";
+  vector<int> shape(2);
+  shape[0] = head_size_;
+  shape[1] = K_;
+  head_weight_.Reshape(shape);
+  shape[0] = M_;
+  shape[1] = head_size_;
+  head_prob_.Reshape(shape);
+  if (top.size() >= 2) {
+    top[1]->Reshape(vector<int>());
+  }
+}
+
+template <typename Dtype>
+Dtype AdaptiveSoftmaxWithLossLayer<Dtype>::get_normalizer(
+    int valid_count) const {
+  Dtype normalizer;
+  switch (normalization_) {
+    case LossParameter_NormalizationMode_FULL:
+    case LossParameter_NormalizationMode_BATCH_SIZE:
+      normalizer = Dtype(M_);
+      break;
+    case LossParameter_NormalizationMode_VALID:
+      normalizer = Dtype(valid_count);
+      break;
+    case LossParameter_NormalizationMode_NONE:
+      normalizer = Dtype(1);
+      break;
+    default:
+      LOG(FATAL) << "Unknown normalization mode: "
+          << LossParameter_NormalizationMode_Name(normalization_);
+  }
+  return std::max(Dtype(1.0), normalizer);
+}
+
+template <typename Dtype>
+void AdaptiveSoftmaxWithLossLayer<Dtype>::Softmax(int rows, int cols,
+    Dtype* logits) {
+  for (int i = 0; i < rows; ++i) {
+    Dtype* row = logits + i * cols;
+    const Dtype max_logit = *std::max_element(row, row + cols);
+    Dtype sum = 0;
+    for (int j = 0; j < cols; ++j) {
+      row[j] = std::exp(row[j] - max_logit);
+      sum += row[j];
+    }
+    caffe_scal(cols, Dtype(1) / sum, row);
+  }
+}
+
+template <typename Dtype>
+void AdaptiveSoftmaxWithLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* x = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* cluster_weight =
+      this->blobs_[cluster_weight_index()]->cpu_data();
+  const int head_classes = cluster_start_[0];
+  const int num_clusters = cluster_examples_.size();
+  // Head: the frequent classes and the clusters, for every example.
+  Dtype* head_weight = head_weight_.mutable_cpu_data();
+  caffe_copy(head_classes * K_, weight, head_weight);
+  caffe_copy(num_clusters * K_, cluster_weight,
+      head_weight + head_classes * K_);
+  Dtype* head_prob = head_prob_.mutable_cpu_data();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, head_size_, K_,
+      Dtype(1), x, head_weight, Dtype(0), head_prob);
+  if (bias_term_) {
+    for (int m = 0; m < M_; ++m) {
+      Dtype* row = head_prob + m * head_size_;
+      caffe_axpy(head_classes, Dtype(1), this->blobs_[1]->cpu_data(), row);
+      caffe_axpy(num_clusters, Dtype(1), this->blobs_[3]->cpu_data(),
+          row + head_classes);
+    }
+  }
+  Softmax(M_, head_size_, head_prob);
+  Dtype loss = 0;
+  int count = 0;
+  for (int t = 0; t < num_clusters; ++t) {
+    cluster_examples_[t].clear();
+  }
+  for (int m = 0; m < M_; ++m) {
+    const int label_value = static_cast<int>(label[m]);
+    if (has_ignore_label_ && label_value == ignore_label_) { continue; }
+    CHECK_GE(label_value, 0);
+    CHECK_LT(label_value, N_);
+    ++count;
+    int head_index = label_value;
+    if (label_value >= head_classes) {
+      const int t = std::upper_bound(cluster_start_.begin(),
+          cluster_start_.end(), label_value) - cluster_start_.begin() - 1;
+      cluster_examples_[t].push_back(m);
+      head_index = head_classes + t;
+    }
+    loss -= std::log(std::max(head_prob[m * head_size_ + head_index],
+                              Dtype(FLT_MIN)));
+  }
+  // Tail: each cluster's softmax, for the examples with a label in it only.
+  for (int t = 0; t < num_clusters; ++t) {
+    const vector<int>& examples = cluster_examples_[t];
+    if (examples.empty()) { continue; }
+    const int n = examples.size();
+    const int start = cluster_start_[t];
+    const int size = cluster_start_[t + 1] - start;
+    vector<int> shape(2);
+    shape[0] = n;
+    shape[1] = K_;
+    cluster_x_[t]->Reshape(shape);
+    shape[1] = size;
+    cluster_prob_[t]->Reshape(shape);
+    Dtype* cluster_x = cluster_x_[t]->mutable_cpu_data();
+    Dtype* cluster_prob = cluster_prob_[t]->mutable_cpu_data();
+    for (int i = 0; i < n; ++i) {
+      caffe_copy(K_, x + examples[i] * K_, cluster_x + i * K_);
+    }
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, n, size, K_, Dtype(1),
+        cluster_x, weight + start * K_, Dtype(0), cluster_prob);
+    if (bias_term_) {
+      for (int i = 0; i < n; ++i) {
+        caffe_axpy(size, Dtype(1), this->blobs_[1]->cpu_data() + start,
+            cluster_prob + i * size);
+      }
+    }
+    Softmax(n, size, cluster_prob);
+    for (int i = 0; i < n; ++i) {
+      const int label_value = static_cast<int>(label[examples[i]]);
+      loss -= std::log(std::max(cluster_prob[i * size + label_value - start],
+                                Dtype(FLT_MIN)));
+    }
+  }
+  normalizer_ = get_normalizer(count);
+  top[0]->mutable_cpu_data()[0] = loss / normalizer_;
+  if (top.size() == 2) {
+    top[1]->mutable_cpu_data()[0] = TopKAccuracy(bottom);
+  }
+}
+
+template <typename Dtype>
+Dtype AdaptiveSoftmaxWithLossLayer<Dtype>::TopKAccuracy(
+    const vector<Blob<Dtype>*>& bottom) {
+  const AdaptiveSoftmaxParameter& param =
+      this->layer_param_.adaptive_softmax_param();
+  const Dtype* x = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* head_prob = head_prob_.cpu_data();
+  const int head_classes = cluster_start_[0];
+  const int num_clusters = cluster_examples_.size();
+  const int eval_clusters = std::min<int>(param.eval_clusters(), num_clusters);
+  vector<std::pair<Dtype, int> > clusters(num_clusters);
+  vector<Dtype> scores;
+  int correct = 0;
+  int count = 0;
+  for (int m = 0; m < M_; ++m) {
+    const int label_value = static_cast<int>(label[m]);
+    if (has_ignore_label_ && label_value == ignore_label_) { continue; }
+    ++count;
+    const Dtype* row = head_prob + m * head_size_;
+    // Probabilities are nonnegative, so -1 marks a label not searched.
+    Dtype label_score = label_value < head_classes ? row[label_value] : -1;
+    scores.assign(row, row + head_classes);
+    for (int t = 0; t < num_clusters; ++t) {
+      clusters[t] = std::make_pair(row[head_classes + t], t);
+    }
+    std::partial_sort(clusters.begin(), clusters.begin() + eval_clusters,
+        clusters.end(), std::greater<std::pair<Dtype, int> >());
+    for (int e = 0; e < eval_clusters; ++e) {
+      const int t = clusters[e].second;
+      const int start = cluster_start_[t];
+      const int size = cluster_start_[t + 1] - start;
+      scores.resize(scores.size() + size);
+      Dtype* cluster_scores = &scores[scores.size() - size];
+      caffe_cpu_gemv<Dtype>(CblasNoTrans, size, K_, Dtype(1),
+          weight + start * K_, x + m * K_, Dtype(0), cluster_scores);
+      if (bias_term_) {
+        caffe_axpy(size, Dtype(1), this->blobs_[1]->cpu_data() + start,
+            cluster_scores);
+      }
+      Softmax(1, size, cluster_scores);
+      caffe_scal(size, clusters[e].first, cluster_scores);
+      if (label_value >= start && label_value < start + size) {
+        label_score = cluster_scores[label_value - start];
+      }
+    }
+    if (label_score < 0) { continue; }
+    int num_better = 0;
+    for (int i = 0; i < scores.size() && num_better < param.top_k(); ++i) {
+      num_better += scores[i] > label_score;
+    }
+    correct += num_better < param.top_k();
+  }
+  return count ? Dtype(correct) / count : Dtype(0);
+}
+
+template <typename Dtype>
+void AdaptiveSoftmaxWithLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  const Dtype scale = top[0]->cpu_diff()[0] / normalizer_;
+  const Dtype* x = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const int head_classes = cluster_start_[0];
+  const int num_clusters = cluster_examples_.size();
+  const bool weight_down = this->param_propagate_down_[0];
+  const bool cluster_weight_down =
+      this->param_propagate_down_[cluster_weight_index()];
+  // The gradient of each softmax loss with respect to its logits is the
+  // softmax output minus the one-hot true entry.
+  Dtype* head_diff = head_prob_.mutable_cpu_diff();
+  caffe_cpu_scale(head_prob_.count(), scale, head_prob_.cpu_data(),
+      head_diff);
+  for (int m = 0; m < M_; ++m) {
+    const int label_value = static_cast<int>(label[m]);
+    Dtype* row = head_diff + m * head_size_;
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      caffe_set(head_size_, Dtype(0), row);
+    } else if (label_value < head_classes) {
+      row[label_value] -= scale;
+    } else {
+      row[head_classes + std::upper_bound(cluster_start_.begin(),
+          cluster_start_.end(), label_value) - cluster_start_.begin() - 1]
+          -= scale;
+    }
+  }
+  Dtype* x_diff = NULL;
+  if (propagate_down[0]) {
+    x_diff = bottom[0]->mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, K_, head_size_,
+        Dtype(1), head_diff, head_weight_.cpu_data(), Dtype(0), x_diff);
+  }
+  if (weight_down || cluster_weight_down) {
+    Dtype* head_weight_diff = head_weight_.mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, head_size_, K_, M_,
+        Dtype(1), head_diff, x, Dtype(0), head_weight_diff);
+    if (weight_down) {
+      caffe_axpy(head_classes * K_, Dtype(1), head_weight_diff,
+          this->blobs_[0]->mutable_cpu_diff());
+    }
+    if (cluster_weight_down) {
+      caffe_axpy(num_clusters * K_, Dtype(1),
+          head_weight_diff + head_classes * K_,
+          this->blobs_[cluster_weight_index()]->mutable_cpu_diff());
+    }
+  }
+  if (bias_term_) {
+    for (int m = 0; m < M_; ++m) {
+      const Dtype* row = head_diff + m * head_size_;
+      if (this->param_propagate_down_[1]) {
+        caffe_axpy(head_classes, Dtype(1), row,
+            this->blobs_[1]->mutable_cpu_diff());
+      }
+      if (this->param_propagate_down_[3]) {
+        caffe_axpy(num_clusters, Dtype(1), row + head_classes,
+            this->blobs_[3]->mutable_cpu_diff());
+      }
+    }
+  }
+  for (int t = 0; t < num_clusters; ++t) {
+    const vector<int>& examples = cluster_examples_[t];
+    if (examples.empty()) { continue; }
+    const int n = examples.size();
+    const int start = cluster_start_[t];
+    const int size = cluster_start_[t + 1] - start;
+    Dtype* cluster_diff = cluster_prob_[t]->mutable_cpu_diff();
+    caffe_cpu_scale(n * size, scale, cluster_prob_[t]->cpu_data(),
+        cluster_diff);
+    for (int i = 0; i < n; ++i) {
+      const int label_value = static_cast<int>(label[examples[i]]);
+      cluster_diff[i * size + label_value - start] -= scale;
+    }
+    if (propagate_down[0]) {
+      Dtype* cluster_x_diff = cluster_x_[t]->mutable_cpu_diff();
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, n, K_, size,
+          Dtype(1), cluster_diff, weight + start * K_, Dtype(0),
+          cluster_x_diff);
+      for (int i = 0; i < n; ++i) {
+        caffe_axpy(K_, Dtype(1), cluster_x_diff + i * K_,
+            x_diff + examples[i] * K_);
+      }
+    }
+    if (weight_down) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, size, K_, n, Dtype(1),
+          cluster_diff, cluster_x_[t]->cpu_data(), Dtype(1),
+          this->blobs_[0]->mutable_cpu_diff() + start * K_);
+    }
+    if (bias_term_ && this->param_propagate_down_[1]) {
+      for (int i = 0; i < n; ++i) {
+        caffe_axpy(size, Dtype(1), cluster_diff + i * size,
+            this->blobs_[1]->mutable_cpu_diff() + start);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(AdaptiveSoftmaxWithLossLayer);
+REGISTER_LAYER_CLASS(AdaptiveSoftmaxWithLoss);
+
+}  // namespace caffe
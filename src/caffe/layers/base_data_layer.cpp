@@ -1,4 +1,6 @@
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/thread.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -7,10 +9,25 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
-#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/lock_free_ring.hpp"
 
 namespace caffe {
 
+// The prefetch depth adapts once per window of batches, and never goes below
+// one batch output plus one loading.
+static const int kPrefetchWindow = 20;
+static const int kMinPrefetch = 2;
+// Waiting for data longer than this fraction of the time spent computing
+// makes the depth grow.
+static const double kMaxWaitFraction = 0.02;
+
+static double NowMs() {
+  static const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::local_time();
+  return (boost::posix_time::microsec_clock::local_time() - start)
+      .total_microseconds() / 1000.;
+}
+
 template <typename Dtype>
 BaseDataLayer<Dtype>::BaseDataLayer(const LayerParameter& param)
     : Layer<Dtype>(param),
@@ -37,7 +54,15 @@ BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
       prefetch_(param.data_param().prefetch()),
-      prefetch_free_(), prefetch_full_(), prefetch_current_() {
+      prefetch_free_(std::max(param.data_param().prefetch(),
+                              param.data_param().max_prefetch())),
+      prefetch_full_(std::max(param.data_param().prefetch(),
+                              param.data_param().max_prefetch())),
+      prefetch_current_(), prefetch_target_(prefetch_.size()),
+      max_prefetch_(0), window_min_ready_(0), last_batch_ms_(-1) {
+  if (param.data_param().max_prefetch() > prefetch_.size()) {
+    max_prefetch_ = param.data_param().max_prefetch();
+  }
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i].reset(new Batch<Dtype>());
     prefetch_free_.push(prefetch_[i].get());
@@ -87,6 +112,7 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
+      const double start = NowMs();
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
@@ -97,6 +123,7 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
 #endif
+      batch->load_ms_ = NowMs() - start;
       prefetch_full_.push(batch);
     }
   } catch (boost::thread_interrupted&) {
@@ -110,12 +137,87 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 }
 
 template <typename Dtype>
-void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+void BasePrefetchingDataLayer<Dtype>::NextBatch() {
+  const double start = NowMs();
   if (prefetch_current_) {
-    prefetch_free_.push(prefetch_current_);
+    if (prefetch_.size() > prefetch_target_) {
+      // Retire the batch to bring the depth down to the target.
+      for (int i = 0; i < prefetch_.size(); ++i) {
+        if (prefetch_[i].get() == prefetch_current_) {
+          prefetch_.erase(prefetch_.begin() + i);
+          break;
+        }
+      }
+    } else {
+      prefetch_free_.push(prefetch_current_);
+    }
+  }
+  const int ready = prefetch_full_.size();
+  if (!prefetch_full_.try_pop(&prefetch_current_)) {
+    LOG_EVERY_N(INFO, 100) << "Waiting for data";
+    prefetch_current_ = prefetch_full_.pop();
+  }
+  const double end = NowMs();
+  PrefetchStats* counters[] = {&prefetch_stats_, &window_};
+  for (int i = 0; i < 2; ++i) {
+    ++counters[i]->batches;
+    counters[i]->ready += ready;
+    counters[i]->wait_ms += end - start;
+    counters[i]->load_ms += prefetch_current_->load_ms_;
+    if (last_batch_ms_ >= 0) {
+      counters[i]->compute_ms += start - last_batch_ms_;
+    }
   }
-  prefetch_current_ = prefetch_full_.pop("Waiting for data");
+  window_min_ready_ = window_.batches == 1 ? ready :
+      std::min(window_min_ready_, ready);
+  last_batch_ms_ = end;
+  if (max_prefetch_ > 0 && window_.batches == kPrefetchWindow) {
+    AdaptPrefetch();
+    window_ = PrefetchStats();
+  }
+  prefetch_stats_.depth = prefetch_.size();
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::AdaptPrefetch() {
+  // More batches in flight only absorb variations in the time to load one,
+  // so the depth grows only if loading keeps up on average.
+  const bool keeps_up = window_.load_ms <= window_.compute_ms;
+  const bool waited = window_.wait_ms > kMaxWaitFraction * window_.compute_ms;
+  if (keeps_up && waited && prefetch_target_ < max_prefetch_) {
+    ++prefetch_target_;
+    // Allocate the batch here rather than on the prefetch thread, as in
+    // LayerSetUp.
+    shared_ptr<Batch<Dtype> > batch(new Batch<Dtype>());
+    batch->data_.ReshapeLike(prefetch_current_->data_);
+    batch->data_.mutable_cpu_data();
+    if (this->output_labels_) {
+      batch->label_.ReshapeLike(prefetch_current_->label_);
+      batch->label_.mutable_cpu_data();
+    }
+#ifndef CPU_ONLY
+    if (Caffe::mode() == Caffe::GPU) {
+      batch->data_.mutable_gpu_data();
+      if (this->output_labels_) {
+        batch->label_.mutable_gpu_data();
+      }
+    }
+#endif
+    prefetch_.push_back(batch);
+    prefetch_free_.push(batch.get());
+    DLOG(INFO) << "Prefetching " << prefetch_target_ << " batches";
+  } else if ((!keeps_up || (!waited && window_min_ready_ >= 2)) &&
+             prefetch_target_ > kMinPrefetch) {
+    // Loading is too slow for depth to help, or batches pile up unused.
+    --prefetch_target_;
+    DLOG(INFO) << "Prefetching " << prefetch_target_ << " batches";
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  NextBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
   top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
@@ -3,9 +3,172 @@
 
 #include "caffe/layers/batch_norm_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/task_graph.hpp"
 
 namespace caffe {
 
+// Everything the per-channel CPU kernels read and write.
+template <typename Dtype>
+struct BatchNormChannelArgs {
+  int num, channels, spatial_dim;
+  bool use_global_stats;
+  const Dtype* bottom_data;
+  const Dtype* top_diff;
+  // The normalized data kept by Forward, or NULL to recompute it.
+  const Dtype* x_norm;
+  // The top data in Forward, the bottom diff in Backward.
+  Dtype* out;
+  // Where Forward also keeps the normalized data, if not NULL.
+  Dtype* x_norm_out;
+  // Per channel: the mean, and the variance, or sqrt(var(X) + eps) once the
+  // statistics are complete.
+  Dtype* mean;
+  Dtype* variance;
+};
+
+template <typename Dtype>
+class BatchNormChannelTask : public TaskGraphExecutor::Task {
+ public:
+  typedef void (*Kernel)(const BatchNormChannelArgs<Dtype>& args, int c);
+  BatchNormChannelTask(Kernel kernel, const BatchNormChannelArgs<Dtype>& args)
+      : kernel_(kernel), args_(args) {}
+  virtual void run(int c) { kernel_(args_, c); }
+
+ private:
+  Kernel kernel_;
+  const BatchNormChannelArgs<Dtype>& args_;
+};
+
+// Runs kernel on every channel, spread over the executor threads if any.
+template <typename Dtype>
+static void ForEachChannel(TaskGraphExecutor* executor, int channels,
+    typename BatchNormChannelTask<Dtype>::Kernel kernel,
+    const BatchNormChannelArgs<Dtype>& args) {
+  if (!executor || channels == 1) {
+    for (int c = 0; c < channels; ++c) {
+      kernel(args, c);
+    }
+    return;
+  }
+  vector<int> ids(channels);
+  for (int c = 0; c < channels; ++c) {
+    ids[c] = c;
+  }
+  BatchNormChannelTask<Dtype> task(kernel, args);
+  executor->Run(ids, vector<vector<int> >(channels), &task);
+}
+
+// Mean and (biased) variance of channel c. Each plane is summed twice while
+// it is in cache, for its own mean and squared deviations, and the planes
+// are then merged as in the parallel variance algorithm of Chan et al.
+template <typename Dtype>
+static void BatchNormStats(const BatchNormChannelArgs<Dtype>& args, int c) {
+  const int dim = args.spatial_dim;
+  Dtype mean = 0, m2 = 0;
+  for (int n = 0; n < args.num; ++n) {
+    const Dtype* x = args.bottom_data + (n * args.channels + c) * dim;
+    Dtype sum = 0;
+    for (int i = 0; i < dim; ++i) {
+      sum += x[i];
+    }
+    const Dtype plane_mean = sum / dim;
+    Dtype plane_m2 = 0;
+    for (int i = 0; i < dim; ++i) {
+      const Dtype d = x[i] - plane_mean;
+      plane_m2 += d * d;
+    }
+    // Merge the plane into the n planes before it.
+    const Dtype delta = plane_mean - mean;
+    mean += delta / (n + 1);
+    m2 += plane_m2 + delta * delta * dim * n / (n + 1);
+  }
+  args.mean[c] = mean;
+  args.variance[c] = m2 / (args.num * dim);
+}
+
+template <typename Dtype>
+static void BatchNormNormalize(const BatchNormChannelArgs<Dtype>& args,
+    int c) {
+  const int dim = args.spatial_dim;
+  const Dtype mean = args.mean[c];
+  const Dtype inv_std = 1 / args.variance[c];
+  for (int n = 0; n < args.num; ++n) {
+    const int offset = (n * args.channels + c) * dim;
+    const Dtype* x = args.bottom_data + offset;
+    Dtype* y = args.out + offset;
+    for (int i = 0; i < dim; ++i) {
+      y[i] = (x[i] - mean) * inv_std;
+    }
+    if (args.x_norm_out) {
+      caffe_copy(dim, y, args.x_norm_out + offset);
+    }
+  }
+}
+
+// if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
+//
+// dE(Y)/dX =
+//   (dE/dY - mean(dE/dY) - mean(dE/dY \cdot Y) \cdot Y)
+//     ./ sqrt(var(X) + eps)
+//
+// where \cdot and ./ are hadamard product and elementwise division,
+// respectively, dE/dY is the top diff, and mean/var/sum are all computed
+// along all dimensions except the channels dimension.  In the above
+// equation, the operations allow for expansion (i.e. broadcast) along all
+// dimensions except the channels dimension where required.
+template <typename Dtype>
+static void BatchNormBackward(const BatchNormChannelArgs<Dtype>& args,
+    int c) {
+  const int dim = args.spatial_dim;
+  const Dtype mean = args.mean[c];
+  const Dtype inv_std = 1 / args.variance[c];
+  if (args.use_global_stats) {
+    for (int n = 0; n < args.num; ++n) {
+      const int offset = (n * args.channels + c) * dim;
+      caffe_cpu_scale(dim, inv_std, args.top_diff + offset, args.out + offset);
+    }
+    return;
+  }
+  // sum(dE/dY) and sum(dE/dY \cdot Y)
+  Dtype sum_dy = 0, sum_dy_y = 0;
+  for (int n = 0; n < args.num; ++n) {
+    const int offset = (n * args.channels + c) * dim;
+    const Dtype* dy = args.top_diff + offset;
+    if (args.x_norm) {
+      const Dtype* y = args.x_norm + offset;
+      for (int i = 0; i < dim; ++i) {
+        sum_dy += dy[i];
+        sum_dy_y += dy[i] * y[i];
+      }
+    } else {
+      const Dtype* x = args.bottom_data + offset;
+      for (int i = 0; i < dim; ++i) {
+        sum_dy += dy[i];
+        sum_dy_y += dy[i] * (x[i] - mean) * inv_std;
+      }
+    }
+  }
+  const Dtype mean_dy = sum_dy / (args.num * dim);
+  const Dtype mean_dy_y = sum_dy_y / (args.num * dim);
+  for (int n = 0; n < args.num; ++n) {
+    const int offset = (n * args.channels + c) * dim;
+    const Dtype* dy = args.top_diff + offset;
+    Dtype* dx = args.out + offset;
+    if (args.x_norm) {
+      const Dtype* y = args.x_norm + offset;
+      for (int i = 0; i < dim; ++i) {
+        dx[i] = (dy[i] - mean_dy - mean_dy_y * y[i]) * inv_std;
+      }
+    } else {
+      const Dtype* x = args.bottom_data + offset;
+      for (int i = 0; i < dim; ++i) {
+        const Dtype y = (x[i] - mean) * inv_std;
+        dx[i] = (dy[i] - mean_dy - mean_dy_y * y) * inv_std;
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void BatchNormLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -19,6 +182,10 @@ void BatchNormLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   else
     channels_ = bottom[0]->shape(1);
   eps_ = param.eps();
+  CHECK_GT(param.num_threads(), 0) << "BatchNorm needs at least one thread.";
+  if (param.num_threads() > 1) {
+    executor_.reset(new TaskGraphExecutor(param.num_threads()));
+  }
   if (this->blobs_.size() > 0) {
     LOG(INFO) << "Skipping parameter initialization";
   } else {
@@ -86,14 +253,16 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  int num = bottom[0]->shape(0);
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
-
-  if (bottom[0] != top[0]) {
-    caffe_copy(bottom[0]->count(), bottom_data, top_data);
-  }
+  BatchNormChannelArgs<Dtype> args;
+  args.num = bottom[0]->shape(0);
+  args.channels = channels_;
+  args.spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
+  args.use_global_stats = use_global_stats_;
+  args.bottom_data = bottom[0]->cpu_data();
+  args.top_diff = NULL;
+  args.x_norm = NULL;
+  args.mean = mean_.mutable_cpu_data();
+  args.variance = variance_.mutable_cpu_data();
 
   if (use_global_stats_) {
     // use the stored mean/variance estimates.
@@ -104,35 +273,7 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     caffe_cpu_scale(variance_.count(), scale_factor,
         this->blobs_[1]->cpu_data(), variance_.mutable_cpu_data());
   } else {
-    // compute mean
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), bottom_data,
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        mean_.mutable_cpu_data());
-  }
-
-  // subtract mean
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, -1, num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 1., top_data);
-
-  if (!use_global_stats_) {
-    // compute variance using var(X) = E((X-EX)^2)
-    caffe_sqr<Dtype>(top[0]->count(), top_data,
-                     temp_.mutable_cpu_data());  // (X-EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), temp_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E((X_EX)^2)
+    ForEachChannel(executor_.get(), channels_, &BatchNormStats<Dtype>, args);
 
     // compute and save moving average
     this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
@@ -151,94 +292,33 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   caffe_sqrt(variance_.count(), variance_.cpu_data(),
              variance_.mutable_cpu_data());
 
-  // replicate variance to input size
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), variance_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 0., temp_.mutable_cpu_data());
-  caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
-  // TODO(cdoersch): The caching is only needed because later in-place layers
-  //                 might clobber the data.  Can we skip this if they won't?
-  caffe_copy(x_norm_.count(), top_data,
-      x_norm_.mutable_cpu_data());
+  // Backward needs the normalized data, which later in-place layers may
+  // clobber; it is only kept when the bottom is overwritten too.
+  args.out = top[0]->mutable_cpu_data();
+  args.x_norm_out = bottom[0] == top[0] ? x_norm_.mutable_cpu_data() : NULL;
+  ForEachChannel(executor_.get(), channels_, &BatchNormNormalize<Dtype>,
+      args);
 }
 
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff;
-  if (bottom[0] != top[0]) {
-    top_diff = top[0]->cpu_diff();
-  } else {
-    caffe_copy(x_norm_.count(), top[0]->cpu_diff(), x_norm_.mutable_cpu_diff());
-    top_diff = x_norm_.cpu_diff();
-  }
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  if (use_global_stats_) {
-    caffe_div(temp_.count(), top_diff, temp_.cpu_data(), bottom_diff);
-    return;
-  }
-  const Dtype* top_data = x_norm_.cpu_data();
-  int num = bottom[0]->shape()[0];
-  int spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
-  // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
-  //
-  // dE(Y)/dX =
-  //   (dE/dY - mean(dE/dY) - mean(dE/dY \cdot Y) \cdot Y)
-  //     ./ sqrt(var(X) + eps)
-  //
-  // where \cdot and ./ are hadamard product and elementwise division,
-  // respectively, dE/dY is the top diff, and mean/var/sum are all computed
-  // along all dimensions except the channels dimension.  In the above
-  // equation, the operations allow for expansion (i.e. broadcast) along all
-  // dimensions except the channels dimension where required.
-
-  // sum(dE/dY \cdot Y)
-  caffe_mul(temp_.count(), top_data, top_diff, bottom_diff);
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      bottom_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-
-  // reshape (broadcast) the above
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, channels_ * num,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 0., bottom_diff);
-
-  // sum(dE/dY \cdot Y) \cdot Y
-  caffe_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
-
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      top_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-  // reshape (broadcast) the above to make
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num, channels_, 1, 1,
-      batch_sum_multiplier_.cpu_data(), mean_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num * channels_,
-      spatial_dim, 1, 1., num_by_chans_.cpu_data(),
-      spatial_sum_multiplier_.cpu_data(), 1., bottom_diff);
-
-  // dE/dY - mean(dE/dY)-mean(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_axpby(temp_.count(), Dtype(1), top_diff,
-      Dtype(-1. / (num * spatial_dim)), bottom_diff);
-
-  // note: temp_ still contains sqrt(var(X)+eps), computed during the forward
-  // pass.
-  caffe_div(temp_.count(), bottom_diff, temp_.cpu_data(), bottom_diff);
+  BatchNormChannelArgs<Dtype> args;
+  args.num = bottom[0]->shape(0);
+  args.channels = channels_;
+  args.spatial_dim = bottom[0]->count()/(bottom[0]->shape(0)*channels_);
+  args.use_global_stats = use_global_stats_;
+  args.bottom_data = bottom[0]->cpu_data();
+  args.top_diff = top[0]->cpu_diff();
+  args.x_norm = bottom[0] == top[0] ? x_norm_.cpu_data() : NULL;
+  // Each element of the top diff is read before the bottom diff is written
+  // there, so computing in place needs no copy of it.
+  args.out = bottom[0]->mutable_cpu_diff();
+  args.x_norm_out = NULL;
+  args.mean = mean_.mutable_cpu_data();
+  args.variance = variance_.mutable_cpu_data();
+  ForEachChannel(executor_.get(), channels_, &BatchNormBackward<Dtype>, args);
 }
 
 
@@ -63,6 +63,19 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
+    // Net may have made the bottom a view of its part of the top.
+    if (num_concats_ == 1 &&
+        bottom_data == top_data + offset_concat_axis * concat_input_size_) {
+      offset_concat_axis += bottom_concat_axis;
+      continue;
+    }
+    if (!bottom[i]->is_contiguous()) {
+      caffe_copy_strided(bottom[i]->shape(), bottom_data, bottom[i]->strides(),
+          top_data + offset_concat_axis * concat_input_size_,
+          top[0]->strides());
+      offset_concat_axis += bottom_concat_axis;
+      continue;
+    }
     for (int n = 0; n < num_concats_; ++n) {
       caffe_copy(bottom_concat_axis * concat_input_size_,
           bottom_data + n * bottom_concat_axis * concat_input_size_,
@@ -82,8 +95,16 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
-    if (propagate_down[i]) {
+    if (propagate_down[i] && (num_concats_ > 1 || bottom[i]->cpu_diff() !=
+        top_diff + offset_concat_axis * concat_input_size_)) {
       Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+      if (!bottom[i]->is_contiguous()) {
+        caffe_copy_strided(bottom[i]->shape(),
+            top_diff + offset_concat_axis * concat_input_size_,
+            top[0]->strides(), bottom_diff, bottom[i]->strides());
+        offset_concat_axis += bottom_concat_axis;
+        continue;
+      }
       for (int n = 0; n < num_concats_; ++n) {
         caffe_copy(bottom_concat_axis * concat_input_size_, top_diff +
             (n * top_concat_axis + offset_concat_axis) * concat_input_size_,
@@ -35,6 +35,19 @@ void ConcatLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->gpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
+    if (num_concats_ == 1 &&
+        bottom_data == top_data + offset_concat_axis * concat_input_size_) {
+      offset_concat_axis += bottom_concat_axis;
+      continue;
+    }
+    if (!bottom[i]->is_contiguous()) {
+      caffe_gpu_copy_strided(bottom[i]->shape(), bottom_data,
+          bottom[i]->strides(),
+          top_data + offset_concat_axis * concat_input_size_,
+          top[0]->strides());
+      offset_concat_axis += bottom_concat_axis;
+      continue;
+    }
     const int bottom_concat_size = bottom_concat_axis * concat_input_size_;
     const int nthreads = bottom_concat_size * num_concats_;
     Concat<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
@@ -55,8 +68,16 @@ void ConcatLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   const bool kForward = false;
   for (int i = 0; i < bottom.size(); ++i) {
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
-    if (propagate_down[i]) {
+    if (propagate_down[i] && (num_concats_ > 1 || bottom[i]->gpu_diff() !=
+        top_diff + offset_concat_axis * concat_input_size_)) {
       Dtype* bottom_diff = bottom[i]->mutable_gpu_diff();
+      if (!bottom[i]->is_contiguous()) {
+        caffe_gpu_copy_strided(bottom[i]->shape(),
+            top_diff + offset_concat_axis * concat_input_size_,
+            top[0]->strides(), bottom_diff, bottom[i]->strides());
+        offset_concat_axis += bottom_concat_axis;
+        continue;
+      }
       const int bottom_concat_size = bottom_concat_axis * concat_input_size_;
       const int nthreads = bottom_concat_size * num_concats_;
       Concat<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
@@ -8,6 +8,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/crop_layer.hpp"
 #include "caffe/net.hpp"
+#include "caffe/util/math_functions.hpp"
 
 
 namespace caffe {
@@ -71,9 +72,11 @@ void CropLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   // Compute strides
   src_strides_.Reshape(offsets_shape);
   dest_strides_.Reshape(offsets_shape);
+  top_offset_ = 0;
   for (int i = 0; i < input_dim; ++i) {
     src_strides_.mutable_cpu_data()[i] = bottom[0]->count(i + 1, input_dim);
     dest_strides_.mutable_cpu_data()[i] = top[0]->count(i + 1, input_dim);
+    top_offset_ += offset_data[i] * src_strides_.cpu_data()[i];
   }
 }
 
@@ -124,6 +127,8 @@ void CropLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   std::vector<int> indices(top[0]->num_axes(), 0);
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
+  // Net may have made the top a view of its part of the bottom.
+  if (top_data == bottom_data + top_offset_) { return; }
   crop_copy(bottom, top, offsets.cpu_data(), indices, 0, bottom_data, top_data,
       true);
 }
@@ -135,6 +140,16 @@ void CropLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
 
   if (propagate_down[0]) {
+    if (top_diff == bottom_diff + top_offset_) {
+      view_diff_.ReshapeLike(*top[0]);
+      caffe_copy_strided(top[0]->shape(), top_diff, top[0]->strides(),
+          view_diff_.mutable_cpu_data(), view_diff_.strides());
+      caffe_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
+      caffe_copy_strided(top[0]->shape(), view_diff_.cpu_data(),
+          view_diff_.strides(), bottom_diff + top_offset_,
+          top[0]->strides());
+      return;
+    }
     caffe_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
     std::vector<int> indices(top[0]->num_axes(), 0);
     crop_copy(bottom, top, offsets.cpu_data(), indices, 0, top_diff,
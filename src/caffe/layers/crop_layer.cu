@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layers/crop_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -53,6 +54,7 @@ void CropLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
+  if (top_data == bottom_data + top_offset_) { return; }
   int n = top[0]->count();
   // NOLINT_NEXT_LINE(whitespace/operators)
   crop_kernel_forward<<<CAFFE_GET_BLOCKS(n), CAFFE_CUDA_NUM_THREADS>>>(n,
@@ -71,6 +73,16 @@ void CropLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   int n = top[0]->count();
 
   if (propagate_down[0]) {
+    if (top_diff == bottom_diff + top_offset_) {
+      view_diff_.ReshapeLike(*top[0]);
+      caffe_gpu_copy_strided(top[0]->shape(), top_diff, top[0]->strides(),
+          view_diff_.mutable_gpu_data(), view_diff_.strides());
+      caffe_gpu_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
+      caffe_gpu_copy_strided(top[0]->shape(), view_diff_.gpu_data(),
+          view_diff_.strides(), bottom_diff + top_offset_,
+          top[0]->strides());
+      return;
+    }
     caffe_gpu_set(bottom[0]->count(), static_cast<Dtype>(0), bottom_diff);
     // NOLINT_NEXT_LINE(whitespace/operators)
     crop_kernel_backward<<<CAFFE_GET_BLOCKS(n), CAFFE_CUDA_NUM_THREADS>>>(n,
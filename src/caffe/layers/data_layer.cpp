@@ -8,16 +8,21 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    offset_() {
+    offset_(), caching_(false), cache_complete_(false), cache_bytes_(0),
+    position_(0) {
   db_.reset(db::GetDB(param.data_param().backend()));
   db_->Open(param.data_param().source(), db::READ);
   cursor_.reset(db_->NewCursor());
+  if (param.data_param().has_compression_dictionary()) {
+    codec_.ReadDictionary(param.data_param().compression_dictionary());
+  }
 }
 
 template <typename Dtype>
@@ -32,6 +37,7 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // Read a data point, and use it to initialize the top blob.
   Datum datum;
   datum.ParseFromString(cursor_->value());
+  codec_.Decompress(&datum);
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
@@ -54,6 +60,19 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
+  // Without random transformations, every pass gives the same items.
+  if (this->layer_param_.data_param().cache()) {
+    if (this->phase_ == TEST && !this->transform_param_.mirror()) {
+      caching_ = true;
+      LOG_IF(INFO, Caffe::root_solver())
+          << "Caching the first pass over " << this->layer_param_.name()
+          << "'s source";
+    } else {
+      LOG(WARNING) << "Not caching " << this->layer_param_.name()
+          << ": its transformations are random outside of the TEST phase "
+          << "or with mirror.";
+    }
+  }
 }
 
 template <typename Dtype>
@@ -69,20 +88,53 @@ bool DataLayer<Dtype>::Skip() {
 template<typename Dtype>
 void DataLayer<Dtype>::Next() {
   cursor_->Next();
+  ++position_;
   if (!cursor_->valid()) {
-    LOG_IF(INFO, Caffe::root_solver())
-        << "Restarting data prefetching from start.";
+    if (caching_) {
+      LOG_IF(INFO, Caffe::root_solver()) << "Cached " << cache_.size()
+          << " items (" << cache_bytes_ / (1 << 20) << " MB); replaying them.";
+      cache_complete_ = true;
+    } else {
+      LOG_IF(INFO, Caffe::root_solver())
+          << "Restarting data prefetching from start.";
+    }
     cursor_->SeekToFirst();
+    position_ = 0;
   }
   offset_++;
 }
 
+template<typename Dtype>
+void DataLayer<Dtype>::CacheItem(const Blob<Dtype>& item, Dtype label) {
+  // The cache fills during the first pass, one record after the other.
+  if (position_ != cache_.size()) {
+    return;
+  }
+  const size_t limit =
+      static_cast<size_t>(this->layer_param_.data_param().cache_limit_mb())
+      << 20;
+  cache_bytes_ += item.count() * sizeof(Dtype);
+  if (cache_bytes_ > limit) {
+    LOG(WARNING) << "Not caching " << this->layer_param_.name()
+        << ": its source does not fit in cache_limit_mb.";
+    vector<CachedItem>().swap(cache_);
+    caching_ = false;
+    return;
+  }
+  cache_.push_back(CachedItem());
+  CachedItem& cached = cache_.back();
+  cached.shape = item.shape();
+  cached.data.assign(item.cpu_data(), item.cpu_data() + item.count());
+  cached.label = label;
+}
+
 // This function is called on prefetch thread
 template<typename Dtype>
 void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
   double read_time = 0;
+  double decompress_time = 0;
   double trans_time = 0;
   CPUTimer timer;
   CHECK(batch->data_.count());
@@ -91,12 +143,34 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
 
   Datum datum;
   for (int item_id = 0; item_id < batch_size; ++item_id) {
+    if (cache_complete_) {
+      const CachedItem& cached = cache_[position_];
+      if (item_id == 0) {
+        vector<int> top_shape = cached.shape;
+        top_shape[0] = batch_size;
+        batch->data_.Reshape(top_shape);
+      }
+      CHECK_EQ(cached.data.size() * batch_size, batch->data_.count())
+          << "Items of a batch must have the same shape.";
+      caffe_copy(cached.data.size(), &cached.data[0],
+          batch->data_.mutable_cpu_data() + batch->data_.offset(item_id));
+      if (this->output_labels_) {
+        batch->label_.mutable_cpu_data()[item_id] = cached.label;
+      }
+      position_ = (position_ + 1) % cache_.size();
+      continue;
+    }
     timer.Start();
     while (Skip()) {
       Next();
     }
     datum.ParseFromString(cursor_->value());
     read_time += timer.MicroSeconds();
+    if (datum.compression() != Datum_Compression_NONE) {
+      timer.Start();
+      codec_.Decompress(&datum);
+      decompress_time += timer.MicroSeconds();
+    }
 
     if (item_id == 0) {
       // Reshape according to the first datum of each batch
@@ -120,6 +194,9 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       Dtype* top_label = batch->label_.mutable_cpu_data();
       top_label[item_id] = datum.label();
     }
+    if (caching_) {
+      CacheItem(this->transformed_data_, datum.label());
+    }
     trans_time += timer.MicroSeconds();
     Next();
   }
@@ -127,6 +204,7 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
+  DLOG(INFO) << "Decompress time: " << decompress_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
@@ -77,8 +77,8 @@ void EmbedLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
   if (bias_term_) {
     const Dtype* bias = this->blobs_[1]->cpu_data();
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, Dtype(1),
-        bias_multiplier_.cpu_data(), bias, Dtype(1), top_data);
+    caffe_cpu_broadcast_add<Dtype>(M_, N_, 1, top_data, Dtype(1), bias,
+        top_data);
   }
 }
 
@@ -104,8 +104,8 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (bias_term_ && this->param_propagate_down_[1]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
-    caffe_cpu_gemv<Dtype>(CblasTrans, M_, N_, Dtype(1), top_diff,
-        bias_multiplier_.cpu_data(), Dtype(1), bias_diff);
+    caffe_cpu_reduce_sum<Dtype>(M_, N_, 1, Dtype(1), top_diff, Dtype(1),
+        bias_diff);
   }
 }
 
@@ -1,10 +1,229 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/task_graph.hpp"
 
 namespace caffe {
 
+// Everything the per-image CPU kernels read and write.
+template <typename Dtype>
+struct LRNImageArgs {
+  int channels, height, width, size;
+  Dtype alpha, beta, k;
+  const Dtype* bottom_data;
+  const Dtype* top_data;
+  const Dtype* top_diff;
+  Dtype* scale_data;
+  Dtype* out;
+};
+
+template <typename Dtype>
+class LRNImageTask : public TaskGraphExecutor::Task {
+ public:
+  typedef void (*Kernel)(const LRNImageArgs<Dtype>& args, int n);
+  LRNImageTask(Kernel kernel, const LRNImageArgs<Dtype>& args)
+      : kernel_(kernel), args_(args) {}
+  virtual void run(int n) { kernel_(args_, n); }
+
+ private:
+  Kernel kernel_;
+  const LRNImageArgs<Dtype>& args_;
+};
+
+// Runs kernel on every image, spread over the executor threads if any.
+template <typename Dtype>
+static void ForEachImage(TaskGraphExecutor* executor, int num,
+    typename LRNImageTask<Dtype>::Kernel kernel,
+    const LRNImageArgs<Dtype>& args) {
+  if (!executor || num == 1) {
+    for (int n = 0; n < num; ++n) {
+      kernel(args, n);
+    }
+    return;
+  }
+  vector<int> images(num);
+  for (int n = 0; n < num; ++n) {
+    images[n] = n;
+  }
+  LRNImageTask<Dtype> task(kernel, args);
+  executor->Run(images, vector<vector<int> >(num), &task);
+}
+
+// out = sum of in over the (2 * half + 1)^2 window around each pixel of a
+// height x width plane, clipped at the borders; tmp holds the row sums.
+template <typename Dtype>
+static void BoxSum(const Dtype* in, int height, int width, int half,
+    Dtype* tmp, Dtype* out) {
+  for (int h = 0; h < height; ++h) {
+    const Dtype* row = in + h * width;
+    Dtype* row_sum = tmp + h * width;
+    Dtype sum = 0;
+    for (int w = 0; w < std::min(half, width); ++w) {
+      sum += row[w];
+    }
+    for (int w = 0; w < width; ++w) {
+      if (w + half < width) { sum += row[w + half]; }
+      row_sum[w] = sum;
+      if (w - half >= 0) { sum -= row[w - half]; }
+    }
+  }
+  caffe_set(width, Dtype(0), out);
+  for (int h = 0; h <= std::min(half, height - 1); ++h) {
+    caffe_axpy<Dtype>(width, Dtype(1), tmp + h * width, out);
+  }
+  for (int h = 1; h < height; ++h) {
+    const Dtype* head = (h + half < height) ? tmp + (h + half) * width : NULL;
+    const Dtype* tail = (h - half - 1 >= 0) ? tmp + (h - half - 1) * width
+                                            : NULL;
+    const Dtype* prev = out + (h - 1) * width;
+    Dtype* cur = out + h * width;
+    for (int w = 0; w < width; ++w) {
+      cur[w] = prev[w] + (head ? head[w] : Dtype(0))
+          - (tail ? tail[w] : Dtype(0));
+    }
+  }
+}
+
+// scale_c = k + alpha / size * sum of x^2 over the channels [c - pre, c + pre],
+// as a running sum along the channels; top = bottom * scale^-beta.
+template <typename Dtype>
+static void CrossChannelForwardImage(const LRNImageArgs<Dtype>& args, int n) {
+  const int dim = args.height * args.width;
+  const int offset = n * args.channels * dim;
+  const int pre = (args.size - 1) / 2;
+  const Dtype alpha_over_size = args.alpha / args.size;
+  const Dtype* x = args.bottom_data + offset;
+  Dtype* scale = args.scale_data + offset;
+  caffe_set(dim, args.k, scale);
+  for (int c = 0; c <= std::min(pre, args.channels - 1); ++c) {
+    const Dtype* x_c = x + c * dim;
+    for (int i = 0; i < dim; ++i) {
+      scale[i] += alpha_over_size * x_c[i] * x_c[i];
+    }
+  }
+  for (int c = 1; c < args.channels; ++c) {
+    const Dtype* prev = scale + (c - 1) * dim;
+    Dtype* cur = scale + c * dim;
+    caffe_copy(dim, prev, cur);
+    if (c + pre < args.channels) {
+      const Dtype* head = x + (c + pre) * dim;
+      for (int i = 0; i < dim; ++i) {
+        cur[i] += alpha_over_size * head[i] * head[i];
+      }
+    }
+    if (c - pre - 1 >= 0) {
+      const Dtype* tail = x + (c - pre - 1) * dim;
+      for (int i = 0; i < dim; ++i) {
+        cur[i] -= alpha_over_size * tail[i] * tail[i];
+      }
+    }
+  }
+  Dtype* y = args.out + offset;
+  caffe_powx<Dtype>(args.channels * dim, scale, -args.beta, y);
+  caffe_mul<Dtype>(args.channels * dim, y, x, y);
+}
+
+// bottom_diff_c = top_diff_c * scale_c^-beta - 2 alpha beta / size * x_c *
+//     sum of top_diff * top / scale over the channels [c - pre, c + pre].
+template <typename Dtype>
+static void CrossChannelBackwardImage(const LRNImageArgs<Dtype>& args,
+    int n) {
+  const int dim = args.height * args.width;
+  const int offset = n * args.channels * dim;
+  const int pre = (args.size - 1) / 2;
+  const Dtype cache_ratio_value = 2. * args.alpha * args.beta / args.size;
+  const Dtype* x = args.bottom_data + offset;
+  const Dtype* y = args.top_data + offset;
+  const Dtype* dy = args.top_diff + offset;
+  const Dtype* scale = args.scale_data + offset;
+  Dtype* dx = args.out + offset;
+  vector<Dtype> accum_ratio(dim, Dtype(0));
+  for (int c = 0; c < std::min(pre, args.channels); ++c) {
+    for (int i = 0; i < dim; ++i) {
+      const int j = c * dim + i;
+      accum_ratio[i] += dy[j] * y[j] / scale[j];
+    }
+  }
+  caffe_powx<Dtype>(args.channels * dim, scale, -args.beta, dx);
+  for (int c = 0; c < args.channels; ++c) {
+    if (c + pre < args.channels) {
+      for (int i = 0; i < dim; ++i) {
+        const int j = (c + pre) * dim + i;
+        accum_ratio[i] += dy[j] * y[j] / scale[j];
+      }
+    }
+    for (int i = 0; i < dim; ++i) {
+      const int j = c * dim + i;
+      dx[j] = dy[j] * dx[j] - cache_ratio_value * x[j] * accum_ratio[i];
+    }
+    if (c - pre >= 0) {
+      for (int i = 0; i < dim; ++i) {
+        const int j = (c - pre) * dim + i;
+        accum_ratio[i] -= dy[j] * y[j] / scale[j];
+      }
+    }
+  }
+}
+
+// scale = 1 + alpha / size^2 * sum of x^2 over the size x size window,
+// clipped at the borders; top = bottom * scale^-beta.
+template <typename Dtype>
+static void WithinChannelForwardImage(const LRNImageArgs<Dtype>& args,
+    int n) {
+  const int dim = args.height * args.width;
+  const int offset = n * args.channels * dim;
+  const Dtype alpha_over_area = args.alpha / (args.size * args.size);
+  vector<Dtype> buffer(2 * dim);
+  for (int c = 0; c < args.channels; ++c) {
+    const Dtype* x = args.bottom_data + offset + c * dim;
+    Dtype* scale = args.scale_data + offset + c * dim;
+    caffe_sqr(dim, x, &buffer[0]);
+    BoxSum(&buffer[0], args.height, args.width, (args.size - 1) / 2,
+           &buffer[dim], scale);
+    for (int i = 0; i < dim; ++i) {
+      scale[i] = 1 + alpha_over_area * scale[i];
+    }
+  }
+  Dtype* y = args.out + offset;
+  caffe_powx<Dtype>(args.channels * dim, args.scale_data + offset,
+                    -args.beta, y);
+  caffe_mul<Dtype>(args.channels * dim, y, args.bottom_data + offset, y);
+}
+
+// bottom_diff = top_diff * scale^-beta - 2 alpha beta / size^2 * x *
+//     sum of top_diff * top / scale over the size x size window.
+template <typename Dtype>
+static void WithinChannelBackwardImage(const LRNImageArgs<Dtype>& args,
+    int n) {
+  const int dim = args.height * args.width;
+  const int offset = n * args.channels * dim;
+  const Dtype cache_ratio_value =
+      2. * args.alpha * args.beta / (args.size * args.size);
+  vector<Dtype> buffer(3 * dim);
+  Dtype* ratio = &buffer[0];
+  Dtype* accum_ratio = &buffer[2 * dim];
+  for (int c = 0; c < args.channels; ++c) {
+    const int j = offset + c * dim;
+    const Dtype* x = args.bottom_data + j;
+    const Dtype* y = args.top_data + j;
+    const Dtype* dy = args.top_diff + j;
+    const Dtype* scale = args.scale_data + j;
+    Dtype* dx = args.out + j;
+    for (int i = 0; i < dim; ++i) {
+      ratio[i] = dy[i] * y[i] / scale[i];
+    }
+    BoxSum(ratio, args.height, args.width, (args.size - 1) / 2,
+           &buffer[dim], accum_ratio);
+    caffe_powx<Dtype>(dim, scale, -args.beta, dx);
+    for (int i = 0; i < dim; ++i) {
+      dx[i] = dy[i] * dx[i] - cache_ratio_value * x[i] * accum_ratio[i];
+    }
+  }
+}
+
 template <typename Dtype>
 void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -14,6 +233,11 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   alpha_ = this->layer_param_.lrn_param().alpha();
   beta_ = this->layer_param_.lrn_param().beta();
   k_ = this->layer_param_.lrn_param().k();
+  const int num_threads = this->layer_param_.lrn_param().num_threads();
+  CHECK_GT(num_threads, 0) << "LRN needs at least one thread.";
+  if (num_threads > 1) {
+    executor_.reset(new TaskGraphExecutor(num_threads));
+  }
   if (this->layer_param_.lrn_param().norm_region() ==
       LRNParameter_NormRegion_WITHIN_CHANNEL) {
     // Set up split_layer_ to use inputs in the numerator and denominator.
@@ -80,6 +304,7 @@ void LRNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     scale_.Reshape(num_, channels_, height_, width_);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
+    scale_.Reshape(num_, channels_, height_, width_);
     split_layer_->Reshape(bottom, split_top_vec_);
     square_layer_->Reshape(square_bottom_vec_, square_top_vec_);
     pool_layer_->Reshape(square_top_vec_, pool_top_vec_);
@@ -97,7 +322,7 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     CrossChannelForward_cpu(bottom, top);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelForward(bottom, top);
+    WithinChannelForward_cpu(bottom, top);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -107,48 +332,19 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelForward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
-  }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
-    }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
-    }
-  }
+  LRNImageArgs<Dtype> args = {channels_, height_, width_, size_, alpha_,
+      beta_, k_, bottom[0]->cpu_data(), NULL, NULL,
+      scale_.mutable_cpu_data(), top[0]->mutable_cpu_data()};
+  ForEachImage(executor_.get(), num_, CrossChannelForwardImage<Dtype>, args);
+}
 
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelForward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LRNImageArgs<Dtype> args = {channels_, height_, width_, size_, alpha_,
+      beta_, k_, bottom[0]->cpu_data(), NULL, NULL,
+      scale_.mutable_cpu_data(), top[0]->mutable_cpu_data()};
+  ForEachImage(executor_.get(), num_, WithinChannelForwardImage<Dtype>, args);
 }
 
 template <typename Dtype>
@@ -169,7 +365,7 @@ void LRNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     CrossChannelBackward_cpu(top, propagate_down, bottom);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelBackward(top, propagate_down, bottom);
+    WithinChannelBackward_cpu(top, propagate_down, bottom);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -180,54 +376,24 @@ template <typename Dtype>
 void LRNLayer<Dtype>::CrossChannelBackward_cpu(
     const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff = top[0]->cpu_diff();
-  const Dtype* top_data = top[0]->cpu_data();
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* scale_data = scale_.cpu_data();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Blob<Dtype> padded_ratio(1, channels_ + size_ - 1, height_, width_);
-  Blob<Dtype> accum_ratio(1, 1, height_, width_);
-  Dtype* padded_ratio_data = padded_ratio.mutable_cpu_data();
-  Dtype* accum_ratio_data = accum_ratio.mutable_cpu_data();
-  // We hack a little bit by using the diff() to store an additional result
-  Dtype* accum_ratio_times_bottom = accum_ratio.mutable_cpu_diff();
-  caffe_set(padded_ratio.count(), Dtype(0), padded_ratio_data);
-  Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
-
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
-  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
+  LRNImageArgs<Dtype> args = {channels_, height_, width_, size_, alpha_,
+      beta_, k_, bottom[0]->cpu_data(), top[0]->cpu_data(),
+      top[0]->cpu_diff(), scale_.mutable_cpu_data(),
+      bottom[0]->mutable_cpu_diff()};
+  ForEachImage(executor_.get(), num_, CrossChannelBackwardImage<Dtype>, args);
+}
 
-  // go through individual data
-  int inverse_pre_pad = size_ - (size_ + 1) / 2;
-  for (int n = 0; n < num_; ++n) {
-    int block_offset = scale_.offset(n);
-    // first, compute diff_i * y_i / s_i
-    caffe_mul<Dtype>(channels_ * height_ * width_,
-        top_diff + block_offset, top_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    caffe_div<Dtype>(channels_ * height_ * width_,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad),
-        scale_data + block_offset,
-        padded_ratio_data + padded_ratio.offset(0, inverse_pre_pad));
-    // Now, compute the accumulated ratios and the bottom diff
-    caffe_set(accum_ratio.count(), Dtype(0), accum_ratio_data);
-    for (int c = 0; c < size_ - 1; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
-    }
-    for (int c = 0; c < channels_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, 1.,
-          padded_ratio_data + padded_ratio.offset(0, c + size_ - 1),
-          accum_ratio_data);
-      // compute bottom diff
-      caffe_mul<Dtype>(height_ * width_,
-          bottom_data + top[0]->offset(n, c),
-          accum_ratio_data, accum_ratio_times_bottom);
-      caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
-          accum_ratio_times_bottom, bottom_diff + top[0]->offset(n, c));
-      caffe_axpy<Dtype>(height_ * width_, -1.,
-          padded_ratio_data + padded_ratio.offset(0, c), accum_ratio_data);
-    }
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelBackward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[0]) {
+    LRNImageArgs<Dtype> args = {channels_, height_, width_, size_, alpha_,
+        beta_, k_, bottom[0]->cpu_data(), top[0]->cpu_data(),
+        top[0]->cpu_diff(), scale_.mutable_cpu_data(),
+        bottom[0]->mutable_cpu_diff()};
+    ForEachImage(executor_.get(), num_, WithinChannelBackwardImage<Dtype>,
+                 args);
   }
 }
 
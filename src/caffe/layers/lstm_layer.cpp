@@ -1,3 +1,4 @@
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -238,6 +239,351 @@ void LSTMLayer<Dtype>::FillUnrolledNet(NetParameter* net_param) const {
   net_param->add_layer()->CopyFrom(output_concat_layer);
 }
 
+template <typename Dtype>
+inline Dtype sigmoid(Dtype x) {
+  return 1. / (1. + exp(-x));
+}
+
+template <typename Dtype>
+inline Dtype tanh(Dtype x) {
+  return 2. * sigmoid(2. * x) - 1.;
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const RecurrentParameter& recurrent_param =
+      this->layer_param_.recurrent_param();
+  fused_ = recurrent_param.engine() == RecurrentParameter_Engine_FUSED ||
+      (recurrent_param.engine() == RecurrentParameter_Engine_DEFAULT &&
+       Caffe::mode() == Caffe::CPU);
+  if (!fused_) {
+    RecurrentLayer<Dtype>::LayerSetUp(bottom, top);
+    return;
+  }
+  CHECK_GE(bottom[0]->num_axes(), 2)
+      << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
+  this->T_ = bottom[0]->shape(0);
+  this->N_ = bottom[0]->shape(1);
+  LOG(INFO) << "Initializing fused LSTM layer: assuming input batch contains "
+            << this->T_ << " timesteps of " << this->N_
+            << " independent streams.";
+  CHECK_EQ(bottom[1]->num_axes(), 2)
+      << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
+  CHECK_EQ(this->T_, bottom[1]->shape(0));
+  CHECK_EQ(this->N_, bottom[1]->shape(1));
+  this->expose_hidden_ = recurrent_param.expose_hidden();
+  this->static_input_ = (bottom.size() > 2 + 2 * this->expose_hidden_);
+  if (this->static_input_) {
+    CHECK_GE(bottom[2]->num_axes(), 1);
+    CHECK_EQ(this->N_, bottom[2]->shape(0));
+  }
+  hidden_dim_ = recurrent_param.num_output();
+  CHECK_GT(hidden_dim_, 0) << "num_output must be positive";
+  input_dim_ = bottom[0]->count(2);
+  static_dim_ = this->static_input_ ? bottom[2]->count(1) : 0;
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    // Same params, filled in the same order, as the unrolled net.
+    shared_ptr<Filler<Dtype> > weight_filler(
+        GetFiller<Dtype>(recurrent_param.weight_filler()));
+    shared_ptr<Filler<Dtype> > bias_filler(
+        GetFiller<Dtype>(recurrent_param.bias_filler()));
+    vector<int> weight_shape(2);
+    weight_shape[0] = 4 * hidden_dim_;
+    weight_shape[1] = input_dim_;
+    this->blobs_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>(weight_shape)));
+    weight_filler->Fill(this->blobs_.back().get());
+    vector<int> bias_shape(1, 4 * hidden_dim_);
+    this->blobs_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>(bias_shape)));
+    bias_filler->Fill(this->blobs_.back().get());
+    if (this->static_input_) {
+      weight_shape[1] = static_dim_;
+      this->blobs_.push_back(
+          shared_ptr<Blob<Dtype> >(new Blob<Dtype>(weight_shape)));
+      weight_filler->Fill(this->blobs_.back().get());
+    }
+    weight_shape[1] = hidden_dim_;
+    this->blobs_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>(weight_shape)));
+    weight_filler->Fill(this->blobs_.back().get());
+  }
+  this->param_propagate_down_.clear();
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  vector<int> state_shape(3);
+  state_shape[0] = 1;
+  state_shape[1] = this->N_;
+  state_shape[2] = hidden_dim_;
+  h_T_.Reshape(state_shape);
+  c_T_.Reshape(state_shape);
+  Reset();
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (!fused_) {
+    RecurrentLayer<Dtype>::Reshape(bottom, top);
+    return;
+  }
+  CHECK_GE(bottom[0]->num_axes(), 2)
+      << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
+  this->T_ = bottom[0]->shape(0);
+  this->N_ = bottom[0]->shape(1);
+  CHECK_EQ(bottom[1]->num_axes(), 2)
+      << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
+  CHECK_EQ(this->T_, bottom[1]->shape(0));
+  CHECK_EQ(this->N_, bottom[1]->shape(1));
+  CHECK_EQ(input_dim_, bottom[0]->count(2))
+      << "Input size incompatible with LSTM parameters.";
+  vector<int> shape(3);
+  shape[0] = this->T_;
+  shape[1] = this->N_;
+  shape[2] = 4 * hidden_dim_;
+  gates_.Reshape(shape);
+  shape[2] = hidden_dim_;
+  cell_.Reshape(shape);
+  h_conted_.Reshape(shape);
+  top[0]->Reshape(shape);
+  shape[0] = 1;
+  h_0_.Reshape(shape);
+  c_0_.Reshape(shape);
+  h_T_.Reshape(shape);
+  c_T_.Reshape(shape);
+  if (this->static_input_) {
+    CHECK_EQ(this->N_, bottom[2]->shape(0));
+    CHECK_EQ(static_dim_, bottom[2]->count(1))
+        << "Static input size incompatible with LSTM parameters.";
+    shape[2] = 4 * hidden_dim_;
+    static_gates_.Reshape(shape);
+  }
+  vector<int> bias_shape(1, this->T_ * this->N_);
+  if (bias_multiplier_.count() != bias_shape[0]) {
+    bias_multiplier_.Reshape(bias_shape);
+    caffe_set(bias_shape[0], Dtype(1), bias_multiplier_.mutable_cpu_data());
+  }
+  if (this->expose_hidden_) {
+    const int bottom_offset = 2 + this->static_input_;
+    CHECK(h_0_.shape() == bottom[bottom_offset]->shape())
+        << "shape mismatch - h_0: " << h_0_.shape_string()
+        << " vs. bottom[" << bottom_offset << "]: "
+        << bottom[bottom_offset]->shape_string();
+    CHECK(c_0_.shape() == bottom[bottom_offset + 1]->shape())
+        << "shape mismatch - c_0: " << c_0_.shape_string()
+        << " vs. bottom[" << bottom_offset + 1 << "]: "
+        << bottom[bottom_offset + 1]->shape_string();
+    h_0_.ShareData(*bottom[bottom_offset]);
+    c_0_.ShareData(*bottom[bottom_offset + 1]);
+    top[1]->ReshapeLike(h_T_);
+    top[1]->ShareData(h_T_);
+    top[2]->ReshapeLike(c_T_);
+    top[2]->ShareData(c_T_);
+  }
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Reset() {
+  if (!fused_) {
+    RecurrentLayer<Dtype>::Reset();
+    return;
+  }
+  caffe_set(h_T_.count(), Dtype(0), h_T_.mutable_cpu_data());
+  caffe_set(c_T_.count(), Dtype(0), c_T_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (!fused_) {
+    RecurrentLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int T = this->T_;
+  const int N = this->N_;
+  const int D = hidden_dim_;
+  const int G = 4 * D;
+  if (!this->expose_hidden_) {
+    // Carry the hidden state over from the previous batch.
+    caffe_copy(h_0_.count(), h_T_.cpu_data(), h_0_.mutable_cpu_data());
+    caffe_copy(c_0_.count(), c_T_.cpu_data(), c_0_.mutable_cpu_data());
+  }
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* W_hc = this->blobs_.back()->cpu_data();
+  Dtype* gates = gates_.mutable_cpu_data();
+  Dtype* cell = cell_.mutable_cpu_data();
+  Dtype* h_conted = h_conted_.mutable_cpu_data();
+  Dtype* h = top[0]->mutable_cpu_data();
+  // The input projection of all timesteps does not depend on the recurrence:
+  //     gate_input_t := W_xc * x_t + b_c [+ W_xc_static * x_static]
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, T * N, G, input_dim_,
+      (Dtype)1., bottom[0]->cpu_data(), this->blobs_[0]->cpu_data(),
+      (Dtype)0., gates);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, G, 1, (Dtype)1.,
+      bias_multiplier_.cpu_data(), this->blobs_[1]->cpu_data(), (Dtype)1.,
+      gates);
+  if (this->static_input_) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, G, static_dim_,
+        (Dtype)1., bottom[2]->cpu_data(), this->blobs_[2]->cpu_data(),
+        (Dtype)0., static_gates_.mutable_cpu_data());
+    for (int t = 0; t < T; ++t) {
+      caffe_axpy<Dtype>(N * G, (Dtype)1., static_gates_.cpu_data(),
+          gates + t * N * G);
+    }
+  }
+  for (int t = 0; t < T; ++t) {
+    const Dtype* h_prev = t ? h + (t - 1) * N * D : h_0_.cpu_data();
+    const Dtype* c_prev = t ? cell + (t - 1) * N * D : c_0_.cpu_data();
+    Dtype* h_conted_t = h_conted + t * N * D;
+    Dtype* gates_t = gates + t * N * G;
+    Dtype* c_t = cell + t * N * D;
+    Dtype* h_t = h + t * N * D;
+    const Dtype* cont_t = cont + t * N;
+    //     h_conted_{t-1} := cont_t * h_{t-1}
+    //     gate_input_t += W_hc * h_conted_{t-1}
+    for (int n = 0; n < N; ++n) {
+      caffe_cpu_scale<Dtype>(D, cont_t[n], h_prev + n * D,
+          h_conted_t + n * D);
+    }
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, G, D, (Dtype)1.,
+        h_conted_t, W_hc, (Dtype)1., gates_t);
+    // Gate non-linearities and state updates, as in LSTMUnitLayer. The
+    // activations overwrite the gate inputs as Backward needs only those.
+    for (int n = 0; n < N; ++n) {
+      Dtype* X = gates_t + n * G;
+      for (int d = 0; d < D; ++d) {
+        const Dtype i = sigmoid(X[d]);
+        const Dtype f = (cont_t[n] == 0) ? 0 :
+            (cont_t[n] * sigmoid(X[1 * D + d]));
+        const Dtype o = sigmoid(X[2 * D + d]);
+        const Dtype g = tanh(X[3 * D + d]);
+        const Dtype c = f * c_prev[n * D + d] + i * g;
+        X[d] = i;
+        X[1 * D + d] = f;
+        X[2 * D + d] = o;
+        X[3 * D + d] = g;
+        c_t[n * D + d] = c;
+        h_t[n * D + d] = o * tanh(c);
+      }
+    }
+  }
+  caffe_copy(N * D, h + (T - 1) * N * D, h_T_.mutable_cpu_data());
+  caffe_copy(N * D, cell + (T - 1) * N * D, c_T_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (fused_) {
+    Forward_cpu(bottom, top);
+  } else {
+    RecurrentLayer<Dtype>::Forward_gpu(bottom, top);
+  }
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!fused_) {
+    RecurrentLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
+  CHECK(!propagate_down[1]) << "Cannot backpropagate to sequence indicators.";
+  const int T = this->T_;
+  const int N = this->N_;
+  const int D = hidden_dim_;
+  const int G = 4 * D;
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* gates = gates_.cpu_data();
+  const Dtype* cell = cell_.cpu_data();
+  const Dtype* h_diff = top[0]->cpu_diff();
+  const Dtype* W_hc = this->blobs_.back()->cpu_data();
+  Dtype* gates_diff = gates_.mutable_cpu_diff();
+  // The gradients flowing into h_{t-1} and c_{t-1} from timestep t. As in
+  // the unrolled net, nothing flows in from the next batch, nor out to the
+  // exposed initial states.
+  Dtype* h_prev_diff = h_0_.mutable_cpu_diff();
+  Dtype* c_prev_diff = c_0_.mutable_cpu_diff();
+  caffe_set(N * D, Dtype(0), h_prev_diff);
+  caffe_set(N * D, Dtype(0), c_prev_diff);
+  for (int t = T - 1; t >= 0; --t) {
+    const Dtype* c_prev = t ? cell + (t - 1) * N * D : c_0_.cpu_data();
+    const Dtype* cont_t = cont + t * N;
+    for (int n = 0; n < N; ++n) {
+      const Dtype* X = gates + (t * N + n) * G;
+      Dtype* X_diff = gates_diff + (t * N + n) * G;
+      const int offset = (t * N + n) * D;
+      for (int d = 0; d < D; ++d) {
+        const Dtype i = X[d];
+        const Dtype f = X[1 * D + d];
+        const Dtype o = X[2 * D + d];
+        const Dtype g = X[3 * D + d];
+        const Dtype tanh_c = tanh(cell[offset + d]);
+        const Dtype h_term_diff = h_diff[offset + d] + h_prev_diff[n * D + d];
+        const Dtype c_term_diff = c_prev_diff[n * D + d] +
+            h_term_diff * o * (1 - tanh_c * tanh_c);
+        c_prev_diff[n * D + d] = c_term_diff * f;
+        X_diff[d] = c_term_diff * g * i * (1 - i);
+        X_diff[1 * D + d] = c_term_diff * c_prev[n * D + d] * f * (1 - f);
+        X_diff[2 * D + d] = h_term_diff * tanh_c * o * (1 - o);
+        X_diff[3 * D + d] = c_term_diff * i * (1 - g * g);
+      }
+    }
+    if (t > 0) {
+      //     h_diff_{t-1} := cont_t * (W_hc^T * gate_diff_t)
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, D, G, (Dtype)1.,
+          gates_diff + t * N * G, W_hc, (Dtype)0., h_prev_diff);
+      for (int n = 0; n < N; ++n) {
+        caffe_scal<Dtype>(D, cont_t[n], h_prev_diff + n * D);
+      }
+    }
+  }
+  // With the gate gradients of all timesteps known, the param and input
+  // gradients are each a single GEMM.
+  const int W_hc_index = this->blobs_.size() - 1;
+  if (this->param_propagate_down_[0]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, G, input_dim_, T * N,
+        (Dtype)1., gates_diff, bottom[0]->cpu_data(), (Dtype)1.,
+        this->blobs_[0]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[1]) {
+    caffe_cpu_gemv<Dtype>(CblasTrans, T * N, G, (Dtype)1., gates_diff,
+        bias_multiplier_.cpu_data(), (Dtype)1.,
+        this->blobs_[1]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[W_hc_index]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, G, D, T * N,
+        (Dtype)1., gates_diff, h_conted_.cpu_data(), (Dtype)1.,
+        this->blobs_[W_hc_index]->mutable_cpu_diff());
+  }
+  if (propagate_down[0]) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, input_dim_, G,
+        (Dtype)1., gates_diff, this->blobs_[0]->cpu_data(), (Dtype)0.,
+        bottom[0]->mutable_cpu_diff());
+  }
+  if (this->static_input_) {
+    // The static input feeds every timestep; sum its gate gradients.
+    Dtype* static_gates_diff = static_gates_.mutable_cpu_diff();
+    caffe_copy(N * G, gates_diff, static_gates_diff);
+    for (int t = 1; t < T; ++t) {
+      caffe_axpy<Dtype>(N * G, (Dtype)1., gates_diff + t * N * G,
+          static_gates_diff);
+    }
+    if (this->param_propagate_down_[2]) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, G, static_dim_, N,
+          (Dtype)1., static_gates_diff, bottom[2]->cpu_data(), (Dtype)1.,
+          this->blobs_[2]->mutable_cpu_diff());
+    }
+    if (propagate_down[2]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, static_dim_, G,
+          (Dtype)1., static_gates_diff, this->blobs_[2]->cpu_data(),
+          (Dtype)0., bottom[2]->mutable_cpu_diff());
+    }
+  }
+}
+
 INSTANTIATE_CLASS(LSTMLayer);
 REGISTER_LAYER_CLASS(LSTM);
 
@@ -1,3 +1,4 @@
+#include <map>
 #include <string>
 #include <vector>
 
@@ -13,6 +14,9 @@ namespace caffe {
 template <typename Dtype>
 void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  CHECK_NE(this->layer_param_.recurrent_param().engine(),
+           RecurrentParameter_Engine_FUSED)
+      << this->type() << " layers have no fused implementation.";
   CHECK_GE(bottom[0]->num_axes(), 2)
       << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
   T_ = bottom[0]->shape(0);
@@ -29,85 +33,123 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // the hidden state blobs at the first and last timesteps.
   expose_hidden_ = this->layer_param_.recurrent_param().expose_hidden();
 
-  // Get (recurrent) input/output names.
-  vector<string> output_names;
-  OutputBlobNames(&output_names);
+  // If provided, bottom[2] is a static input to the recurrent net.
   vector<string> recur_input_names;
   RecurrentInputBlobNames(&recur_input_names);
-  vector<string> recur_output_names;
-  RecurrentOutputBlobNames(&recur_output_names);
-  const int num_recur_blobs = recur_input_names.size();
-  CHECK_EQ(num_recur_blobs, recur_output_names.size());
-
-  // If provided, bottom[2] is a static input to the recurrent net.
-  const int num_hidden_exposed = expose_hidden_ * num_recur_blobs;
+  const int num_hidden_exposed = expose_hidden_ * recur_input_names.size();
   static_input_ = (bottom.size() > 2 + num_hidden_exposed);
   if (static_input_) {
     CHECK_GE(bottom[2]->num_axes(), 1);
     CHECK_EQ(N_, bottom[2]->shape(0));
   }
+  vector<string> output_names;
+  OutputBlobNames(&output_names);
+  CHECK_EQ(top.size() - num_hidden_exposed, output_names.size())
+      << "OutputBlobNames must provide an output blob name for each top.";
 
-  // Create a NetParameter; setup the inputs that aren't unique to particular
-  // recurrent architectures.
-  NetParameter net_param;
-
-  LayerParameter* input_layer_param = net_param.add_layer();
-  input_layer_param->set_type("Input");
-  InputParameter* input_param = input_layer_param->mutable_input_param();
-  input_layer_param->add_top("x");
-  BlobShape input_shape;
-  for (int i = 0; i < bottom[0]->num_axes(); ++i) {
-    input_shape.add_dim(bottom[0]->shape(i));
-  }
-  input_param->add_shape()->CopyFrom(input_shape);
+  unrolled_nets_.clear();
+  this->blobs_.clear();
+  UnrollNet(bottom);
 
-  input_shape.Clear();
-  for (int i = 0; i < bottom[1]->num_axes(); ++i) {
-    input_shape.add_dim(bottom[1]->shape(i));
+  // This layer's parameters are any parameters in the layers of the unrolled
+  // net. We only want one copy of each parameter, so check that the parameter
+  // is "owned" by the layer, rather than shared with another.
+  for (int i = 0; i < unrolled_net_->params().size(); ++i) {
+    if (unrolled_net_->param_owners()[i] == -1) {
+      LOG(INFO) << "Adding parameter " << i << ": "
+                << unrolled_net_->param_display_names()[i];
+      this->blobs_.push_back(unrolled_net_->params()[i]);
+    }
+  }
+  // Check that param_propagate_down is set for all of the parameters in the
+  // unrolled net; set param_propagate_down to true in this layer.
+  for (int i = 0; i < unrolled_net_->layers().size(); ++i) {
+    for (int j = 0; j < unrolled_net_->layers()[i]->blobs().size(); ++j) {
+      CHECK(unrolled_net_->layers()[i]->param_propagate_down(j))
+          << "param_propagate_down not set for layer " << i << ", param " << j;
+    }
   }
-  input_layer_param->add_top("cont");
-  input_param->add_shape()->CopyFrom(input_shape);
+  this->param_propagate_down_.clear();
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+}
+
+template <typename Dtype>
+void RecurrentLayer<Dtype>::UnrollNet(const vector<Blob<Dtype>*>& bottom) {
+  typename map<int, shared_ptr<Net<Dtype> > >::iterator it =
+      unrolled_nets_.find(T_);
+  const bool cached = (it != unrolled_nets_.end());
+  if (cached) {
+    unrolled_net_ = it->second;
+  } else {
+    // Create a NetParameter; setup the inputs that aren't unique to particular
+    // recurrent architectures.
+    NetParameter net_param;
+
+    LayerParameter* input_layer_param = net_param.add_layer();
+    input_layer_param->set_type("Input");
+    InputParameter* input_param = input_layer_param->mutable_input_param();
+    input_layer_param->add_top("x");
+    BlobShape input_shape;
+    for (int i = 0; i < bottom[0]->num_axes(); ++i) {
+      input_shape.add_dim(bottom[0]->shape(i));
+    }
+    input_param->add_shape()->CopyFrom(input_shape);
 
-  if (static_input_) {
     input_shape.Clear();
-    for (int i = 0; i < bottom[2]->num_axes(); ++i) {
-      input_shape.add_dim(bottom[2]->shape(i));
+    for (int i = 0; i < bottom[1]->num_axes(); ++i) {
+      input_shape.add_dim(bottom[1]->shape(i));
     }
-    input_layer_param->add_top("x_static");
+    input_layer_param->add_top("cont");
     input_param->add_shape()->CopyFrom(input_shape);
-  }
 
-  // Call the child's FillUnrolledNet implementation to specify the unrolled
-  // recurrent architecture.
-  this->FillUnrolledNet(&net_param);
+    if (static_input_) {
+      input_shape.Clear();
+      for (int i = 0; i < bottom[2]->num_axes(); ++i) {
+        input_shape.add_dim(bottom[2]->shape(i));
+      }
+      input_layer_param->add_top("x_static");
+      input_param->add_shape()->CopyFrom(input_shape);
+    }
 
-  // Prepend this layer's name to the names of each layer in the unrolled net.
-  const string& layer_name = this->layer_param_.name();
-  if (layer_name.size()) {
-    for (int i = 0; i < net_param.layer_size(); ++i) {
-      LayerParameter* layer = net_param.mutable_layer(i);
-      layer->set_name(layer_name + "_" + layer->name());
+    // Call the child's FillUnrolledNet implementation to specify the unrolled
+    // recurrent architecture.
+    this->FillUnrolledNet(&net_param);
+
+    // Prepend this layer's name to the names of each layer in the unrolled
+    // net.
+    const string& layer_name = this->layer_param_.name();
+    if (layer_name.size()) {
+      for (int i = 0; i < net_param.layer_size(); ++i) {
+        LayerParameter* layer = net_param.mutable_layer(i);
+        layer->set_name(layer_name + "_" + layer->name());
+      }
     }
-  }
 
-  // Add "pseudo-losses" to all outputs to force backpropagation.
-  // (Setting force_backward is too aggressive as we may not need to backprop to
-  // all inputs, e.g., the sequence continuation indicators.)
-  vector<string> pseudo_losses(output_names.size());
-  for (int i = 0; i < output_names.size(); ++i) {
-    LayerParameter* layer = net_param.add_layer();
-    pseudo_losses[i] = output_names[i] + "_pseudoloss";
-    layer->set_name(pseudo_losses[i]);
-    layer->set_type("Reduction");
-    layer->add_bottom(output_names[i]);
-    layer->add_top(pseudo_losses[i]);
-    layer->add_loss_weight(1);
-  }
+    // Add "pseudo-losses" to all outputs to force backpropagation.
+    // (Setting force_backward is too aggressive as we may not need to backprop
+    // to all inputs, e.g., the sequence continuation indicators.)
+    vector<string> output_names;
+    OutputBlobNames(&output_names);
+    for (int i = 0; i < output_names.size(); ++i) {
+      LayerParameter* layer = net_param.add_layer();
+      layer->set_name(output_names[i] + "_pseudoloss");
+      layer->set_type("Reduction");
+      layer->add_bottom(output_names[i]);
+      layer->add_top(output_names[i] + "_pseudoloss");
+      layer->add_loss_weight(1);
+    }
 
-  // Create the unrolled net.
-  unrolled_net_.reset(new Net<Dtype>(net_param));
-  unrolled_net_->set_debug_info(
-      this->layer_param_.recurrent_param().debug_info());
+    // Create the unrolled net.
+    unrolled_net_.reset(new Net<Dtype>(net_param));
+    unrolled_net_->set_debug_info(
+        this->layer_param_.recurrent_param().debug_info());
+    unrolled_nets_[T_] = unrolled_net_;
+    // Nets unrolled for another number of timesteps use the params of the
+    // first one.
+    if (this->blobs_.size() > 0) {
+      ShareParams();
+    }
+  }
 
   // Setup pointers to the inputs.
   x_input_blob_ = CHECK_NOTNULL(unrolled_net_->blob_by_name("x").get());
@@ -118,6 +160,12 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   // Setup pointers to paired recurrent inputs/outputs.
+  vector<string> recur_input_names;
+  RecurrentInputBlobNames(&recur_input_names);
+  vector<string> recur_output_names;
+  RecurrentOutputBlobNames(&recur_output_names);
+  const int num_recur_blobs = recur_input_names.size();
+  CHECK_EQ(num_recur_blobs, recur_output_names.size());
   recur_input_blobs_.resize(num_recur_blobs);
   recur_output_blobs_.resize(num_recur_blobs);
   for (int i = 0; i < recur_input_names.size(); ++i) {
@@ -128,8 +176,8 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   // Setup pointers to outputs.
-  CHECK_EQ(top.size() - num_hidden_exposed, output_names.size())
-      << "OutputBlobNames must provide an output blob name for each top.";
+  vector<string> output_names;
+  OutputBlobNames(&output_names);
   output_blobs_.resize(output_names.size());
   for (int i = 0; i < output_names.size(); ++i) {
     output_blobs_[i] =
@@ -141,50 +189,53 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   CHECK_EQ(2 + num_recur_blobs + static_input_,
            unrolled_net_->input_blobs().size());
 
-  // This layer's parameters are any parameters in the layers of the unrolled
-  // net. We only want one copy of each parameter, so check that the parameter
-  // is "owned" by the layer, rather than shared with another.
-  this->blobs_.clear();
-  for (int i = 0; i < unrolled_net_->params().size(); ++i) {
-    if (unrolled_net_->param_owners()[i] == -1) {
-      LOG(INFO) << "Adding parameter " << i << ": "
-                << unrolled_net_->param_display_names()[i];
-      this->blobs_.push_back(unrolled_net_->params()[i]);
+  if (!cached) {
+    // Set the diffs of recurrent outputs to 0 -- we can't backpropagate across
+    // batches.
+    for (int i = 0; i < recur_output_blobs_.size(); ++i) {
+      caffe_set(recur_output_blobs_[i]->count(), Dtype(0),
+                recur_output_blobs_[i]->mutable_cpu_diff());
     }
   }
-  // Check that param_propagate_down is set for all of the parameters in the
-  // unrolled net; set param_propagate_down to true in this layer.
-  for (int i = 0; i < unrolled_net_->layers().size(); ++i) {
-    for (int j = 0; j < unrolled_net_->layers()[i]->blobs().size(); ++j) {
-      CHECK(unrolled_net_->layers()[i]->param_propagate_down(j))
-          << "param_propagate_down not set for layer " << i << ", param " << j;
-    }
-  }
-  this->param_propagate_down_.clear();
-  this->param_propagate_down_.resize(this->blobs_.size(), true);
-
-  // Set the diffs of recurrent outputs to 0 -- we can't backpropagate across
-  // batches.
-  for (int i = 0; i < recur_output_blobs_.size(); ++i) {
-    caffe_set(recur_output_blobs_[i]->count(), Dtype(0),
-              recur_output_blobs_[i]->mutable_cpu_diff());
-  }
 
   // Check that the last output_names.size() layers are the pseudo-losses;
   // set last_layer_index so that we don't actually run these layers.
   const vector<string>& layer_names = unrolled_net_->layer_names();
-  last_layer_index_ = layer_names.size() - 1 - pseudo_losses.size();
+  last_layer_index_ = layer_names.size() - 1 - output_names.size();
   for (int i = last_layer_index_ + 1, j = 0; i < layer_names.size(); ++i, ++j) {
-    CHECK_EQ(layer_names[i], pseudo_losses[j]);
+    CHECK_EQ(layer_names[i], output_names[j] + "_pseudoloss");
   }
 }
 
+template <typename Dtype>
+void RecurrentLayer<Dtype>::ShareParams() {
+  const vector<shared_ptr<Blob<Dtype> > >& params = unrolled_net_->params();
+  for (int i = 0, j = 0; i < params.size(); ++i) {
+    if (unrolled_net_->param_owners()[i] == -1) {
+      CHECK_LT(j, this->blobs_.size());
+      CHECK(params[i]->shape() == this->blobs_[j]->shape());
+      if (params[i] != this->blobs_[j]) {
+        params[i]->ShareData(*this->blobs_[j]);
+        params[i]->ShareDiff(*this->blobs_[j]);
+      }
+      ++j;
+    }
+  }
+  unrolled_net_->ShareWeights();
+}
+
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_GE(bottom[0]->num_axes(), 2)
       << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
-  CHECK_EQ(T_, bottom[0]->shape(0)) << "input number of timesteps changed";
+  // A change in the number of timesteps switches to a net unrolled for the
+  // new T, built on first use; the hidden state carries over.
+  const vector<Blob<Dtype>*> prev_recur_output_blobs = recur_output_blobs_;
+  if (T_ != bottom[0]->shape(0)) {
+    T_ = bottom[0]->shape(0);
+    UnrollNet(bottom);
+  }
   N_ = bottom[0]->shape(1);
   CHECK_EQ(bottom[1]->num_axes(), 2)
       << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
@@ -203,6 +254,14 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     recur_input_blobs_[i]->Reshape(recur_input_shapes[i]);
   }
   unrolled_net_->Reshape();
+  for (int i = 0; i < recur_output_blobs_.size(); ++i) {
+    const Blob<Dtype>* prev = prev_recur_output_blobs[i];
+    if (recur_output_blobs_[i] != prev &&
+        recur_output_blobs_[i]->count() == prev->count()) {
+      caffe_copy(prev->count(), prev->cpu_data(),
+                 recur_output_blobs_[i]->mutable_cpu_data());
+    }
+  }
   x_input_blob_->ShareData(*bottom[0]);
   x_input_blob_->ShareDiff(*bottom[0]);
   cont_input_blob_->ShareData(*bottom[1]);
@@ -250,7 +309,7 @@ void RecurrentLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   // called test_net->ShareTrainedLayersWith(net_.get()).
   // TODO: somehow make this work non-hackily.
   if (this->phase_ == TEST) {
-    unrolled_net_->ShareWeights();
+    ShareParams();
   }
 
   DCHECK_EQ(recur_input_blobs_.size(), recur_output_blobs_.size());
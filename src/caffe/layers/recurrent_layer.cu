@@ -15,7 +15,7 @@ void RecurrentLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   // Hacky fix for test time... reshare all the shared blobs.
   // TODO: somehow make this work non-hackily.
   if (this->phase_ == TEST) {
-    unrolled_net_->ShareWeights();
+    ShareParams();
   }
 
   DCHECK_EQ(recur_input_blobs_.size(), recur_output_blobs_.size());
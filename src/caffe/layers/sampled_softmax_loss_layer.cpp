@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/sampled_softmax_loss_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void SampledSoftmaxWithLossLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::LayerSetUp(bottom, top);
+  const SampledSoftmaxParameter& param =
+      this->layer_param_.sampled_softmax_param();
+  N_ = param.num_output();
+  CHECK_GT(N_, 0) << "num_output must be positive.";
+  num_sampled_ = param.num_sampled();
+  CHECK(num_sampled_ > 0 || bottom.size() == 3)
+      << "num_sampled must be positive unless the samples are given.";
+  bias_term_ = param.bias_term();
+  remove_accidental_hits_ = param.remove_accidental_hits();
+  K_ = bottom[0]->count(1);
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    this->blobs_.resize(bias_term_ ? 2 : 1);
+    // The weights have the layout of InnerProductLayer's, N_ x K_.
+    vector<int> weight_shape(2);
+    weight_shape[0] = N_;
+    weight_shape[1] = K_;
+    this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+    shared_ptr<Filler<Dtype> > weight_filler(
+        GetFiller<Dtype>(param.weight_filler()));
+    weight_filler->Fill(this->blobs_[0].get());
+    if (bias_term_) {
+      vector<int> bias_shape(1, N_);
+      this->blobs_[1].reset(new Blob<Dtype>(bias_shape));
+      shared_ptr<Filler<Dtype> > bias_filler(
+          GetFiller<Dtype>(param.bias_filler()));
+      bias_filler->Fill(this->blobs_[1].get());
+    }
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+
+  has_ignore_label_ = this->layer_param_.loss_param().has_ignore_label();
+  if (has_ignore_label_) {
+    ignore_label_ = this->layer_param_.loss_param().ignore_label();
+  }
+  if (!this->layer_param_.loss_param().has_normalization() &&
+      this->layer_param_.loss_param().has_normalize()) {
+    normalization_ = this->layer_param_.loss_param().normalize() ?
+                     LossParameter_NormalizationMode_VALID :
+                     LossParameter_NormalizationMode_BATCH_SIZE;
+  } else {
+    normalization_ = this->layer_param_.loss_param().normalization();
+  }
+}
+
+template <typename Dtype>
+void SampledSoftmaxWithLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  CHECK_EQ(K_, bottom[0]->count(1))
+      << "Input size incompatible with the weights.";
+  M_ = bottom[0]->shape(0);
+  CHECK_EQ(M_, bottom[1]->count())
+      << "There must be one label per example.";
+  if (bottom.size() == 3) {
+    num_sampled_ = bottom[2]->count();
+    CHECK_GT(num_sampled_, 0);
+  }
+  true_prob_.Reshape(vector<int>(1, M_));
+}
+
+template <typename Dtype>
+Dtype SampledSoftmaxWithLossLayer<Dtype>::LogExpectedCount(int c) const {
+  double q;
+  if (this->layer_param_.sampled_softmax_param().sampler() ==
+      SampledSoftmaxParameter_Sampler_UNIFORM) {
+    q = 1. / N_;
+  } else {
+    q = std::log((c + 2.) / (c + 1.)) / std::log(N_ + 1.);
+  }
+  return std::log(num_sampled_ * q);
+}
+
+template <typename Dtype>
+void SampledSoftmaxWithLossLayer<Dtype>::Sample() {
+  vector<Dtype> u(num_sampled_);
+  caffe_philox_uniform<Dtype>(num_sampled_, Dtype(0), Dtype(1), &u[0]);
+  const bool uniform = this->layer_param_.sampled_softmax_param().sampler()
+      == SampledSoftmaxParameter_Sampler_UNIFORM;
+  sampled_.resize(num_sampled_);
+  for (int j = 0; j < num_sampled_; ++j) {
+    // Inverse of the CDF of the sampler, log((c + 1) / 1) / log(N + 1) for
+    // log-uniform.
+    const int c = uniform ? static_cast<int>(u[j] * N_) :
+        static_cast<int>(std::exp(u[j] * std::log(N_ + 1.))) - 1;
+    sampled_[j] = std::min(std::max(c, 0), N_ - 1);
+  }
+}
+
+template <typename Dtype>
+Dtype SampledSoftmaxWithLossLayer<Dtype>::get_normalizer(
+    int valid_count) const {
+  Dtype normalizer;
+  switch (normalization_) {
+    case LossParameter_NormalizationMode_FULL:
+    case LossParameter_NormalizationMode_BATCH_SIZE:
+      normalizer = Dtype(M_);
+      break;
+    case LossParameter_NormalizationMode_VALID:
+      normalizer = Dtype(valid_count);
+      break;
+    case LossParameter_NormalizationMode_NONE:
+      normalizer = Dtype(1);
+      break;
+    default:
+      LOG(FATAL) << "Unknown normalization mode: "
+          << LossParameter_NormalizationMode_Name(normalization_);
+  }
+  return std::max(Dtype(1.0), normalizer);
+}
+
+template <typename Dtype>
+void SampledSoftmaxWithLossLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* x = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  sampled_mode_ = this->phase_ == TRAIN;
+  // The offsets of the logits of the scored classes, and of the true ones.
+  vector<Dtype> offset;
+  int num_scored = N_;
+  if (sampled_mode_) {
+    if (bottom.size() == 3) {
+      const Dtype* given = bottom[2]->cpu_data();
+      sampled_.resize(num_sampled_);
+      for (int j = 0; j < num_sampled_; ++j) {
+        sampled_[j] = static_cast<int>(given[j]);
+        CHECK_GE(sampled_[j], 0);
+        CHECK_LT(sampled_[j], N_);
+      }
+    } else {
+      Sample();
+    }
+    num_scored = num_sampled_;
+    vector<int> weight_shape(2);
+    weight_shape[0] = num_sampled_;
+    weight_shape[1] = K_;
+    sampled_weight_.Reshape(weight_shape);
+    Dtype* sampled_weight = sampled_weight_.mutable_cpu_data();
+    offset.resize(num_sampled_);
+    for (int j = 0; j < num_sampled_; ++j) {
+      caffe_copy(K_, weight + sampled_[j] * K_, sampled_weight + j * K_);
+      offset[j] = (bias ? bias[sampled_[j]] : Dtype(0)) -
+          LogExpectedCount(sampled_[j]);
+    }
+    weight = sampled_weight;
+  } else if (bias) {
+    offset.assign(bias, bias + N_);
+  } else {
+    offset.assign(N_, Dtype(0));
+  }
+  vector<int> prob_shape(2);
+  prob_shape[0] = M_;
+  prob_shape[1] = num_scored;
+  prob_.Reshape(prob_shape);
+  Dtype* prob = prob_.mutable_cpu_data();
+  Dtype* true_prob = true_prob_.mutable_cpu_data();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, M_, num_scored, K_,
+      Dtype(1), x, weight, Dtype(0), prob);
+  Dtype loss = 0;
+  int count = 0;
+  for (int m = 0; m < M_; ++m) {
+    Dtype* row = prob + m * num_scored;
+    const int label_value = static_cast<int>(label[m]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      caffe_set(num_scored, Dtype(0), row);
+      true_prob[m] = 0;
+      continue;
+    }
+    CHECK_GE(label_value, 0);
+    CHECK_LT(label_value, N_);
+    caffe_add(num_scored, row, &offset[0], row);
+    Dtype true_logit;
+    if (sampled_mode_) {
+      true_logit = caffe_cpu_dot(K_, x + m * K_,
+          this->blobs_[0]->cpu_data() + label_value * K_) +
+          (bias ? bias[label_value] : Dtype(0)) -
+          LogExpectedCount(label_value);
+      if (remove_accidental_hits_) {
+        for (int j = 0; j < num_sampled_; ++j) {
+          if (sampled_[j] == label_value) { row[j] = -FLT_MAX; }
+        }
+      }
+    } else {
+      true_logit = row[label_value];
+    }
+    Dtype max_logit = true_logit;
+    for (int j = 0; j < num_scored; ++j) {
+      max_logit = std::max(max_logit, row[j]);
+    }
+    Dtype sum = 0;
+    for (int j = 0; j < num_scored; ++j) {
+      row[j] = std::exp(row[j] - max_logit);
+      sum += row[j];
+    }
+    const Dtype true_exp = std::exp(true_logit - max_logit);
+    if (sampled_mode_) { sum += true_exp; }
+    caffe_scal(num_scored, Dtype(1) / sum, row);
+    true_prob[m] = true_exp / sum;
+    loss -= std::log(std::max(true_prob[m], Dtype(FLT_MIN)));
+    ++count;
+  }
+  normalizer_ = get_normalizer(count);
+  top[0]->mutable_cpu_data()[0] = loss / normalizer_;
+}
+
+template <typename Dtype>
+void SampledSoftmaxWithLossLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (propagate_down[1] || (bottom.size() == 3 && propagate_down[2])) {
+    LOG(FATAL) << this->type()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  const int num_scored = sampled_mode_ ? num_sampled_ : N_;
+  const Dtype scale = top[0]->cpu_diff()[0] / normalizer_;
+  const Dtype* x = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  // The gradient of the loss with respect to the logits is the softmax
+  // output minus the one-hot true class.
+  Dtype* logit_diff = prob_.mutable_cpu_diff();
+  Dtype* true_diff = true_prob_.mutable_cpu_diff();
+  caffe_cpu_scale(prob_.count(), scale, prob_.cpu_data(), logit_diff);
+  caffe_cpu_scale(M_, scale, true_prob_.cpu_data(), true_diff);
+  for (int m = 0; m < M_; ++m) {
+    const int label_value = static_cast<int>(label[m]);
+    if (has_ignore_label_ && label_value == ignore_label_) { continue; }
+    if (sampled_mode_) {
+      true_diff[m] -= scale;
+    } else {
+      logit_diff[m * N_ + label_value] -= scale;
+    }
+  }
+  const Dtype* weight = sampled_mode_ ? sampled_weight_.cpu_data() :
+      this->blobs_[0]->cpu_data();
+  if (propagate_down[0]) {
+    Dtype* x_diff = bottom[0]->mutable_cpu_diff();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, K_, num_scored,
+        Dtype(1), logit_diff, weight, Dtype(0), x_diff);
+    if (sampled_mode_) {
+      for (int m = 0; m < M_; ++m) {
+        const int label_value = static_cast<int>(label[m]);
+        if (has_ignore_label_ && label_value == ignore_label_) { continue; }
+        caffe_axpy(K_, true_diff[m],
+            this->blobs_[0]->cpu_data() + label_value * K_, x_diff + m * K_);
+      }
+    }
+  }
+  if (this->param_propagate_down_[0]) {
+    Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    if (sampled_mode_) {
+      // Only the rows of the scored classes get a gradient.
+      Dtype* sampled_diff = sampled_weight_.mutable_cpu_diff();
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, num_sampled_, K_, M_,
+          Dtype(1), logit_diff, x, Dtype(0), sampled_diff);
+      for (int j = 0; j < num_sampled_; ++j) {
+        caffe_axpy(K_, Dtype(1), sampled_diff + j * K_,
+            weight_diff + sampled_[j] * K_);
+      }
+      for (int m = 0; m < M_; ++m) {
+        const int label_value = static_cast<int>(label[m]);
+        if (has_ignore_label_ && label_value == ignore_label_) { continue; }
+        caffe_axpy(K_, true_diff[m], x + m * K_,
+            weight_diff + label_value * K_);
+      }
+    } else {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, N_, K_, M_,
+          Dtype(1), logit_diff, x, Dtype(1), weight_diff);
+    }
+  }
+  if (bias_term_ && this->param_propagate_down_[1]) {
+    Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
+    for (int m = 0; m < M_; ++m) {
+      const Dtype* row = logit_diff + m * num_scored;
+      if (!sampled_mode_) {
+        caffe_axpy(N_, Dtype(1), row, bias_diff);
+        continue;
+      }
+      for (int j = 0; j < num_sampled_; ++j) {
+        bias_diff[sampled_[j]] += row[j];
+      }
+      const int label_value = static_cast<int>(label[m]);
+      if (has_ignore_label_ && label_value == ignore_label_) { continue; }
+      bias_diff[label_value] += true_diff[m];
+    }
+  }
+}
+
+INSTANTIATE_CLASS(SampledSoftmaxWithLossLayer);
+REGISTER_LAYER_CLASS(SampledSoftmaxWithLoss);
+
+}  // namespace caffe
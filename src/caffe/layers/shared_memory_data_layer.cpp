@@ -0,0 +1,60 @@
+#include <vector>
+
+#include "caffe/layers/shared_memory_data_layer.hpp"
+
+namespace caffe {
+
+// Points top at the floats of the ring, or converts them if Dtype is double.
+template <typename Dtype>
+static void SetTop(const float* data, Blob<Dtype>* top);
+
+template <>
+void SetTop<float>(const float* data, Blob<float>* top) {
+  top->set_cpu_data(const_cast<float*>(data));
+}
+
+template <>
+void SetTop<double>(const float* data, Blob<double>* top) {
+  double* top_data = top->mutable_cpu_data();
+  for (int i = 0; i < top->count(); ++i) {
+    top_data[i] = data[i];
+  }
+}
+
+template <typename Dtype>
+void SharedMemoryDataLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const SharedMemoryDataParameter& param =
+      this->layer_param_.shared_memory_data_param();
+  CHECK(param.has_ring()) << "Set the ring the data_loader publishes to.";
+  ring_.reset(new ShmBatchRing(param.ring()));
+  top[0]->Reshape(ring_->data_shape());
+  if (top.size() > 1) {
+    CHECK(!ring_->label_shape().empty())
+        << "The data_loader of " << param.ring() << " publishes no labels.";
+    top[1]->Reshape(ring_->label_shape());
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Reading "
+      << (ring_->broadcast() ? "every batch" : "a shard of the batches")
+      << " of " << param.ring();
+}
+
+template <typename Dtype>
+void SharedMemoryDataLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Backward is done with the previous batch by now.
+  if (reading_) {
+    ring_->EndRead();
+  }
+  const float* batch = ring_->BeginRead();
+  reading_ = true;
+  SetTop(batch, top[0]);
+  if (top.size() > 1) {
+    SetTop(batch + ring_->data_count(), top[1]);
+  }
+}
+
+INSTANTIATE_CLASS(SharedMemoryDataLayer);
+REGISTER_LAYER_CLASS(SharedMemoryData);
+
+}  // namespace caffe
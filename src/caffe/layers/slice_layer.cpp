@@ -68,9 +68,16 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     }
   }
   CHECK_EQ(count, bottom[0]->count());
+  top_offsets_.clear();
   if (top.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+  } else {
+    int offset_slice_axis = 0;
+    for (int i = 0; i < top.size(); ++i) {
+      top_offsets_.push_back(offset_slice_axis * slice_size_);
+      offset_slice_axis += top[i]->shape(slice_axis_);
+    }
   }
 }
 
@@ -84,6 +91,12 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < top.size(); ++i) {
     Dtype* top_data = top[i]->mutable_cpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    // Net may have made the top a view of its part of the bottom, see
+    // StridedTopOffset.
+    if (top_data == bottom_data + offset_slice_axis * slice_size_) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
@@ -105,6 +118,10 @@ void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    if (top_diff == bottom_diff + offset_slice_axis * slice_size_) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
@@ -19,6 +19,9 @@ void SplitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
         "allow in-place computation.";
     top[i]->ReshapeLike(*bottom[0]);
     CHECK_EQ(count_, top[i]->count());
+    // Shared here too, so that the net sees which blobs share memory before
+    // the first forward pass.
+    top[i]->ShareData(*bottom[0]);
   }
 }
 
@@ -1,3 +1,10 @@
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <map>
 #include <set>
@@ -8,25 +15,33 @@
 #include "hdf5.h"
 
 #include "caffe/common.hpp"
+#include "caffe/filler.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/task_graph.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
-Net<Dtype>::Net(const NetParameter& param) {
-  Init(param);
+Net<Dtype>::Net(const NetParameter& param, const vector<string>* weights)
+    : branch_threads_(1), deferred_fills_(NULL), zero_copy_concat_(false),
+      strided_views_(false) {
+  Init(param, weights);
 }
 
 template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase,
-    const int level, const vector<string>* stages) {
+    const int level, const vector<string>* stages,
+    const vector<string>* weights)
+    : branch_threads_(1), deferred_fills_(NULL), zero_copy_concat_(false),
+      strided_views_(false) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   // Set phase, stages and level
@@ -37,11 +52,12 @@ Net<Dtype>::Net(const string& param_file, Phase phase,
     }
   }
   param.mutable_state()->set_level(level);
-  Init(param);
+  Init(param, weights);
 }
 
 template <typename Dtype>
-void Net<Dtype>::Init(const NetParameter& in_param) {
+void Net<Dtype>::Init(const NetParameter& in_param,
+    const vector<string>* weights) {
   // Set phase from the state.
   phase_ = in_param.state().phase();
   // Filter layers based on their include/exclude rules and
@@ -66,6 +82,12 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   param_id_vecs_.resize(param.layer_size());
   top_id_vecs_.resize(param.layer_size());
   bottom_need_backward_.resize(param.layer_size());
+  // When weights will be loaded, the layers' fills are only recorded here, so
+  // that the params the weights files supply are never filled.
+  shared_ptr<DeferredFills<Dtype> > deferred_fills;
+  if (weights && weights->size()) {
+    deferred_fills.reset(new DeferredFills<Dtype>());
+  }
   for (int layer_id = 0; layer_id < param.layer_size(); ++layer_id) {
     // Inherit phase from net if unset.
     if (!param.layer(layer_id).has_phase()) {
@@ -251,7 +273,39 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  // Shared params now hold their owners' values, which their own deferred
+  // fills must not overwrite. This includes nets built by layers, e.g.
+  // unrolled recurrent nets, while an outer net defers its fills.
+  if (DeferredFills<Dtype>::current()) {
+    for (int i = 0; i < params_.size(); ++i) {
+      if (param_owners_[i] >= 0) {
+        DeferredFills<Dtype>::current()->Cancel(params_[i].get());
+      }
+    }
+  }
+  if (deferred_fills) {
+    deferred_fills->Deactivate();
+    deferred_fills_ = deferred_fills.get();
+    for (int i = 0; i < weights->size(); ++i) {
+      LOG_IF(INFO, Caffe::root_solver())
+          << "Loading weights from " << (*weights)[i];
+      CopyTrainedLayersFrom((*weights)[i]);
+    }
+    deferred_fills_ = NULL;
+    deferred_fills->Fill();
+  }
   debug_info_ = param.debug_info();
+  zero_copy_concat_ = param.zero_copy_concat();
+  strided_views_ = param.strided_views();
+  InitSegments(param);
+  ShareViews();
+  if (!recompute_layers_.empty()) {
+    LOG_IF(INFO, Caffe::root_solver()) << "Recomputing activations in "
+        << segment_ends_.size() << " segments sharing "
+        << checkpoint_pool_.count() * sizeof(Dtype) << " bytes";
+  }
+  InitBranchGraph();
+  set_branch_threads(param.branch_threads());
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -512,12 +566,602 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   }
 }
 
+// Helper for Net::Init: find which layers may run concurrently. A layer
+// depends on the last layer that wrote any of its bottoms or tops, and
+// in-place layers also on every layer that read the blob they overwrite.
+// Backward runs along the reversed edges; in addition, layers that
+// accumulate into the same diff (readers of one blob, sharers of one param)
+// are serialized there.
+template <typename Dtype>
+void Net<Dtype>::InitBranchGraph() {
+  forward_successors_.assign(layers_.size(), vector<int>());
+  backward_successors_.assign(layers_.size(), vector<int>());
+  vector<int> last_writer(blobs_.size(), -1);
+  vector<vector<int> > readers(blobs_.size());
+  vector<int> last_param_user(learnable_params_.size(), -1);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    set<int> forward_deps;
+    set<int> backward_deps;
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = bottom_id_vecs_[layer_id][i];
+      if (last_writer[blob_id] >= 0) {
+        forward_deps.insert(last_writer[blob_id]);
+      }
+      if (!readers[blob_id].empty()) {
+        backward_deps.insert(readers[blob_id].back());
+      }
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = top_id_vecs_[layer_id][i];
+      if (last_writer[blob_id] >= 0) {
+        forward_deps.insert(last_writer[blob_id]);
+      }
+      forward_deps.insert(readers[blob_id].begin(), readers[blob_id].end());
+    }
+    for (int i = 0; i < param_id_vecs_[layer_id].size(); ++i) {
+      const int learnable_param_id =
+          learnable_param_ids_[param_id_vecs_[layer_id][i]];
+      if (last_param_user[learnable_param_id] >= 0) {
+        backward_deps.insert(last_param_user[learnable_param_id]);
+      }
+      last_param_user[learnable_param_id] = layer_id;
+    }
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      readers[bottom_id_vecs_[layer_id][i]].push_back(layer_id);
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      last_writer[top_id_vecs_[layer_id][i]] = layer_id;
+      readers[top_id_vecs_[layer_id][i]].clear();
+    }
+    forward_deps.erase(layer_id);
+    backward_deps.erase(layer_id);
+    backward_deps.insert(forward_deps.begin(), forward_deps.end());
+    for (set<int>::iterator it = forward_deps.begin();
+         it != forward_deps.end(); ++it) {
+      forward_successors_[*it].push_back(layer_id);
+    }
+    backward_successors_[layer_id].assign(backward_deps.begin(),
+                                          backward_deps.end());
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_branch_threads(const int num_threads) {
+  CHECK_GE(num_threads, 1) << "branch_threads must be at least 1.";
+  if (num_threads == branch_threads_ && (num_threads == 1) ==
+      (branch_executor_.get() == NULL)) {
+    return;
+  }
+  branch_threads_ = num_threads;
+  if (num_threads > 1) {
+    LOG_IF(INFO, Caffe::root_solver()) << "Running independent branches of "
+        << name_ << " on " << num_threads << " threads.";
+    branch_executor_.reset(new TaskGraphExecutor(num_threads));
+  } else {
+    branch_executor_.reset();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::UnshareViews() {
+  for (int i = 0; i < views_.size(); ++i) {
+    Blob<Dtype>* blob = views_[i].first;
+    Blob<Dtype> fresh(blob->shape());
+    if (views_[i].second) {
+      blob->ShareDiff(fresh);
+    } else {
+      blob->ShareData(fresh);
+    }
+  }
+  views_.clear();
+  recompute_layers_.clear();
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareViews() {
+  if (!zero_copy_concat_ && !strided_views_ && segment_ends_.empty()) {
+    return;
+  }
+  const int num_blobs = blobs_.size();
+  // The blob whose memory the data (diff) of each blob is, following the
+  // layers that share their tops' memory with a bottom, like Split, Flatten
+  // or Reshape; the layer creating each blob; the last layer writing the
+  // data of each root, itself or in place; whether an in-place layer writes
+  // the diff of each root in Backward; and whether other blobs share the
+  // memory of each root.
+  vector<int> data_root(num_blobs);
+  vector<int> diff_root(num_blobs);
+  vector<int> creator(num_blobs, -1);
+  vector<int> last_write(num_blobs, -1);
+  vector<bool> diff_in_place(num_blobs, false);
+  vector<bool> has_sharers(num_blobs, false);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    data_root[blob_id] = diff_root[blob_id] = blob_id;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int top_id = top_id_vecs_[layer_id][i];
+      if (std::find(bottom_ids.begin(), bottom_ids.end(), top_id) !=
+          bottom_ids.end()) {
+        last_write[data_root[top_id]] = layer_id;
+        diff_in_place[diff_root[top_id]] = true;
+        continue;
+      }
+      creator[top_id] = layer_id;
+      last_write[top_id] = layer_id;
+      if (blobs_[top_id]->count() == 0) { continue; }
+      for (int j = 0; j < bottom_ids.size(); ++j) {
+        if (blobs_[bottom_ids[j]]->count() == 0) { continue; }
+        if (blobs_[top_id]->data() == blobs_[bottom_ids[j]]->data()) {
+          data_root[top_id] = data_root[bottom_ids[j]];
+          has_sharers[data_root[top_id]] = true;
+        }
+        if (blobs_[top_id]->diff() == blobs_[bottom_ids[j]]->diff()) {
+          diff_root[top_id] = diff_root[bottom_ids[j]];
+          has_sharers[diff_root[top_id]] = true;
+        }
+      }
+    }
+  }
+  // Each root is made a view once at most.
+  vector<bool> data_shared(num_blobs, false);
+  vector<bool> diff_shared(num_blobs, false);
+  // Concats first, the last one first, so that the inputs of a concat feeding
+  // another one become views of the views of the outer concat's output.
+  for (int layer_id = layers_.size() - 1; layer_id >= 0; --layer_id) {
+    if (!zero_copy_concat_ ||
+        layers_[layer_id]->layer_param().type() != "Concat" ||
+        bottom_id_vecs_[layer_id].size() < 2) {
+      continue;
+    }
+    const int top_id = top_id_vecs_[layer_id][0];
+    Blob<Dtype>* top = blobs_[top_id].get();
+    const ConcatParameter& concat_param =
+        layers_[layer_id]->layer_param().concat_param();
+    const int axis = concat_param.has_concat_dim() ? concat_param.concat_dim()
+        : top->CanonicalAxisIndex(concat_param.axis());
+    // The inputs are contiguous ranges of the output only if the axes before
+    // the concatenation axis have a single element.
+    if (top->count(0, axis) != 1 || last_write[top_id] != layer_id ||
+        blob_loss_weights_[top_id] != 0) {
+      continue;
+    }
+    int offset = 0;
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int bottom_id = bottom_id_vecs_[layer_id][i];
+      const int count = blobs_[bottom_id]->count();
+      if (count == 0) { continue; }
+      // The data: the producer writes the range of the output, as long as no
+      // layer writes it after the concat.
+      const int data_id = data_root[bottom_id];
+      if (!data_shared[data_id] && data_id != top_id &&
+          creator[data_id] >= 0 && !bottom_id_vecs_[creator[data_id]].empty()
+          && last_write[data_id] < layer_id &&
+          blobs_[data_id]->count() == count &&
+          blob_loss_weights_[data_id] == 0) {
+        blobs_[data_id]->ShareDataRange(*top, offset);
+        RecordView(data_id, false, data_root);
+        data_shared[data_id] = true;
+      }
+      // The diff: the concat's consumers write the inputs' gradients, as
+      // long as no in-place layer rewrites them after the concat's Backward.
+      const int diff_id = diff_root[bottom_id];
+      if (!diff_shared[diff_id] && !diff_in_place[diff_id] &&
+          diff_id != top_id &&
+          blobs_[diff_id]->count() == count &&
+          blob_loss_weights_[diff_id] == 0 &&
+          blob_loss_weights_[bottom_id] == 0) {
+        blobs_[diff_id]->ShareDiffRange(*top, offset);
+        RecordView(diff_id, true, diff_root);
+        diff_shared[diff_id] = true;
+      }
+      offset += count;
+    }
+  }
+  // Then slices, the first one first, so that slices of a slice's outputs
+  // are views of the views of its input.
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (!zero_copy_concat_ ||
+        layers_[layer_id]->layer_param().type() != "Slice" ||
+        top_id_vecs_[layer_id].size() < 2) {
+      continue;
+    }
+    const int bottom_id = bottom_id_vecs_[layer_id][0];
+    const int data_id = data_root[bottom_id];
+    const int diff_id = diff_root[bottom_id];
+    Blob<Dtype>* bottom = blobs_[bottom_id].get();
+    const SliceParameter& slice_param =
+        layers_[layer_id]->layer_param().slice_param();
+    const int axis = slice_param.has_slice_dim() ? slice_param.slice_dim() :
+        bottom->CanonicalAxisIndex(slice_param.axis());
+    if (bottom->count(0, axis) != 1 || last_write[data_id] > layer_id ||
+        blobs_[data_id]->count() != bottom->count() ||
+        blob_loss_weights_[bottom_id] != 0) {
+      continue;
+    }
+    const bool share_diff = !diff_in_place[diff_id] &&
+        blobs_[diff_id]->count() == bottom->count() &&
+        blob_loss_weights_[diff_id] == 0;
+    int offset = 0;
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int top_id = top_id_vecs_[layer_id][i];
+      Blob<Dtype>* top = blobs_[top_id].get();
+      if (blob_loss_weights_[top_id] == 0) {
+        // The data: as long as no layer writes the output in place.
+        if (!data_shared[top_id] && last_write[top_id] == layer_id) {
+          top->ShareDataRange(*blobs_[data_id], offset);
+          RecordView(top_id, false, data_root);
+          data_shared[top_id] = true;
+        }
+        if (share_diff && !diff_shared[top_id]) {
+          top->ShareDiffRange(*blobs_[diff_id], offset);
+          RecordView(top_id, true, diff_root);
+          diff_shared[top_id] = true;
+        }
+      }
+      offset += top->count();
+    }
+  }
+  // Then, with strided_views, the tops that are parts of the first bottom of
+  // their layer, like those of Slice and Crop, are made strided views of it
+  // where all the layers reading them take strided bottoms.
+  if (strided_views_ && !debug_info_) {
+    vector<bool> strided_ok(num_blobs, true);
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+        if (!layers_[layer_id]->AllowStridedBottom(i)) {
+          strided_ok[bottom_id_vecs_[layer_id][i]] = false;
+        }
+      }
+    }
+    for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+      strided_ok[net_output_blob_indices_[i]] = false;
+    }
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      if (bottom_id_vecs_[layer_id].empty()) { continue; }
+      const int bottom_id = bottom_id_vecs_[layer_id][0];
+      Blob<Dtype>* bottom = blobs_[bottom_id].get();
+      // As for slices above, nothing may write the bottom after the layer.
+      if (!bottom->is_contiguous() ||
+          last_write[data_root[bottom_id]] > layer_id ||
+          diff_in_place[diff_root[bottom_id]] ||
+          blob_loss_weights_[bottom_id] != 0) {
+        continue;
+      }
+      for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+        const int offset = layers_[layer_id]->StridedTopOffset(i);
+        const int top_id = top_id_vecs_[layer_id][i];
+        if (offset < 0 || !strided_ok[top_id] || data_shared[top_id] ||
+            diff_shared[top_id] || has_sharers[top_id] ||
+            creator[top_id] != layer_id || last_write[top_id] != layer_id ||
+            blob_loss_weights_[top_id] != 0 ||
+            blobs_[top_id]->count() == 0) {
+          continue;
+        }
+        blobs_[top_id]->ShareView(*bottom, offset, bottom->strides());
+        RecordView(top_id, false, data_root);
+        RecordView(top_id, true, diff_root);
+        data_shared[top_id] = diff_shared[top_id] = true;
+      }
+    }
+  }
+  // Last, with gradient checkpointing, the blobs that one segment both writes
+  // and reads, and no other, are recomputed before its Backward; they share
+  // checkpoint_pool_ with those of the other segments.
+  if (!segment_ends_.empty()) {
+    ShareCheckpointPool(data_root, diff_root, creator, last_write);
+  }
+  // Branches running concurrently write the ranges of a blob; its memory is
+  // allocated now rather than by whichever comes first.
+  if (Caffe::mode() == Caffe::CPU) {
+    for (int i = 0; i < views_.size(); ++i) {
+      if (views_[i].second) {
+        views_[i].first->mutable_cpu_diff();
+      } else {
+        views_[i].first->mutable_cpu_data();
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::InitSegments(const NetParameter& param) {
+  segment_ends_.clear();
+  if (!param.gradient_checkpointing() || phase_ != TRAIN) { return; }
+  const int num_layers = layers_.size();
+  for (int layer_id = 0; layer_id < num_layers - 1; ++layer_id) {
+    if (layers_[layer_id]->layer_param().checkpoint()) {
+      segment_ends_.push_back(layer_id);
+    }
+  }
+  // Without marked layers, about sqrt(N) segments of sqrt(N) layers each.
+  if (segment_ends_.empty()) {
+    const int length = std::ceil(std::sqrt(static_cast<double>(num_layers)));
+    for (int layer_id = length - 1; layer_id < num_layers - 1;
+         layer_id += length) {
+      segment_ends_.push_back(layer_id);
+    }
+  }
+  segment_ends_.push_back(num_layers - 1);
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareCheckpointPool(const vector<int>& data_root,
+    const vector<int>& diff_root, const vector<int>& creator,
+    const vector<int>& last_write) {
+  const int num_blobs = blobs_.size();
+  const int num_segments = segment_ends_.size();
+  vector<int> segment(layers_.size());
+  for (int s = 0, layer_id = 0; s < num_segments; ++s) {
+    for (; layer_id <= segment_ends_[s]; ++layer_id) {
+      segment[layer_id] = s;
+    }
+  }
+  // The memory of the views made so far, and the memory they view, are left
+  // alone.
+  set<const SyncedMemory*> viewed;
+  for (int i = 0; i < views_.size(); ++i) {
+    const Blob<Dtype>& view = *views_[i].first;
+    const shared_ptr<SyncedMemory>& memory =
+        views_[i].second ? view.diff() : view.data();
+    viewed.insert(memory.get());
+    viewed.insert(memory->base().get());
+  }
+  // A data root is recomputed if the layers writing it and its sharers can
+  // run again, and those and the layers reading them are all in the segment
+  // of its creator.
+  vector<bool> recompute(num_blobs, false);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    const int layer_id = creator[blob_id];
+    recompute[blob_id] = data_root[blob_id] == blob_id && layer_id >= 0 &&
+        !bottom_id_vecs_[layer_id].empty() && blobs_[blob_id]->count() > 0 &&
+        !viewed.count(blobs_[blob_id]->data().get()) &&
+        !viewed.count(blobs_[blob_id]->diff().get());
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    recompute[data_root[net_output_blob_indices_[i]]] = false;
+  }
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (blob_loss_weights_[blob_id] != 0) {
+      recompute[data_root[blob_id]] = false;
+    }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const int layer_segment = segment[layer_id];
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int root = data_root[bottom_id_vecs_[layer_id][i]];
+      if (creator[root] < 0 || segment[creator[root]] != layer_segment) {
+        recompute[root] = false;
+      }
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int root = data_root[top_id_vecs_[layer_id][i]];
+      if (creator[root] < 0 || segment[creator[root]] != layer_segment ||
+          !layers_[layer_id]->AllowRecompute()) {
+        recompute[root] = false;
+      }
+    }
+  }
+  // A layer runs again only if all its tops are recomputed, and none of its
+  // bottoms kept is written in place after it; otherwise its tops are kept.
+  for (bool changed = true; changed; ) {
+    changed = false;
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      const vector<int>& top_ids = top_id_vecs_[layer_id];
+      bool all = !top_ids.empty(), any = false;
+      for (int i = 0; i < top_ids.size(); ++i) {
+        const bool top_recomputed = recompute[data_root[top_ids[i]]];
+        all &= top_recomputed;
+        any |= top_recomputed;
+      }
+      for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+        const int root = data_root[bottom_id_vecs_[layer_id][i]];
+        all &= recompute[root] || last_write[root] <= layer_id;
+      }
+      if (any && !all) {
+        for (int i = 0; i < top_ids.size(); ++i) {
+          recompute[data_root[top_ids[i]]] = false;
+        }
+        changed = true;
+      }
+    }
+  }
+  // The diff of a root is shared if all the blobs sharing it are recomputed:
+  // it is then written and read within the Backward of their segment.
+  vector<bool> pool_diff(num_blobs, false);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    pool_diff[blob_id] = diff_root[blob_id] == blob_id &&
+        blobs_[blob_id]->count() > 0 &&
+        !viewed.count(blobs_[blob_id]->diff().get());
+  }
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (!recompute[data_root[blob_id]]) {
+      pool_diff[diff_root[blob_id]] = false;
+    }
+  }
+  // Each segment lays its blobs out from the start of the pool.
+  vector<int> data_offset(num_blobs), diff_offset(num_blobs);
+  vector<int> data_size(num_segments, 0), diff_size(num_segments, 0);
+  int pool_size = 0;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (recompute[blob_id]) {
+      int* size = &data_size[segment[creator[blob_id]]];
+      data_offset[blob_id] = *size;
+      *size += blobs_[blob_id]->count();
+      pool_size = std::max(pool_size, *size);
+    }
+    if (pool_diff[blob_id]) {
+      int* size = &diff_size[segment[creator[blob_id]]];
+      diff_offset[blob_id] = *size;
+      *size += blobs_[blob_id]->count();
+      pool_size = std::max(pool_size, *size);
+    }
+  }
+  if (pool_size == 0) { return; }
+  checkpoint_pool_.Reshape(vector<int>(1, pool_size));
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (recompute[blob_id]) {
+      blobs_[blob_id]->ShareDataRange(checkpoint_pool_, data_offset[blob_id]);
+      RecordView(blob_id, false, data_root);
+    }
+    if (pool_diff[blob_id]) {
+      blobs_[blob_id]->ShareDiffRange(checkpoint_pool_, diff_offset[blob_id]);
+      RecordView(blob_id, true, diff_root);
+    }
+  }
+  recompute_layers_.resize(num_segments);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    if (!top_ids.empty() && recompute[data_root[top_ids[0]]]) {
+      recompute_layers_[segment[layer_id]].push_back(layer_id);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecordView(const int blob_id, const bool diff,
+    const vector<int>& root) {
+  views_.push_back(make_pair(blobs_[blob_id].get(), diff));
+  // The blobs sharing the memory of the new view, e.g. the tops of a Split.
+  for (int i = 0; i < blobs_.size(); ++i) {
+    if (i == blob_id || root[i] != blob_id) { continue; }
+    if (diff) {
+      blobs_[i]->ShareDiff(*blobs_[blob_id]);
+    } else {
+      blobs_[i]->ShareData(*blobs_[blob_id]);
+    }
+  }
+}
+
+// Runs the Forward or Backward of one layer per task on the branch scheduler.
+template <typename Dtype>
+class Net<Dtype>::BranchTask : public TaskGraphExecutor::Task {
+ public:
+  BranchTask(Net* net, bool backward)
+      : net_(net), backward_(backward), losses_(net->layers_.size(), 0) {}
+
+  virtual void run(int layer_id) {
+    Net& net = *net_;
+    if (!backward_) {
+      RunCallbacks(net.before_forward_, layer_id);
+      losses_[layer_id] = net.layers_[layer_id]->Forward(
+          net.bottom_vecs_[layer_id], net.top_vecs_[layer_id]);
+      if (net.debug_info_) { net.ForwardDebugInfo(layer_id); }
+      RunCallbacks(net.after_forward_, layer_id);
+    } else {
+      RunCallbacks(net.before_backward_, layer_id);
+      if (net.layer_need_backward_[layer_id]) {
+        net.layers_[layer_id]->Backward(net.top_vecs_[layer_id],
+            net.bottom_need_backward_[layer_id], net.bottom_vecs_[layer_id]);
+        if (net.debug_info_) { net.BackwardDebugInfo(layer_id); }
+      }
+      RunCallbacks(net.after_backward_, layer_id);
+    }
+  }
+
+  Dtype loss(int layer_id) const { return losses_[layer_id]; }
+
+ private:
+  void RunCallbacks(const vector<Callback*>& callbacks, int layer_id) {
+    if (callbacks.empty()) { return; }
+    boost::mutex::scoped_lock lock(callback_mutex_);
+    for (int c = 0; c < callbacks.size(); ++c) {
+      callbacks[c]->run(layer_id);
+    }
+  }
+
+  Net* net_;
+  bool backward_;
+  vector<Dtype> losses_;
+  boost::mutex callback_mutex_;
+};
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardBranches(const vector<int>& layer_ids) {
+  BranchTask task(this, false);
+  branch_executor_->Run(layer_ids, forward_successors_, &task);
+  // Sum in layer order so that the loss does not depend on the schedule.
+  Dtype loss = 0;
+  for (int i = 0; i < layer_ids.size(); ++i) {
+    loss += task.loss(layer_ids[i]);
+  }
+  return loss;
+}
+
+template <typename Dtype>
+void Net<Dtype>::BackwardBranches(int start, int end) {
+  vector<int> layer_ids;
+  for (int i = start; i >= end; --i) {
+    layer_ids.push_back(i);
+  }
+  BranchTask task(this, true);
+  branch_executor_->Run(layer_ids, backward_successors_, &task);
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
-  Dtype loss = 0;
+  vector<int> layer_ids;
   for (int i = start; i <= end; ++i) {
+    layer_ids.push_back(i);
+  }
+  return ForwardLayers(layer_ids);
+}
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardBlobs(const vector<string>& blob_names) {
+  vector<int> blob_ids;
+  for (int i = 0; i < blob_names.size(); ++i) {
+    CHECK(has_blob(blob_names[i])) << "Unknown blob name " << blob_names[i];
+    blob_ids.push_back(blob_names_index_[blob_names[i]]);
+  }
+  std::sort(blob_ids.begin(), blob_ids.end());
+  blob_ids.erase(std::unique(blob_ids.begin(), blob_ids.end()),
+      blob_ids.end());
+  map<vector<int>, vector<int> >::iterator plan =
+      forward_plans_.find(blob_ids);
+  if (plan == forward_plans_.end()) {
+    // Walk the layers backwards: a layer is needed if it writes a needed
+    // blob, and then its bottoms are needed too. A blob stays needed past
+    // the layer that creates it, so layers computing in place on it before
+    // the requested blobs are read run as well.
+    vector<bool> blob_needed(blobs_.size(), false);
+    for (int i = 0; i < blob_ids.size(); ++i) {
+      blob_needed[blob_ids[i]] = true;
+    }
+    vector<int> layer_ids;
+    for (int i = layers_.size() - 1; i >= 0; --i) {
+      bool needed = false;
+      for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+        needed = needed || blob_needed[top_id_vecs_[i][j]];
+      }
+      if (!needed) { continue; }
+      layer_ids.push_back(i);
+      for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+        blob_needed[bottom_id_vecs_[i][j]] = true;
+      }
+    }
+    std::reverse(layer_ids.begin(), layer_ids.end());
+    LOG_IF(INFO, Caffe::root_solver()) << "Forward to the "
+        << blob_ids.size() << " blobs requested runs " << layer_ids.size()
+        << " of " << layers_.size() << " layers";
+    plan = forward_plans_.insert(make_pair(blob_ids, layer_ids)).first;
+  }
+  return ForwardLayers(plan->second);
+}
+
+template <typename Dtype>
+Dtype Net<Dtype>::ForwardLayers(const vector<int>& layer_ids) {
+  // Segments sharing the checkpoint pool must not run concurrently.
+  if (branch_executor_ && Caffe::mode() == Caffe::CPU &&
+      recompute_layers_.empty()) {
+    return ForwardBranches(layer_ids);
+  }
+  Dtype loss = 0;
+  for (int l = 0; l < layer_ids.size(); ++l) {
+    const int i = layer_ids[l];
     for (int c = 0; c < before_forward_.size(); ++c) {
       before_forward_[c]->run(i);
     }
@@ -567,6 +1211,10 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  if (branch_executor_ && Caffe::mode() == Caffe::CPU) {
+    BackwardBranches(start, end);
+    return;
+  }
   for (int i = start; i >= end; --i) {
     for (int c = 0; c < before_backward_.size(); ++c) {
       before_backward_[c]->run(i);
@@ -705,7 +1353,23 @@ void Net<Dtype>::BackwardTo(int end) {
 
 template <typename Dtype>
 void Net<Dtype>::Backward() {
-  BackwardFromTo(layers_.size() - 1, 0);
+  if (recompute_layers_.empty()) {
+    BackwardFromTo(layers_.size() - 1, 0);
+  } else {
+    // The later segments have overwritten the blobs each segment but the last
+    // did not keep: they are recomputed before its Backward.
+    const int num_segments = segment_ends_.size();
+    for (int s = num_segments - 1; s >= 0; --s) {
+      if (s < num_segments - 1) {
+        for (int i = 0; i < recompute_layers_[s].size(); ++i) {
+          const int layer_id = recompute_layers_[s][i];
+          layers_[layer_id]->Forward(bottom_vecs_[layer_id],
+                                     top_vecs_[layer_id]);
+        }
+      }
+      BackwardFromTo(segment_ends_[s], s > 0 ? segment_ends_[s - 1] + 1 : 0);
+    }
+  }
   if (debug_info_) {
     Dtype asum_data = 0, asum_diff = 0, sumsq_data = 0, sumsq_diff = 0;
     for (int i = 0; i < learnable_params_.size(); ++i) {
@@ -724,9 +1388,15 @@ void Net<Dtype>::Backward() {
 
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
+  // The views of the old shapes are dropped before the layers reshape, so
+  // that the blobs sharing memory with them, e.g. the tops of Split layers,
+  // share the fresh memory again. Layers whose blobs kept their shapes and
+  // memory skip their Reshape.
+  UnshareViews();
   for (int i = 0; i < layers_.size(); ++i) {
-    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+    layers_[i]->ReshapeIfChanged(bottom_vecs_[i], top_vecs_[i]);
   }
+  ShareViews();
 }
 
 template <typename Dtype>
@@ -763,6 +1433,9 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       }
       const bool kReshape = false;
       target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
+      if (deferred_fills_) {
+        deferred_fills_->Cancel(target_blobs[j].get());
+      }
     }
   }
 }
@@ -776,12 +1449,116 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   }
 }
 
+// Walks the layers of a serialized NetParameter one at a time, copying the
+// blobs of those in this net straight into it and skipping the others, so
+// that no more than a few buffers' worth of the file is held in memory.
+// Legacy (V0/V1) nets, which need upgrading as a whole, are parsed instead.
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
     const string trained_filename) {
-  NetParameter param;
-  ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
-  CopyTrainedLayersFrom(param);
+  using google::protobuf::io::CodedInputStream;
+  using google::protobuf::internal::WireFormatLite;
+  const int fd = open(trained_filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << trained_filename;
+  bool legacy = false;
+  {
+    google::protobuf::io::FileInputStream raw_input(fd);
+    while (!legacy) {
+      // A fresh CodedInputStream for each layer keeps every one of them, not
+      // the whole file, under protobuf's 2 GB limit.
+      CodedInputStream input(&raw_input);
+      SetProtoReadBytesLimit(&input);
+      const uint32_t tag = input.ReadTag();
+      if (!tag) { break; }
+      const int field = WireFormatLite::GetTagFieldNumber(tag);
+      if (field == NetParameter::kLayerFieldNumber) {
+        uint32_t length;
+        CHECK(input.ReadVarint32(&length))
+            << "Failed to parse NetParameter file: " << trained_filename;
+        const CodedInputStream::Limit limit = input.PushLimit(length);
+        CopyTrainedLayerFromStream(&input);
+        CHECK(input.Skip(input.BytesUntilLimit()))
+            << "Failed to parse NetParameter file: " << trained_filename;
+        input.PopLimit(limit);
+      } else if (field == NetParameter::kLayersFieldNumber) {
+        legacy = true;
+      } else {
+        CHECK(WireFormatLite::SkipField(&input, tag))
+            << "Failed to parse NetParameter file: " << trained_filename;
+      }
+    }
+  }
+  close(fd);
+  if (legacy) {
+    NetParameter param;
+    ReadNetParamsFromBinaryFileOrDie(trained_filename, &param);
+    CopyTrainedLayersFrom(param);
+  }
+}
+
+// The shape described by the shape fields of a BlobProto.
+static string ProtoShapeString(const BlobProto& proto) {
+  ostringstream stream;
+  if (proto.has_num() || proto.has_channels() ||
+      proto.has_height() || proto.has_width()) {
+    stream << proto.num() << " " << proto.channels() << " "
+           << proto.height() << " " << proto.width() << " ";
+  } else {
+    for (int i = 0; i < proto.shape().dim_size(); ++i) {
+      stream << proto.shape().dim(i) << " ";
+    }
+  }
+  return stream.str();
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayerFromStream(
+    google::protobuf::io::CodedInputStream* input) {
+  using google::protobuf::io::CodedInputStream;
+  using google::protobuf::internal::WireFormatLite;
+  string source_layer_name;
+  vector<shared_ptr<Blob<Dtype> > >* target_blobs = NULL;
+  int num_source_blobs = 0;
+  for (uint32_t tag = input->ReadTag(); tag; tag = input->ReadTag()) {
+    const int field = WireFormatLite::GetTagFieldNumber(tag);
+    if (field == LayerParameter::kNameFieldNumber) {
+      CHECK(WireFormatLite::ReadString(input, &source_layer_name));
+      if (!layer_names_index_.count(source_layer_name)) {
+        LOG(INFO) << "Ignoring source layer " << source_layer_name;
+        return;
+      }
+      DLOG(INFO) << "Copying source layer " << source_layer_name;
+      target_blobs = &layers_[layer_names_index_[source_layer_name]]->blobs();
+    } else if (field == LayerParameter::kBlobsFieldNumber) {
+      // Serializers write fields in order, so the name comes first.
+      CHECK(target_blobs) << "Layer blobs found before the layer name";
+      CHECK_LT(num_source_blobs, target_blobs->size())
+          << "Incompatible number of blobs for layer " << source_layer_name;
+      const int j = num_source_blobs++;
+      uint32_t length;
+      CHECK(input->ReadVarint32(&length));
+      const CodedInputStream::Limit limit = input->PushLimit(length);
+      BlobProto source_shape;
+      if (!(*target_blobs)[j]->FromCodedStream(input, &source_shape)) {
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape is "
+            << ProtoShapeString(source_shape) << "; target param shape is "
+            << (*target_blobs)[j]->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      input->PopLimit(limit);
+      if (deferred_fills_) {
+        deferred_fills_->Cancel((*target_blobs)[j].get());
+      }
+    } else {
+      CHECK(WireFormatLite::SkipField(input, tag));
+    }
+  }
+  if (target_blobs) {
+    CHECK_EQ(target_blobs->size(), num_source_blobs)
+        << "Incompatible number of blobs for layer " << source_layer_name;
+  }
 }
 
 template <typename Dtype>
@@ -827,6 +1604,9 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
       }
       hdf5_load_nd_dataset(layer_hid, dataset_name.c_str(), 0, kMaxBlobAxes,
           target_blobs[j].get());
+      if (deferred_fills_) {
+        deferred_fills_->Cancel(target_blobs[j].get());
+      }
     }
     H5Gclose(layer_hid);
   }
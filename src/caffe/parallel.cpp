@@ -10,6 +10,7 @@
 #include "caffe/caffe.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/numa.hpp"
 
 namespace caffe {
 
@@ -268,6 +269,11 @@ class Worker : public InternalThread {
 
  protected:
   void InternalThreadEntry() {
+    // Run on the NUMA node of this solver's GPU if so asked
+    if (GetNumaPolicy().node == NumaPolicy::kAutoNode) {
+      Caffe::set_numa_node(SolverNode(device_));
+    }
+    PinThread(SOLVER_THREAD, 0);
     // Create solver and install callbacks
     SolverParameter param(rank0_->param());
     param.set_device_id(device_);
@@ -60,18 +60,20 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   current_step_ = 0;
 }
 
-// Load weights from the caffemodel(s) specified in "weights" solver parameter
-// into the train and test nets.
-template <typename Dtype>
-void LoadNetWeights(shared_ptr<Net<Dtype> > net,
-    const std::string& model_list) {
-  std::vector<std::string> model_names;
-  boost::split(model_names, model_list, boost::is_any_of(","));
-  for (int i = 0; i < model_names.size(); ++i) {
-    boost::trim(model_names[i]);
-    LOG(INFO) << "Finetuning from " << model_names[i];
-    net->CopyTrainedLayersFrom(model_names[i]);
+// The caffemodel(s) specified in the "weights" solver parameter, to be loaded
+// into the train and test nets as they are created.
+static vector<string> WeightFiles(const SolverParameter& param) {
+  vector<string> weights;
+  for (int w_idx = 0; w_idx < param.weights_size(); ++w_idx) {
+    std::vector<std::string> model_names;
+    boost::split(model_names, param.weights(w_idx), boost::is_any_of(","));
+    for (int i = 0; i < model_names.size(); ++i) {
+      boost::trim(model_names[i]);
+      LOG(INFO) << "Finetuning from " << model_names[i];
+      weights.push_back(model_names[i]);
+    }
   }
+  return weights;
 }
 
 template <typename Dtype>
@@ -112,10 +114,8 @@ void Solver<Dtype>::InitTrainNet() {
   net_state.MergeFrom(net_param.state());
   net_state.MergeFrom(param_.train_state());
   net_param.mutable_state()->CopyFrom(net_state);
-  net_.reset(new Net<Dtype>(net_param));
-  for (int w_idx = 0; w_idx < param_.weights_size(); ++w_idx) {
-    LoadNetWeights(net_, param_.weights(w_idx));
-  }
+  const vector<string> weights = WeightFiles(param_);
+  net_.reset(new Net<Dtype>(net_param, &weights));
 }
 
 template <typename Dtype>
@@ -189,11 +189,9 @@ void Solver<Dtype>::InitTestNets() {
     net_params[i].mutable_state()->CopyFrom(net_state);
     LOG(INFO)
         << "Creating test net (#" << i << ") specified by " << sources[i];
-    test_nets_[i].reset(new Net<Dtype>(net_params[i]));
+    const vector<string> weights = WeightFiles(param_);
+    test_nets_[i].reset(new Net<Dtype>(net_params[i], &weights));
     test_nets_[i]->set_debug_info(param_.debug_info());
-    for (int w_idx = 0; w_idx < param_.weights_size(); ++w_idx) {
-      LoadNetWeights(test_nets_[i], param_.weights(w_idx));
-    }
   }
 }
 
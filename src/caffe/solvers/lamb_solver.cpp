@@ -0,0 +1,99 @@
+#include <cmath>
+#include <vector>
+
+#include "caffe/sgd_solvers.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void LAMBSolver<Dtype>::LAMBPreSolve() {
+  CHECK_EQ(this->param_.regularization_type(), "L2")
+      << "LAMB only supports L2 weight decay.";
+  // The second moments follow the first ones, as in Adam.
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    const vector<int>& shape = net_params[i]->shape();
+    this->history_.push_back(
+        shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+  }
+}
+
+// The trust ratio ||w|| / ||r||, or 1 if either norm is 0.
+template <typename Dtype>
+static Dtype TrustRatio(double w_sumsq, double r_sumsq) {
+  if (w_sumsq <= 0 || r_sumsq <= 0) { return Dtype(1); }
+  return std::sqrt(w_sumsq / r_sumsq);
+}
+
+#ifndef CPU_ONLY
+template <typename Dtype>
+void lamb_update_gpu(int N, const Dtype* w, Dtype* g, Dtype* m, Dtype* v,
+    Dtype beta1, Dtype beta2, Dtype correction1, Dtype correction2,
+    Dtype eps, Dtype decay);
+#endif
+
+template <typename Dtype>
+void LAMBSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<float>& net_params_lr = this->net_->params_lr();
+  const vector<float>& net_params_weight_decay =
+      this->net_->params_weight_decay();
+  const Dtype local_rate = rate * net_params_lr[param_id];
+  const Dtype decay =
+      this->param_.weight_decay() * net_params_weight_decay[param_id];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const Dtype eps = this->param_.delta();
+  const int t = this->iter_ + 1;
+  const Dtype correction1 = Dtype(1) / (Dtype(1) - pow(beta1, t));
+  const Dtype correction2 = Dtype(1) / (Dtype(1) - pow(beta2, t));
+  const int N = net_params[param_id]->count();
+  Blob<Dtype>* val_m = this->history_[param_id].get();
+  Blob<Dtype>* val_v = this->history_[param_id + net_params.size()].get();
+  switch (Caffe::mode()) {
+  case Caffe::CPU: {
+    // The moments, the step r = m / (sqrt(v) + eps) + decay w and both
+    // norms in one pass; the scaling by the trust ratio in another.
+    const Dtype* w = net_params[param_id]->cpu_data();
+    Dtype* g = net_params[param_id]->mutable_cpu_diff();
+    Dtype* m = val_m->mutable_cpu_data();
+    Dtype* v = val_v->mutable_cpu_data();
+    double w_sumsq = 0, r_sumsq = 0;
+    for (int i = 0; i < N; ++i) {
+      m[i] = beta1 * m[i] + (1 - beta1) * g[i];
+      v[i] = beta2 * v[i] + (1 - beta2) * g[i] * g[i];
+      g[i] = m[i] * correction1 / (std::sqrt(v[i] * correction2) + eps) +
+          decay * w[i];
+      w_sumsq += w[i] * w[i];
+      r_sumsq += g[i] * g[i];
+    }
+    caffe_scal(N, local_rate * TrustRatio<Dtype>(w_sumsq, r_sumsq), g);
+    break;
+  }
+  case Caffe::GPU: {
+#ifndef CPU_ONLY
+    lamb_update_gpu(N, net_params[param_id]->gpu_data(),
+        net_params[param_id]->mutable_gpu_diff(), val_m->mutable_gpu_data(),
+        val_v->mutable_gpu_data(), beta1, beta2, correction1, correction2,
+        eps, decay);
+    Dtype w_sumsq, r_sumsq;
+    caffe_gpu_dot(N, net_params[param_id]->gpu_data(),
+        net_params[param_id]->gpu_data(), &w_sumsq);
+    caffe_gpu_dot(N, net_params[param_id]->gpu_diff(),
+        net_params[param_id]->gpu_diff(), &r_sumsq);
+    caffe_gpu_scal(N, local_rate * TrustRatio<Dtype>(w_sumsq, r_sumsq),
+        net_params[param_id]->mutable_gpu_diff());
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+  }
+}
+
+INSTANTIATE_CLASS(LAMBSolver);
+REGISTER_SOLVER_CLASS(LAMB);
+
+}  // namespace caffe
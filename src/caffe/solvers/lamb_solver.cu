@@ -0,0 +1,31 @@
+#include "caffe/util/math_functions.hpp"
+
+
+namespace caffe {
+
+template <typename Dtype>
+__global__ void LAMBUpdate(int N, const Dtype* w, Dtype* g, Dtype* m,
+    Dtype* v, Dtype beta1, Dtype beta2, Dtype correction1, Dtype correction2,
+    Dtype eps, Dtype decay) {
+  CUDA_KERNEL_LOOP(i, N) {
+    Dtype gi = g[i];
+    Dtype mi = m[i] = m[i]*beta1 + gi*(1-beta1);
+    Dtype vi = v[i] = v[i]*beta2 + gi*gi*(1-beta2);
+    g[i] = mi * correction1 / (sqrt(vi * correction2) + eps) + decay * w[i];
+  }
+}
+template <typename Dtype>
+void lamb_update_gpu(int N, const Dtype* w, Dtype* g, Dtype* m, Dtype* v,
+    Dtype beta1, Dtype beta2, Dtype correction1, Dtype correction2,
+    Dtype eps, Dtype decay) {
+  LAMBUpdate<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+      <<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, w, g, m, v, beta1, beta2, correction1, correction2, eps, decay);
+  CUDA_POST_KERNEL_CHECK;
+}
+template void lamb_update_gpu<float>(int, const float*, float*, float*,
+    float*, float, float, float, float, float, float);
+template void lamb_update_gpu<double>(int, const double*, double*, double*,
+    double*, double, double, double, double, double, double);
+
+}  // namespace caffe
@@ -0,0 +1,70 @@
+#include <cmath>
+#include <vector>
+
+#include "caffe/sgd_solvers.hpp"
+
+namespace caffe {
+
+#ifndef CPU_ONLY
+template <typename Dtype>
+void sgd_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
+    Dtype local_rate);
+#endif
+
+// The trust ratio eta ||w|| / ||g||, or 1 if either norm is 0.
+template <typename Dtype>
+static Dtype TrustRatio(Dtype eta, double w_sumsq, double g_sumsq) {
+  if (w_sumsq <= 0 || g_sumsq <= 0) { return Dtype(1); }
+  return eta * std::sqrt(w_sumsq / g_sumsq);
+}
+
+template <typename Dtype>
+void LARSSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<float>& net_params_lr = this->net_->params_lr();
+  const Dtype momentum = this->param_.momentum();
+  const Dtype eta = this->param_.lars_eta();
+  const Dtype local_rate = rate * net_params_lr[param_id];
+  const int N = net_params[param_id]->count();
+  switch (Caffe::mode()) {
+  case Caffe::CPU: {
+    // Both norms in one pass, then the momentum update in another.
+    const Dtype* w = net_params[param_id]->cpu_data();
+    Dtype* g = net_params[param_id]->mutable_cpu_diff();
+    double w_sumsq = 0, g_sumsq = 0;
+    for (int i = 0; i < N; ++i) {
+      w_sumsq += w[i] * w[i];
+      g_sumsq += g[i] * g[i];
+    }
+    const Dtype trust_rate =
+        local_rate * TrustRatio<Dtype>(eta, w_sumsq, g_sumsq);
+    Dtype* h = this->history_[param_id]->mutable_cpu_data();
+    for (int i = 0; i < N; ++i) {
+      g[i] = h[i] = momentum * h[i] + trust_rate * g[i];
+    }
+    break;
+  }
+  case Caffe::GPU: {
+#ifndef CPU_ONLY
+    Dtype w_sumsq, g_sumsq;
+    caffe_gpu_dot(N, net_params[param_id]->gpu_data(),
+        net_params[param_id]->gpu_data(), &w_sumsq);
+    caffe_gpu_dot(N, net_params[param_id]->gpu_diff(),
+        net_params[param_id]->gpu_diff(), &g_sumsq);
+    sgd_update_gpu(N, net_params[param_id]->mutable_gpu_diff(),
+        this->history_[param_id]->mutable_gpu_data(), momentum,
+        local_rate * TrustRatio<Dtype>(eta, w_sumsq, g_sumsq));
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
+  }
+}
+
+INSTANTIATE_CLASS(LARSSolver);
+REGISTER_SOLVER_CLASS(LARS);
+
+}  // namespace caffe
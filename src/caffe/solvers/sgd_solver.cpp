@@ -66,6 +66,9 @@ Dtype SGDSolver<Dtype>::GetLearningRate() {
   } else {
     LOG(FATAL) << "Unknown learning rate policy: " << lr_policy;
   }
+  if (this->iter_ < this->param_.warmup_iter()) {
+    rate *= Dtype(this->iter_ + 1) / Dtype(this->param_.warmup_iter());
+  }
   return rate;
 }
 
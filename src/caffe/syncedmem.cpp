@@ -5,7 +5,8 @@
 namespace caffe {
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    offset_(0) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -15,7 +16,22 @@ SyncedMemory::SyncedMemory()
 
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    offset_(0) {
+#ifndef CPU_ONLY
+#ifdef DEBUG
+  CUDA_CHECK(cudaGetDevice(&device_));
+#endif
+#endif
+}
+
+SyncedMemory::SyncedMemory(const shared_ptr<SyncedMemory>& base,
+    size_t offset, size_t size)
+  : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    base_(base), offset_(offset) {
+  CHECK(base_);
+  CHECK_LE(offset + size, base_->size()) << "View out of the base's range.";
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -91,12 +107,16 @@ inline void SyncedMemory::to_gpu() {
 }
 
 const void* SyncedMemory::cpu_data() {
+  if (base_) {
+    return static_cast<const char*>(base_->cpu_data()) + offset_;
+  }
   check_device();
   to_cpu();
   return (const void*)cpu_ptr_;
 }
 
 void SyncedMemory::set_cpu_data(void* data) {
+  CHECK(!base_) << "Cannot set the data of a view.";
   check_device();
   CHECK(data);
   if (own_cpu_data_) {
@@ -108,6 +128,9 @@ void SyncedMemory::set_cpu_data(void* data) {
 }
 
 const void* SyncedMemory::gpu_data() {
+  if (base_) {
+    return static_cast<const char*>(base_->gpu_data()) + offset_;
+  }
   check_device();
 #ifndef CPU_ONLY
   to_gpu();
@@ -119,6 +142,7 @@ const void* SyncedMemory::gpu_data() {
 }
 
 void SyncedMemory::set_gpu_data(void* data) {
+  CHECK(!base_) << "Cannot set the data of a view.";
   check_device();
 #ifndef CPU_ONLY
   CHECK(data);
@@ -134,6 +158,9 @@ void SyncedMemory::set_gpu_data(void* data) {
 }
 
 void* SyncedMemory::mutable_cpu_data() {
+  if (base_) {
+    return static_cast<char*>(base_->mutable_cpu_data()) + offset_;
+  }
   check_device();
   to_cpu();
   head_ = HEAD_AT_CPU;
@@ -141,6 +168,9 @@ void* SyncedMemory::mutable_cpu_data() {
 }
 
 void* SyncedMemory::mutable_gpu_data() {
+  if (base_) {
+    return static_cast<char*>(base_->mutable_gpu_data()) + offset_;
+  }
   check_device();
 #ifndef CPU_ONLY
   to_gpu();
@@ -154,6 +184,10 @@ void* SyncedMemory::mutable_gpu_data() {
 
 #ifndef CPU_ONLY
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
+  if (base_) {
+    base_->async_gpu_push(stream);
+    return;
+  }
   check_device();
   CHECK(head_ == HEAD_AT_CPU);
   if (gpu_ptr_ == NULL) {
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/adaptive_softmax_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class AdaptiveSoftmaxWithLossLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  AdaptiveSoftmaxWithLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(8, 5, 1, 1)),
+        blob_bottom_label_(new Blob<Dtype>(8, 1, 1, 1)),
+        blob_top_loss_(new Blob<Dtype>()),
+        blob_top_accuracy_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    // Labels in the head and in both clusters.
+    const int labels[] = {0, 3, 4, 7, 8, 11, 5, 9};
+    for (int i = 0; i < 8; ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = labels[i];
+    }
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+    // Classes 0-3 in the head, 4-7 and 8-11 in the clusters.
+    AdaptiveSoftmaxParameter* param =
+        layer_param_.mutable_adaptive_softmax_param();
+    param->set_num_output(12);
+    param->add_cutoff(4);
+    param->add_cutoff(8);
+    param->mutable_weight_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+  }
+  virtual ~AdaptiveSoftmaxWithLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_loss_;
+    delete blob_top_accuracy_;
+  }
+
+  // Returns the probabilities of all the classes for example m, computed
+  // from the full softmaxes of the head and of the clusters.
+  vector<double> ReferenceProbs(Layer<Dtype>* layer, int m) {
+    const Dtype* x = blob_bottom_data_->cpu_data() + m * 5;
+    vector<double> head(6);
+    for (int i = 0; i < 6; ++i) {
+      const Blob<Dtype>& weight = *layer->blobs()[i < 4 ? 0 : 2];
+      const Blob<Dtype>& bias = *layer->blobs()[i < 4 ? 1 : 3];
+      const int row = i < 4 ? i : i - 4;
+      head[i] = bias.cpu_data()[row];
+      for (int k = 0; k < 5; ++k) {
+        head[i] += x[k] * weight.cpu_data()[row * 5 + k];
+      }
+    }
+    Softmax(&head);
+    vector<double> probs(head.begin(), head.begin() + 4);
+    for (int t = 0; t < 2; ++t) {
+      vector<double> cluster(4);
+      for (int i = 0; i < 4; ++i) {
+        const int c = 4 + t * 4 + i;
+        cluster[i] = layer->blobs()[1]->cpu_data()[c];
+        for (int k = 0; k < 5; ++k) {
+          cluster[i] += x[k] * layer->blobs()[0]->cpu_data()[c * 5 + k];
+        }
+      }
+      Softmax(&cluster);
+      for (int i = 0; i < 4; ++i) {
+        probs.push_back(head[4 + t] * cluster[i]);
+      }
+    }
+    return probs;
+  }
+
+  static void Softmax(vector<double>* logits) {
+    const double max_logit = *std::max_element(logits->begin(),
+                                               logits->end());
+    double sum = 0;
+    for (int i = 0; i < logits->size(); ++i) {
+      (*logits)[i] = std::exp((*logits)[i] - max_logit);
+      sum += (*logits)[i];
+    }
+    for (int i = 0; i < logits->size(); ++i) {
+      (*logits)[i] /= sum;
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_loss_;
+  Blob<Dtype>* const blob_top_accuracy_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  LayerParameter layer_param_;
+};
+
+TYPED_TEST_CASE(AdaptiveSoftmaxWithLossLayerTest, TestDtypes);
+
+TYPED_TEST(AdaptiveSoftmaxWithLossLayerTest, TestForward) {
+  AdaptiveSoftmaxWithLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  double loss = 0;
+  for (int m = 0; m < 8; ++m) {
+    const vector<double> probs = this->ReferenceProbs(&layer, m);
+    double sum = 0;
+    for (int c = 0; c < 12; ++c) {
+      sum += probs[c];
+    }
+    EXPECT_NEAR(1, sum, 1e-6);
+    loss -= std::log(probs[this->blob_bottom_label_->cpu_data()[m]]);
+  }
+  EXPECT_NEAR(loss / 8, this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(AdaptiveSoftmaxWithLossLayerTest, TestForwardTopK) {
+  AdaptiveSoftmaxParameter* param =
+      this->layer_param_.mutable_adaptive_softmax_param();
+  param->set_top_k(3);
+  this->layer_param_.add_loss_weight(1);
+  this->layer_param_.add_loss_weight(0);
+  this->blob_top_vec_.push_back(this->blob_top_accuracy_);
+  AdaptiveSoftmaxWithLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  int correct = 0;
+  for (int m = 0; m < 8; ++m) {
+    const vector<double> probs = this->ReferenceProbs(&layer, m);
+    const double label_prob = probs[this->blob_bottom_label_->cpu_data()[m]];
+    int num_better = 0;
+    for (int c = 0; c < 12; ++c) {
+      num_better += probs[c] > label_prob;
+    }
+    correct += num_better < 3;
+  }
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const TypeParam approximate = this->blob_top_accuracy_->cpu_data()[0];
+  EXPECT_GE(approximate, 0);
+  EXPECT_LE(approximate, 1);
+  // Searching all the clusters gives the exact accuracy.
+  param->set_eval_clusters(2);
+  AdaptiveSoftmaxWithLossLayer<TypeParam> exact_layer(this->layer_param_);
+  exact_layer.blobs() = layer.blobs();
+  exact_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  exact_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_FLOAT_EQ(correct / 8., this->blob_top_accuracy_->cpu_data()[0]);
+}
+
+TYPED_TEST(AdaptiveSoftmaxWithLossLayerTest, TestGradient) {
+  AdaptiveSoftmaxWithLossLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(AdaptiveSoftmaxWithLossLayerTest, TestGradientIgnoreLabel) {
+  this->layer_param_.mutable_loss_param()->set_ignore_label(7);
+  AdaptiveSoftmaxWithLossLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
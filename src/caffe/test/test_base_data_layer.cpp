@@ -0,0 +1,88 @@
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Outputs batches numbered in order, each taking a fixed time to load.
+template <typename Dtype>
+class SlowDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  SlowDataLayer(const LayerParameter& param, int load_ms)
+      : BasePrefetchingDataLayer<Dtype>(param), load_ms_(load_ms), count_(0) {}
+  virtual ~SlowDataLayer() { this->StopInternalThread(); }
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    vector<int> shape(1, 1);
+    top[0]->Reshape(shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->data_.Reshape(shape);
+    }
+  }
+  virtual inline const char* type() const { return "SlowData"; }
+  virtual inline int ExactNumBottomBlobs() const { return 0; }
+  virtual inline int ExactNumTopBlobs() const { return 1; }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(load_ms_));
+    batch->data_.mutable_cpu_data()[0] = count_++;
+  }
+
+  int load_ms_;
+  int count_;
+};
+
+template <typename Dtype>
+class BaseDataLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  BaseDataLayerTest() : blob_top_(new Blob<Dtype>()) {
+    blob_top_vec_.push_back(blob_top_);
+    layer_param_.mutable_data_param()->set_prefetch(4);
+  }
+  virtual ~BaseDataLayerTest() { delete blob_top_; }
+
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  LayerParameter layer_param_;
+};
+
+TYPED_TEST_CASE(BaseDataLayerTest, TestDtypes);
+
+TYPED_TEST(BaseDataLayerTest, TestFixedDepth) {
+  SlowDataLayer<TypeParam> layer(this->layer_param_, 1);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < 50; ++i) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(i, this->blob_top_->cpu_data()[0]);
+  }
+  const PrefetchStats& stats = layer.prefetch_stats();
+  EXPECT_EQ(50, stats.batches);
+  EXPECT_EQ(4, stats.depth);
+  EXPECT_GE(stats.load_ms, 50);
+}
+
+TYPED_TEST(BaseDataLayerTest, TestShrinkWhenLoadingIsSlow) {
+  // The net does nothing between batches, so loading never keeps up and
+  // more batches in flight would not help.
+  this->layer_param_.mutable_data_param()->set_max_prefetch(8);
+  SlowDataLayer<TypeParam> layer(this->layer_param_, 2);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < 100; ++i) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(i, this->blob_top_->cpu_data()[0]);
+  }
+  EXPECT_EQ(2, layer.prefetch_stats().depth);
+  EXPECT_GT(layer.prefetch_stats().wait_ms, 0);
+}
+
+}  // namespace caffe
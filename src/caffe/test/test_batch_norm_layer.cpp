@@ -8,6 +8,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/batch_norm_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -120,6 +121,44 @@ namespace caffe {
     }
   }
 
+  // Computing in place, or over several threads, gives the same results.
+  TYPED_TEST(BatchNormLayerTest, TestInplaceThreads) {
+    typedef typename TypeParam::Dtype Dtype;
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    LayerParameter layer_param;
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*this->blob_top_);
+    filler.Fill(&top_diff);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    vector<bool> propagate_down(1, true);
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+
+    layer_param.mutable_batch_norm_param()->set_num_threads(3);
+    Blob<Dtype> blob_inplace;
+    blob_inplace.CopyFrom(*this->blob_bottom_, false, true);
+    vector<Blob<Dtype>*> blob_vec(1, &blob_inplace);
+    BatchNormLayer<Dtype> inplace_layer(layer_param);
+    inplace_layer.SetUp(blob_vec, blob_vec);
+    inplace_layer.Forward(blob_vec, blob_vec);
+    for (int i = 0; i < blob_inplace.count(); ++i) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[i], blob_inplace.cpu_data()[i],
+          1e-5);
+    }
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        blob_inplace.mutable_cpu_diff());
+    inplace_layer.Backward(blob_vec, propagate_down, blob_vec);
+    for (int i = 0; i < blob_inplace.count(); ++i) {
+      EXPECT_NEAR(this->blob_bottom_->cpu_diff()[i],
+          blob_inplace.cpu_diff()[i], 1e-5);
+    }
+  }
+
   TYPED_TEST(BatchNormLayerTest, TestGradient) {
     typedef typename TypeParam::Dtype Dtype;
     LayerParameter layer_param;
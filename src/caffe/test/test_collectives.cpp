@@ -0,0 +1,120 @@
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/collectives.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Returns "127.0.0.1:<port>" for a port that was free a moment ago.
+static string FreeLocalAddress() {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  CHECK_GE(fd, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+  socklen_t len = sizeof(addr);
+  CHECK_EQ(getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len), 0);
+  close(fd);
+  std::ostringstream address;
+  address << "127.0.0.1:" << ntohs(addr.sin_port);
+  return address.str();
+}
+
+template <typename Dtype>
+class CollectivesTest : public ::testing::Test {
+ protected:
+  // Runs all collectives on every rank of a world of the given size, one
+  // thread per rank, and stores what each rank ends up with.
+  void RunRanks(int size, int count, size_t tree_threshold) {
+    size_ = size;
+    count_ = count;
+    tree_threshold_ = tree_threshold;
+    address_ = FreeLocalAddress();
+    sums_.assign(size, vector<Dtype>());
+    broadcasts_.assign(size, vector<Dtype>());
+    boost::thread_group ranks;
+    for (int rank = 0; rank < size; ++rank) {
+      ranks.create_thread(
+          boost::bind(&CollectivesTest<Dtype>::RunRank, this, rank));
+    }
+    ranks.join_all();
+  }
+
+  static Dtype Value(int rank, int i) {
+    return Dtype((rank + 1) * (i % 7 + 1));
+  }
+
+  void RunRank(int rank) {
+    shared_ptr<Transport> transport(
+        new TCPTransport(rank, size_, address_));
+    Collectives<Dtype> collectives(transport, tree_threshold_);
+    vector<Dtype>& sum = sums_[rank];
+    sum.resize(count_);
+    for (int i = 0; i < count_; ++i) {
+      sum[i] = Value(rank, i);
+    }
+    collectives.AllReduce(count_ ? &sum[0] : NULL, count_);
+    vector<Dtype>& broadcast = broadcasts_[rank];
+    broadcast.assign(count_, Dtype(rank));
+    collectives.Broadcast(count_ ? &broadcast[0] : NULL, count_, size_ - 1);
+    collectives.Barrier();
+  }
+
+  void CheckResults() {
+    const Dtype rank_sum = Dtype(size_ * (size_ + 1) / 2);
+    for (int rank = 0; rank < size_; ++rank) {
+      ASSERT_EQ(count_, sums_[rank].size());
+      for (int i = 0; i < count_; ++i) {
+        EXPECT_EQ(rank_sum * (i % 7 + 1), sums_[rank][i]);
+        EXPECT_EQ(Dtype(size_ - 1), broadcasts_[rank][i]);
+      }
+    }
+  }
+
+  int size_;
+  int count_;
+  size_t tree_threshold_;
+  string address_;
+  vector<vector<Dtype> > sums_;
+  vector<vector<Dtype> > broadcasts_;
+};
+
+TYPED_TEST_CASE(CollectivesTest, TestDtypes);
+
+TYPED_TEST(CollectivesTest, TestSingleRank) {
+  this->RunRanks(1, 10, 0);
+  this->CheckResults();
+}
+
+TYPED_TEST(CollectivesTest, TestRing) {
+  for (int size = 2; size <= 4; ++size) {
+    // Counts that do not split evenly into chunks, and fewer than the ranks.
+    this->RunRanks(size, 1003, 0);
+    this->CheckResults();
+    this->RunRanks(size, size - 1, 0);
+    this->CheckResults();
+  }
+}
+
+TYPED_TEST(CollectivesTest, TestTree) {
+  for (int size = 2; size <= 4; ++size) {
+    this->RunRanks(size, 1003, 16384);
+    this->CheckResults();
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,114 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/compression.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class CompressionTest : public ::testing::Test {
+ protected:
+  // A byte datum of pseudo-random bytes: a first quarter common to all seeds,
+  // as records of a dataset share content, then a block of the seed's own
+  // repeated three times, so that each datum compresses on its own too.
+  void FillByteDatum(int seed, Datum* datum) {
+    datum->set_channels(3);
+    datum->set_height(16);
+    datum->set_width(16);
+    datum->set_label(seed);
+    string data(3 * 16 * 16, 0);
+    unsigned int state = 1;
+    for (int i = 0; i < data.size(); ++i) {
+      if (i % 192 == 0) {
+        state = i == 0 ? 1 : seed + 1;
+      }
+      state = state * 1103515245 + 12345;
+      data[i] = static_cast<char>(state >> 16);
+    }
+    datum->set_data(data);
+  }
+
+  void FillFloatDatum(Datum* datum) {
+    datum->set_channels(100);
+    datum->set_height(1);
+    datum->set_width(1);
+    for (int i = 0; i < 100; ++i) {
+      datum->add_float_data(i % 10 * 0.5);
+    }
+  }
+
+  void TestRoundTrip(Datum_Compression type, int level,
+      const Datum& original, DatumCodec* codec) {
+    Datum datum(original);
+    codec->Compress(type, level, &datum);
+    EXPECT_EQ(type, datum.compression());
+    EXPECT_EQ(0, datum.float_data_size());
+    EXPECT_LT(datum.data().size(), datum.raw_size());
+    EXPECT_EQ(original.label(), datum.label());
+    EXPECT_TRUE(codec->Decompress(&datum));
+    EXPECT_EQ(Datum_Compression_NONE, datum.compression());
+    EXPECT_EQ(original.SerializeAsString(), datum.SerializeAsString());
+  }
+};
+
+TEST_F(CompressionTest, TestNone) {
+  DatumCodec codec;
+  Datum original;
+  FillByteDatum(1, &original);
+  Datum datum(original);
+  codec.Compress(Datum_Compression_NONE, 0, &datum);
+  EXPECT_FALSE(codec.Decompress(&datum));
+  EXPECT_EQ(original.SerializeAsString(), datum.SerializeAsString());
+}
+
+#ifdef USE_LZ4
+TEST_F(CompressionTest, TestLZ4) {
+  DatumCodec codec;
+  Datum bytes, floats;
+  FillByteDatum(1, &bytes);
+  FillFloatDatum(&floats);
+  TestRoundTrip(Datum_Compression_LZ4, 0, bytes, &codec);
+  TestRoundTrip(Datum_Compression_LZ4, 0, floats, &codec);
+  // LZ4HC
+  TestRoundTrip(Datum_Compression_LZ4, 9, bytes, &codec);
+}
+#endif  // USE_LZ4
+
+#ifdef USE_ZSTD
+TEST_F(CompressionTest, TestZstd) {
+  DatumCodec codec;
+  Datum bytes, floats;
+  FillByteDatum(1, &bytes);
+  FillFloatDatum(&floats);
+  TestRoundTrip(Datum_Compression_ZSTD, 0, bytes, &codec);
+  TestRoundTrip(Datum_Compression_ZSTD, 0, floats, &codec);
+  TestRoundTrip(Datum_Compression_ZSTD, 19, bytes, &codec);
+}
+
+TEST_F(CompressionTest, TestZstdDictionary) {
+  vector<Datum> samples(500);
+  for (int i = 0; i < samples.size(); ++i) {
+    FillByteDatum(i, &samples[i]);
+  }
+  DatumCodec codec;
+  codec.set_dictionary(TrainDatumDictionary(samples, 4096));
+  EXPECT_FALSE(codec.dictionary().empty());
+  EXPECT_LE(codec.dictionary().size(), 4096u);
+  Datum original;
+  FillByteDatum(1000, &original);
+  TestRoundTrip(Datum_Compression_ZSTD, 0, original, &codec);
+  // The dictionary must make records smaller than plain Zstd does.
+  DatumCodec plain_codec;
+  Datum with_dictionary(original), without_dictionary(original);
+  codec.Compress(Datum_Compression_ZSTD, 0, &with_dictionary);
+  plain_codec.Compress(Datum_Compression_ZSTD, 0, &without_dictionary);
+  EXPECT_LT(with_dictionary.data().size(), without_dictionary.data().size());
+}
+#endif  // USE_ZSTD
+
+}  // namespace caffe
@@ -131,6 +131,36 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     Caffe::set_solver_rank(0);
   }
 
+  // Batches that do not line up with the source check that the replayed
+  // cache keeps the order of the items across passes.
+  void TestCache() {
+    const Dtype scale = 3;
+    const int batch_size = 3;
+    LayerParameter param;
+    param.set_phase(TEST);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_cache(true);
+    param.mutable_transform_param()->set_scale(scale);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    int label = 0;
+    for (int iter = 0; iter < 20; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        EXPECT_EQ(label, blob_top_label_->cpu_data()[i]);
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(scale * label, blob_top_data_->cpu_data()[i * 24 + j])
+              << "debug: iter " << iter << " i " << i << " j " << j;
+        }
+        label = (label + 1) % 5;
+      }
+    }
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -391,6 +421,11 @@ TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
 
+TYPED_TEST(DataLayerTest, TestCacheLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestCache();
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainLevelDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
@@ -436,6 +471,11 @@ TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
 
+TYPED_TEST(DataLayerTest, TestCacheLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestCache();
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainLMDB) {
   const bool unique_pixels = true;  // all images the same; pixels different
   this->Fill(unique_pixels, DataParameter_DB_LMDB);
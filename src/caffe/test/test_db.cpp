@@ -132,5 +132,35 @@ TYPED_TEST(DBTest, TestWrite) {
   txn->Commit();
 }
 
+TYPED_TEST(DBTest, TestBulkWrite) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::WRITE);
+  Datum datum;
+  ReadFileToDatum(this->root_images_ + "cat.jpg", 0, &datum);
+  string out;
+  CHECK(datum.SerializeToString(&out));
+  // Keys after the existing ones, the last out of order.
+  string keys[] = {"goat.jpg", "horse.jpg", "dog.jpg"};
+  scoped_ptr<db::Transaction> txn(db->NewBulkTransaction(3 * out.size()));
+  txn->Put(keys[0], out);
+  txn->Commit();
+  txn.reset(db->NewBulkTransaction(3 * out.size()));
+  txn->Put(keys[1], out);
+  txn->Put(keys[2], out);
+  txn->Commit();
+  db->Close();
+
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  string expected[] = {"cat.jpg", "dog.jpg", "fish-bike.jpg", "goat.jpg",
+      "horse.jpg"};
+  for (int i = 0; i < 5; ++i) {
+    ASSERT_TRUE(cursor->valid());
+    EXPECT_EQ(expected[i], cursor->key());
+    cursor->Next();
+  }
+  EXPECT_FALSE(cursor->valid());
+}
+
 }  // namespace caffe
 #endif  // USE_LEVELDB, USE_LMDB and USE_OPENCV
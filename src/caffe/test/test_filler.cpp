@@ -552,4 +552,32 @@ TYPED_TEST(BilinearFillerTest, TestFillEven) {
   this->test_params(blob_shape);
 }
 
+template <typename Dtype>
+class DeferredFillsTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(DeferredFillsTest, TestDtypes);
+
+TYPED_TEST(DeferredFillsTest, TestDeferAndCancel) {
+  Blob<TypeParam> loaded(2, 3, 4, 5);
+  Blob<TypeParam> filled(2, 3, 4, 5);
+  FillerParameter filler_param;
+  filler_param.set_value(7);
+  DeferredFills<TypeParam> fills;
+  EXPECT_EQ(&fills, DeferredFills<TypeParam>::current());
+  shared_ptr<Filler<TypeParam> > filler(GetFiller<TypeParam>(filler_param));
+  filler->Fill(&loaded);
+  filler->Fill(&filled);
+  // Nothing is written, or even allocated, until the fills are run.
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, loaded.data()->head());
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, filled.data()->head());
+  fills.Deactivate();
+  EXPECT_TRUE(DeferredFills<TypeParam>::current() == NULL);
+  fills.Cancel(&loaded);
+  fills.Fill();
+  EXPECT_EQ(SyncedMemory::UNINITIALIZED, loaded.data()->head());
+  for (int i = 0; i < filled.count(); ++i) {
+    EXPECT_EQ(TypeParam(7), filled.cpu_data()[i]);
+  }
+}
+
 }  // namespace caffe
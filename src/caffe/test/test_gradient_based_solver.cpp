@@ -261,6 +261,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     Blob<Dtype>& updated_bias = *(*updated_params)[1];
     updated_bias.ReshapeLike(bias);
 
+    vector<Dtype> grads(D + 1);
     for (int i = 0; i <= D; ++i) {
       // Compute the derivative with respect to the ith weight (i.e., the ith
       // element of the gradient).
@@ -285,14 +286,57 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
         grad -= element_i * targets.cpu_data()[k];
       }
       // Scale the gradient over the N samples.
-      grad /= N;
+      grads[i] = grad / N;
+    }
+
+    // LARS and LAMB scale the steps of the weights and of the bias by the
+    // ratios of their norms to the norms of the steps.
+    const bool lars = solver_->type() == string("LARS");
+    const bool lamb = solver_->type() == string("LAMB");
+    vector<Dtype> steps(D + 1);
+    Dtype trust[2] = {1, 1};
+    if (lars || lamb) {
+      const vector<shared_ptr<Blob<Dtype> > >& history = solver_->history();
+      double param_sumsq[2] = {0, 0}, step_sumsq[2] = {0, 0};
+      for (int i = 0; i <= D; ++i) {
+        const Dtype param =
+            (i == D) ? bias.cpu_data()[0] : weights.cpu_data()[i];
+        if (lars) {
+          steps[i] = grads[i] + weight_decay * param;
+        } else {
+          // Adam's step, with the weight decay added to it.
+          const Dtype momentum2 = 0.999;
+          const Dtype m = (i == D) ?
+              history[1]->cpu_data()[0] : history[0]->cpu_data()[i];
+          const Dtype v = (i == D) ?
+              history[1 + num_param_blobs]->cpu_data()[0] :
+              history[0 + num_param_blobs]->cpu_data()[i];
+          const Dtype val_m = (1 - momentum) * grads[i] + momentum * m;
+          const Dtype val_v =
+              (1 - momentum2) * grads[i] * grads[i] + momentum2 * v;
+          steps[i] = val_m / (Dtype(1) - pow(momentum, num_iters)) /
+              (std::sqrt(val_v / (Dtype(1) - pow(momentum2, num_iters))) +
+               delta_) + weight_decay * param;
+        }
+        param_sumsq[i == D] += param * param;
+        step_sumsq[i == D] += steps[i] * steps[i];
+      }
+      const Dtype eta = lars ? solver_->param().lars_eta() : 1;
+      for (int k = 0; k < 2; ++k) {
+        if (param_sumsq[k] > 0 && step_sumsq[k] > 0) {
+          trust[k] = eta * std::sqrt(param_sumsq[k] / step_sumsq[k]);
+        }
+      }
+    }
+
+    for (int i = 0; i <= D; ++i) {
       // Add the weight decay to the gradient.
-      grad += weight_decay *
+      const Dtype grad = grads[i] + weight_decay *
           ((i == D) ? bias.cpu_data()[0] : weights.cpu_data()[i]);
       // Finally, compute update.
       const vector<shared_ptr<Blob<Dtype> > >& history = solver_->history();
       if (solver_->type() != string("AdaDelta")
-          && solver_->type() != string("Adam")) {
+          && solver_->type() != string("Adam") && !lamb) {
         ASSERT_EQ(2, history.size());  // 1 blob for weights, 1 for bias
       } else {
         ASSERT_EQ(4, history.size());  // additional blobs for update history
@@ -336,6 +380,10 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
             std::sqrt(Dtype(1) - pow(momentum2, num_iters)) /
             (Dtype(1.) - pow(momentum, num_iters));
         update_value = alpha_t * val_m / (std::sqrt(val_v) + delta_);
+      } else if (lars) {
+        update_value = learning_rate * trust[i == D] * steps[i] + temp;
+      } else if (lamb) {
+        update_value = learning_rate * trust[i == D] * steps[i];
       } else {
         LOG(FATAL) << "Unknown solver type: " << solver_->type();
       }
@@ -599,6 +647,21 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdate) {
   this->TestLeastSquaresUpdate();
 }
 
+TYPED_TEST(SGDSolverTest, TestWarmup) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.5;
+  this->RunLeastSquaresSolver(kLearningRate, 0, 0, 0);
+  SolverParameter param = this->solver_->param();
+  param.set_warmup_iter(4);
+  this->InitSolver(param);
+  // The rate ramps up over the first 4 iterations, then holds.
+  EXPECT_FLOAT_EQ(kLearningRate / 4, this->solver_->GetLearningRate());
+  this->solver_->Step(2);
+  EXPECT_FLOAT_EQ(kLearningRate * 3 / 4, this->solver_->GetLearningRate());
+  this->solver_->Step(2);
+  EXPECT_FLOAT_EQ(kLearningRate, this->solver_->GetLearningRate());
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateLROneHundredth) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1286,4 +1349,155 @@ TYPED_TEST(RMSPropSolverTest, TestSnapshotShare) {
   }
 }
 
+template <typename TypeParam>
+class LARSSolverTest : public GradientBasedSolverTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void InitSolver(const SolverParameter& param) {
+    SolverParameter new_param = param;
+    new_param.set_lars_eta(0.02);
+    this->solver_.reset(new LARSSolver<Dtype>(new_param));
+  }
+};
+
+TYPED_TEST_CASE(LARSSolverTest, TestDtypesAndDevices);
+
+TYPED_TEST(LARSSolverTest, TestLARSLeastSquaresUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0;
+  const Dtype kMomentum = 0.9;
+  this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum);
+}
+
+TYPED_TEST(LARSSolverTest, TestLARSLeastSquaresUpdateWithWeightDecay) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum);
+}
+
+TYPED_TEST(LARSSolverTest, TestLARSLeastSquaresUpdateWithEverything) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LARSSolverTest, TestLARSLeastSquaresUpdateWithEverythingShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->share_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LARSSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckAccumulation(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(LARSSolverTest, TestSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+template <typename TypeParam>
+class LAMBSolverTest : public GradientBasedSolverTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void InitSolver(const SolverParameter& param) {
+    SolverParameter new_param = param;
+    new_param.set_momentum(0.9);
+    new_param.set_momentum2(0.999);
+    this->solver_.reset(new LAMBSolver<Dtype>(new_param));
+  }
+};
+
+TYPED_TEST_CASE(LAMBSolverTest, TestDtypesAndDevices);
+
+TYPED_TEST(LAMBSolverTest, TestLAMBLeastSquaresUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0;
+  const Dtype kMomentum = 0.9;
+  this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum);
+}
+
+TYPED_TEST(LAMBSolverTest, TestLAMBLeastSquaresUpdateWithWeightDecay) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum);
+}
+
+TYPED_TEST(LAMBSolverTest, TestLAMBLeastSquaresUpdateWithEverything) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LAMBSolverTest, TestLAMBLeastSquaresUpdateWithEverythingShare) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->share_ = true;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(LAMBSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  const int kIterSize = 2;
+  this->CheckAccumulation(kLearningRate, kWeightDecay, kMomentum, kNumIters,
+      kIterSize);
+}
+
+TYPED_TEST(LAMBSolverTest, TestSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 }  // namespace caffe
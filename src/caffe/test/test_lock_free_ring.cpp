@@ -0,0 +1,76 @@
+#include <boost/thread.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/lock_free_ring.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class LockFreeRingTest : public ::testing::Test {};
+
+TEST_F(LockFreeRingTest, TestPushPop) {
+  LockFreeRing<int> ring(3);
+  EXPECT_EQ(4, ring.capacity());
+  int value;
+  EXPECT_FALSE(ring.try_pop(&value));
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.try_push(i));
+  }
+  EXPECT_FALSE(ring.try_push(4));
+  EXPECT_EQ(4, ring.size());
+  // Wrap around a few times.
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(ring.try_pop(&value));
+    EXPECT_EQ(i, value);
+    EXPECT_TRUE(ring.try_push(i + 4));
+  }
+  EXPECT_EQ(10, ring.pop());
+  EXPECT_EQ(3, ring.size());
+}
+
+static void Produce(LockFreeRing<int>* ring, int first, int count) {
+  for (int i = first; i < first + count; ++i) {
+    ring->push(i);
+  }
+}
+
+static void Consume(LockFreeRing<int>* ring, int count, vector<int>* seen) {
+  for (int i = 0; i < count; ++i) {
+    ++(*seen)[ring->pop()];
+  }
+}
+
+TEST_F(LockFreeRingTest, TestConcurrent) {
+  // Two producers and two consumers through a small ring: every value must
+  // come out exactly once.
+  const int count = 20000;
+  LockFreeRing<int> ring(8);
+  vector<int> seen0(2 * count), seen1(2 * count);
+  boost::thread consumer0(&Consume, &ring, count, &seen0);
+  boost::thread consumer1(&Consume, &ring, count, &seen1);
+  boost::thread producer0(&Produce, &ring, 0, count);
+  boost::thread producer1(&Produce, &ring, count, count);
+  producer0.join();
+  producer1.join();
+  consumer0.join();
+  consumer1.join();
+  for (int i = 0; i < 2 * count; ++i) {
+    EXPECT_EQ(1, seen0[i] + seen1[i]);
+  }
+  EXPECT_EQ(0, ring.size());
+}
+
+TEST_F(LockFreeRingTest, TestInterrupt) {
+  LockFreeRing<int> ring(2);
+  boost::thread consumer(&Consume, &ring, 1, static_cast<vector<int>*>(NULL));
+  consumer.interrupt();
+  consumer.join();
+  EXPECT_EQ(0, ring.size());
+}
+
+}  // namespace caffe
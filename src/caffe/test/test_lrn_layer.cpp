@@ -250,6 +250,62 @@ TYPED_TEST(LRNLayerTest, TestGradientWithinChannel) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardWithinChannelLargeRegion) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(2, 3, 6, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  layer_param.mutable_lrn_param()->set_norm_region(
+      LRNParameter_NormRegion_WITHIN_CHANNEL);
+  layer_param.mutable_lrn_param()->set_local_size(5);
+  LRNLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> top_reference;
+  this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+      &top_reference);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i], top_reference.cpu_data()[i],
+                this->epsilon_);
+  }
+}
+
+TYPED_TEST(LRNLayerTest, TestMultiThreaded) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_->Reshape(5, 7, 4, 3);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  for (int region = 0; region < 2; ++region) {
+    LayerParameter layer_param;
+    layer_param.mutable_lrn_param()->set_norm_region(
+        static_cast<LRNParameter_NormRegion>(region));
+    vector<shared_ptr<Blob<Dtype> > > tops, bottom_diffs;
+    for (int num_threads = 1; num_threads <= 3; num_threads += 2) {
+      layer_param.mutable_lrn_param()->set_num_threads(num_threads);
+      LRNLayer<Dtype> layer(layer_param);
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int i = 0; i < this->blob_top_->count(); ++i) {
+        this->blob_top_->mutable_cpu_diff()[i] = Dtype(i % 5) - 2;
+      }
+      layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+                     this->blob_bottom_vec_);
+      tops.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      tops.back()->CopyFrom(*this->blob_top_, false, true);
+      bottom_diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      bottom_diffs.back()->CopyFrom(*this->blob_bottom_, true, true);
+    }
+    for (int i = 0; i < this->blob_top_->count(); ++i) {
+      EXPECT_EQ(tops[0]->cpu_data()[i], tops[1]->cpu_data()[i]);
+      EXPECT_EQ(bottom_diffs[0]->cpu_diff()[i],
+                bottom_diffs[1]->cpu_diff()[i]);
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNLRNLayerTest : public GPUDeviceTest<Dtype> {
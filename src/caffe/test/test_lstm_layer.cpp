@@ -185,6 +185,60 @@ TYPED_TEST(LSTMLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(LSTMLayerTest, TestForwardVariableTimesteps) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumTimesteps = 4;
+  const int num = this->blob_bottom_.shape(1);
+  this->ReshapeBlobs(kNumTimesteps, num);
+  for (int t = 0; t < kNumTimesteps; ++t) {
+    for (int n = 0; n < num; ++n) {
+      this->blob_bottom_cont_.mutable_cpu_data()[t * num + n] = t > 0;
+    }
+  }
+
+  // Process the full sequence in a single batch.
+  FillerParameter filler_param;
+  filler_param.set_mean(0);
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> sequence_filler(filler_param);
+  sequence_filler.Fill(&this->blob_bottom_);
+  LSTMLayer<Dtype> layer(this->layer_param_);
+  Caffe::set_random_seed(1701);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> bottom_copy(this->blob_bottom_.shape());
+  bottom_copy.CopyFrom(this->blob_bottom_);
+  Blob<Dtype> top_copy(this->blob_top_.shape());
+  top_copy.CopyFrom(this->blob_top_);
+
+  // Process it again with the same layer in batches of 2, 1 and 1 timesteps;
+  // the hidden state must carry over between them.
+  layer.Reset();
+  const int kChunks[] = {2, 1, 1};
+  const Dtype kEpsilon = 1e-5;
+  for (int c = 0, t0 = 0; c < 3; t0 += kChunks[c], ++c) {
+    this->ReshapeBlobs(kChunks[c], num);
+    const int bottom_count = this->blob_bottom_.count();
+    caffe_copy(bottom_count,
+               bottom_copy.cpu_data() + t0 * bottom_count / kChunks[c],
+               this->blob_bottom_.mutable_cpu_data());
+    for (int t = 0; t < kChunks[c]; ++t) {
+      for (int n = 0; n < num; ++n) {
+        this->blob_bottom_cont_.mutable_cpu_data()[t * num + n] = t0 + t > 0;
+      }
+    }
+    layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int top_count = this->blob_top_.count();
+    const int top_offset = t0 * top_count / kChunks[c];
+    for (int i = 0; i < top_count; ++i) {
+      EXPECT_NEAR(top_copy.cpu_data()[top_offset + i],
+                  this->blob_top_.cpu_data()[i], kEpsilon)
+          << "t0 = " << t0 << "; i = " << i;
+    }
+  }
+}
+
 TYPED_TEST(LSTMLayerTest, TestLSTMUnitSetUp) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -284,5 +338,79 @@ TYPED_TEST(LSTMLayerTest, TestGradientNonZeroContBufferSize2WithStaticInput) {
       this->blob_top_vec_, 2);
 }
 
+TYPED_TEST(LSTMLayerTest, TestFusedMatchesUnrolled) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumTimesteps = 3;
+  const int kNumInstances = 2;
+  this->ReshapeBlobs(kNumTimesteps, kNumInstances);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_);
+  filler.Fill(&this->blob_bottom_static_);
+  this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = i > 2;
+  }
+  LayerParameter unrolled_param(this->layer_param_);
+  unrolled_param.mutable_recurrent_param()->set_engine(
+      RecurrentParameter_Engine_UNROLLED);
+  LayerParameter fused_param(this->layer_param_);
+  fused_param.mutable_recurrent_param()->set_engine(
+      RecurrentParameter_Engine_FUSED);
+
+  // Run both implementations with the same params, inputs and top diff.
+  Blob<Dtype> top_diff;
+  vector<shared_ptr<Blob<Dtype> > > tops, bottom_diffs, param_diffs;
+  for (int engine = 0; engine < 2; ++engine) {
+    Caffe::set_random_seed(1701);
+    LSTMLayer<Dtype> layer(engine ? fused_param : unrolled_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    if (engine == 0) {
+      top_diff.ReshapeLike(this->blob_top_);
+      filler.Fill(&top_diff);
+    }
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+               this->blob_top_.mutable_cpu_diff());
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      caffe_set(layer.blobs()[i]->count(), Dtype(0),
+                layer.blobs()[i]->mutable_cpu_diff());
+    }
+    vector<bool> propagate_down(this->blob_bottom_vec_.size(), true);
+    propagate_down[1] = false;
+    layer.Backward(this->blob_top_vec_, propagate_down,
+                   this->blob_bottom_vec_);
+    tops.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    tops.back()->CopyFrom(this->blob_top_, false, true);
+    for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+      if (i == 1) { continue; }
+      bottom_diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      bottom_diffs.back()->CopyFrom(*this->blob_bottom_vec_[i], true, true);
+    }
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      param_diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      param_diffs.back()->CopyFrom(*layer.blobs()[i], true, true);
+    }
+  }
+  const Dtype kEpsilon = 1e-5;
+  for (int i = 0; i < tops[0]->count(); ++i) {
+    EXPECT_NEAR(tops[0]->cpu_data()[i], tops[1]->cpu_data()[i], kEpsilon);
+  }
+  ASSERT_EQ(4, bottom_diffs.size());
+  for (int j = 0; j < 2; ++j) {
+    for (int i = 0; i < bottom_diffs[j]->count(); ++i) {
+      EXPECT_NEAR(bottom_diffs[j]->cpu_diff()[i],
+                  bottom_diffs[j + 2]->cpu_diff()[i], kEpsilon);
+    }
+  }
+  ASSERT_EQ(8, param_diffs.size());
+  for (int j = 0; j < 4; ++j) {
+    ASSERT_TRUE(param_diffs[j]->shape() == param_diffs[j + 4]->shape());
+    for (int i = 0; i < param_diffs[j]->count(); ++i) {
+      EXPECT_NEAR(param_diffs[j]->cpu_diff()[i],
+                  param_diffs[j + 4]->cpu_diff()[i], kEpsilon);
+    }
+  }
+}
 
 }  // namespace caffe
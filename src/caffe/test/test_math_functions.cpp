@@ -1,6 +1,7 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
 #include <cmath>  // for std::fabs
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -119,6 +120,73 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestCopyStrided) {
+  // A 3x4x5x6 part of the bottom, starting at (1, 2, 3, 4), copied densely.
+  vector<int> shape(4);
+  shape[0] = 3; shape[1] = 4; shape[2] = 5; shape[3] = 6;
+  const int offset = this->blob_bottom_->offset(1, 2, 3, 4);
+  Blob<TypeParam> part(shape);
+  caffe_copy_strided(shape, this->blob_bottom_->cpu_data() + offset,
+      this->blob_bottom_->strides(), part.mutable_cpu_data(), part.strides());
+  for (int n = 0; n < 3; ++n) {
+    for (int c = 0; c < 4; ++c) {
+      for (int h = 0; h < 5; ++h) {
+        for (int w = 0; w < 6; ++w) {
+          EXPECT_EQ(this->blob_bottom_->data_at(n + 1, c + 2, h + 3, w + 4),
+                    part.data_at(n, c, h, w));
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestBroadcast) {
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  // The broadcast vector is the top's data.
+  const TypeParam* b = this->blob_top_->cpu_data();
+  TypeParam* y = this->blob_bottom_->mutable_cpu_diff();
+  // As a per-channel vector over N x C x (H * W), and over the last axes.
+  const int outers[] = {11, 11};
+  const int dims[] = {17, 17 * 19 * 23};
+  const int inners[] = {19 * 23, 1};
+  for (int l = 0; l < 2; ++l) {
+    const int outer = outers[l], dim = dims[l], inner = inners[l];
+    caffe_cpu_broadcast_add<TypeParam>(outer, dim, inner, x, 0.5, b, y);
+    for (int i = 0; i < outer * dim * inner; ++i) {
+      EXPECT_EQ(x[i] + TypeParam(0.5) * b[i / inner % dim], y[i]);
+    }
+    caffe_cpu_broadcast_mul<TypeParam>(outer, dim, inner, x, b, y);
+    for (int i = 0; i < outer * dim * inner; ++i) {
+      EXPECT_EQ(x[i] * b[i / inner % dim], y[i]);
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestReduce) {
+  const TypeParam* x = this->blob_bottom_->cpu_data();
+  const TypeParam* z = this->blob_top_->cpu_data();
+  const int outers[] = {11, 11};
+  const int dims[] = {17, 17 * 19 * 23};
+  const int inners[] = {19 * 23, 1};
+  for (int l = 0; l < 2; ++l) {
+    const int outer = outers[l], dim = dims[l], inner = inners[l];
+    vector<TypeParam> sum(dim, 0), dot(dim, 0);
+    for (int i = 0; i < outer * dim * inner; ++i) {
+      sum[i / inner % dim] += x[i];
+      dot[i / inner % dim] += x[i] * z[i];
+    }
+    vector<TypeParam> y(dim, 1);
+    caffe_cpu_reduce_sum<TypeParam>(outer, dim, inner, 2, x, 0.5, &y[0]);
+    for (int d = 0; d < dim; ++d) {
+      EXPECT_NEAR(2 * sum[d] + 0.5, y[d], 1e-4);
+    }
+    caffe_cpu_reduce_dot<TypeParam>(outer, dim, inner, 1, x, z, 0, &y[0]);
+    for (int d = 0; d < dim; ++d) {
+      EXPECT_NEAR(dot[d], y[d], 1e-4);
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -197,6 +265,25 @@ TYPED_TEST(GPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(GPUMathFunctionsTest, TestCopyStrided) {
+  vector<int> shape(4);
+  shape[0] = 3; shape[1] = 4; shape[2] = 5; shape[3] = 6;
+  const int offset = this->blob_bottom_->offset(1, 2, 3, 4);
+  Blob<TypeParam> part(shape);
+  caffe_gpu_copy_strided(shape, this->blob_bottom_->gpu_data() + offset,
+      this->blob_bottom_->strides(), part.mutable_gpu_data(), part.strides());
+  for (int n = 0; n < 3; ++n) {
+    for (int c = 0; c < 4; ++c) {
+      for (int h = 0; h < 5; ++h) {
+        for (int w = 0; w < 6; ++w) {
+          EXPECT_EQ(this->blob_bottom_->data_at(n + 1, c + 2, h + 3, w + 4),
+                    part.data_at(n, c, h, w));
+        }
+      }
+    }
+  }
+}
+
 #endif
 
 
@@ -839,6 +839,287 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoFileWithState(proto, phase, level, stages);
   }
 
+  // Two towers concatenated, then sliced back, along axis 0. With
+  // in_place_after_slice, the first slice is written in place.
+  virtual void InitConcatSliceNet(const bool zero_copy_concat,
+      const bool in_place_after_slice = false) {
+    ostringstream proto;
+    proto << "name: 'ConcatSliceNetwork' "
+        "zero_copy_concat: " << (zero_copy_concat ? "true " : "false ") <<
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 5 } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'a' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'b' "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'b' "
+        "  top: 'b' "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  concat_param { axis: 0 } "
+        "  bottom: 'a' "
+        "  bottom: 'b' "
+        "  top: 'c' "
+        "} "
+        "layer { "
+        "  name: 'tanh' "
+        "  type: 'TanH' "
+        "  bottom: 'c' "
+        "  top: 'd' "
+        "} "
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  slice_param { axis: 0 } "
+        "  bottom: 'd' "
+        "  top: 'e' "
+        "  top: 'f' "
+        "} ";
+    if (in_place_after_slice) {
+      proto <<
+          "layer { "
+          "  name: 'power' "
+          "  type: 'Power' "
+          "  power_param { scale: 2 } "
+          "  bottom: 'e' "
+          "  top: 'e' "
+          "} ";
+    }
+    proto <<
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'e' "
+        "  bottom: 'f' "
+        "  top: 'loss' "
+        "} ";
+    Caffe::set_random_seed(this->seed_);
+    InitNetFromProtoString(proto.str());
+  }
+
+  // Runs Forward and Backward on the net from InitConcatSliceNet, with and
+  // without zero_copy_concat, and checks that the results match.
+  virtual void RunConcatSliceNets(const bool in_place_after_slice) {
+    InitConcatSliceNet(false, in_place_after_slice);
+    const Dtype loss = net_->ForwardBackward();
+    vector<shared_ptr<Blob<Dtype> > > blob_data, blob_diffs, param_diffs;
+    const bool kCopyDiff = true;
+    CopyNetBlobs(!kCopyDiff, &blob_data);
+    CopyNetBlobs(kCopyDiff, &blob_diffs);
+    CopyNetParams(kCopyDiff, &param_diffs);
+    InitConcatSliceNet(true, in_place_after_slice);
+    EXPECT_EQ(loss, net_->ForwardBackward());
+    for (int i = 0; i < blob_data.size(); ++i) {
+      const Blob<Dtype>& blob = *net_->blobs()[i];
+      for (int j = 0; j < blob.count(); ++j) {
+        EXPECT_EQ(blob_data[i]->cpu_data()[j], blob.cpu_data()[j]);
+        EXPECT_EQ(blob_diffs[i]->cpu_diff()[j], blob.cpu_diff()[j]);
+      }
+    }
+    for (int i = 0; i < param_diffs.size(); ++i) {
+      const Blob<Dtype>& param = *net_->params()[i];
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_EQ(param_diffs[i]->cpu_diff()[j], param.cpu_diff()[j]);
+      }
+    }
+  }
+
+  // Parts of an output sliced and cropped along axis 1, then concatenated
+  // back in another order.
+  virtual void InitStridedViewNet(const bool strided_views) {
+    ostringstream proto;
+    proto << "name: 'StridedViewNetwork' "
+        "strided_views: " << (strided_views ? "true " : "false ") <<
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 5 } "
+        "    shape { dim: 2 dim: 9 } "
+        "    shape { dim: 2 dim: 3 } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "  top: 'ref' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'c' "
+        "} "
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  slice_param { axis: 1 slice_point: 2 } "
+        "  bottom: 'c' "
+        "  top: 'e' "
+        "  top: 'f' "
+        "} "
+        "layer { "
+        "  name: 'crop' "
+        "  type: 'Crop' "
+        "  crop_param { axis: 1 offset: 2 } "
+        "  bottom: 'c' "
+        "  bottom: 'ref' "
+        "  top: 'h' "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  concat_param { axis: 1 } "
+        "  bottom: 'f' "
+        "  bottom: 'h' "
+        "  bottom: 'e' "
+        "  top: 'g' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'g' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    Caffe::set_random_seed(this->seed_);
+    InitNetFromProtoString(proto.str());
+  }
+
+  // A chain of three segments for gradient checkpointing: the first two end
+  // at the layers marked checkpoint (with mark_checkpoints), and the second
+  // has a dropout, which cannot be recomputed, and a split.
+  virtual void InitCheckpointNet(const bool gradient_checkpointing,
+      const bool mark_checkpoints) {
+    const string checkpoint = mark_checkpoints ? "checkpoint: true " : "";
+    ostringstream proto;
+    proto << "name: 'CheckpointNetwork' "
+        "state { phase: TRAIN } "
+        "gradient_checkpointing: " <<
+        (gradient_checkpointing ? "true " : "false ") <<
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 5 } "
+        "    shape { dim: 2 dim: 4 } "
+        "    data_filler { type: 'gaussian' } "
+        "  } "
+        "  top: 'data' "
+        "  top: 'target' "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'a' "
+        "} "
+        "layer { name: 'tanh1' type: 'TanH' bottom: 'a' top: 'b' } "
+        "layer { name: 'relu1' type: 'ReLU' bottom: 'b' top: 'b' } "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'b' "
+        "  top: 'c' " << checkpoint <<
+        "} "
+        "layer { name: 'tanh2' type: 'TanH' bottom: 'c' top: 'd' } "
+        "layer { name: 'drop' type: 'Dropout' bottom: 'd' top: 'dd' } "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'dd' "
+        "  top: 'e' "
+        "} "
+        "layer { "
+        "  name: 'ip4' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' } "
+        "  } "
+        "  bottom: 'e' "
+        "  top: 'f' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'e' "
+        "  bottom: 'f' "
+        "  top: 'g' " << checkpoint <<
+        "} "
+        "layer { name: 'tanh3' type: 'TanH' bottom: 'g' top: 'h' } "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'h' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    Caffe::set_random_seed(this->seed_);
+    InitNetFromProtoString(proto.str());
+  }
+
+  // Runs Forward and Backward on the net from InitCheckpointNet, with and
+  // without gradient checkpointing, and checks that the gradients match.
+  virtual void RunCheckpointNets(const bool mark_checkpoints) {
+    InitCheckpointNet(false, mark_checkpoints);
+    const Dtype loss = net_->ForwardBackward();
+    vector<shared_ptr<Blob<Dtype> > > param_diffs;
+    const bool kCopyDiff = true;
+    CopyNetParams(kCopyDiff, &param_diffs);
+    InitCheckpointNet(true, mark_checkpoints);
+    EXPECT_EQ(loss, net_->ForwardBackward());
+    for (int i = 0; i < param_diffs.size(); ++i) {
+      const Blob<Dtype>& param = *net_->params()[i];
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_EQ(param_diffs[i]->cpu_diff()[j], param.cpu_diff()[j]);
+      }
+    }
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -1342,6 +1623,122 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestLoadWeightsAtInit) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'LoadWeightsAtInit' "
+      "layer { "
+      "  name: 'data' type: 'DummyData' top: 'data' "
+      "  dummy_data_param { "
+      "    shape { dim: 4 dim: 5 } "
+      "    data_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'innerproduct1' type: 'InnerProduct' bottom: 'data' "
+      "  top: 'ip1' param { name: 'shared' } "
+      "  inner_product_param { "
+      "    num_output: 5 bias_term: false "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'innerproduct2' type: 'InnerProduct' bottom: 'ip1' "
+      "  top: 'ip2' param { name: 'shared' } "
+      "  inner_product_param { "
+      "    num_output: 5 bias_term: false "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'innerproduct3' type: 'InnerProduct' bottom: 'ip2' "
+      "  top: 'ip3' "
+      "  inner_product_param { "
+      "    num_output: 2 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "    bias_filler { type: 'constant' value: 3 } "
+      "  } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  // Save the weights of the first two layers only.
+  Caffe::set_random_seed(this->seed_);
+  this->net_.reset(new Net<Dtype>(param));
+  NetParameter weights_param;
+  this->net_->ToProto(&weights_param);
+  weights_param.mutable_layer()->RemoveLast();
+  string weights_file;
+  MakeTempFilename(&weights_file);
+  WriteProtoToBinaryFile(weights_param, weights_file);
+  vector<shared_ptr<Blob<Dtype> > > saved_params;
+  this->CopyNetParams(false, &saved_params);
+
+  // A net initialized with the weights gets them, through the owner of the
+  // shared param, and still fills innerproduct3.
+  Caffe::set_random_seed(this->seed_ + 1);
+  const vector<string> weights(1, weights_file);
+  this->net_.reset(new Net<Dtype>(param, &weights));
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(4, params.size());
+  EXPECT_EQ(params[0]->cpu_data(), params[1]->cpu_data());
+  for (int i = 0; i < params[0]->count(); ++i) {
+    EXPECT_EQ(saved_params[0]->cpu_data()[i], params[0]->cpu_data()[i]);
+  }
+  int num_changed = 0;
+  for (int i = 0; i < params[2]->count(); ++i) {
+    num_changed += saved_params[2]->cpu_data()[i] != params[2]->cpu_data()[i];
+  }
+  EXPECT_GT(num_changed, 0);
+  for (int i = 0; i < params[3]->count(); ++i) {
+    EXPECT_EQ(Dtype(3), params[3]->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromBinaryProto) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Save a net, with its values stored as floats whatever Dtype, along
+  // with a layer the net does not have.
+  Caffe::set_random_seed(this->seed_);
+  const bool kBiasTerm = true;
+  this->InitUnsharedWeightsNet(NULL, NULL, false, kBiasTerm);
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  for (int i = 0; i < net_param.layer_size(); ++i) {
+    for (int j = 0; j < net_param.layer(i).blobs_size(); ++j) {
+      BlobProto* blob = net_param.mutable_layer(i)->mutable_blobs(j);
+      for (int k = 0; k < blob->double_data_size(); ++k) {
+        blob->add_data(blob->double_data(k));
+      }
+      blob->clear_double_data();
+    }
+  }
+  LayerParameter* unknown_layer = net_param.add_layer();
+  unknown_layer->set_name("unknown");
+  unknown_layer->add_blobs()->mutable_shape()->add_dim(1000);
+  for (int k = 0; k < 1000; ++k) {
+    unknown_layer->mutable_blobs(0)->add_data(k);
+  }
+  string weights_file;
+  MakeTempFilename(&weights_file);
+  WriteProtoToBinaryFile(net_param, weights_file);
+  vector<shared_ptr<Blob<Dtype> > > saved_params;
+  this->CopyNetParams(false, &saved_params);
+
+  // Reinitialize the net with other values and load the file.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitUnsharedWeightsNet(NULL, NULL, false, kBiasTerm);
+  this->net_->CopyTrainedLayersFrom(weights_file);
+  const vector<shared_ptr<Blob<Dtype> > >& params = this->net_->params();
+  ASSERT_EQ(saved_params.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    ASSERT_EQ(saved_params[i]->count(), params[i]->count());
+    for (int k = 0; k < params[i]->count(); ++k) {
+      EXPECT_EQ(static_cast<float>(saved_params[i]->cpu_data()[k]),
+                params[i]->cpu_data()[k]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -1457,6 +1854,191 @@ TYPED_TEST(NetTest, TestFromTo) {
   }
 }
 
+TYPED_TEST(NetTest, TestForwardBlobs) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kAccuracyLayer = true;
+  this->InitTinyNet(false, kAccuracyLayer);
+  Net<Dtype>* net = this->net_.get();
+  Blob<Dtype>* loss = net->blob_by_name("top_loss").get();
+  Blob<Dtype>* accuracy = net->blob_by_name("accuracy").get();
+  loss->mutable_cpu_data()[0] = -1;
+  accuracy->mutable_cpu_data()[0] = -1;
+
+  // Only the data and InnerProduct layers run for the InnerProduct output.
+  vector<string> blob_names(1, "innerproduct");
+  EXPECT_EQ(0, net->ForwardBlobs(blob_names));
+  EXPECT_EQ(-1, loss->cpu_data()[0]);
+  EXPECT_EQ(-1, accuracy->cpu_data()[0]);
+  Blob<Dtype> innerproduct;
+  innerproduct.CopyFrom(*net->blob_by_name("innerproduct"), false, true);
+  // Running the InnerProduct on the same data gives the same output.
+  net->ForwardFromTo(1, 1);
+  const Blob<Dtype>& expected = *net->blob_by_name("innerproduct");
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], innerproduct.cpu_data()[i]);
+  }
+
+  // The loss runs for the loss, but the accuracy still does not; repeated
+  // names are ignored.
+  blob_names.push_back("top_loss");
+  blob_names.push_back("innerproduct");
+  const Dtype forward_loss = net->ForwardBlobs(blob_names);
+  EXPECT_GT(forward_loss, 0);
+  EXPECT_EQ(forward_loss, loss->cpu_data()[0]);
+  EXPECT_EQ(-1, accuracy->cpu_data()[0]);
+}
+
+TYPED_TEST(NetTest, TestBranchThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  const bool kForceBackward = true;
+  const bool kBiasTerm = true;
+  this->InitUnsharedWeightsNet(NULL, NULL, kForceBackward, kBiasTerm);
+  Net<Dtype>* net = this->net_.get();
+
+  // Run Forward and Backward on a single thread, recording all results.
+  // Note that we skip layer zero after the first Forward to keep the same data.
+  net->Forward();
+  const Dtype loss = net->ForwardFrom(1);
+  net->ClearParamDiffs();
+  net->Backward();
+  vector<shared_ptr<Blob<Dtype> > > blob_data, blob_diffs, param_diffs;
+  const bool kCopyDiff = true;
+  this->CopyNetBlobs(!kCopyDiff, &blob_data);
+  this->CopyNetBlobs(kCopyDiff, &blob_diffs);
+  this->CopyNetParams(kCopyDiff, &param_diffs);
+
+  // Check that running the two InnerProduct towers concurrently gives the
+  // same results.
+  for (int num_threads = 2; num_threads <= 4; ++num_threads) {
+    net->set_branch_threads(num_threads);
+    EXPECT_EQ(num_threads, net->branch_threads());
+    EXPECT_EQ(loss, net->ForwardFrom(1));
+    net->ClearParamDiffs();
+    net->Backward();
+    for (int i = 0; i < blob_data.size(); ++i) {
+      const Blob<Dtype>& blob = *net->blobs()[i];
+      for (int j = 0; j < blob.count(); ++j) {
+        EXPECT_EQ(blob_data[i]->cpu_data()[j], blob.cpu_data()[j]);
+        EXPECT_EQ(blob_diffs[i]->cpu_diff()[j], blob.cpu_diff()[j]);
+      }
+    }
+    for (int i = 0; i < param_diffs.size(); ++i) {
+      const Blob<Dtype>& param = *net->params()[i];
+      for (int j = 0; j < param.count(); ++j) {
+        EXPECT_EQ(param_diffs[i]->cpu_diff()[j], param.cpu_diff()[j]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestZeroCopyConcatSlice) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->RunConcatSliceNets(false);
+  // The towers write their parts of the concatenation, and the slices are
+  // parts of their input, data and diffs.
+  Net<Dtype>* net = this->net_.get();
+  const Dtype* c_data = net->blob_by_name("c")->cpu_data();
+  const Dtype* c_diff = net->blob_by_name("c")->cpu_diff();
+  EXPECT_EQ(c_data, net->blob_by_name("a")->cpu_data());
+  EXPECT_EQ(c_data + 8, net->blob_by_name("b")->cpu_data());
+  EXPECT_EQ(c_diff, net->blob_by_name("a")->cpu_diff());
+  // The in-place ReLU writes the diff of b after the concat's Backward.
+  EXPECT_NE(c_diff + 8, net->blob_by_name("b")->cpu_diff());
+  const Dtype* d_data = net->blob_by_name("d")->cpu_data();
+  const Dtype* d_diff = net->blob_by_name("d")->cpu_diff();
+  EXPECT_EQ(d_data, net->blob_by_name("e")->cpu_data());
+  EXPECT_EQ(d_data + 8, net->blob_by_name("f")->cpu_data());
+  EXPECT_EQ(d_diff, net->blob_by_name("e")->cpu_diff());
+  EXPECT_EQ(d_diff + 8, net->blob_by_name("f")->cpu_diff());
+  // Reshaping keeps the views.
+  net->Reshape();
+  EXPECT_EQ(net->blob_by_name("c")->cpu_data() + 8,
+            net->blob_by_name("b")->cpu_data());
+  EXPECT_EQ(net->blob_by_name("d")->cpu_data() + 8,
+            net->blob_by_name("f")->cpu_data());
+}
+
+TYPED_TEST(NetTest, TestZeroCopySliceWrittenInPlace) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->RunConcatSliceNets(true);
+  // The first slice is written in place, so it keeps its own data; its
+  // gradient is still the slice's input gradient.
+  Net<Dtype>* net = this->net_.get();
+  const Dtype* d_data = net->blob_by_name("d")->cpu_data();
+  const Dtype* d_diff = net->blob_by_name("d")->cpu_diff();
+  EXPECT_NE(d_data, net->blob_by_name("e")->cpu_data());
+  EXPECT_EQ(d_data + 8, net->blob_by_name("f")->cpu_data());
+  EXPECT_EQ(d_diff, net->blob_by_name("e")->cpu_diff());
+  EXPECT_EQ(d_diff + 8, net->blob_by_name("f")->cpu_diff());
+}
+
+TYPED_TEST(NetTest, TestStridedViews) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitStridedViewNet(false);
+  const Dtype loss = this->net_->ForwardBackward();
+  vector<shared_ptr<Blob<Dtype> > > blob_data, blob_diffs, param_diffs;
+  const bool kCopyDiff = true;
+  this->CopyNetBlobs(!kCopyDiff, &blob_data);
+  this->CopyNetBlobs(kCopyDiff, &blob_diffs);
+  this->CopyNetParams(kCopyDiff, &param_diffs);
+  this->InitStridedViewNet(true);
+  EXPECT_EQ(loss, this->net_->ForwardBackward());
+  // The strided blobs are compared through their offsets.
+  Net<Dtype>* net = this->net_.get();
+  for (int i = 0; i < blob_data.size(); ++i) {
+    const Blob<Dtype>& blob = *net->blobs()[i];
+    if (blob.num_axes() != 2) { continue; }
+    for (int n = 0; n < blob.shape(0); ++n) {
+      for (int c = 0; c < blob.shape(1); ++c) {
+        EXPECT_EQ(blob_data[i]->data_at(n, c, 0, 0),
+                  blob.data_at(n, c, 0, 0));
+        EXPECT_EQ(blob_diffs[i]->diff_at(n, c, 0, 0),
+                  blob.diff_at(n, c, 0, 0));
+      }
+    }
+  }
+  for (int i = 0; i < param_diffs.size(); ++i) {
+    const Blob<Dtype>& param = *net->params()[i];
+    for (int j = 0; j < param.count(); ++j) {
+      EXPECT_EQ(param_diffs[i]->cpu_diff()[j], param.cpu_diff()[j]);
+    }
+  }
+  // The slices and the crop are strided parts of their input's data; the
+  // diffs of the slices are parts of the diff of its split.
+  const Blob<Dtype>& c = *net->blob_by_name("c");
+  const Blob<Dtype>& e = *net->blob_by_name("e");
+  EXPECT_FALSE(e.is_contiguous());
+  EXPECT_EQ(6, e.stride(0));
+  EXPECT_EQ(1, e.stride(1));
+  EXPECT_EQ(c.cpu_data(), e.cpu_data());
+  EXPECT_EQ(c.cpu_data() + 2, net->blob_by_name("f")->cpu_data());
+  EXPECT_EQ(c.cpu_data() + 2, net->blob_by_name("h")->cpu_data());
+  EXPECT_EQ(e.cpu_diff() + 2, net->blob_by_name("f")->cpu_diff());
+  EXPECT_TRUE(net->blob_by_name("g")->is_contiguous());
+}
+
+TYPED_TEST(NetTest, TestGradientCheckpointing) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->RunCheckpointNets(true);
+  // The first blob of each segment starts the shared memory; the blobs read
+  // by the next segment, and the dropout's output, are kept.
+  Net<Dtype>* net = this->net_.get();
+  const Dtype* pool = net->blob_by_name("a")->cpu_data();
+  EXPECT_EQ(pool, net->blob_by_name("d")->cpu_data());
+  EXPECT_EQ(pool, net->blob_by_name("h")->cpu_data());
+  EXPECT_EQ(pool + 8, net->blob_by_name("b")->cpu_data());
+  EXPECT_EQ(net->blob_by_name("a")->cpu_diff(),
+            net->blob_by_name("d")->cpu_diff());
+  const char* kept[] = {"c", "dd", "g"};
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_FALSE(net->blob_by_name(kept[i])->data()->base()) << kept[i];
+  }
+}
+
+TYPED_TEST(NetTest, TestGradientCheckpointingAutomatic) {
+  this->RunCheckpointNets(false);
+}
+
 class FilterNetTest : public ::testing::Test {
  protected:
   void RunFilterNetTest(
@@ -2446,6 +3028,37 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestReshapeIfChanged) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitReshapableNet();
+  Net<Dtype>* net = this->net_.get();
+  Blob<Dtype>* input_blob = net->blob_by_name("data").get();
+  input_blob->Reshape(2, 3, 12, 10);
+  net->Reshape();
+  // Once reshaped, the layers skip their Reshape until their blobs change.
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    EXPECT_FALSE(layers[i]->ReshapeIfChanged(net->bottom_vecs()[i],
+        net->top_vecs()[i])) << net->layer_names()[i];
+  }
+  input_blob->Reshape(4, 3, 9, 11);
+  EXPECT_FALSE(layers[0]->ReshapeIfChanged(net->bottom_vecs()[0],
+      net->top_vecs()[0]));
+  EXPECT_TRUE(layers[1]->ReshapeIfChanged(net->bottom_vecs()[1],
+      net->top_vecs()[1]));
+  EXPECT_FALSE(layers[1]->ReshapeIfChanged(net->bottom_vecs()[1],
+      net->top_vecs()[1]));
+  // The next layers see the new shapes of conv1.
+  net->Reshape();
+  const Blob<Dtype>& pool1 = *net->blob_by_name("pool1");
+  const Blob<Dtype>& conv1 = *net->blob_by_name("conv1");
+  EXPECT_EQ(4, pool1.num());
+  EXPECT_EQ(conv1.shape(0), pool1.shape(0));
+  EXPECT_EQ(net->blob_by_name("norm1")->shape(),
+            net->blob_by_name("softmax")->shape());
+  EXPECT_EQ(pool1.shape(), net->blob_by_name("norm1")->shape());
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
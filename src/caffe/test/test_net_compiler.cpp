@@ -0,0 +1,170 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/pooling_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/compiled_net.hpp"
+#include "caffe/util/net_compiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+struct TestConvolutionShape {
+  enum {
+    N = 2, C = 4, H = 7, W = 6, K = 6, OH = 4, OW = 5,
+    KH = 3, KW = 2, SH = 2, SW = 1, PH = 1, PW = 0,
+    DH = 1, DW = 1, G = 2
+  };
+};
+
+struct TestPoolingShape {
+  enum {
+    N = 2, C = 3, H = 7, W = 6, OH = 4, OW = 4,
+    KH = 3, KW = 3, SH = 2, SW = 2, PH = 1, PW = 1
+  };
+};
+
+class NetCompilerTest : public CPUDeviceTest<float> {
+ protected:
+  NetCompilerTest() : blob_bottom_(new Blob<float>()),
+        blob_top_(new Blob<float>()) {
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~NetCompilerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  void FillBottom(int num, int channels, int height, int width) {
+    blob_bottom_->Reshape(num, channels, height, width);
+    FillerParameter filler_param;
+    GaussianFiller<float> filler(filler_param);
+    filler.Fill(blob_bottom_);
+  }
+
+  void TestPooling(PoolingParameter::PoolMethod method) {
+    FillBottom(TestPoolingShape::N, TestPoolingShape::C, TestPoolingShape::H,
+        TestPoolingShape::W);
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_pool(method);
+    pooling_param->set_kernel_size(3);
+    pooling_param->set_stride(2);
+    pooling_param->set_pad(1);
+    PoolingLayer<float> layer(layer_param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(TestPoolingShape::OH, blob_top_->height());
+    EXPECT_EQ(TestPoolingShape::OW, blob_top_->width());
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    vector<float> top(blob_top_->count());
+    if (method == PoolingParameter_PoolMethod_MAX) {
+      compiled::Pooling<TestPoolingShape, compiled::kMaxPool>(
+          blob_bottom_->cpu_data(), &top[0]);
+    } else {
+      compiled::Pooling<TestPoolingShape, compiled::kAvePool>(
+          blob_bottom_->cpu_data(), &top[0]);
+    }
+    for (int i = 0; i < top.size(); ++i) {
+      EXPECT_NEAR(blob_top_->cpu_data()[i], top[i], 1e-5);
+    }
+  }
+
+  void InitNet(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    net_.reset(new Net<float>(param));
+  }
+
+  Blob<float>* const blob_bottom_;
+  Blob<float>* const blob_top_;
+  vector<Blob<float>*> blob_bottom_vec_;
+  vector<Blob<float>*> blob_top_vec_;
+  shared_ptr<Net<float> > net_;
+};
+
+TEST_F(NetCompilerTest, TestConvolution) {
+  typedef TestConvolutionShape S;
+  FillBottom(S::N, S::C, S::H, S::W);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_num_output(S::K);
+  convolution_param->set_kernel_h(S::KH);
+  convolution_param->set_kernel_w(S::KW);
+  convolution_param->set_stride_h(S::SH);
+  convolution_param->set_stride_w(S::SW);
+  convolution_param->set_pad_h(S::PH);
+  convolution_param->set_pad_w(S::PW);
+  convolution_param->set_group(S::G);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<float> layer(layer_param);
+  layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+  EXPECT_EQ(S::OH, blob_top_->height());
+  EXPECT_EQ(S::OW, blob_top_->width());
+  layer.Forward(blob_bottom_vec_, blob_top_vec_);
+  vector<float> col(S::C * S::KH * S::KW * S::OH * S::OW);
+  vector<float> top(blob_top_->count());
+  compiled::Convolution<S, compiled::kReLU>(blob_bottom_->cpu_data(),
+      layer.blobs()[0]->cpu_data(), layer.blobs()[1]->cpu_data(), 0.f,
+      &col[0], &top[0]);
+  for (int i = 0; i < top.size(); ++i) {
+    EXPECT_NEAR(std::max(blob_top_->cpu_data()[i], 0.f), top[i], 1e-4);
+  }
+}
+
+TEST_F(NetCompilerTest, TestMaxPooling) {
+  TestPooling(PoolingParameter_PoolMethod_MAX);
+}
+
+TEST_F(NetCompilerTest, TestAvePooling) {
+  TestPooling(PoolingParameter_PoolMethod_AVE);
+}
+
+TEST_F(NetCompilerTest, TestFuseAndPlan) {
+  InitNet(
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 8 dim: 8 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 pad: 1 } } "
+      "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'conv' } "
+      "layer { name: 'scale' type: 'Scale' bottom: 'conv' top: 'conv' "
+      "  scale_param { bias_term: true } } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' } "
+      "layer { name: 'pool' type: 'Pooling' bottom: 'conv' top: 'pool' "
+      "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'pool' top: 'ip' "
+      "  inner_product_param { num_output: 10 } } "
+      "layer { name: 'drop' type: 'Dropout' bottom: 'ip' top: 'ip' } "
+      "layer { name: 'prob' type: 'Softmax' bottom: 'ip' top: 'prob' } ");
+  NetCompiler compiler(*net_);
+  // The batch normalization, scale and ReLU go into the convolution, and
+  // the dropout is dropped.
+  EXPECT_EQ(4, compiler.num_steps());
+  // The input and convolution outputs cannot overlap, but the pooling
+  // output can take the place of the input, and the softmax works in place.
+  const int data = 2 * 3 * 8 * 8;
+  const int conv = 2 * 4 * 8 * 8;
+  const int columns = 3 * 3 * 3 * 8 * 8;
+  EXPECT_LE(compiler.arena_size(), data + columns + conv + 64);
+  std::ostringstream header, source;
+  compiler.Write("test_net", &header, &source);
+  EXPECT_NE(string::npos, header.str().find("namespace test_net {"));
+  EXPECT_NE(string::npos,
+      source.str().find("rt::Convolution<conv_shape, rt::kReLU>"));
+  EXPECT_NE(string::npos, source.str().find("// conv, bn, scale, relu\n"));
+  EXPECT_NE(string::npos,
+      source.str().find("rt::InnerProduct<2, 10, 64, false, rt::kIdentity>"));
+}
+
+}  // namespace caffe
@@ -0,0 +1,114 @@
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <boost/thread.hpp>
+
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/numa.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class NumaTest : public ::testing::Test {
+ protected:
+  virtual void TearDown() {
+    SetNumaPolicy(NumaPolicy());
+    Caffe::set_numa_node(-1);
+  }
+};
+
+TEST_F(NumaTest, TestTopology) {
+  const NumaTopology& topology = NumaTopology::Get();
+  ASSERT_GE(topology.num_nodes(), 1);
+  // Every CPU belongs to a single node.
+  std::set<int> cpus;
+  for (int node = 0; node < topology.num_nodes(); ++node) {
+    for (int i = 0; i < topology.cpus(node).size(); ++i) {
+      EXPECT_TRUE(cpus.insert(topology.cpus(node)[i]).second);
+    }
+  }
+  EXPECT_FALSE(cpus.empty());
+}
+
+TEST_F(NumaTest, TestSolverNode) {
+  EXPECT_EQ(-1, SolverNode(-1));
+  NumaPolicy policy;
+  policy.node = 0;
+  SetNumaPolicy(policy);
+  EXPECT_EQ(0, SolverNode(-1));
+  policy.node = NumaPolicy::kAutoNode;
+  SetNumaPolicy(policy);
+  EXPECT_EQ(Caffe::solver_rank() % NumaTopology::Get().num_nodes(),
+            SolverNode(-1));
+}
+
+TEST_F(NumaTest, TestMapHost) {
+  NumaPolicy policy;
+  policy.huge_page_bytes = 1 << 20;
+  SetNumaPolicy(policy);
+  Caffe::set_numa_node(0);
+  // Small allocations are left to malloc.
+  EXPECT_TRUE(NumaMapHost(1000) == NULL);
+  const size_t size = 3 << 20;
+  void* ptr = NumaMapHost(size);
+#ifdef __linux__
+  ASSERT_TRUE(ptr != NULL);
+  memset(ptr, 1, size);  // NOLINT(caffe/alt_fn)
+  EXPECT_EQ(1, static_cast<char*>(ptr)[size - 1]);
+  EXPECT_TRUE(NumaUnmapHost(ptr));
+#endif
+  int other;
+  EXPECT_FALSE(NumaUnmapHost(&other));
+}
+
+TEST_F(NumaTest, TestSyncedMemory) {
+  NumaPolicy policy;
+  policy.huge_page_bytes = 1 << 20;
+  SetNumaPolicy(policy);
+  SyncedMemory mem(2 << 20);
+  const char* data = static_cast<const char*>(mem.cpu_data());
+  for (int i = 0; i < mem.size(); i += 4096) {
+    EXPECT_EQ(0, data[i]);
+  }
+}
+
+#ifdef __linux__
+static void PinWorker(int index, int* cpu) {
+  Caffe::set_numa_node(0);
+  if (PinThread(WORKER_THREAD, index)) {
+    *cpu = sched_getcpu();
+  }
+}
+
+TEST_F(NumaTest, TestPinThread) {
+  // Nothing is pinned without a node.
+  EXPECT_FALSE(PinThread(SOLVER_THREAD, 0));
+  NumaPolicy policy;
+  policy.worker_affinity = AFFINITY_CORE;
+  SetNumaPolicy(policy);
+  const vector<int>& cpus = NumaTopology::Get().cpus(0);
+  if (cpus.empty()) {
+    return;
+  }
+  // Pin threads of their own, not to leave the test thread pinned.
+  for (int index = 0; index < 2; ++index) {
+    int cpu = -1;
+    boost::thread thread(&PinWorker, index, &cpu);
+    thread.join();
+    if (cpu >= 0) {
+      EXPECT_EQ(cpus[index % cpus.size()], cpu);
+    }
+  }
+}
+#endif
+
+}  // namespace caffe
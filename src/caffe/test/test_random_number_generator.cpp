@@ -5,6 +5,7 @@
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -258,6 +259,68 @@ TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulli2) {
 }
 
 
+TYPED_TEST(RandomNumberGeneratorTest, TestPhiloxKnownAnswer) {
+  // Philox4x32-10 of the zero counter with the zero key, from Random123.
+  uint32_t out[4];
+  Philox::Block(0, 0, out);
+  EXPECT_EQ(0x6627e8d5u, out[0]);
+  EXPECT_EQ(0xe169c58du, out[1]);
+  EXPECT_EQ(0xbc57ac4cu, out[2]);
+  EXPECT_EQ(0x9b00dbd8u, out[3]);
+}
+
+TYPED_TEST(RandomNumberGeneratorTest, TestPhiloxUniform) {
+  const TypeParam lower = -7.3;
+  const TypeParam upper = -2.3;
+  TypeParam* uniform_data =
+      static_cast<TypeParam*>(this->data_->mutable_cpu_data());
+  caffe_philox_uniform(this->sample_size_, lower, upper, uniform_data);
+  this->RngUniformChecks(lower, upper, uniform_data);
+}
+
+TYPED_TEST(RandomNumberGeneratorTest, TestPhiloxGaussian) {
+  const TypeParam mu = -2;
+  const TypeParam sigma = 3;
+  TypeParam* gaussian_data =
+      static_cast<TypeParam*>(this->data_->mutable_cpu_data());
+  caffe_philox_gaussian(this->sample_size_, mu, sigma, gaussian_data);
+  this->RngGaussianChecks(mu, sigma, gaussian_data);
+}
+
+TYPED_TEST(RandomNumberGeneratorTest, TestPhiloxBernoulli) {
+  const TypeParam p = 0.3;
+  int* bernoulli_data = static_cast<int*>(this->int_data_->mutable_cpu_data());
+  caffe_philox_bernoulli(this->sample_size_, p, bernoulli_data);
+  this->RngBernoulliChecks(p, bernoulli_data);
+}
+
+TYPED_TEST(RandomNumberGeneratorTest, TestPhiloxSplit) {
+  // Filling a range in unaligned pieces gives the same values as filling it
+  // at once, as when threads split it.
+  const uint64_t key = caffe_philox_key();
+  TypeParam* whole = static_cast<TypeParam*>(this->data_->mutable_cpu_data());
+  TypeParam* pieces =
+      static_cast<TypeParam*>(this->data_2_->mutable_cpu_data());
+  philox_gaussian(key, 5, this->sample_size_, TypeParam(0), TypeParam(1),
+                  whole);
+  const int bounds[] = {0, 3, 4, 13, 1001,
+                        static_cast<int>(this->sample_size_)};
+  for (int i = 0; i + 1 < 6; ++i) {
+    philox_gaussian(key, 5 + bounds[i], bounds[i + 1] - bounds[i],
+                    TypeParam(0), TypeParam(1), pieces + bounds[i]);
+  }
+  for (int i = 0; i < this->sample_size_; ++i) {
+    EXPECT_EQ(whole[i], pieces[i]);
+  }
+  // The stateful generator walks the same stream.
+  Philox philox(key, 7);
+  uint32_t block[4];
+  for (int i = 7; i < 40; ++i) {
+    Philox::Block(key, i / 4, block);
+    EXPECT_EQ(block[i % 4], philox());
+  }
+}
+
 TYPED_TEST(RandomNumberGeneratorTest, TestRngGaussianTimesGaussian) {
   const TypeParam mu = 0;
   const TypeParam sigma = 1;
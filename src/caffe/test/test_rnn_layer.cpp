@@ -160,6 +160,60 @@ TYPED_TEST(RNNLayerTest, TestForward) {
   }
 }
 
+TYPED_TEST(RNNLayerTest, TestForwardVariableTimesteps) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumTimesteps = 4;
+  const int num = this->blob_bottom_.shape(1);
+  this->ReshapeBlobs(kNumTimesteps, num);
+  for (int t = 0; t < kNumTimesteps; ++t) {
+    for (int n = 0; n < num; ++n) {
+      this->blob_bottom_cont_.mutable_cpu_data()[t * num + n] = t > 0;
+    }
+  }
+
+  // Process the full sequence in a single batch.
+  FillerParameter filler_param;
+  filler_param.set_mean(0);
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> sequence_filler(filler_param);
+  sequence_filler.Fill(&this->blob_bottom_);
+  RNNLayer<Dtype> layer(this->layer_param_);
+  Caffe::set_random_seed(1701);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> bottom_copy(this->blob_bottom_.shape());
+  bottom_copy.CopyFrom(this->blob_bottom_);
+  Blob<Dtype> top_copy(this->blob_top_.shape());
+  top_copy.CopyFrom(this->blob_top_);
+
+  // Process it again with the same layer in batches of 2, 1 and 1 timesteps;
+  // the hidden state must carry over between them.
+  layer.Reset();
+  const int kChunks[] = {2, 1, 1};
+  const Dtype kEpsilon = 1e-5;
+  for (int c = 0, t0 = 0; c < 3; t0 += kChunks[c], ++c) {
+    this->ReshapeBlobs(kChunks[c], num);
+    const int bottom_count = this->blob_bottom_.count();
+    caffe_copy(bottom_count,
+               bottom_copy.cpu_data() + t0 * bottom_count / kChunks[c],
+               this->blob_bottom_.mutable_cpu_data());
+    for (int t = 0; t < kChunks[c]; ++t) {
+      for (int n = 0; n < num; ++n) {
+        this->blob_bottom_cont_.mutable_cpu_data()[t * num + n] = t0 + t > 0;
+      }
+    }
+    layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int top_count = this->blob_top_.count();
+    const int top_offset = t0 * top_count / kChunks[c];
+    for (int i = 0; i < top_count; ++i) {
+      EXPECT_NEAR(top_copy.cpu_data()[top_offset + i],
+                  this->blob_top_.cpu_data()[i], kEpsilon)
+          << "t0 = " << t0 << "; i = " << i;
+    }
+  }
+}
+
 TYPED_TEST(RNNLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   RNNLayer<Dtype> layer(this->layer_param_);
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/sampled_softmax_loss_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class SampledSoftmaxWithLossLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  SampledSoftmaxWithLossLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(6, 2, 2, 1)),
+        blob_bottom_label_(new Blob<Dtype>(6, 1, 1, 1)),
+        blob_bottom_sampled_(new Blob<Dtype>(vector<int>(1, 5))),
+        blob_top_loss_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    const int sampled[] = {2, 0, 7, 2, 9};
+    for (int j = 0; j < 5; ++j) {
+      blob_bottom_sampled_->mutable_cpu_data()[j] = sampled[j];
+    }
+    for (int i = 0; i < blob_bottom_label_->count(); ++i) {
+      blob_bottom_label_->mutable_cpu_data()[i] = caffe_rng_rand() % 10;
+    }
+    // An accidental hit.
+    blob_bottom_label_->mutable_cpu_data()[0] = 7;
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_loss_);
+    SampledSoftmaxParameter* param =
+        layer_param_.mutable_sampled_softmax_param();
+    param->set_num_output(10);
+    param->set_num_sampled(5);
+    param->mutable_weight_filler()->set_type("gaussian");
+    param->mutable_bias_filler()->set_type("gaussian");
+  }
+  virtual ~SampledSoftmaxWithLossLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_bottom_sampled_;
+    delete blob_top_loss_;
+  }
+
+  // Returns the average over the examples of the softmax loss over the true
+  // class and the sampled ones, or all the classes if sampled is empty.
+  Dtype ReferenceLoss(Layer<Dtype>* layer, const vector<int>& sampled) {
+    const Dtype* x = blob_bottom_data_->cpu_data();
+    const Dtype* weight = layer->blobs()[0]->cpu_data();
+    const Dtype* bias = layer->blobs()[1]->cpu_data();
+    const double log_n = std::log(11.);
+    Dtype loss = 0;
+    for (int m = 0; m < 6; ++m) {
+      const int label = blob_bottom_label_->cpu_data()[m];
+      vector<int> classes(1, label);
+      if (sampled.empty()) {
+        for (int c = 0; c < 10; ++c) {
+          if (c != label) { classes.push_back(c); }
+        }
+      } else {
+        for (int j = 0; j < sampled.size(); ++j) {
+          if (sampled[j] != label) { classes.push_back(sampled[j]); }
+        }
+      }
+      vector<double> logits;
+      for (int i = 0; i < classes.size(); ++i) {
+        double logit = bias[classes[i]];
+        for (int k = 0; k < 4; ++k) {
+          logit += x[m * 4 + k] * weight[classes[i] * 4 + k];
+        }
+        if (!sampled.empty()) {
+          logit -= std::log(sampled.size() *
+              std::log((classes[i] + 2.) / (classes[i] + 1.)) / log_n);
+        }
+        logits.push_back(logit);
+      }
+      const double max_logit = *std::max_element(logits.begin(),
+                                                 logits.end());
+      double sum = 0;
+      for (int i = 0; i < logits.size(); ++i) {
+        sum += std::exp(logits[i] - max_logit);
+      }
+      loss += std::log(sum) + max_logit - logits[0];
+    }
+    return loss / 6;
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_bottom_sampled_;
+  Blob<Dtype>* const blob_top_loss_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  LayerParameter layer_param_;
+};
+
+TYPED_TEST_CASE(SampledSoftmaxWithLossLayerTest, TestDtypes);
+
+TYPED_TEST(SampledSoftmaxWithLossLayerTest, TestForwardSampled) {
+  this->blob_bottom_vec_.push_back(this->blob_bottom_sampled_);
+  SampledSoftmaxWithLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<int> sampled;
+  for (int j = 0; j < 5; ++j) {
+    sampled.push_back(this->blob_bottom_sampled_->cpu_data()[j]);
+  }
+  EXPECT_NEAR(this->ReferenceLoss(&layer, sampled),
+              this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(SampledSoftmaxWithLossLayerTest, TestForwardFull) {
+  this->layer_param_.set_phase(TEST);
+  SampledSoftmaxWithLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NEAR(this->ReferenceLoss(&layer, vector<int>()),
+              this->blob_top_loss_->cpu_data()[0], 1e-4);
+}
+
+TYPED_TEST(SampledSoftmaxWithLossLayerTest, TestBackwardDrawsSamples) {
+  // Drawing many samples, and keeping the hits, the gradients get close to
+  // those of the full softmax loss.
+  SampledSoftmaxParameter* param =
+      this->layer_param_.mutable_sampled_softmax_param();
+  param->set_num_sampled(50000);
+  param->set_remove_accidental_hits(false);
+  SampledSoftmaxWithLossLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->blob_top_loss_->mutable_cpu_diff()[0] = 1;
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  Blob<TypeParam> sampled_diff;
+  sampled_diff.CopyFrom(*this->blob_bottom_data_, true, true);
+  this->layer_param_.set_phase(TEST);
+  SampledSoftmaxWithLossLayer<TypeParam> full_layer(this->layer_param_);
+  full_layer.blobs() = layer.blobs();
+  full_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  full_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  full_layer.Backward(this->blob_top_vec_, propagate_down,
+      this->blob_bottom_vec_);
+  for (int i = 0; i < sampled_diff.count(); ++i) {
+    EXPECT_NEAR(this->blob_bottom_data_->cpu_diff()[i],
+                sampled_diff.cpu_diff()[i], 0.05);
+  }
+}
+
+TYPED_TEST(SampledSoftmaxWithLossLayerTest, TestGradientSampled) {
+  this->blob_bottom_vec_.push_back(this->blob_bottom_sampled_);
+  SampledSoftmaxWithLossLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(SampledSoftmaxWithLossLayerTest, TestGradientFull) {
+  this->layer_param_.set_phase(TEST);
+  this->layer_param_.mutable_loss_param()->set_ignore_label(3);
+  SampledSoftmaxWithLossLayer<TypeParam> layer(this->layer_param_);
+  GradientChecker<TypeParam> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
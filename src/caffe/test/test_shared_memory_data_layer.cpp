@@ -0,0 +1,165 @@
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/shared_memory_data_layer.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/shm_ring.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ShmBatchRingTest : public ::testing::Test {
+ protected:
+  ShmBatchRingTest()
+      : name_("/caffe_test_ring_" + format_int(getpid())),
+        data_shape_(2, 3), label_shape_(1, 3) {}
+
+  // Publishes batch seq, whose values are all seq, and its labels -seq.
+  void Publish(ShmBatchRing* ring, int seq) {
+    float* slot = ring->BeginWrite();
+    for (int i = 0; i < 9; ++i) {
+      slot[i] = seq;
+    }
+    for (int i = 0; i < 3; ++i) {
+      slot[9 + i] = -seq;
+    }
+    ring->EndWrite();
+  }
+
+  // Reads a batch and returns its number.
+  int Read(ShmBatchRing* ring) {
+    const float* batch = ring->BeginRead();
+    const int seq = batch[0];
+    EXPECT_EQ(seq, batch[8]);
+    EXPECT_EQ(-seq, batch[9]);
+    ring->EndRead();
+    return seq;
+  }
+
+  const string name_;
+  vector<int> data_shape_, label_shape_;
+};
+
+TEST_F(ShmBatchRingTest, TestShapes) {
+  ShmBatchRing producer(name_, 2, data_shape_, label_shape_, true);
+  ShmBatchRing consumer(name_);
+  EXPECT_TRUE(consumer.broadcast());
+  EXPECT_TRUE(consumer.data_shape() == data_shape_);
+  EXPECT_TRUE(consumer.label_shape() == label_shape_);
+  EXPECT_EQ(9, consumer.data_count());
+}
+
+TEST_F(ShmBatchRingTest, TestBroadcast) {
+  ShmBatchRing producer(name_, 2, data_shape_, label_shape_, true);
+  ShmBatchRing consumer0(name_);
+  ShmBatchRing consumer1(name_);
+  Publish(&producer, 0);
+  Publish(&producer, 1);
+  // Both consumers get every batch, and the slots are reused only once both
+  // have read them.
+  EXPECT_EQ(0, Read(&consumer0));
+  EXPECT_EQ(1, Read(&consumer0));
+  EXPECT_EQ(0, Read(&consumer1));
+  Publish(&producer, 2);
+  EXPECT_EQ(2, Read(&consumer0));
+  EXPECT_EQ(1, Read(&consumer1));
+  EXPECT_EQ(2, Read(&consumer1));
+}
+
+TEST_F(ShmBatchRingTest, TestBroadcastDetach) {
+  ShmBatchRing producer(name_, 2, data_shape_, label_shape_, true);
+  ShmBatchRing consumer0(name_);
+  {
+    ShmBatchRing consumer1(name_);
+    Publish(&producer, 0);
+    Publish(&producer, 1);
+  }
+  // The consumer that left no longer holds up the slots.
+  EXPECT_EQ(0, Read(&consumer0));
+  Publish(&producer, 2);
+  EXPECT_EQ(1, Read(&consumer0));
+  EXPECT_EQ(2, Read(&consumer0));
+}
+
+TEST_F(ShmBatchRingTest, TestShard) {
+  ShmBatchRing producer(name_, 3, data_shape_, label_shape_, false);
+  ShmBatchRing consumer0(name_);
+  ShmBatchRing consumer1(name_);
+  EXPECT_FALSE(consumer0.broadcast());
+  for (int i = 0; i < 3; ++i) {
+    Publish(&producer, i);
+  }
+  // Each batch goes to one consumer only.
+  EXPECT_EQ(0, Read(&consumer0));
+  EXPECT_EQ(1, Read(&consumer1));
+  EXPECT_EQ(2, Read(&consumer1));
+  Publish(&producer, 3);
+  EXPECT_EQ(3, Read(&consumer0));
+}
+
+template <typename TypeParam>
+class SharedMemoryDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SharedMemoryDataLayerTest()
+      : name_("/caffe_test_ring_" + format_int(getpid())),
+        blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+  }
+  virtual ~SharedMemoryDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  const string name_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SharedMemoryDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SharedMemoryDataLayerTest, TestRead) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> data_shape(4), label_shape(1, 2);
+  data_shape[0] = 2;
+  data_shape[1] = 3;
+  data_shape[2] = 4;
+  data_shape[3] = 5;
+  ShmBatchRing producer(this->name_, 2, data_shape, label_shape, true);
+  LayerParameter param;
+  param.mutable_shared_memory_data_param()->set_ring(this->name_);
+  SharedMemoryDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_TRUE(this->blob_top_data_->shape() == data_shape);
+  EXPECT_TRUE(this->blob_top_label_->shape() == label_shape);
+  for (int iter = 0; iter < 5; ++iter) {
+    float* slot = producer.BeginWrite();
+    for (int i = 0; i < 120; ++i) {
+      slot[i] = iter * 1000 + i;
+    }
+    slot[120] = iter;
+    slot[121] = iter + 1;
+    producer.EndWrite();
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const Dtype* data = this->blob_top_data_->cpu_data();
+    for (int i = 0; i < 120; ++i) {
+      EXPECT_EQ(iter * 1000 + i, data[i]);
+    }
+    EXPECT_EQ(iter, this->blob_top_label_->cpu_data()[0]);
+    EXPECT_EQ(iter + 1, this->blob_top_label_->cpu_data()[1]);
+  }
+}
+
+}  // namespace caffe
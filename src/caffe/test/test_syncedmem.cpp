@@ -67,6 +67,21 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestView) {
+  shared_ptr<SyncedMemory> base(new SyncedMemory(10));
+  SyncedMemory view(base, 4, 6);
+  EXPECT_EQ(view.size(), 6);
+  EXPECT_EQ(view.head(), SyncedMemory::UNINITIALIZED);
+  char* view_data = static_cast<char*>(view.mutable_cpu_data());
+  EXPECT_EQ(base->head(), SyncedMemory::HEAD_AT_CPU);
+  EXPECT_EQ(static_cast<char*>(base->mutable_cpu_data()) + 4, view_data);
+  caffe_memset(view.size(), 2, view_data);
+  const char* base_data = static_cast<const char*>(base->cpu_data());
+  for (int i = 4; i < base->size(); ++i) {
+    EXPECT_EQ(base_data[i], 2);
+  }
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
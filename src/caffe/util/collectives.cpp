@@ -0,0 +1,366 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "caffe/util/collectives.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// How long non-zero ranks keep trying to reach rank 0 while it starts up.
+const int kConnectTimeoutSeconds = 300;
+
+static void SetNoDelay(int fd) {
+  int one = 1;
+  CHECK_EQ(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)), 0)
+      << "setsockopt: " << strerror(errno);
+}
+
+// Listens on all interfaces; port 0 picks a free port, returned in port.
+static int Listen(int* port, int backlog) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  CHECK_GE(fd, 0) << "socket: " << strerror(errno);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(*port);
+  CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0)
+      << "Cannot bind port " << *port << ": " << strerror(errno);
+  CHECK_EQ(listen(fd, backlog), 0) << "listen: " << strerror(errno);
+  socklen_t len = sizeof(addr);
+  CHECK_EQ(getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len), 0);
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+static int Accept(int listen_fd, uint32_t* peer_ip) {
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  int fd;
+  do {
+    fd = accept(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+  } while (fd < 0 && errno == EINTR);
+  CHECK_GE(fd, 0) << "accept: " << strerror(errno);
+  SetNoDelay(fd);
+  if (peer_ip) { *peer_ip = addr.sin_addr.s_addr; }
+  return fd;
+}
+
+// Connects to an IPv4 address in network byte order, retrying until the
+// peer is listening.
+static int Connect(uint32_t ip, int port) {
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = ip;
+  addr.sin_port = htons(port);
+  for (int attempt = 0; ; ++attempt) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0) << "socket: " << strerror(errno);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+      SetNoDelay(fd);
+      return fd;
+    }
+    const int error = errno;
+    close(fd);
+    CHECK_LT(attempt, kConnectTimeoutSeconds * 10)
+        << "Cannot connect to " << inet_ntoa(addr.sin_addr) << ":" << port
+        << ": " << strerror(error);
+    boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+  }
+}
+
+static uint32_t Resolve(const string& host) {
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = NULL;
+  const int error = getaddrinfo(host.c_str(), NULL, &hints, &result);
+  CHECK_EQ(error, 0) << "Cannot resolve " << host << ": "
+      << gai_strerror(error);
+  const uint32_t ip =
+      reinterpret_cast<sockaddr_in*>(result->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(result);
+  return ip;
+}
+
+static void SendAll(int fd, const void* data, size_t bytes) {
+  const char* ptr = static_cast<const char*>(data);
+  while (bytes > 0) {
+    ssize_t n = send(fd, ptr, bytes, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) { continue; }
+    CHECK_GT(n, 0) << "send: " << strerror(errno);
+    ptr += n;
+    bytes -= n;
+  }
+}
+
+static void RecvAll(int fd, void* data, size_t bytes) {
+  char* ptr = static_cast<char*>(data);
+  while (bytes > 0) {
+    ssize_t n = recv(fd, ptr, bytes, 0);
+    if (n < 0 && errno == EINTR) { continue; }
+    CHECK_GE(n, 0) << "recv: " << strerror(errno);
+    CHECK_GT(n, 0) << "Connection closed by peer.";
+    ptr += n;
+    bytes -= n;
+  }
+}
+
+TCPTransport::TCPTransport(int rank, int size, const string& address)
+    : rank_(rank), sockets_(size, -1) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, size);
+  if (size == 1) { return; }
+  const size_t colon = address.rfind(':');
+  CHECK(colon != string::npos) << "Address must be host:port, got "
+      << address;
+  const string host = address.substr(0, colon);
+  int port = atoi(address.substr(colon + 1).c_str());
+  CHECK_GT(port, 0) << "Invalid port in " << address;
+  // Table of the listening IPv4 address and port of each rank.
+  vector<uint32_t> table(2 * size, 0);
+  if (rank == 0) {
+    int listen_fd = Listen(&port, size);
+    for (int i = 1; i < size; ++i) {
+      uint32_t ip;
+      const int fd = Accept(listen_fd, &ip);
+      uint32_t hello[2];
+      RecvAll(fd, hello, sizeof(hello));
+      CHECK_GT(hello[0], 0);
+      CHECK_LT(hello[0], size);
+      CHECK_EQ(sockets_[hello[0]], -1) << "Rank " << hello[0] << " joined "
+          << "twice.";
+      sockets_[hello[0]] = fd;
+      table[2 * hello[0]] = ip;
+      table[2 * hello[0] + 1] = hello[1];
+    }
+    close(listen_fd);
+    for (int i = 1; i < size; ++i) {
+      SendAll(sockets_[i], &table[0], table.size() * sizeof(uint32_t));
+    }
+  } else {
+    int listen_port = 0;
+    int listen_fd = Listen(&listen_port, size);
+    sockets_[0] = Connect(Resolve(host), port);
+    uint32_t hello[2] = { static_cast<uint32_t>(rank),
+                          static_cast<uint32_t>(listen_port) };
+    SendAll(sockets_[0], hello, sizeof(hello));
+    RecvAll(sockets_[0], &table[0], table.size() * sizeof(uint32_t));
+    // Connect to the lower ranks, then accept the higher ones.
+    for (int i = 1; i < rank; ++i) {
+      sockets_[i] = Connect(table[2 * i], table[2 * i + 1]);
+      const uint32_t me = rank;
+      SendAll(sockets_[i], &me, sizeof(me));
+    }
+    for (int i = rank + 1; i < size; ++i) {
+      const int fd = Accept(listen_fd, NULL);
+      uint32_t peer;
+      RecvAll(fd, &peer, sizeof(peer));
+      CHECK_GT(peer, rank);
+      CHECK_LT(peer, size);
+      CHECK_EQ(sockets_[peer], -1) << "Rank " << peer << " joined twice.";
+      sockets_[peer] = fd;
+    }
+    close(listen_fd);
+  }
+  LOG(INFO) << "Rank " << rank << " connected to " << size - 1 << " peers.";
+}
+
+TCPTransport::~TCPTransport() {
+  for (int i = 0; i < sockets_.size(); ++i) {
+    if (sockets_[i] >= 0) { close(sockets_[i]); }
+  }
+}
+
+int TCPTransport::socket(int peer) const {
+  CHECK_GE(peer, 0);
+  CHECK_LT(peer, sockets_.size());
+  CHECK_NE(peer, rank_) << "Cannot communicate with self.";
+  return sockets_[peer];
+}
+
+void TCPTransport::Send(int peer, const void* data, size_t bytes) {
+  SendAll(socket(peer), data, bytes);
+}
+
+void TCPTransport::Recv(int peer, void* data, size_t bytes) {
+  RecvAll(socket(peer), data, bytes);
+}
+
+void TCPTransport::SendRecv(int dst, const void* send_data, size_t send_bytes,
+    int src, void* recv_data, size_t recv_bytes) {
+  const int send_fd = socket(dst);
+  const int recv_fd = socket(src);
+  const char* send_ptr = static_cast<const char*>(send_data);
+  char* recv_ptr = static_cast<char*>(recv_data);
+  while (send_bytes > 0 || recv_bytes > 0) {
+    pollfd fds[2];
+    int num_fds = 0;
+    if (send_bytes > 0) {
+      fds[num_fds].fd = send_fd;
+      fds[num_fds].events = POLLOUT;
+      ++num_fds;
+    }
+    if (recv_bytes > 0) {
+      if (num_fds > 0 && send_fd == recv_fd) {
+        fds[0].events |= POLLIN;
+      } else {
+        fds[num_fds].fd = recv_fd;
+        fds[num_fds].events = POLLIN;
+        ++num_fds;
+      }
+    }
+    if (poll(fds, num_fds, -1) < 0) {
+      CHECK_EQ(errno, EINTR) << "poll: " << strerror(errno);
+      continue;
+    }
+    for (int i = 0; i < num_fds; ++i) {
+      CHECK(!(fds[i].revents & (POLLERR | POLLNVAL)))
+          << "Socket error while exchanging data.";
+      if (send_bytes > 0 && fds[i].fd == send_fd &&
+          (fds[i].revents & POLLOUT)) {
+        ssize_t n = send(send_fd, send_ptr, send_bytes,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+          send_ptr += n;
+          send_bytes -= n;
+        } else {
+          CHECK(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+              << "send: " << strerror(errno);
+        }
+      }
+      if (recv_bytes > 0 && fds[i].fd == recv_fd &&
+          (fds[i].revents & (POLLIN | POLLHUP))) {
+        ssize_t n = recv(recv_fd, recv_ptr, recv_bytes, MSG_DONTWAIT);
+        CHECK_NE(n, 0) << "Connection closed by peer.";
+        if (n > 0) {
+          recv_ptr += n;
+          recv_bytes -= n;
+        } else {
+          CHECK(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+              << "recv: " << strerror(errno);
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+Collectives<Dtype>::Collectives(shared_ptr<Transport> transport,
+    size_t tree_threshold)
+    : transport_(transport), tree_threshold_(tree_threshold) {
+}
+
+template <typename Dtype>
+void Collectives<Dtype>::AllReduce(Dtype* data, size_t count) {
+  if (size() == 1 || count == 0) { return; }
+  if (count <= tree_threshold_ || count < size()) {
+    TreeAllReduce(data, count);
+  } else {
+    RingAllReduce(data, count);
+  }
+}
+
+template <typename Dtype>
+void Collectives<Dtype>::RingAllReduce(Dtype* data, size_t count) {
+  const int p = size();
+  const int right = (rank() + 1) % p;
+  const int left = (rank() + p - 1) % p;
+  // Segment i covers [offset[i], offset[i + 1]).
+  vector<size_t> offset(p + 1);
+  for (int i = 0; i <= p; ++i) {
+    offset[i] = count / p * i + std::min<size_t>(i, count % p);
+  }
+  buffer_.resize(offset[1] - offset[0]);
+  // Reduce-scatter: after p - 1 steps, rank r holds the sum of segment r + 1.
+  for (int step = 0; step < p - 1; ++step) {
+    const int send_seg = (rank() - step + p) % p;
+    const int recv_seg = (rank() - step - 1 + 2 * p) % p;
+    const size_t recv_count = offset[recv_seg + 1] - offset[recv_seg];
+    transport_->SendRecv(right, data + offset[send_seg],
+        (offset[send_seg + 1] - offset[send_seg]) * sizeof(Dtype),
+        left, &buffer_[0], recv_count * sizeof(Dtype));
+    caffe_axpy<Dtype>(recv_count, Dtype(1), &buffer_[0],
+                      data + offset[recv_seg]);
+  }
+  // Allgather: pass the reduced segments around the ring.
+  for (int step = 0; step < p - 1; ++step) {
+    const int send_seg = (rank() - step + 1 + p) % p;
+    const int recv_seg = (rank() - step + p) % p;
+    transport_->SendRecv(right, data + offset[send_seg],
+        (offset[send_seg + 1] - offset[send_seg]) * sizeof(Dtype),
+        left, data + offset[recv_seg],
+        (offset[recv_seg + 1] - offset[recv_seg]) * sizeof(Dtype));
+  }
+}
+
+template <typename Dtype>
+void Collectives<Dtype>::TreeAllReduce(Dtype* data, size_t count) {
+  // Binomial tree reduce to rank 0...
+  buffer_.resize(count);
+  for (int mask = 1; mask < size(); mask <<= 1) {
+    if (rank() & mask) {
+      transport_->Send(rank() - mask, data, count * sizeof(Dtype));
+      break;
+    }
+    if (rank() + mask < size()) {
+      transport_->Recv(rank() + mask, &buffer_[0], count * sizeof(Dtype));
+      caffe_axpy<Dtype>(count, Dtype(1), &buffer_[0], data);
+    }
+  }
+  // ...and back.
+  Broadcast(data, count, 0);
+}
+
+template <typename Dtype>
+void Collectives<Dtype>::Broadcast(Dtype* data, size_t count, int root) {
+  const int p = size();
+  if (p == 1 || count == 0) { return; }
+  const int relative_rank = (rank() - root + p) % p;
+  int mask = 1;
+  for (; mask < p; mask <<= 1) {
+    if (relative_rank & mask) {
+      transport_->Recv((relative_rank - mask + root) % p, data,
+                       count * sizeof(Dtype));
+      break;
+    }
+  }
+  for (mask >>= 1; mask > 0; mask >>= 1) {
+    if (relative_rank + mask < p) {
+      transport_->Send((relative_rank + mask + root) % p, data,
+                       count * sizeof(Dtype));
+    }
+  }
+}
+
+template <typename Dtype>
+void Collectives<Dtype>::Barrier() {
+  // Dissemination barrier: log(p) rounds of token exchange.
+  const int p = size();
+  const char token = 0;
+  char received;
+  for (int distance = 1; distance < p; distance <<= 1) {
+    transport_->SendRecv((rank() + distance) % p, &token, 1,
+                         (rank() - distance + p) % p, &received, 1);
+  }
+}
+
+INSTANTIATE_CLASS(Collectives);
+
+}  // namespace caffe
@@ -0,0 +1,207 @@
+#ifdef USE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif  // USE_LZ4
+#ifdef USE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif  // USE_ZSTD
+
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/compression.hpp"
+
+namespace caffe {
+
+class DatumCodec::contexts {
+ public:
+#ifdef USE_ZSTD
+  contexts() : cctx(NULL), dctx(NULL), ddict(NULL) { }
+  ~contexts() {
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+    ZSTD_freeDDict(ddict);
+  }
+
+  ZSTD_CCtx* cctx;
+  ZSTD_DCtx* dctx;
+  // Digested once, as every record is decompressed with it.
+  ZSTD_DDict* ddict;
+#endif  // USE_ZSTD
+};
+
+// Appends the uncompressed payload of datum to payload.
+static void AppendPayload(const Datum& datum, string* payload) {
+  if (datum.float_data_size() > 0) {
+    CHECK(datum.data().empty()) << "Datum holds both data and float_data";
+    payload->append(reinterpret_cast<const char*>(datum.float_data().data()),
+        datum.float_data_size() * sizeof(float));
+  } else {
+    payload->append(datum.data());
+  }
+}
+
+DatumCodec::DatumCodec()
+    : contexts_(new contexts()) {
+}
+
+void DatumCodec::set_dictionary(const string& dictionary) {
+  dictionary_ = dictionary;
+#ifdef USE_ZSTD
+  ZSTD_freeDDict(contexts_->ddict);
+  contexts_->ddict = NULL;
+  if (!dictionary_.empty()) {
+    contexts_->ddict = ZSTD_createDDict(dictionary_.data(),
+        dictionary_.size());
+    CHECK(contexts_->ddict) << "Invalid Zstd dictionary";
+  }
+#endif  // USE_ZSTD
+}
+
+void DatumCodec::ReadDictionary(const string& filename) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  CHECK(file.is_open()) << "Failed to open dictionary " << filename;
+  std::ostringstream contents;
+  contents << file.rdbuf();
+  set_dictionary(contents.str());
+}
+
+void DatumCodec::Compress(Datum_Compression type, int level, Datum* datum) {
+  CHECK_EQ(datum->compression(), Datum_Compression_NONE)
+      << "Datum is already compressed";
+  if (type == Datum_Compression_NONE) {
+    return;
+  }
+  buffer_.clear();
+  AppendPayload(*datum, &buffer_);
+  if (buffer_.empty()) {
+    return;
+  }
+  const bool float_payload = datum->float_data_size() > 0;
+  string* out = datum->mutable_data();
+  switch (type) {
+  case Datum_Compression_LZ4: {
+#ifdef USE_LZ4
+    CHECK(dictionary_.empty()) << "Dictionaries are only supported by Zstd";
+    out->resize(LZ4_compressBound(buffer_.size()));
+    int size = level > 0 ?
+        LZ4_compress_HC(buffer_.data(), &(*out)[0], buffer_.size(),
+            out->size(), level) :
+        LZ4_compress_default(buffer_.data(), &(*out)[0], buffer_.size(),
+            out->size());
+    CHECK_GT(size, 0) << "LZ4 compression failed";
+    out->resize(size);
+#else
+    LOG(FATAL) << "LZ4 compression requires Caffe built with USE_LZ4.";
+#endif  // USE_LZ4
+    break;
+  }
+  case Datum_Compression_ZSTD: {
+#ifdef USE_ZSTD
+    if (!contexts_->cctx) {
+      contexts_->cctx = ZSTD_createCCtx();
+    }
+    out->resize(ZSTD_compressBound(buffer_.size()));
+    size_t size = ZSTD_compress_usingDict(contexts_->cctx, &(*out)[0],
+        out->size(), buffer_.data(), buffer_.size(), dictionary_.data(),
+        dictionary_.size(), level);
+    CHECK(!ZSTD_isError(size)) << ZSTD_getErrorName(size);
+    out->resize(size);
+#else
+    LOG(FATAL) << "Zstd compression requires Caffe built with USE_ZSTD.";
+#endif  // USE_ZSTD
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown Datum compression " << type;
+  }
+  datum->clear_float_data();
+  datum->set_compression(type);
+  datum->set_raw_size(buffer_.size());
+  datum->set_float_payload(float_payload);
+}
+
+bool DatumCodec::Decompress(Datum* datum) {
+  if (datum->compression() == Datum_Compression_NONE) {
+    return false;
+  }
+  const string& in = datum->data();
+  buffer_.resize(datum->raw_size());
+  switch (datum->compression()) {
+  case Datum_Compression_LZ4: {
+#ifdef USE_LZ4
+    int size = LZ4_decompress_safe(in.data(), &buffer_[0], in.size(),
+        buffer_.size());
+    CHECK_EQ(size, static_cast<int>(buffer_.size()))
+        << "Corrupt LZ4 Datum payload";
+#else
+    LOG(FATAL) << "LZ4 Datums require Caffe built with USE_LZ4.";
+#endif  // USE_LZ4
+    break;
+  }
+  case Datum_Compression_ZSTD: {
+#ifdef USE_ZSTD
+    if (!contexts_->dctx) {
+      contexts_->dctx = ZSTD_createDCtx();
+    }
+    size_t size = contexts_->ddict ?
+        ZSTD_decompress_usingDDict(contexts_->dctx, &buffer_[0],
+            buffer_.size(), in.data(), in.size(), contexts_->ddict) :
+        ZSTD_decompressDCtx(contexts_->dctx, &buffer_[0], buffer_.size(),
+            in.data(), in.size());
+    CHECK(!ZSTD_isError(size)) << ZSTD_getErrorName(size)
+        << (ZSTD_getDictID_fromFrame(in.data(), in.size()) ?
+            " (the Datum was written with a compression dictionary)" : "");
+    CHECK_EQ(size, buffer_.size()) << "Corrupt Zstd Datum payload";
+#else
+    LOG(FATAL) << "Zstd Datums require Caffe built with USE_ZSTD.";
+#endif  // USE_ZSTD
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown Datum compression " << datum->compression();
+  }
+  if (datum->float_payload()) {
+    const int count = buffer_.size() / sizeof(float);
+    datum->mutable_float_data()->Resize(count, 0);
+    memcpy(datum->mutable_float_data()->mutable_data(), buffer_.data(),
+        buffer_.size());
+    datum->clear_data();
+  } else {
+    // Keep the old buffer around for the next record.
+    datum->mutable_data()->swap(buffer_);
+  }
+  datum->clear_compression();
+  datum->clear_raw_size();
+  datum->clear_float_payload();
+  return true;
+}
+
+string TrainDatumDictionary(const vector<Datum>& samples, size_t dict_size) {
+#ifdef USE_ZSTD
+  string payloads;
+  vector<size_t> sizes;
+  for (int i = 0; i < samples.size(); ++i) {
+    const size_t before = payloads.size();
+    AppendPayload(samples[i], &payloads);
+    sizes.push_back(payloads.size() - before);
+  }
+  CHECK(!payloads.empty()) << "No samples to train a dictionary on";
+  string dictionary(dict_size, 0);
+  size_t size = ZDICT_trainFromBuffer(&dictionary[0], dictionary.size(),
+      payloads.data(), &sizes[0], sizes.size());
+  CHECK(!ZDICT_isError(size)) << "Dictionary training failed: "
+      << ZDICT_getErrorName(size);
+  dictionary.resize(size);
+  return dictionary;
+#else
+  LOG(FATAL) << "Dictionary training requires Caffe built with USE_ZSTD.";
+  return string();
+#endif  // USE_ZSTD
+}
+
+}  // namespace caffe
@@ -3,10 +3,25 @@
 
 #include <sys/stat.h>
 
+#include <algorithm>
 #include <string>
 
 namespace caffe { namespace db {
 
+// Grows the map to at least min_size bytes, in whole megabytes. No
+// transaction may be open in this process.
+static void GrowMapSize(MDB_env* mdb_env, size_t min_size) {
+  struct MDB_envinfo current_info;
+  MDB_CHECK(mdb_env_info(mdb_env, &current_info));
+  if (min_size <= current_info.me_mapsize) {
+    return;
+  }
+  const size_t kMB = 1 << 20;
+  size_t new_size = (min_size + kMB - 1) / kMB * kMB;
+  DLOG(INFO) << "Growing LMDB map size to " << (new_size>>20) << "MB ...";
+  MDB_CHECK(mdb_env_set_mapsize(mdb_env, new_size));
+}
+
 void LMDB::Open(const string& source, Mode mode) {
   MDB_CHECK(mdb_env_create(&mdb_env_));
   if (mode == NEW) {
@@ -15,6 +30,10 @@ void LMDB::Open(const string& source, Mode mode) {
   int flags = 0;
   if (mode == READ) {
     flags = MDB_RDONLY | MDB_NOTLS;
+  } else if (mode == NEW) {
+    // Nobody else has the new database open, so commits can write straight
+    // into the map rather than through malloc'd pages.
+    flags = MDB_WRITEMAP;
   }
   int rc = mdb_env_open(mdb_env_, source.c_str(), flags, 0664);
 #ifndef ALLOW_LMDB_NOLOCK
@@ -48,6 +67,18 @@ LMDBTransaction* LMDB::NewTransaction() {
   return new LMDBTransaction(mdb_env_);
 }
 
+LMDBTransaction* LMDB::NewBulkTransaction(size_t expected_bytes) {
+  if (!bulk_) {
+    // Commits only start flushing the map; Close() waits for the disk.
+    MDB_CHECK(mdb_env_set_flags(mdb_env_, MDB_MAPASYNC, 1));
+    bulk_ = true;
+  }
+  // Appending fills pages completely, so a quarter on top of the data
+  // covers keys, branch pages and the tails of overflow pages.
+  GrowMapSize(mdb_env_, expected_bytes + expected_bytes / 4);
+  return new LMDBTransaction(mdb_env_, true);
+}
+
 void LMDBTransaction::Put(const string& key, const string& value) {
   keys.push_back(key);
   values.push_back(value);
@@ -58,6 +89,8 @@ void LMDBTransaction::Commit() {
   MDB_val mdb_key, mdb_data;
   MDB_txn *mdb_txn;
 
+  ReserveMapSize();
+
   // Initialize MDB variables
   MDB_CHECK(mdb_txn_begin(mdb_env_, NULL, 0, &mdb_txn));
   MDB_CHECK(mdb_dbi_open(mdb_txn, NULL, 0, &mdb_dbi));
@@ -69,7 +102,14 @@ void LMDBTransaction::Commit() {
     mdb_data.mv_data = const_cast<char*>(values[i].data());
 
     // Add data to the transaction
-    int put_rc = mdb_put(mdb_txn, mdb_dbi, &mdb_key, &mdb_data, 0);
+    int put_rc = mdb_put(mdb_txn, mdb_dbi, &mdb_key, &mdb_data,
+        append_ ? MDB_APPEND : 0);
+    if (put_rc == MDB_KEYEXIST && append_) {
+      LOG(WARNING) << "LMDB bulk load got key " << keys[i]
+          << " out of order; falling back to ordinary puts.";
+      append_ = false;
+      put_rc = mdb_put(mdb_txn, mdb_dbi, &mdb_key, &mdb_data, 0);
+    }
     if (put_rc == MDB_MAP_FULL) {
       // Out of memory - double the map size and retry
       mdb_txn_abort(mdb_txn);
@@ -100,6 +140,26 @@ void LMDBTransaction::Commit() {
   values.clear();
 }
 
+void LMDBTransaction::ReserveMapSize() {
+  // Make room for the whole commit up front instead of failing and
+  // replaying it after each doubling.
+  size_t pending = 0;
+  for (int i = 0; i < keys.size(); ++i) {
+    pending += keys[i].size() + values[i].size();
+  }
+  struct MDB_envinfo current_info;
+  struct MDB_stat current_stat;
+  MDB_CHECK(mdb_env_info(mdb_env_, &current_info));
+  MDB_CHECK(mdb_env_stat(mdb_env_, &current_stat));
+  size_t used = (current_info.me_last_pgno + 1) *
+      static_cast<size_t>(current_stat.ms_psize);
+  // Random inserts leave pages about half full.
+  size_t needed = used + 2 * pending;
+  if (needed > current_info.me_mapsize) {
+    GrowMapSize(mdb_env_, std::max(needed, 2 * current_info.me_mapsize));
+  }
+}
+
 void LMDBTransaction::DoubleMapSize() {
   struct MDB_envinfo current_info;
   MDB_CHECK(mdb_env_info(mdb_env_, &current_info));
@@ -17,6 +17,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/compression.hpp"
 #include "caffe/util/io.hpp"
 
 const int kProtoReadBytesLimit = INT_MAX;  // Max size of 2 GB minus 1 byte.
@@ -49,12 +50,20 @@ void WriteProtoToTextFile(const Message& proto, const char* filename) {
   close(fd);
 }
 
+void SetProtoReadBytesLimit(CodedInputStream* input) {
+#if GOOGLE_PROTOBUF_VERSION >= 3006000
+  input->SetTotalBytesLimit(kProtoReadBytesLimit);
+#else
+  input->SetTotalBytesLimit(kProtoReadBytesLimit, 536870912);
+#endif
+}
+
 bool ReadProtoFromBinaryFile(const char* filename, Message* proto) {
   int fd = open(filename, O_RDONLY);
   CHECK_NE(fd, -1) << "File not found: " << filename;
   ZeroCopyInputStream* raw_input = new FileInputStream(fd);
   CodedInputStream* coded_input = new CodedInputStream(raw_input);
-  coded_input->SetTotalBytesLimit(kProtoReadBytesLimit, 536870912);
+  SetProtoReadBytesLimit(coded_input);
 
   bool success = proto->ParseFromCodedStream(coded_input);
 
@@ -164,6 +173,11 @@ bool ReadFileToDatum(const string& filename, const int label,
 
 #ifdef USE_OPENCV
 cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
+  if (datum.compression() != Datum_Compression_NONE) {
+    Datum raw(datum);
+    DatumCodec().Decompress(&raw);
+    return DecodeDatumToCVMatNative(raw);
+  }
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
@@ -175,6 +189,11 @@ cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
   return cv_img;
 }
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
+  if (datum.compression() != Datum_Compression_NONE) {
+    Datum raw(datum);
+    DatumCodec().Decompress(&raw);
+    return DecodeDatumToCVMat(raw, is_color);
+  }
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
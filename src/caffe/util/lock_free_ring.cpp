@@ -0,0 +1,158 @@
+#include <stdint.h>
+
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/lock_free_ring.hpp"
+
+namespace caffe {
+
+// Positions written by different threads live on separate cache lines.
+static const int kCacheLine = 64;
+// How long a blocked push or pop spins, then yields, before it sleeps.
+static const int kSpins = 64;
+static const int kYields = 64;
+static const int kSleepMicroseconds = 50;
+
+template <typename T>
+class LockFreeRing<T>::slots {
+ public:
+  struct Slot {
+    boost::atomic<size_t> sequence;
+    T value;
+  };
+
+  explicit slots(size_t capacity)
+      : mask(capacity - 1), ring(new Slot[capacity]), push_position(0),
+        pop_position(0) {
+    for (size_t i = 0; i < capacity; ++i) {
+      ring[i].sequence.store(i, boost::memory_order_relaxed);
+    }
+  }
+
+  const size_t mask;
+  boost::scoped_array<Slot> ring;
+  char pad0[kCacheLine];
+  boost::atomic<size_t> push_position;
+  char pad1[kCacheLine];
+  boost::atomic<size_t> pop_position;
+  char pad2[kCacheLine];
+};
+
+// Waits a little longer on every call, and lets the thread be interrupted.
+static void Backoff(int* attempt) {
+  if (*attempt < kSpins) {
+    ++*attempt;
+    return;
+  }
+  boost::this_thread::interruption_point();
+  if (*attempt < kSpins + kYields) {
+    ++*attempt;
+    boost::this_thread::yield();
+  } else {
+    boost::this_thread::sleep(
+        boost::posix_time::microseconds(kSleepMicroseconds));
+  }
+}
+
+template <typename T>
+LockFreeRing<T>::LockFreeRing(int capacity) {
+  CHECK_GT(capacity, 0);
+  size_t size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+  slots_.reset(new slots(size));
+}
+
+template <typename T>
+bool LockFreeRing<T>::try_push(const T& t) {
+  typename slots::Slot* slot;
+  size_t position = slots_->push_position.load(boost::memory_order_relaxed);
+  while (true) {
+    slot = &slots_->ring[position & slots_->mask];
+    const size_t sequence = slot->sequence.load(boost::memory_order_acquire);
+    const intptr_t lag = static_cast<intptr_t>(sequence) -
+        static_cast<intptr_t>(position);
+    if (lag == 0) {
+      // The slot is free: claim it.
+      if (slots_->push_position.compare_exchange_weak(position, position + 1,
+          boost::memory_order_relaxed)) {
+        break;
+      }
+    } else if (lag < 0) {
+      // The slot still holds the value of a lap ago: the ring is full.
+      return false;
+    } else {
+      position = slots_->push_position.load(boost::memory_order_relaxed);
+    }
+  }
+  slot->value = t;
+  slot->sequence.store(position + 1, boost::memory_order_release);
+  return true;
+}
+
+template <typename T>
+bool LockFreeRing<T>::try_pop(T* t) {
+  typename slots::Slot* slot;
+  size_t position = slots_->pop_position.load(boost::memory_order_relaxed);
+  while (true) {
+    slot = &slots_->ring[position & slots_->mask];
+    const size_t sequence = slot->sequence.load(boost::memory_order_acquire);
+    const intptr_t lag = static_cast<intptr_t>(sequence) -
+        static_cast<intptr_t>(position + 1);
+    if (lag == 0) {
+      if (slots_->pop_position.compare_exchange_weak(position, position + 1,
+          boost::memory_order_relaxed)) {
+        break;
+      }
+    } else if (lag < 0) {
+      // Nothing was pushed to the slot yet: the ring is empty.
+      return false;
+    } else {
+      position = slots_->pop_position.load(boost::memory_order_relaxed);
+    }
+  }
+  *t = slot->value;
+  // Hand the slot over to the push of the next lap.
+  slot->sequence.store(position + slots_->mask + 1,
+      boost::memory_order_release);
+  return true;
+}
+
+template <typename T>
+void LockFreeRing<T>::push(const T& t) {
+  for (int attempt = 0; !try_push(t); ) {
+    Backoff(&attempt);
+  }
+}
+
+template <typename T>
+T LockFreeRing<T>::pop() {
+  T t;
+  for (int attempt = 0; !try_pop(&t); ) {
+    Backoff(&attempt);
+  }
+  return t;
+}
+
+template <typename T>
+int LockFreeRing<T>::size() const {
+  const size_t pushed =
+      slots_->push_position.load(boost::memory_order_relaxed);
+  const size_t popped = slots_->pop_position.load(boost::memory_order_relaxed);
+  return pushed > popped ? pushed - popped : 0;
+}
+
+template <typename T>
+int LockFreeRing<T>::capacity() const {
+  return slots_->mask + 1;
+}
+
+template class LockFreeRing<Batch<float>*>;
+template class LockFreeRing<Batch<double>*>;
+template class LockFreeRing<int>;
+
+}  // namespace caffe
@@ -1,10 +1,12 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -104,6 +106,202 @@ template void caffe_copy<unsigned int>(const int N, const unsigned int* X,
 template void caffe_copy<float>(const int N, const float* X, float* Y);
 template void caffe_copy<double>(const int N, const double* X, double* Y);
 
+template <typename Dtype>
+void caffe_copy_strided(const vector<int>& shape, const Dtype* X,
+    const vector<int>& x_strides, Dtype* Y, const vector<int>& y_strides) {
+  CHECK_EQ(shape.size(), x_strides.size());
+  CHECK_EQ(shape.size(), y_strides.size());
+  const int num_axes = shape.size();
+  if (num_axes == 0) {
+    *Y = *X;
+    return;
+  }
+  int count = 1;
+  for (int i = 0; i < num_axes; ++i) {
+    count *= shape[i];
+  }
+  if (count == 0) { return; }
+  // Copy row by row along the last axis, counting through the others.
+  const int last = num_axes - 1;
+  const int row = shape[last];
+  const bool dense_rows = x_strides[last] == 1 && y_strides[last] == 1;
+  vector<int> indices(last, 0);
+  for (int r = 0; r < count / row; ++r) {
+    int x_offset = 0;
+    int y_offset = 0;
+    for (int i = 0; i < last; ++i) {
+      x_offset += indices[i] * x_strides[i];
+      y_offset += indices[i] * y_strides[i];
+    }
+    if (dense_rows) {
+      caffe_copy(row, X + x_offset, Y + y_offset);
+    } else {
+      for (int j = 0; j < row; ++j) {
+        Y[y_offset + j * y_strides[last]] = X[x_offset + j * x_strides[last]];
+      }
+    }
+    for (int i = last - 1; i >= 0 && ++indices[i] == shape[i]; --i) {
+      indices[i] = 0;
+    }
+  }
+}
+
+template void caffe_copy_strided<float>(const vector<int>& shape,
+    const float* X, const vector<int>& x_strides, float* Y,
+    const vector<int>& y_strides);
+template void caffe_copy_strided<double>(const vector<int>& shape,
+    const double* X, const vector<int>& x_strides, double* Y,
+    const vector<int>& y_strides);
+
+// Arrays smaller than this are not worth waking up OpenMP threads for.
+static const int kParallelMinCount = 1 << 16;
+// Reductions over a contiguous middle axis accumulate blocks of it at once.
+static const int kReduceBlock = 256;
+
+template <typename Dtype>
+void caffe_cpu_broadcast_add(const int outer, const int dim, const int inner,
+    const Dtype* X, const Dtype alpha, const Dtype* b, Dtype* Y) {
+  if (inner == 1) {
+#ifdef _OPENMP
+#pragma omp parallel for if (outer * dim * inner >= kParallelMinCount)
+#endif
+    for (int o = 0; o < outer; ++o) {
+      const Dtype* x = X + o * dim;
+      Dtype* y = Y + o * dim;
+      for (int d = 0; d < dim; ++d) {
+        y[d] = x[d] + alpha * b[d];
+      }
+    }
+    return;
+  }
+#ifdef _OPENMP
+#pragma omp parallel for if (outer * dim * inner >= kParallelMinCount)
+#endif
+  for (int row = 0; row < outer * dim; ++row) {
+    const Dtype value = alpha * b[row % dim];
+    const Dtype* x = X + row * inner;
+    Dtype* y = Y + row * inner;
+    for (int i = 0; i < inner; ++i) {
+      y[i] = x[i] + value;
+    }
+  }
+}
+
+template void caffe_cpu_broadcast_add<float>(const int outer, const int dim,
+    const int inner, const float* X, const float alpha, const float* b,
+    float* Y);
+template void caffe_cpu_broadcast_add<double>(const int outer, const int dim,
+    const int inner, const double* X, const double alpha, const double* b,
+    double* Y);
+
+template <typename Dtype>
+void caffe_cpu_broadcast_mul(const int outer, const int dim, const int inner,
+    const Dtype* X, const Dtype* b, Dtype* Y) {
+  if (inner == 1) {
+#ifdef _OPENMP
+#pragma omp parallel for if (outer * dim * inner >= kParallelMinCount)
+#endif
+    for (int o = 0; o < outer; ++o) {
+      const Dtype* x = X + o * dim;
+      Dtype* y = Y + o * dim;
+      for (int d = 0; d < dim; ++d) {
+        y[d] = x[d] * b[d];
+      }
+    }
+    return;
+  }
+#ifdef _OPENMP
+#pragma omp parallel for if (outer * dim * inner >= kParallelMinCount)
+#endif
+  for (int row = 0; row < outer * dim; ++row) {
+    const Dtype value = b[row % dim];
+    const Dtype* x = X + row * inner;
+    Dtype* y = Y + row * inner;
+    for (int i = 0; i < inner; ++i) {
+      y[i] = x[i] * value;
+    }
+  }
+}
+
+template void caffe_cpu_broadcast_mul<float>(const int outer, const int dim,
+    const int inner, const float* X, const float* b, float* Y);
+template void caffe_cpu_broadcast_mul<double>(const int outer, const int dim,
+    const int inner, const double* X, const double* b, double* Y);
+
+// Sums X, or X * Z when kDot, over the outer and inner axes. y is only read
+// when beta is nonzero, as in BLAS.
+template <typename Dtype, bool kDot>
+static void caffe_cpu_reduce(const int outer, const int dim, const int inner,
+    const Dtype alpha, const Dtype* X, const Dtype* Z, const Dtype beta,
+    Dtype* y) {
+  if (inner == 1) {
+    // Accumulate a block of the contiguous axis row by row.
+    const int blocks = (dim + kReduceBlock - 1) / kReduceBlock;
+#ifdef _OPENMP
+#pragma omp parallel for if (outer * dim * inner >= kParallelMinCount)
+#endif
+    for (int block = 0; block < blocks; ++block) {
+      const int begin = block * kReduceBlock;
+      const int size = std::min(kReduceBlock, dim - begin);
+      Dtype sum[kReduceBlock] = {0};
+      for (int o = 0; o < outer; ++o) {
+        const Dtype* x = X + o * dim + begin;
+        const Dtype* z = kDot ? Z + o * dim + begin : NULL;
+        for (int d = 0; d < size; ++d) {
+          sum[d] += kDot ? x[d] * z[d] : x[d];
+        }
+      }
+      for (int d = 0; d < size; ++d) {
+        y[begin + d] = alpha * sum[d] +
+            (beta == 0 ? Dtype(0) : beta * y[begin + d]);
+      }
+    }
+    return;
+  }
+#ifdef _OPENMP
+#pragma omp parallel for if (outer * dim * inner >= kParallelMinCount)
+#endif
+  for (int d = 0; d < dim; ++d) {
+    Dtype sum = 0;
+    for (int o = 0; o < outer; ++o) {
+      const int offset = (o * dim + d) * inner;
+      const Dtype* x = X + offset;
+      const Dtype* z = kDot ? Z + offset : NULL;
+      for (int i = 0; i < inner; ++i) {
+        sum += kDot ? x[i] * z[i] : x[i];
+      }
+    }
+    y[d] = alpha * sum + (beta == 0 ? Dtype(0) : beta * y[d]);
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_reduce_sum(const int outer, const int dim, const int inner,
+    const Dtype alpha, const Dtype* X, const Dtype beta, Dtype* y) {
+  caffe_cpu_reduce<Dtype, false>(outer, dim, inner, alpha, X, NULL, beta, y);
+}
+
+template void caffe_cpu_reduce_sum<float>(const int outer, const int dim,
+    const int inner, const float alpha, const float* X, const float beta,
+    float* y);
+template void caffe_cpu_reduce_sum<double>(const int outer, const int dim,
+    const int inner, const double alpha, const double* X, const double beta,
+    double* y);
+
+template <typename Dtype>
+void caffe_cpu_reduce_dot(const int outer, const int dim, const int inner,
+    const Dtype alpha, const Dtype* X, const Dtype* Z, const Dtype beta,
+    Dtype* y) {
+  caffe_cpu_reduce<Dtype, true>(outer, dim, inner, alpha, X, Z, beta, y);
+}
+
+template void caffe_cpu_reduce_dot<float>(const int outer, const int dim,
+    const int inner, const float alpha, const float* X, const float* Z,
+    const float beta, float* y);
+template void caffe_cpu_reduce_dot<double>(const int outer, const int dim,
+    const int inner, const double alpha, const double* X, const double* Z,
+    const double beta, double* y);
+
 template <>
 void caffe_scal<float>(const int N, const float alpha, float *X) {
   cblas_sscal(N, alpha, X, 1);
@@ -335,6 +533,63 @@ void caffe_rng_bernoulli<double>(const int n, const double p, unsigned int* r);
 template
 void caffe_rng_bernoulli<float>(const int n, const float p, unsigned int* r);
 
+uint64_t caffe_philox_key() {
+  const uint64_t high = caffe_rng_rand();
+  return (high << 32) | caffe_rng_rand();
+}
+
+template <typename Dtype>
+void caffe_philox_uniform(const int n, const Dtype a, const Dtype b,
+                          Dtype* r) {
+  philox_uniform(caffe_philox_key(), 0, n, a, b, r);
+}
+
+template
+void caffe_philox_uniform<float>(const int n, const float a, const float b,
+                                 float* r);
+
+template
+void caffe_philox_uniform<double>(const int n, const double a,
+                                  const double b, double* r);
+
+template <typename Dtype>
+void caffe_philox_gaussian(const int n, const Dtype mu, const Dtype sigma,
+                           Dtype* r) {
+  philox_gaussian(caffe_philox_key(), 0, n, mu, sigma, r);
+}
+
+template
+void caffe_philox_gaussian<float>(const int n, const float mu,
+                                  const float sigma, float* r);
+
+template
+void caffe_philox_gaussian<double>(const int n, const double mu,
+                                   const double sigma, double* r);
+
+template <typename Dtype>
+void caffe_philox_bernoulli(const int n, const Dtype p, int* r) {
+  philox_bernoulli(caffe_philox_key(), 0, n, p, r);
+}
+
+template
+void caffe_philox_bernoulli<float>(const int n, const float p, int* r);
+
+template
+void caffe_philox_bernoulli<double>(const int n, const double p, int* r);
+
+template <typename Dtype>
+void caffe_philox_bernoulli(const int n, const Dtype p, unsigned int* r) {
+  philox_bernoulli(caffe_philox_key(), 0, n, p, r);
+}
+
+template
+void caffe_philox_bernoulli<float>(const int n, const float p,
+                                   unsigned int* r);
+
+template
+void caffe_philox_bernoulli<double>(const int n, const double p,
+                                    unsigned int* r);
+
 template <>
 float caffe_cpu_strided_dot<float>(const int n, const float* x, const int incx,
     const float* y, const int incy) {
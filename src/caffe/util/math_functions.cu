@@ -5,6 +5,7 @@
 
 #include <cmath>
 
+#include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -80,6 +81,60 @@ void caffe_gpu_memcpy(const size_t N, const void* X, void* Y) {
   }
 }
 
+// The shape and strides of caffe_gpu_copy_strided, passed by value.
+struct StridedLayout {
+  int num_axes;
+  int shape[kMaxBlobAxes];
+  int x_strides[kMaxBlobAxes];
+  int y_strides[kMaxBlobAxes];
+};
+
+template <typename Dtype>
+__global__ void copy_strided_kernel(const int n, const StridedLayout layout,
+    const Dtype* x, Dtype* y) {
+  CUDA_KERNEL_LOOP(index, n) {
+    int remaining = index;
+    int x_index = 0;
+    int y_index = 0;
+    for (int i = layout.num_axes - 1; i >= 0; --i) {
+      const int coord = remaining % layout.shape[i];
+      remaining /= layout.shape[i];
+      x_index += coord * layout.x_strides[i];
+      y_index += coord * layout.y_strides[i];
+    }
+    y[y_index] = x[x_index];
+  }
+}
+
+template <typename Dtype>
+void caffe_gpu_copy_strided(const vector<int>& shape, const Dtype* X,
+    const vector<int>& x_strides, Dtype* Y, const vector<int>& y_strides) {
+  CHECK_EQ(shape.size(), x_strides.size());
+  CHECK_EQ(shape.size(), y_strides.size());
+  CHECK_LE(shape.size(), kMaxBlobAxes);
+  StridedLayout layout;
+  layout.num_axes = shape.size();
+  int n = 1;
+  for (int i = 0; i < shape.size(); ++i) {
+    layout.shape[i] = shape[i];
+    layout.x_strides[i] = x_strides[i];
+    layout.y_strides[i] = y_strides[i];
+    n *= shape[i];
+  }
+  if (n == 0) { return; }
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  copy_strided_kernel<Dtype><<<CAFFE_GET_BLOCKS(n), CAFFE_CUDA_NUM_THREADS>>>(
+      n, layout, X, Y);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template void caffe_gpu_copy_strided<float>(const vector<int>& shape,
+    const float* X, const vector<int>& x_strides, float* Y,
+    const vector<int>& y_strides);
+template void caffe_gpu_copy_strided<double>(const vector<int>& shape,
+    const double* X, const vector<int>& x_strides, double* Y,
+    const vector<int>& y_strides);
+
 template <>
 void caffe_gpu_scal<float>(const int N, const float alpha, float *X) {
   CUBLAS_CHECK(cublasSscal(Caffe::cublas_handle(), N, &alpha, X, 1));
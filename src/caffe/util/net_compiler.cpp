@@ -0,0 +1,689 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/layer.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/net_compiler.hpp"
+
+namespace caffe {
+
+// Offsets into the arena are rounded up to a cache line of floats.
+static const int kAlignment = 16;
+
+// The kernel, stride, padding and dilation of a 2D convolution, as
+// BaseConvolutionLayer reads them.
+struct ConvolutionGeometry {
+  explicit ConvolutionGeometry(const ConvolutionParameter& param) {
+    for (int i = 0; i < 2; ++i) {
+      if (param.has_kernel_h()) {
+        kernel[i] = i == 0 ? param.kernel_h() : param.kernel_w();
+      } else {
+        kernel[i] = param.kernel_size(param.kernel_size_size() == 1 ? 0 : i);
+      }
+      if (param.has_stride_h()) {
+        stride[i] = i == 0 ? param.stride_h() : param.stride_w();
+      } else {
+        stride[i] = param.stride_size() == 0 ? 1 :
+            param.stride(param.stride_size() == 1 ? 0 : i);
+      }
+      if (param.has_pad_h()) {
+        pad[i] = i == 0 ? param.pad_h() : param.pad_w();
+      } else {
+        pad[i] = param.pad_size() == 0 ? 0 :
+            param.pad(param.pad_size() == 1 ? 0 : i);
+      }
+      dilation[i] = param.dilation_size() == 0 ? 1 :
+          param.dilation(param.dilation_size() == 1 ? 0 : i);
+    }
+  }
+  bool is_1x1() const {
+    return kernel[0] == 1 && kernel[1] == 1 && stride[0] == 1 &&
+        stride[1] == 1 && pad[0] == 0 && pad[1] == 0;
+  }
+
+  int kernel[2];
+  int stride[2];
+  int pad[2];
+  int dilation[2];
+};
+
+// The kernel, stride and padding of a pooling, as PoolingLayer reads them.
+struct PoolingGeometry {
+  PoolingGeometry(const PoolingParameter& param, const vector<int>& shape) {
+    if (param.global_pooling()) {
+      kernel[0] = shape[2];
+      kernel[1] = shape[3];
+    } else if (param.has_kernel_size()) {
+      kernel[0] = kernel[1] = param.kernel_size();
+    } else {
+      kernel[0] = param.kernel_h();
+      kernel[1] = param.kernel_w();
+    }
+    if (param.has_pad_h()) {
+      pad[0] = param.pad_h();
+      pad[1] = param.pad_w();
+    } else {
+      pad[0] = pad[1] = param.pad();
+    }
+    if (param.has_stride_h()) {
+      stride[0] = param.stride_h();
+      stride[1] = param.stride_w();
+    } else {
+      stride[0] = stride[1] = param.stride();
+    }
+  }
+
+  int kernel[2];
+  int stride[2];
+  int pad[2];
+};
+
+static int Count(const vector<int>& shape, int start, int end) {
+  int count = 1;
+  for (int i = start; i < end; ++i) {
+    count *= shape[i];
+  }
+  return count;
+}
+
+static int Count(const vector<int>& shape) {
+  return Count(shape, 0, shape.size());
+}
+
+static void CopyData(const Blob<float>& blob, vector<float>* data) {
+  data->assign(blob.cpu_data(), blob.cpu_data() + blob.count());
+}
+
+// A C++ identifier made of the characters of name that can be in one.
+static string Identifier(const string& name) {
+  string identifier = name;
+  for (int i = 0; i < identifier.size(); ++i) {
+    if (!isalnum(identifier[i])) {
+      identifier[i] = '_';
+    }
+  }
+  if (identifier.empty() || isdigit(identifier[0])) {
+    identifier = "_" + identifier;
+  }
+  return identifier;
+}
+
+static string StringLiteral(const string& s) {
+  string literal = "\"";
+  for (int i = 0; i < s.size(); ++i) {
+    if (s[i] == '"' || s[i] == '\\') {
+      literal += '\\';
+    }
+    literal += s[i];
+  }
+  return literal + "\"";
+}
+
+// A float literal that reads back as f exactly.
+static string FloatLiteral(float f) {
+  CHECK(!isnan(f) && !isinf(f)) << "Cannot compile the weight " << f;
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.9g", f);
+  string literal = buffer;
+  if (literal.find_first_of(".e") == string::npos) {
+    literal += '.';
+  }
+  return literal + 'f';
+}
+
+static string ActivationName(const string& activation) {
+  if (activation.empty()) {
+    return "rt::kIdentity";
+  }
+  return activation == "ReLU" ? "rt::kReLU" :
+      activation == "Sigmoid" ? "rt::kSigmoid" : "rt::kTanH";
+}
+
+static void WriteArray(const string& name, const vector<float>& data,
+    std::ostream* os) {
+  *os << "const float " << name << "[" << data.size() << "] = {";
+  for (int i = 0; i < data.size(); ++i) {
+    *os << (i % 8 == 0 ? "\n  " : " ") << FloatLiteral(data[i]) << ",";
+  }
+  *os << "\n};\n";
+}
+
+NetCompiler::NetCompiler(const Net<float>& net) : arena_size_(0) {
+  // The value each blob holds at this point of the forward pass.
+  map<const Blob<float>*, int> current;
+  for (int i = 0; i < net.layers().size(); ++i) {
+    Layer<float>* layer = net.layers()[i].get();
+    const string type = layer->type();
+    const bool alias = type == "Reshape" || type == "Flatten" ||
+        type == "Split" || type == "Dropout";
+    vector<int> bottoms;
+    for (int j = 0; j < net.bottom_vecs()[i].size(); ++j) {
+      bottoms.push_back(current[net.bottom_vecs()[i][j]]);
+    }
+    vector<int> tops;
+    for (int j = 0; j < net.top_vecs()[i].size(); ++j) {
+      const Blob<float>* blob = net.top_vecs()[i][j];
+      const int root = alias ? values_[bottoms[0]].root : values_.size();
+      tops.push_back(AddValue(net.blob_names()[net.top_ids(i)[j]],
+          blob->shape(), root));
+      current[blob] = tops.back();
+      if (alias) {
+        ++values_[bottoms[0]].consumers;
+      }
+    }
+    if (type == "Input") {
+      inputs_.insert(inputs_.end(), tops.begin(), tops.end());
+    } else if (!alias) {
+      AddStep(layer, bottoms, tops);
+    }
+  }
+  for (int i = 0; i < net.output_blobs().size(); ++i) {
+    outputs_.push_back(current[net.output_blobs()[i]]);
+    ++values_[outputs_.back()].consumers;
+  }
+  Fuse();
+  PlanMemory();
+}
+
+int NetCompiler::AddValue(const string& name, const vector<int>& shape,
+    int root) {
+  Value value;
+  value.name = name;
+  value.shape = shape;
+  value.root = root;
+  value.consumers = 0;
+  value.offset = -1;
+  values_.push_back(value);
+  return values_.size() - 1;
+}
+
+void NetCompiler::AddStep(Layer<float>* layer, const vector<int>& bottoms,
+    const vector<int>& tops) {
+  const LayerParameter& param = layer->layer_param();
+  const string type = layer->type();
+  Step step;
+  step.type = type;
+  step.layers.push_back(param.name());
+  step.param = param;
+  step.axis = 1;
+  step.bottoms = bottoms;
+  step.tops = tops;
+  step.slope = 0;
+  step.scratch = -1;
+  const vector<int>& shape = values_[bottoms[0]].shape;
+  const int num_axes = shape.size();
+  if (type == "Convolution") {
+    CHECK_EQ(num_axes, 4) << "Can only compile 2D convolutions: "
+        << param.name();
+    const int axis = param.convolution_param().axis();
+    CHECK_EQ(1, axis < 0 ? axis + num_axes : axis) << "Can only compile "
+        << "convolutions along the channel axis: " << param.name();
+    CopyData(*layer->blobs()[0], &step.weight);
+    if (param.convolution_param().bias_term()) {
+      CopyData(*layer->blobs()[1], &step.bias);
+    }
+    const ConvolutionGeometry geometry(param.convolution_param());
+    if (!geometry.is_1x1()) {
+      const vector<int>& top_shape = values_[tops[0]].shape;
+      vector<int> col_shape(2);
+      col_shape[0] = shape[1] * geometry.kernel[0] * geometry.kernel[1];
+      col_shape[1] = top_shape[2] * top_shape[3];
+      step.scratch = AddValue(param.name() + " columns", col_shape,
+          values_.size());
+    }
+  } else if (type == "InnerProduct") {
+    const int axis = param.inner_product_param().axis();
+    step.axis = axis < 0 ? axis + num_axes : axis;
+    CopyData(*layer->blobs()[0], &step.weight);
+    if (param.inner_product_param().bias_term()) {
+      CopyData(*layer->blobs()[1], &step.bias);
+    }
+  } else if (type == "Pooling") {
+    const PoolingParameter::PoolMethod method = param.pooling_param().pool();
+    CHECK(method == PoolingParameter_PoolMethod_AVE ||
+        (method == PoolingParameter_PoolMethod_MAX && tops.size() == 1))
+        << "Can only compile average and max pooling without mask: "
+        << param.name();
+  } else if (type == "ReLU" || type == "Sigmoid" || type == "TanH") {
+    step.type = "Activation";
+    step.activation = type;
+    step.slope = type == "ReLU" ? param.relu_param().negative_slope() : 0;
+  } else if (type == "Softmax") {
+    const int axis = param.softmax_param().axis();
+    step.axis = axis < 0 ? axis + num_axes : axis;
+  } else if (type == "BatchNorm") {
+    CHECK(param.batch_norm_param().use_global_stats() ||
+        (!param.batch_norm_param().has_use_global_stats() &&
+         param.phase() == TEST)) << "Can only compile batch normalization "
+        << "with global statistics: " << param.name();
+    CHECK_GT(num_axes, 1) << "Cannot compile " << param.name();
+    step.type = "Affine";
+    const float factor = layer->blobs()[2]->cpu_data()[0];
+    const float scale = factor == 0 ? 0 : 1 / factor;
+    const float eps = param.batch_norm_param().eps();
+    const float* mean = layer->blobs()[0]->cpu_data();
+    const float* variance = layer->blobs()[1]->cpu_data();
+    for (int c = 0; c < shape[1]; ++c) {
+      step.weight.push_back(1 / std::sqrt(variance[c] * scale + eps));
+      step.bias.push_back(-mean[c] * scale * step.weight.back());
+    }
+  } else if (type == "Scale" || type == "Bias") {
+    CHECK_EQ(bottoms.size(), 1) << "Can only compile " << type
+        << " layers with learned parameters: " << param.name();
+    step.type = "Affine";
+    const int axis = type == "Scale" ? param.scale_param().axis() :
+        param.bias_param().axis();
+    step.axis = axis < 0 ? axis + num_axes : axis;
+    if (type == "Scale") {
+      CopyData(*layer->blobs()[0], &step.weight);
+      if (param.scale_param().bias_term()) {
+        CopyData(*layer->blobs()[1], &step.bias);
+      }
+    } else {
+      CopyData(*layer->blobs()[0], &step.bias);
+    }
+  } else if (type == "Eltwise") {
+    const EltwiseParameter& eltwise = param.eltwise_param();
+    for (int i = 0; i < bottoms.size(); ++i) {
+      step.weight.push_back(eltwise.coeff_size() ? eltwise.coeff(i) : 1);
+    }
+  } else if (type == "Concat") {
+    const ConcatParameter& concat = param.concat_param();
+    const int axis = concat.has_concat_dim() ? concat.concat_dim() :
+        concat.axis();
+    step.axis = axis < 0 ? axis + num_axes : axis;
+  } else {
+    LOG(FATAL) << "Cannot compile layer " << param.name() << " of type "
+        << type;
+  }
+  for (int i = 0; i < bottoms.size(); ++i) {
+    ++values_[bottoms[i]].consumers;
+  }
+  steps_.push_back(step);
+}
+
+void NetCompiler::Fuse() {
+  // The step producing each value, while steps are fused.
+  vector<int> producer(values_.size(), -1);
+  vector<bool> fused(steps_.size(), false);
+  for (int i = 0; i < steps_.size(); ++i) {
+    Step& step = steps_[i];
+    const int value = step.bottoms[0];
+    const int p = producer[value];
+    bool fuse = false;
+    if ((step.type == "Affine" || step.type == "Activation") && p >= 0 &&
+        values_[value].root == value && values_[value].consumers == 1 &&
+        steps_[p].activation.empty()) {
+      Step& previous = steps_[p];
+      const int channels = std::max(step.weight.size(), step.bias.size());
+      const vector<int>& shape = values_[value].shape;
+      if (step.type == "Activation") {
+        fuse = previous.type == "Convolution" ||
+            previous.type == "InnerProduct" || previous.type == "Affine" ||
+            previous.type == "Eltwise";
+        if (fuse) {
+          previous.activation = step.activation;
+          previous.slope = step.slope;
+        }
+      } else if ((previous.type == "Convolution" && step.axis == 1) ||
+          (previous.type == "InnerProduct" && step.axis == previous.axis)) {
+        // Scale the outputs of the layer by scaling its weights.
+        fuse = channels == shape[step.axis] &&
+            (previous.type == "Convolution" ||
+             Count(shape, step.axis + 1, shape.size()) == 1);
+        if (fuse) {
+          const bool transpose = previous.type == "InnerProduct" &&
+              previous.param.inner_product_param().transpose();
+          const int inner = previous.weight.size() / channels;
+          previous.bias.resize(channels, 0);
+          for (int c = 0; c < channels; ++c) {
+            const float scale = step.weight.empty() ? 1 : step.weight[c];
+            const float shift = step.bias.empty() ? 0 : step.bias[c];
+            for (int j = 0; j < inner; ++j) {
+              previous.weight[transpose ? j * channels + c : c * inner + j] *=
+                  scale;
+            }
+            previous.bias[c] = previous.bias[c] * scale + shift;
+          }
+        }
+      } else if (previous.type == "Affine" && step.axis == previous.axis &&
+          channels == std::max(previous.weight.size(),
+              previous.bias.size())) {
+        fuse = true;
+        previous.weight.resize(channels, 1);
+        previous.bias.resize(channels, 0);
+        for (int c = 0; c < channels; ++c) {
+          const float scale = step.weight.empty() ? 1 : step.weight[c];
+          const float shift = step.bias.empty() ? 0 : step.bias[c];
+          previous.weight[c] *= scale;
+          previous.bias[c] = previous.bias[c] * scale + shift;
+        }
+      }
+      if (fuse) {
+        previous.tops[0] = step.tops[0];
+        previous.layers.insert(previous.layers.end(), step.layers.begin(),
+            step.layers.end());
+        values_[value].consumers = 0;
+        producer[step.tops[0]] = p;
+        fused[i] = true;
+      }
+    }
+    if (!fuse) {
+      for (int j = 0; j < step.tops.size(); ++j) {
+        producer[step.tops[j]] = i;
+      }
+    }
+  }
+  vector<Step> steps;
+  for (int i = 0; i < steps_.size(); ++i) {
+    if (!fused[i]) {
+      steps.push_back(steps_[i]);
+    }
+  }
+  steps_.swap(steps);
+}
+
+// The memory of values in the arena, and the steps from its first write to
+// its last read, inputs being written before step 0 and outputs read after
+// the last.
+struct Buffer {
+  int size;
+  int first;
+  int last;
+  int offset;
+};
+
+void NetCompiler::PlanMemory() {
+  const int end = steps_.size();
+  vector<int> last_use(values_.size(), -1);
+  for (int i = 0; i < steps_.size(); ++i) {
+    for (int j = 0; j < steps_[i].bottoms.size(); ++j) {
+      last_use[values_[steps_[i].bottoms[j]].root] = i;
+    }
+  }
+  for (int i = 0; i < outputs_.size(); ++i) {
+    last_use[values_[outputs_[i]].root] = end;
+  }
+  vector<Buffer> buffers;
+  vector<int> buffer(values_.size(), -1);
+  set<int> inputs;
+  for (int i = 0; i < inputs_.size(); ++i) {
+    const Buffer input = {Count(values_[inputs_[i]].shape), -1,
+        last_use[inputs_[i]], -1};
+    buffer[inputs_[i]] = buffers.size();
+    inputs.insert(buffers.size());
+    buffers.push_back(input);
+  }
+  for (int i = 0; i < steps_.size(); ++i) {
+    const Step& step = steps_[i];
+    // Elementwise kernels write over their first input if nothing reads it
+    // later.
+    const bool in_place = step.type == "Activation" ||
+        step.type == "Affine" || step.type == "Eltwise" ||
+        step.type == "Softmax";
+    for (int j = 0; j < step.tops.size(); ++j) {
+      const int top = step.tops[j];
+      const int size = Count(values_[top].shape);
+      const int reused = buffer[values_[step.bottoms[0]].root];
+      if (in_place && buffers[reused].last == i && !inputs.count(reused) &&
+          buffers[reused].size == size) {
+        buffer[top] = reused;
+        buffers[reused].last = last_use[top];
+      } else {
+        const Buffer output = {size, i, last_use[top], -1};
+        buffer[top] = buffers.size();
+        buffers.push_back(output);
+      }
+    }
+    if (step.scratch >= 0) {
+      const Buffer scratch = {Count(values_[step.scratch].shape), i, i, -1};
+      buffer[step.scratch] = buffers.size();
+      buffers.push_back(scratch);
+    }
+  }
+  // Place the largest buffers first, each at the lowest offset that no
+  // buffer alive at the same time overlaps.
+  vector<std::pair<int, int> > by_size;
+  for (int i = 0; i < buffers.size(); ++i) {
+    by_size.push_back(std::make_pair(-buffers[i].size, i));
+  }
+  std::sort(by_size.begin(), by_size.end());
+  vector<int> placed;
+  for (int i = 0; i < by_size.size(); ++i) {
+    Buffer& b = buffers[by_size[i].second];
+    vector<std::pair<int, int> > taken;
+    for (int j = 0; j < placed.size(); ++j) {
+      const Buffer& other = buffers[placed[j]];
+      if (other.first <= b.last && b.first <= other.last) {
+        taken.push_back(std::make_pair(other.offset,
+            other.offset + other.size));
+      }
+    }
+    std::sort(taken.begin(), taken.end());
+    int offset = 0;
+    for (int j = 0; j < taken.size(); ++j) {
+      if (offset + b.size <= taken[j].first) {
+        break;
+      }
+      offset = std::max(offset, (taken[j].second + kAlignment - 1) /
+          kAlignment * kAlignment);
+    }
+    b.offset = offset;
+    arena_size_ = std::max(arena_size_, offset + b.size);
+    placed.push_back(by_size[i].second);
+  }
+  for (int i = 0; i < values_.size(); ++i) {
+    const int b = buffer[values_[i].root];
+    values_[i].offset = b < 0 ? -1 : buffers[b].offset;
+  }
+}
+
+void NetCompiler::Write(const string& name, std::ostream* header,
+    std::ostream* source) const {
+  string guard = Identifier(name) + "_HPP_";
+  std::transform(guard.begin(), guard.end(), guard.begin(), ::toupper);
+  *header << "// Generated by compile_net: do not edit.\n"
+      << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+      << "namespace " << name << " {\n\n"
+      << "// The inputs and outputs of the net, in the order of the net:\n";
+  for (int i = 0; i < inputs_.size() + outputs_.size(); ++i) {
+    const bool input = i < inputs_.size();
+    const Value& value =
+        values_[input ? inputs_[i] : outputs_[i - inputs_.size()]];
+    *header << "//   " << (input ? "input " : "output ")
+        << (input ? i : i - inputs_.size()) << " " << value.name << ": ";
+    for (int j = 0; j < value.shape.size(); ++j) {
+      *header << (j ? " x " : "") << value.shape[j];
+    }
+    *header << "\n";
+  }
+  *header << "const int kNumInputs = " << inputs_.size() << ";\n"
+      << "const int kNumOutputs = " << outputs_.size() << ";\n\n"
+      << "const char* input_name(int i);\n"
+      << "int input_count(int i);\n"
+      << "float* input(int i);\n"
+      << "const char* output_name(int i);\n"
+      << "int output_count(int i);\n"
+      << "const float* output(int i);\n\n"
+      << "// Runs the net from the inputs to the outputs. The blobs live in "
+      << "static\n// memory: only one thread may run the net at a time.\n"
+      << "void Forward();\n\n"
+      << "}  // namespace " << name << "\n\n"
+      << "#endif  // " << guard << "\n";
+
+  *source << "// Generated by compile_net: do not edit.\n"
+      << "#include \"" << name << ".hpp\"\n\n"
+      << "#include \"caffe/util/compiled_net.hpp\"\n\n"
+      << "namespace " << name << " {\n\n"
+      << "namespace {\n\n"
+      << "namespace rt = caffe::compiled;\n\n"
+      << "float arena[" << std::max(arena_size_, 1) << "];\n";
+  std::ostringstream forward;
+  set<string> identifiers;
+  for (int i = 0; i < steps_.size(); ++i) {
+    const Step& step = steps_[i];
+    string id = Identifier(step.layers[0]);
+    for (int j = 1; identifiers.count(id); ++j) {
+      id = Identifier(step.layers[0]) + "_" + format_int(j);
+    }
+    identifiers.insert(id);
+    const vector<int>& shape = values_[step.bottoms[0]].shape;
+    const vector<int>& top_shape = values_[step.tops[0]].shape;
+    std::ostringstream x, y;
+    x << "arena + " << values_[step.bottoms[0]].offset;
+    y << "arena + " << values_[step.tops[0]].offset;
+    const string weight = step.weight.empty() ? "NULL" : id + "_weight";
+    const string bias = step.bias.empty() ? "NULL" : id + "_bias";
+    const string activation = ActivationName(step.activation);
+    const string slope = FloatLiteral(step.slope);
+    string layers = step.layers[0];
+    for (int j = 1; j < step.layers.size(); ++j) {
+      layers += ", " + step.layers[j];
+    }
+    forward << "  // " << layers << "\n";
+    if (step.type == "Convolution" || step.type == "Pooling" ||
+        (step.type != "Eltwise" && !(step.weight.empty() &&
+                                     step.bias.empty()))) {
+      *source << "\n// " << layers << "\n";
+    }
+    if (step.type != "Eltwise") {
+      if (!step.weight.empty()) {
+        WriteArray(weight, step.weight, source);
+      }
+      if (!step.bias.empty()) {
+        WriteArray(bias, step.bias, source);
+      }
+    }
+    if (step.type == "Convolution") {
+      const ConvolutionGeometry g(step.param.convolution_param());
+      *source << "struct " << id << "_shape {\n  enum {\n"
+          << "    N = " << shape[0] << ", C = " << shape[1] << ", H = "
+          << shape[2] << ", W = " << shape[3] << ", K = " << top_shape[1]
+          << ", OH = " << top_shape[2] << ", OW = " << top_shape[3] << ",\n"
+          << "    KH = " << g.kernel[0] << ", KW = " << g.kernel[1]
+          << ", SH = " << g.stride[0] << ", SW = " << g.stride[1]
+          << ", PH = " << g.pad[0] << ", PW = " << g.pad[1] << ",\n"
+          << "    DH = " << g.dilation[0] << ", DW = " << g.dilation[1]
+          << ", G = " << step.param.convolution_param().group() << "\n"
+          << "  };\n};\n";
+      forward << "  rt::Convolution<" << id << "_shape, " << activation
+          << ">(" << x.str() << ", " << weight << ", " << bias << ",\n"
+          << "      " << slope << ", ";
+      if (step.scratch >= 0) {
+        forward << "arena + " << values_[step.scratch].offset;
+      } else {
+        forward << "NULL";
+      }
+      forward << ", " << y.str() << ");\n";
+    } else if (step.type == "InnerProduct") {
+      forward << "  rt::InnerProduct<" << Count(shape, 0, step.axis) << ", "
+          << top_shape[step.axis] << ", "
+          << Count(shape, step.axis, shape.size()) << ", "
+          << (step.param.inner_product_param().transpose() ? "true" : "false")
+          << ", " << activation << ">(\n      " << x.str() << ", " << weight
+          << ", " << bias << ", " << slope << ", " << y.str() << ");\n";
+    } else if (step.type == "Pooling") {
+      const PoolingGeometry g(step.param.pooling_param(), shape);
+      *source << "struct " << id << "_shape {\n  enum {\n"
+          << "    N = " << shape[0] << ", C = " << shape[1] << ", H = "
+          << shape[2] << ", W = " << shape[3] << ", OH = " << top_shape[2]
+          << ", OW = " << top_shape[3] << ",\n"
+          << "    KH = " << g.kernel[0] << ", KW = " << g.kernel[1]
+          << ", SH = " << g.stride[0] << ", SW = " << g.stride[1]
+          << ", PH = " << g.pad[0] << ", PW = " << g.pad[1] << "\n"
+          << "  };\n};\n";
+      forward << "  rt::Pooling<" << id << "_shape, "
+          << (step.param.pooling_param().pool() ==
+              PoolingParameter_PoolMethod_MAX ? "rt::kMaxPool" :
+              "rt::kAvePool") << ">(" << x.str() << ", " << y.str()
+          << ");\n";
+    } else if (step.type == "Activation") {
+      forward << "  rt::Activation<" << Count(shape) << ", " << activation
+          << ">(" << x.str() << ", " << slope << ", " << y.str() << ");\n";
+    } else if (step.type == "Softmax") {
+      forward << "  rt::Softmax<" << Count(shape, 0, step.axis) << ", "
+          << shape[step.axis] << ", "
+          << Count(shape, step.axis + 1, shape.size()) << ">("
+          << x.str() << ", " << y.str() << ");\n";
+    } else if (step.type == "Affine") {
+      const int channels = std::max(step.weight.size(), step.bias.size());
+      const int outer = Count(shape, 0, step.axis);
+      forward << "  rt::ChannelAffine<" << outer << ", " << channels << ", "
+          << Count(shape) / outer / channels << ", " << activation << ">("
+          << x.str() << ", " << weight << ",\n      " << bias << ", "
+          << slope << ", " << y.str() << ");\n";
+    } else if (step.type == "Eltwise") {
+      const EltwiseParameter::EltwiseOp op = step.param.eltwise_param()
+          .operation();
+      const string op_name = op == EltwiseParameter_EltwiseOp_PROD ?
+          "rt::kProd" : op == EltwiseParameter_EltwiseOp_SUM ? "rt::kSum" :
+          "rt::kMax";
+      for (int j = 1; j < step.bottoms.size(); ++j) {
+        const bool last = j + 1 == step.bottoms.size();
+        forward << "  rt::Eltwise<" << Count(shape) << ", " << op_name << ", "
+            << (last ? activation : "rt::kIdentity") << ">(";
+        if (j == 1) {
+          forward << x.str() << ", " << FloatLiteral(step.weight[0]);
+        } else {
+          forward << y.str() << ", 1.f";
+        }
+        forward << ",\n      arena + " << values_[step.bottoms[j]].offset
+            << ", " << FloatLiteral(step.weight[j]) << ", " << slope << ", "
+            << y.str() << ");\n";
+      }
+    } else if (step.type == "Concat") {
+      const int outer = Count(top_shape, 0, step.axis);
+      int offset = 0;
+      for (int j = 0; j < step.bottoms.size(); ++j) {
+        const Value& bottom = values_[step.bottoms[j]];
+        const int inner = Count(bottom.shape) / outer;
+        forward << "  rt::Concat<" << outer << ", " << inner << ", "
+            << Count(top_shape) / outer << ">(arena + " << bottom.offset
+            << ", arena + " << values_[step.tops[0]].offset + offset
+            << ");\n";
+        offset += inner;
+      }
+    }
+  }
+
+  *source << "\n";
+  const string kinds[] = {"input", "output"};
+  for (int k = 0; k < 2; ++k) {
+    const vector<int>& values = k == 0 ? inputs_ : outputs_;
+    std::ostringstream names, counts, pointers;
+    for (int i = 0; i < values.size(); ++i) {
+      const Value& value = values_[values[i]];
+      names << (i ? ", " : "") << StringLiteral(value.name);
+      counts << (i ? ", " : "") << Count(value.shape);
+      pointers << (i ? ", " : "") << "arena + " << value.offset;
+    }
+    *source << "const char* const " << kinds[k] << "_names[] = {"
+        << names.str() << "};\n"
+        << "const int " << kinds[k] << "_counts[] = {" << counts.str()
+        << "};\n"
+        << "float* const " << kinds[k] << "s[] = {" << pointers.str()
+        << "};\n";
+  }
+  *source << "\n}  // namespace\n\n";
+  for (int k = 0; k < 2; ++k) {
+    *source << "const char* " << kinds[k] << "_name(int i) {\n"
+        << "  return " << kinds[k] << "_names[i];\n}\n\n"
+        << "int " << kinds[k] << "_count(int i) {\n"
+        << "  return " << kinds[k] << "_counts[i];\n}\n\n"
+        << (k == 0 ? "" : "const ") << "float* " << kinds[k] << "(int i) {\n"
+        << "  return " << kinds[k] << "s[i];\n}\n\n";
+  }
+  *source << "void Forward() {\n" << forward.str() << "}\n\n"
+      << "}  // namespace " << name << "\n";
+}
+
+}  // namespace caffe
@@ -0,0 +1,242 @@
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/numa.hpp"
+
+namespace caffe {
+
+// From linux/mempolicy.h, which not all systems have.
+static const int kMpolPreferred = 1;
+
+const int NumaPolicy::kNoNode;
+const int NumaPolicy::kAutoNode;
+
+// Parses a sysfs CPU list such as "0-3,8-11".
+static vector<int> ParseCpuList(const string& list) {
+  vector<int> cpus;
+  std::stringstream stream(list);
+  string range;
+  while (std::getline(stream, range, ',')) {
+    std::stringstream range_stream(range);
+    int first;
+    if (!(range_stream >> first)) { continue; }
+    int last = first;
+    char dash;
+    if (range_stream >> dash && dash == '-') {
+      range_stream >> last;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+NumaTopology::NumaTopology() {
+  for (int node = 0; ; ++node) {
+    std::ostringstream path;
+    path << "/sys/devices/system/node/node" << node << "/cpulist";
+    std::ifstream file(path.str().c_str());
+    string list;
+    if (!file || !std::getline(file, list)) { break; }
+    cpus_.push_back(ParseCpuList(list));
+  }
+  if (cpus_.empty()) {
+    const int num_cpus = std::max(1u, boost::thread::hardware_concurrency());
+    cpus_.push_back(vector<int>());
+    for (int cpu = 0; cpu < num_cpus; ++cpu) {
+      cpus_[0].push_back(cpu);
+    }
+  }
+}
+
+const NumaTopology& NumaTopology::Get() {
+  static NumaTopology topology;
+  return topology;
+}
+
+const vector<int>& NumaTopology::cpus(int node) const {
+  CHECK_GE(node, 0);
+  CHECK_LT(node, num_nodes()) << "There is no NUMA node " << node;
+  return cpus_[node];
+}
+
+int NumaTopology::device_node(int device) const {
+#ifndef CPU_ONLY
+  char bus_id[32];
+  if (cudaDeviceGetPCIBusId(bus_id, sizeof(bus_id), device) != cudaSuccess) {
+    return -1;
+  }
+  string path = "/sys/bus/pci/devices/";
+  for (const char* c = bus_id; *c; ++c) {
+    path += std::tolower(*c);
+  }
+  std::ifstream file((path + "/numa_node").c_str());
+  int node = -1;
+  if (file >> node && node >= 0 && node < num_nodes()) {
+    return node;
+  }
+#endif
+  return -1;
+}
+
+static NumaPolicy numa_policy_;
+// Prefetch threads pinned so far, and the allocations of NumaMapHost.
+static boost::mutex numa_mutex_;
+static int prefetch_threads_ = 0;
+static std::map<void*, size_t> mappings_;
+
+NumaPolicy::NumaPolicy()
+    : node(kNoNode), solver_affinity(AFFINITY_NONE),
+      prefetch_affinity(AFFINITY_NONE), worker_affinity(AFFINITY_NONE),
+      huge_page_bytes(0) {}
+
+void SetNumaPolicy(const NumaPolicy& policy) {
+  if (policy.node >= 0) {
+    CHECK_LT(policy.node, NumaTopology::Get().num_nodes())
+        << "There is no NUMA node " << policy.node;
+  } else {
+    CHECK(policy.node == NumaPolicy::kNoNode ||
+          policy.node == NumaPolicy::kAutoNode);
+  }
+  numa_policy_ = policy;
+}
+
+const NumaPolicy& GetNumaPolicy() {
+  return numa_policy_;
+}
+
+int SolverNode(int device) {
+  if (numa_policy_.node != NumaPolicy::kAutoNode) {
+    return numa_policy_.node;
+  }
+  const NumaTopology& topology = NumaTopology::Get();
+  if (Caffe::mode() == Caffe::GPU && device >= 0) {
+    const int node = topology.device_node(device);
+    if (node >= 0) {
+      return node;
+    }
+  }
+  return Caffe::solver_rank() % topology.num_nodes();
+}
+
+static bool SetThreadAffinity(const vector<int>& cpus) {
+#ifdef __linux__
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (int i = 0; i < cpus.size(); ++i) {
+    CPU_SET(cpus[i], &mask);
+  }
+  const int error = pthread_setaffinity_np(pthread_self(), sizeof(mask),
+      &mask);
+  if (error != 0) {
+    LOG_FIRST_N(WARNING, 1) << "Cannot pin threads: " << strerror(error);
+    return false;
+  }
+  return true;
+#else
+  LOG_FIRST_N(WARNING, 1) << "Pinning threads is not supported here";
+  return false;
+#endif
+}
+
+bool PinThread(ThreadRole role, int index) {
+  const int node = Caffe::numa_node();
+  const NumaTopology& topology = NumaTopology::Get();
+  if (node < 0 || node >= topology.num_nodes()) {
+    return false;
+  }
+  ThreadAffinity affinity = numa_policy_.solver_affinity;
+  if (role == PREFETCH_THREAD) {
+    affinity = numa_policy_.prefetch_affinity;
+  } else if (role == WORKER_THREAD) {
+    affinity = numa_policy_.worker_affinity;
+  }
+  const vector<int>& cpus = topology.cpus(node);
+  // Nodes of memory only have no CPUs to run on.
+  if (affinity == AFFINITY_NONE || cpus.empty()) {
+    return false;
+  }
+  if (affinity == AFFINITY_NODE) {
+    return SetThreadAffinity(cpus);
+  }
+  int cpu = index % cpus.size();
+  if (role == PREFETCH_THREAD) {
+    boost::mutex::scoped_lock lock(numa_mutex_);
+    cpu = cpus.size() - 1 - prefetch_threads_++ % cpus.size();
+  }
+  return SetThreadAffinity(vector<int>(1, cpus[cpu]));
+}
+
+void* NumaMapHost(size_t size) {
+  if (numa_policy_.huge_page_bytes == 0 ||
+      size < numa_policy_.huge_page_bytes) {
+    return NULL;
+  }
+#ifdef __linux__
+  void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+#ifdef SYS_mbind
+  const int node = Caffe::numa_node();
+  if (node >= 0) {
+    const int bits = 8 * sizeof(unsigned long);  // NOLINT(runtime/int)
+    vector<unsigned long> nodes(node / bits + 1, 0);  // NOLINT(runtime/int)
+    nodes[node / bits] |= 1UL << (node % bits);
+    // Preferred rather than bound, so that a full node spills over instead
+    // of failing. The kernel reads one bit less than it is told.
+    if (syscall(SYS_mbind, ptr, size, kMpolPreferred, &nodes[0],
+        nodes.size() * bits + 1, 0) != 0) {
+      LOG_FIRST_N(WARNING, 1) << "Cannot place memory on NUMA node " << node
+          << ": " << strerror(errno);
+    }
+  }
+#endif
+  boost::mutex::scoped_lock lock(numa_mutex_);
+  mappings_[ptr] = size;
+  return ptr;
+#else
+  return NULL;
+#endif
+}
+
+bool NumaUnmapHost(void* ptr) {
+  size_t size;
+  {
+    boost::mutex::scoped_lock lock(numa_mutex_);
+    std::map<void*, size_t>::iterator mapping = mappings_.find(ptr);
+    if (mapping == mappings_.end()) {
+      return false;
+    }
+    size = mapping->second;
+    mappings_.erase(mapping);
+  }
+#ifdef __linux__
+  munmap(ptr, size);
+#endif
+  return true;
+}
+
+}  // namespace caffe
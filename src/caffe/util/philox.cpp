@@ -0,0 +1,140 @@
+#include <cmath>
+
+#include "caffe/common.hpp"
+#include "caffe/util/philox.hpp"
+
+namespace caffe {
+
+// Maps a 32-bit output to a double in (0, 1).
+static inline double ToUnit(uint32_t word) {
+  return (word + 0.5) * (1. / 4294967296.);
+}
+
+// Fills r with outputs [offset, offset + n) of the stream of key, mapping
+// whole blocks of four at a time. Only the partial blocks at the ends of the
+// range go through a temporary.
+template <typename T, typename Map>
+static void PhiloxFill(uint64_t key, uint64_t offset, const int n,
+                       const Map& map, T* r) {
+  CHECK_GE(n, 0);
+  CHECK(r);
+  uint64_t block = offset / 4;
+  int skip = offset % 4;
+  uint32_t words[4];
+  T values[4];
+  int i = 0;
+  while (i < n) {
+    Philox::Block(key, block++, words);
+    if (skip == 0 && n - i >= 4) {
+      map(words, r + i);
+      i += 4;
+      continue;
+    }
+    map(words, values);
+    for (int j = skip; j < 4 && i < n; ++j) {
+      r[i++] = values[j];
+    }
+    skip = 0;
+  }
+}
+
+template <typename Dtype>
+struct UniformMap {
+  UniformMap(Dtype a, Dtype b) : a(a), range(b - a) {}
+  inline void operator()(const uint32_t words[4], Dtype out[4]) const {
+    for (int j = 0; j < 4; ++j) {
+      out[j] = a + range * ToUnit(words[j]);
+    }
+  }
+  const double a, range;
+};
+
+template <typename Dtype>
+struct GaussianMap {
+  GaussianMap(Dtype mu, Dtype sigma) : mu(mu), sigma(sigma) {}
+  inline void operator()(const uint32_t words[4], Dtype out[4]) const {
+    for (int j = 0; j < 4; j += 2) {
+      const double radius = sigma * std::sqrt(-2. * std::log(ToUnit(words[j])));
+      const double theta = 2. * M_PI * ToUnit(words[j + 1]);
+      out[j] = mu + radius * std::cos(theta);
+      out[j + 1] = mu + radius * std::sin(theta);
+    }
+  }
+  const double mu, sigma;
+};
+
+template <typename T>
+struct BernoulliMap {
+  explicit BernoulliMap(double p)
+      : threshold(static_cast<uint64_t>(p * 4294967296.)) {}
+  inline void operator()(const uint32_t words[4], T out[4]) const {
+    for (int j = 0; j < 4; ++j) {
+      out[j] = words[j] < threshold;
+    }
+  }
+  const uint64_t threshold;
+};
+
+template <typename Dtype>
+void philox_uniform(uint64_t key, uint64_t offset, const int n,
+                    const Dtype a, const Dtype b, Dtype* r) {
+  CHECK_LE(a, b);
+  PhiloxFill(key, offset, n, UniformMap<Dtype>(a, b), r);
+}
+
+template
+void philox_uniform<float>(uint64_t key, uint64_t offset, const int n,
+                           const float a, const float b, float* r);
+
+template
+void philox_uniform<double>(uint64_t key, uint64_t offset, const int n,
+                            const double a, const double b, double* r);
+
+template <typename Dtype>
+void philox_gaussian(uint64_t key, uint64_t offset, const int n,
+                     const Dtype mu, const Dtype sigma, Dtype* r) {
+  CHECK_GT(sigma, 0);
+  PhiloxFill(key, offset, n, GaussianMap<Dtype>(mu, sigma), r);
+}
+
+template
+void philox_gaussian<float>(uint64_t key, uint64_t offset, const int n,
+                            const float mu, const float sigma, float* r);
+
+template
+void philox_gaussian<double>(uint64_t key, uint64_t offset, const int n,
+                             const double mu, const double sigma, double* r);
+
+template <typename Dtype>
+void philox_bernoulli(uint64_t key, uint64_t offset, const int n,
+                      const Dtype p, int* r) {
+  CHECK_GE(p, 0);
+  CHECK_LE(p, 1);
+  PhiloxFill(key, offset, n, BernoulliMap<int>(p), r);
+}
+
+template
+void philox_bernoulli<float>(uint64_t key, uint64_t offset, const int n,
+                             const float p, int* r);
+
+template
+void philox_bernoulli<double>(uint64_t key, uint64_t offset, const int n,
+                              const double p, int* r);
+
+template <typename Dtype>
+void philox_bernoulli(uint64_t key, uint64_t offset, const int n,
+                      const Dtype p, unsigned int* r) {
+  CHECK_GE(p, 0);
+  CHECK_LE(p, 1);
+  PhiloxFill(key, offset, n, BernoulliMap<unsigned int>(p), r);
+}
+
+template
+void philox_bernoulli<float>(uint64_t key, uint64_t offset, const int n,
+                             const float p, unsigned int* r);
+
+template
+void philox_bernoulli<double>(uint64_t key, uint64_t offset, const int n,
+                              const double p, unsigned int* r);
+
+}  // namespace caffe
@@ -0,0 +1,248 @@
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+#include <new>
+#include <string>
+#include <vector>
+
+#include "caffe/util/shm_ring.hpp"
+
+namespace caffe {
+
+namespace bip = boost::interprocess;
+
+static const uint32_t kRingMagic = 0xCAFFE001;
+static const int kMaxAxes = 8;
+// Slots start on cache lines, so producer and consumers never share one.
+static const size_t kAlignment = 64;
+
+static size_t Align(size_t bytes) {
+  return (bytes + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+static int Count(const vector<int>& shape) {
+  if (shape.empty()) {
+    return 0;
+  }
+  int count = 1;
+  for (int i = 0; i < shape.size(); ++i) {
+    count *= shape[i];
+  }
+  return count;
+}
+
+struct ShmBatchRing::Header {
+  uint32_t magic;
+  int32_t slots;
+  bool broadcast;
+  bool closed;
+  int32_t data_axes;
+  int32_t data_shape[kMaxAxes];
+  int32_t label_axes;
+  int32_t label_shape[kMaxAxes];
+  uint64_t slot_bytes;
+  // Batches published so far.
+  uint64_t write_seq;
+  // Shard mode: the next batch to hand out.
+  uint64_t claim_seq;
+  int32_t consumers;
+  pid_t producer_pid;
+  bip::interprocess_mutex mutex;
+  // A batch was published, or the ring closed.
+  bip::interprocess_condition written;
+  // A slot was released, or a consumer attached.
+  bip::interprocess_condition released;
+};
+
+struct ShmBatchRing::Slot {
+  uint64_t seq;
+  // Readers that have yet to release the slot.
+  int32_t pending;
+};
+
+class ShmBatchRing::region {
+ public:
+  region(const string& name, size_t size)
+      : shm(bip::create_only, name.c_str(), bip::read_write) {
+    shm.truncate(size);
+    bip::mapped_region(shm, bip::read_write).swap(mapping);
+  }
+  explicit region(const string& name)
+      : shm(bip::open_only, name.c_str(), bip::read_write),
+        mapping(shm, bip::read_write) { }
+
+  bip::shared_memory_object shm;
+  bip::mapped_region mapping;
+};
+
+typedef bip::scoped_lock<bip::interprocess_mutex> ring_lock;
+
+ShmBatchRing::ShmBatchRing(const string& name, int slots,
+    const vector<int>& data_shape, const vector<int>& label_shape,
+    bool broadcast)
+    : name_(name), producer_(true), header_(NULL), data_shape_(data_shape),
+      label_shape_(label_shape), data_count_(Count(data_shape)),
+      next_seq_(0), reading_seq_(0), reading_(false) {
+  CHECK_GT(slots, 0);
+  CHECK(!data_shape.empty());
+  CHECK_LE(data_shape.size(), kMaxAxes);
+  CHECK_LE(label_shape.size(), kMaxAxes);
+  const size_t slot_bytes =
+      Align((data_count_ + Count(label_shape)) * sizeof(float));
+  const size_t size = Align(sizeof(Header)) + Align(slots * sizeof(Slot)) +
+      slots * slot_bytes;
+  bip::shared_memory_object::remove(name.c_str());
+  region_.reset(new region(name, size));
+  header_ = new (region_->mapping.get_address()) Header();
+  header_->slots = slots;
+  header_->broadcast = broadcast;
+  header_->closed = false;
+  header_->data_axes = data_shape.size();
+  for (int i = 0; i < data_shape.size(); ++i) {
+    header_->data_shape[i] = data_shape[i];
+  }
+  header_->label_axes = label_shape.size();
+  for (int i = 0; i < label_shape.size(); ++i) {
+    header_->label_shape[i] = label_shape[i];
+  }
+  header_->slot_bytes = slot_bytes;
+  header_->write_seq = 0;
+  header_->claim_seq = 0;
+  header_->consumers = 0;
+  header_->producer_pid = getpid();
+  for (int i = 0; i < slots; ++i) {
+    slot(i)->seq = 0;
+    slot(i)->pending = 0;
+  }
+  // Consumers check the magic number, so it goes in last.
+  header_->magic = kRingMagic;
+}
+
+ShmBatchRing::ShmBatchRing(const string& name)
+    : name_(name), producer_(false), header_(NULL), data_count_(0),
+      next_seq_(0), reading_seq_(0), reading_(false) {
+  try {
+    region_.reset(new region(name));
+  } catch (const bip::interprocess_exception& e) {
+    LOG(FATAL) << "Cannot open batch ring " << name << " (" << e.what()
+        << "); is its data_loader running?";
+  }
+  header_ = static_cast<Header*>(region_->mapping.get_address());
+  CHECK_EQ(header_->magic, kRingMagic) << name << " is not a batch ring";
+  data_shape_.assign(header_->data_shape,
+      header_->data_shape + header_->data_axes);
+  label_shape_.assign(header_->label_shape,
+      header_->label_shape + header_->label_axes);
+  data_count_ = Count(data_shape_);
+  ring_lock lock(header_->mutex);
+  ++header_->consumers;
+  // Broadcast consumers start with the next batch published.
+  next_seq_ = header_->write_seq;
+  header_->released.notify_all();
+}
+
+ShmBatchRing::~ShmBatchRing() {
+  if (producer_) {
+    Close();
+    bip::shared_memory_object::remove(name_.c_str());
+    return;
+  }
+  // Release the batches this consumer would still have read.
+  ring_lock lock(header_->mutex);
+  if (reading_) {
+    --slot(reading_seq_)->pending;
+  }
+  if (header_->broadcast) {
+    for (uint64_t seq = next_seq_; seq < header_->write_seq; ++seq) {
+      --slot(seq)->pending;
+    }
+  }
+  --header_->consumers;
+  header_->released.notify_all();
+}
+
+bool ShmBatchRing::broadcast() const {
+  return header_->broadcast;
+}
+
+ShmBatchRing::Slot* ShmBatchRing::slot(uint64_t seq) {
+  char* slots = static_cast<char*>(region_->mapping.get_address()) +
+      Align(sizeof(Header));
+  return reinterpret_cast<Slot*>(slots) + seq % header_->slots;
+}
+
+float* ShmBatchRing::slot_data(uint64_t seq) {
+  char* data = static_cast<char*>(region_->mapping.get_address()) +
+      Align(sizeof(Header)) + Align(header_->slots * sizeof(Slot));
+  return reinterpret_cast<float*>(
+      data + seq % header_->slots * header_->slot_bytes);
+}
+
+float* ShmBatchRing::BeginWrite() {
+  CHECK(producer_);
+  ring_lock lock(header_->mutex);
+  const uint64_t seq = header_->write_seq;
+  while (slot(seq)->pending > 0 || header_->consumers == 0) {
+    header_->released.wait(lock);
+  }
+  return slot_data(seq);
+}
+
+void ShmBatchRing::EndWrite() {
+  CHECK(producer_);
+  ring_lock lock(header_->mutex);
+  const uint64_t seq = header_->write_seq;
+  slot(seq)->seq = seq;
+  slot(seq)->pending = header_->broadcast ? header_->consumers : 1;
+  ++header_->write_seq;
+  header_->written.notify_all();
+}
+
+void ShmBatchRing::Close() {
+  CHECK(producer_);
+  ring_lock lock(header_->mutex);
+  header_->closed = true;
+  header_->written.notify_all();
+}
+
+const float* ShmBatchRing::BeginRead() {
+  CHECK(!producer_);
+  CHECK(!reading_) << "EndRead() the previous batch first";
+  ring_lock lock(header_->mutex);
+  const uint64_t seq =
+      header_->broadcast ? next_seq_++ : header_->claim_seq++;
+  while (header_->write_seq <= seq) {
+    CHECK(!header_->closed) << "The data_loader of " << name_ << " stopped";
+    // Check now and then that the producer has not died without closing.
+    const boost::posix_time::ptime deadline =
+        boost::posix_time::microsec_clock::universal_time() +
+        boost::posix_time::seconds(1);
+    if (!header_->written.timed_wait(lock, deadline)) {
+      CHECK(kill(header_->producer_pid, 0) == 0 || errno == EPERM)
+          << "The data_loader of " << name_ << " died";
+    }
+  }
+  CHECK_EQ(slot(seq)->seq, seq);
+  reading_seq_ = seq;
+  reading_ = true;
+  return slot_data(seq);
+}
+
+void ShmBatchRing::EndRead() {
+  CHECK(reading_);
+  ring_lock lock(header_->mutex);
+  --slot(reading_seq_)->pending;
+  reading_ = false;
+  header_->released.notify_all();
+}
+
+}  // namespace caffe
@@ -0,0 +1,246 @@
+#include <boost/atomic.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <vector>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/numa.hpp"
+#include "caffe/util/task_graph.hpp"
+
+namespace caffe {
+
+class TaskGraphExecutor::Impl {
+ public:
+  explicit Impl(int num_threads);
+  ~Impl();
+
+  void Run(const vector<int>& tasks, const vector<vector<int> >& successors,
+      Task* task);
+  int num_threads() const { return queues_.size(); }
+
+ private:
+  struct Queue {
+    boost::mutex mutex;
+    std::deque<int> tasks;
+  };
+
+  void entry(int worker, int rand_seed);
+  // Runs ready tasks until the current graph is done.
+  void Work(int worker);
+  void Push(int worker, int id);
+  bool Pop(int worker, int* id);
+
+  vector<shared_ptr<Queue> > queues_;
+  vector<shared_ptr<boost::thread> > threads_;
+
+  // Guards the fields below and is used with condition_ to park idle workers.
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  int generation_;
+  int busy_;
+  bool stop_;
+  Caffe::Brew mode_;
+  int solver_count_;
+  int solver_rank_;
+  bool multiprocess_;
+  int numa_node_;
+
+  // State of the current run, written before any task of it is pushed.
+  const vector<vector<int> >* successors_;
+  Task* task_;
+  vector<bool> active_;
+  boost::scoped_array<boost::atomic<int> > pending_;
+  int pending_capacity_;
+  boost::atomic<int> remaining_;
+  boost::atomic<int> ready_;
+};
+
+TaskGraphExecutor::Impl::Impl(int num_threads)
+    : generation_(0), busy_(0), stop_(false), mode_(Caffe::mode()),
+      solver_count_(Caffe::solver_count()), solver_rank_(Caffe::solver_rank()),
+      multiprocess_(Caffe::multiprocess()), numa_node_(Caffe::numa_node()),
+      successors_(NULL), task_(NULL),
+      pending_capacity_(0), remaining_(0), ready_(0) {
+  CHECK_GE(num_threads, 1) << "A task graph needs at least one thread.";
+  for (int i = 0; i < num_threads; ++i) {
+    queues_.push_back(shared_ptr<Queue>(new Queue()));
+  }
+  for (int i = 1; i < num_threads; ++i) {
+    try {
+      threads_.push_back(shared_ptr<boost::thread>(new boost::thread(
+          &TaskGraphExecutor::Impl::entry, this, i, caffe_rng_rand())));
+    } catch (std::exception& e) {
+      LOG(FATAL) << "Thread exception: " << e.what();
+    }
+  }
+}
+
+TaskGraphExecutor::Impl::~Impl() {
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  for (int i = 0; i < threads_.size(); ++i) {
+    threads_[i]->join();
+  }
+}
+
+void TaskGraphExecutor::Impl::entry(int worker, int rand_seed) {
+  Caffe::set_random_seed(rand_seed);
+  Caffe::set_numa_node(numa_node_);
+  PinThread(WORKER_THREAD, worker);
+  int generation = 0;
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (generation_ == generation && !stop_) {
+        condition_.wait(lock);
+      }
+      if (stop_) { return; }
+      generation = generation_;
+      ++busy_;
+      Caffe::set_mode(mode_);
+      Caffe::set_solver_count(solver_count_);
+      Caffe::set_solver_rank(solver_rank_);
+      Caffe::set_multiprocess(multiprocess_);
+    }
+    Work(worker);
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      --busy_;
+    }
+    condition_.notify_all();
+  }
+}
+
+void TaskGraphExecutor::Impl::Push(int worker, int id) {
+  {
+    boost::mutex::scoped_lock lock(queues_[worker]->mutex);
+    queues_[worker]->tasks.push_back(id);
+  }
+  ++ready_;
+  // Take the lock so that a worker about to wait cannot miss the wake-up.
+  { boost::mutex::scoped_lock lock(mutex_); }
+  condition_.notify_all();
+}
+
+bool TaskGraphExecutor::Impl::Pop(int worker, int* id) {
+  {
+    Queue& own = *queues_[worker];
+    boost::mutex::scoped_lock lock(own.mutex);
+    if (!own.tasks.empty()) {
+      *id = own.tasks.back();
+      own.tasks.pop_back();
+      --ready_;
+      return true;
+    }
+  }
+  for (int i = 1; i < queues_.size(); ++i) {
+    Queue& victim = *queues_[(worker + i) % queues_.size()];
+    boost::mutex::scoped_lock lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      *id = victim.tasks.front();
+      victim.tasks.pop_front();
+      --ready_;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskGraphExecutor::Impl::Work(int worker) {
+  int id;
+  while (true) {
+    if (Pop(worker, &id)) {
+      task_->run(id);
+      const vector<int>& next = (*successors_)[id];
+      for (int i = 0; i < next.size(); ++i) {
+        if (active_[next[i]] && --pending_[next[i]] == 0) {
+          Push(worker, next[i]);
+        }
+      }
+      if (--remaining_ == 0) {
+        { boost::mutex::scoped_lock lock(mutex_); }
+        condition_.notify_all();
+      }
+      continue;
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    while (ready_ <= 0 && remaining_ > 0) {
+      condition_.wait(lock);
+    }
+    if (remaining_ == 0) { return; }
+  }
+}
+
+void TaskGraphExecutor::Impl::Run(const vector<int>& tasks,
+    const vector<vector<int> >& successors, Task* task) {
+  if (tasks.empty()) { return; }
+  const int num_ids = successors.size();
+  if (pending_capacity_ < num_ids) {
+    pending_.reset(new boost::atomic<int>[num_ids]);
+    pending_capacity_ = num_ids;
+  }
+  active_.assign(num_ids, false);
+  for (int i = 0; i < tasks.size(); ++i) {
+    CHECK_GE(tasks[i], 0);
+    CHECK_LT(tasks[i], num_ids);
+    active_[tasks[i]] = true;
+    pending_[tasks[i]] = 0;
+  }
+  for (int i = 0; i < tasks.size(); ++i) {
+    const vector<int>& next = successors[tasks[i]];
+    for (int j = 0; j < next.size(); ++j) {
+      if (active_[next[j]]) { ++pending_[next[j]]; }
+    }
+  }
+  successors_ = &successors;
+  task_ = task;
+  remaining_ = tasks.size();
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    mode_ = Caffe::mode();
+    solver_count_ = Caffe::solver_count();
+    solver_rank_ = Caffe::solver_rank();
+    multiprocess_ = Caffe::multiprocess();
+  }
+  // Spread the initially ready tasks over the workers.
+  int num_roots = 0;
+  for (int i = 0; i < tasks.size(); ++i) {
+    if (pending_[tasks[i]] == 0) {
+      Push(num_roots % queues_.size(), tasks[i]);
+      ++num_roots;
+    }
+  }
+  CHECK_GT(num_roots, 0) << "Task graph has no task without predecessors.";
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    ++generation_;
+  }
+  condition_.notify_all();
+  Work(0);
+  boost::mutex::scoped_lock lock(mutex_);
+  while (busy_ > 0) {
+    condition_.wait(lock);
+  }
+}
+
+TaskGraphExecutor::TaskGraphExecutor(int num_threads)
+    : impl_(new Impl(num_threads)) {
+}
+
+TaskGraphExecutor::~TaskGraphExecutor() {
+}
+
+void TaskGraphExecutor::Run(const vector<int>& tasks,
+    const vector<vector<int> >& successors, Task* task) {
+  impl_->Run(tasks, successors, task);
+}
+
+int TaskGraphExecutor::num_threads() const {
+  return impl_->num_threads();
+}
+
+}  // namespace caffe
@@ -13,6 +13,8 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/numa.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -54,6 +56,29 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_int32(world_size, 1,
+    "Optional; number of processes training together on CPU. The effective "
+    "training batch size is multiplied by the number of processes.");
+DEFINE_int32(rank, 0,
+    "Optional; rank of this process among the world_size processes. "
+    "Rank 0 tests and snapshots.");
+DEFINE_string(master, "localhost:23456",
+    "Optional; host:port rank 0 listens on for the other processes.");
+DEFINE_string(numa_node, "",
+    "Optional; the NUMA node to train on, or 'auto' for the node of each "
+    "solver's GPU (its rank modulo the number of nodes on CPU).");
+DEFINE_string(solver_affinity, "node",
+    "Optional; how solver threads are pinned on their NUMA node: "
+    "none, node or core.");
+DEFINE_string(prefetch_affinity, "node",
+    "Optional; how prefetch threads are pinned on their NUMA node: "
+    "none, node or core.");
+DEFINE_string(worker_affinity, "core",
+    "Optional; how intra-op worker threads are pinned on their NUMA node: "
+    "none, node or core.");
+DEFINE_int32(huge_page_mb, 0,
+    "Optional; host allocations of at least this many MB are backed by "
+    "transparent huge pages and placed on the NUMA node of their thread.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -162,6 +187,43 @@ caffe::SolverAction::Enum GetRequestedAction(
   LOG(FATAL) << "Invalid signal effect \""<< flag_value << "\" was specified";
 }
 
+// Translate a thread affinity flag to the corresponding enumeration.
+caffe::ThreadAffinity GetThreadAffinity(const std::string& flag_value) {
+  if (flag_value == "none") {
+    return caffe::AFFINITY_NONE;
+  }
+  if (flag_value == "node") {
+    return caffe::AFFINITY_NODE;
+  }
+  if (flag_value == "core") {
+    return caffe::AFFINITY_CORE;
+  }
+  LOG(FATAL) << "Invalid thread affinity "" << flag_value << """;
+}
+
+// Place the threads and memory of training as the NUMA flags say, starting
+// with the calling solver thread.
+void SetNumaPolicyFromFlags(const vector<int>& gpus) {
+  caffe::NumaPolicy policy;
+  if (FLAGS_numa_node == "auto") {
+    policy.node = caffe::NumaPolicy::kAutoNode;
+  } else if (FLAGS_numa_node.size()) {
+    policy.node = boost::lexical_cast<int>(FLAGS_numa_node);
+  }
+  policy.solver_affinity = GetThreadAffinity(FLAGS_solver_affinity);
+  policy.prefetch_affinity = GetThreadAffinity(FLAGS_prefetch_affinity);
+  policy.worker_affinity = GetThreadAffinity(FLAGS_worker_affinity);
+  CHECK_GE(FLAGS_huge_page_mb, 0);
+  policy.huge_page_bytes = static_cast<size_t>(FLAGS_huge_page_mb) << 20;
+  caffe::SetNumaPolicy(policy);
+  Caffe::set_numa_node(caffe::SolverNode(gpus.size() ? gpus[0] : -1));
+  if (Caffe::numa_node() >= 0) {
+    LOG(INFO) << "Training on NUMA node " << Caffe::numa_node() << " of "
+        << caffe::NumaTopology::Get().num_nodes();
+    caffe::PinThread(caffe::SOLVER_THREAD, 0);
+  }
+}
+
 // Train / Finetune a model.
 int train() {
   CHECK_GT(FLAGS_solver.size(), 0) << "Need a solver definition to train.";
@@ -214,6 +276,16 @@ int train() {
     Caffe::set_mode(Caffe::GPU);
     Caffe::set_solver_count(gpus.size());
   }
+  if (FLAGS_world_size > 1) {
+    CHECK_EQ(gpus.size(), 0) << "Multi-process training runs on CPU.";
+    CHECK_GE(FLAGS_rank, 0);
+    CHECK_LT(FLAGS_rank, FLAGS_world_size);
+    Caffe::set_solver_count(FLAGS_world_size);
+    Caffe::set_solver_rank(FLAGS_rank);
+    Caffe::set_multiprocess(true);
+  }
+
+  SetNumaPolicyFromFlags(gpus);
 
   caffe::SignalHandler signal_handler(
         GetRequestedAction(FLAGS_sigint_effect),
@@ -244,6 +316,11 @@ int train() {
 #else
     LOG(FATAL) << "Multi-GPU execution not available - rebuild with USE_NCCL";
 #endif
+  } else if (FLAGS_world_size > 1) {
+    shared_ptr<caffe::Transport> transport(new caffe::TCPTransport(
+        FLAGS_rank, FLAGS_world_size, FLAGS_master));
+    caffe::DistributedSync<float> sync(solver, transport);
+    sync.Run();
   } else {
     solver->Solve();
   }
@@ -276,8 +353,9 @@ int test() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
-  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  const vector<string> weights(1, FLAGS_weights);
+  Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages,
+                       &weights);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
   vector<int> test_score_output_id;
@@ -404,6 +482,20 @@ int time() {
       "\tbackward: " << backward_time_per_layer[i] / 1000 /
       FLAGS_iterations << " ms.";
   }
+  for (int i = 0; i < layers.size(); ++i) {
+    const caffe::BasePrefetchingDataLayer<float>* data_layer =
+        dynamic_cast<caffe::BasePrefetchingDataLayer<float>*>(
+            layers[i].get());
+    if (data_layer == NULL || data_layer->prefetch_stats().batches == 0) {
+      continue;
+    }
+    const caffe::PrefetchStats& stats = data_layer->prefetch_stats();
+    LOG(INFO) << std::setfill(' ') << std::setw(10) <<
+      layers[i]->layer_param().name() << "\tprefetch: " << stats.depth <<
+      " batches in flight, " << stats.ready / stats.batches <<
+      " ready, waited " << stats.wait_ms / stats.batches << " ms, loaded in " <<
+      stats.load_ms / stats.batches << " ms.";
+  }
   total_timer.Stop();
   LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
     FLAGS_iterations << " ms.";
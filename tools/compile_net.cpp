@@ -0,0 +1,42 @@
+// This program compiles a deploy net and its trained weights into C++
+// source that runs the forward pass without Caffe or protobuf.
+// Usage:
+//    compile_net deploy_net_proto_file weights_file output_dir name
+//
+// The forward pass is written to output_dir/name.hpp and output_dir/name.cpp,
+// in namespace name, for the input shapes of deploy_net_proto_file. Build
+// name.cpp with include/caffe/util/compiled_net.hpp on the include path.
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/net_compiler.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: compile_net deploy_net_proto_file weights_file "
+        << "output_dir name";
+    return 1;
+  }
+  Caffe::set_mode(Caffe::CPU);
+  Net<float> net(argv[1], TEST);
+  net.CopyTrainedLayersFrom(argv[2]);
+  NetCompiler compiler(net);
+
+  const string name(argv[4]);
+  const string prefix = string(argv[3]) + "/" + name;
+  std::ofstream header((prefix + ".hpp").c_str());
+  std::ofstream source((prefix + ".cpp").c_str());
+  CHECK(header && source) << "Failed to open " << prefix << ".hpp/.cpp";
+  compiler.Write(name, &header, &source);
+  LOG(INFO) << "Wrote " << prefix << ".hpp and " << prefix << ".cpp: "
+      << net.layers().size() << " layers compiled to "
+      << compiler.num_steps() << " kernels, "
+      << compiler.arena_size() * sizeof(float) << " bytes of blobs.";
+  return 0;
+}
@@ -19,6 +19,7 @@
 #include "glog/logging.h"
 
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/compression.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
@@ -42,6 +43,34 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_string(compression, "none",
+    "Optional: Compress each datum with {none, lz4, zstd}");
+DEFINE_int32(compression_level, 0,
+    "Optional: Compression level; 0 is the codec default, and for lz4 a "
+    "positive level selects LZ4HC");
+DEFINE_string(compression_dictionary, "",
+    "Optional: Train a zstd dictionary on the first images, save it to this "
+    "file and compress with it. Pays off for small images.");
+DEFINE_int32(dictionary_samples, 1000,
+    "Number of images to train the compression dictionary on");
+DEFINE_int32(dictionary_size, 112640,
+    "Maximum size in bytes of the compression dictionary");
+
+#ifdef USE_OPENCV
+// The encoding to store filename with, guessed from its extension if
+// --encoded is set without --encode_type.
+static std::string EncodeType(const std::string& filename) {
+  std::string enc = FLAGS_encode_type;
+  if (FLAGS_encoded && !enc.size()) {
+    size_t p = filename.rfind('.');
+    if ( p == filename.npos )
+      LOG(WARNING) << "Failed to guess the encoding of '" << filename << "'";
+    enc = filename.substr(p+1);
+    std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+  }
+  return enc;
+}
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -70,6 +99,12 @@ int main(int argc, char** argv) {
   const bool check_size = FLAGS_check_size;
   const bool encoded = FLAGS_encoded;
   const string encode_type = FLAGS_encode_type;
+  string compression_name = FLAGS_compression;
+  std::transform(compression_name.begin(), compression_name.end(),
+      compression_name.begin(), ::toupper);
+  Datum_Compression compression;
+  CHECK(Datum_Compression_Parse(compression_name, &compression))
+      << "Unknown compression " << FLAGS_compression;
 
   std::ifstream infile(argv[2]);
   std::vector<std::pair<std::string, int> > lines;
@@ -93,14 +128,43 @@ int main(int argc, char** argv) {
 
   int resize_height = std::max<int>(0, FLAGS_resize_height);
   int resize_width = std::max<int>(0, FLAGS_resize_width);
+  std::string root_folder(argv[1]);
+
+  DatumCodec codec;
+  if (FLAGS_compression_dictionary.size()) {
+    CHECK_EQ(compression, Datum_Compression_ZSTD)
+        << "Compression dictionaries need --compression=zstd";
+    std::vector<Datum> samples;
+    for (int line_id = 0; line_id < lines.size() &&
+         static_cast<int>(samples.size()) < FLAGS_dictionary_samples;
+         ++line_id) {
+      Datum sample;
+      if (ReadImageToDatum(root_folder + lines[line_id].first,
+          lines[line_id].second, resize_height, resize_width, is_color,
+          EncodeType(lines[line_id].first), &sample)) {
+        samples.push_back(sample);
+      }
+    }
+    codec.set_dictionary(TrainDatumDictionary(samples, FLAGS_dictionary_size));
+    std::ofstream dictionary_file(FLAGS_compression_dictionary.c_str(),
+        std::ios::out | std::ios::binary);
+    dictionary_file.write(codec.dictionary().data(),
+        codec.dictionary().size());
+    CHECK(dictionary_file.good()) << "Failed to write "
+        << FLAGS_compression_dictionary;
+    LOG(INFO) << "Trained a " << codec.dictionary().size()
+        << " byte compression dictionary on " << samples.size() << " images.";
+  }
 
   // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+  // Keys below are in ascending order, so the db can be bulk loaded. The
+  // transaction is opened once the first datum gives a size estimate.
+  scoped_ptr<db::Transaction> txn;
+  size_t db_size_estimate = 0;
 
   // Storing to db
-  std::string root_folder(argv[1]);
   Datum datum;
   int count = 0;
   int data_size = 0;
@@ -108,19 +172,10 @@ int main(int argc, char** argv) {
 
   for (int line_id = 0; line_id < lines.size(); ++line_id) {
     bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p+1);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
+    datum.Clear();
     status = ReadImageToDatum(root_folder + lines[line_id].first,
         lines[line_id].second, resize_height, resize_width, is_color,
-        enc, &datum);
+        EncodeType(lines[line_id].first), &datum);
     if (status == false) continue;
     if (check_size) {
       if (!data_size_initialized) {
@@ -132,18 +187,23 @@ int main(int argc, char** argv) {
             << data.size();
       }
     }
+    codec.Compress(compression, FLAGS_compression_level, &datum);
     // sequential
     string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
 
     // Put in db
     string out;
     CHECK(datum.SerializeToString(&out));
+    if (!txn) {
+      db_size_estimate = (out.size() + key_str.size()) * lines.size();
+      txn.reset(db->NewBulkTransaction(db_size_estimate));
+    }
     txn->Put(key_str, out);
 
     if (++count % 1000 == 0) {
       // Commit db
       txn->Commit();
-      txn.reset(db->NewTransaction());
+      txn.reset(db->NewBulkTransaction(db_size_estimate));
       LOG(INFO) << "Processed " << count << " files.";
     }
   }
@@ -0,0 +1,91 @@
+// This program runs the data layer of a net once for all the training
+// processes on a host, e.g. those of a hyperparameter sweep: it publishes
+// each batch to a shared memory ring that SharedMemoryData layers read.
+// Usage:
+//   data_loader [FLAGS] DATA_PROTOTXT RING_NAME
+//
+// where DATA_PROTOTXT is a net holding the data layer, with its
+// transform_param, as the training net would have it. Its first output is
+// published as data and its second, if any, as labels. The training nets
+// replace the data layer by
+//   layer {
+//     name: "data" type: "SharedMemoryData" top: "data" top: "label"
+//     shared_memory_data_param { ring: "RING_NAME" }
+//   }
+
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/shm_ring.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(phase, "TRAIN",
+    "The phase {TRAIN, TEST} to run the data layer in");
+DEFINE_int32(slots, 4, "Number of batches the ring holds");
+DEFINE_bool(broadcast, true,
+    "Give every consumer every batch; otherwise each batch goes to one "
+    "consumer, sharding the data between them");
+DEFINE_int32(iterations, 0,
+    "Stop after publishing this many batches; 0 runs until killed");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Publish the batches of a data layer to a shared\n"
+        "memory ring read by SharedMemoryData layers.\n"
+        "Usage:\n"
+        "    data_loader [FLAGS] DATA_PROTOTXT RING_NAME\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/data_loader");
+    return 1;
+  }
+  CHECK(FLAGS_phase == "TRAIN" || FLAGS_phase == "TEST")
+      << "Unknown phase " << FLAGS_phase;
+  Caffe::set_mode(Caffe::CPU);
+  Net<float> net(argv[1], FLAGS_phase == "TRAIN" ? TRAIN : TEST);
+  const vector<Blob<float>*>& outputs = net.output_blobs();
+  CHECK(outputs.size() == 1 || outputs.size() == 2)
+      << "The net must output the data, and optionally the labels";
+  vector<int> label_shape;
+  if (outputs.size() == 2) {
+    label_shape = outputs[1]->shape();
+  }
+  ShmBatchRing ring(argv[2], FLAGS_slots, outputs[0]->shape(), label_shape,
+      FLAGS_broadcast);
+  LOG(INFO) << "Publishing batches of " << outputs[0]->shape_string()
+      << " to " << argv[2] << (FLAGS_broadcast ? " for every consumer" :
+      " sharded between consumers");
+
+  for (int i = 0; FLAGS_iterations == 0 || i < FLAGS_iterations; ++i) {
+    net.Forward();
+    CHECK(outputs[0]->shape() == ring.data_shape())
+        << "The batches must all have the shape of the first";
+    float* slot = ring.BeginWrite();
+    caffe_copy(outputs[0]->count(), outputs[0]->cpu_data(), slot);
+    if (outputs.size() == 2) {
+      caffe_copy(outputs[1]->count(), outputs[1]->cpu_data(),
+          slot + ring.data_count());
+    }
+    ring.EndWrite();
+    if ((i + 1) % 1000 == 0) {
+      LOG(INFO) << "Published " << i + 1 << " batches.";
+    }
+  }
+  return 0;
+}
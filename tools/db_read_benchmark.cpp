@@ -0,0 +1,98 @@
+// This program reads every Datum of a lmdb/leveldb the way the Data layer
+// does and reports where the time goes, to weigh compressing a dataset
+// (less I/O) against the CPU spent decompressing it.
+// Usage:
+//   db_read_benchmark [FLAGS] DB_NAME
+//
+// Run it on a cold page cache (e.g. after dropping caches, or on the network
+// mount training reads from) for the I/O side of the trade-off.
+
+#include <string>
+
+#include "boost/scoped_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/compression.hpp"
+#include "caffe/util/db.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using boost::scoped_ptr;
+
+DEFINE_string(backend, "lmdb",
+    "The backend {lmdb, leveldb} the database is stored in");
+DEFINE_string(compression_dictionary, "",
+    "The dictionary the database was compressed with, if any");
+DEFINE_int32(max_records, 0,
+    "Stop after this many records; 0 reads the whole database");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Time reading and decompressing the Datums of a\n"
+        "leveldb/lmdb.\n"
+        "Usage:\n"
+        "    db_read_benchmark [FLAGS] DB_NAME\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 2) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/db_read_benchmark");
+    return 1;
+  }
+
+  scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
+  db->Open(argv[1], db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  DatumCodec codec;
+  if (FLAGS_compression_dictionary.size()) {
+    codec.ReadDictionary(FLAGS_compression_dictionary);
+  }
+
+  Datum datum;
+  int count = 0;
+  int compressed = 0;
+  double stored_bytes = 0;
+  double raw_bytes = 0;
+  double read_time = 0;
+  double decompress_time = 0;
+  CPUTimer timer;
+  for (; cursor->valid(); cursor->Next()) {
+    if (FLAGS_max_records > 0 && count == FLAGS_max_records) {
+      break;
+    }
+    timer.Start();
+    const string& value = cursor->value();
+    datum.ParseFromString(value);
+    read_time += timer.MicroSeconds();
+    stored_bytes += value.size();
+    timer.Start();
+    if (codec.Decompress(&datum)) {
+      ++compressed;
+    }
+    decompress_time += timer.MicroSeconds();
+    raw_bytes += datum.data().size() + datum.float_data_size() * sizeof(float);
+    ++count;
+  }
+  CHECK_GT(count, 0) << "No records in " << argv[1];
+
+  const double kMB = 1 << 20;
+  LOG(INFO) << "Read " << count << " records, " << compressed
+      << " of them compressed.";
+  LOG(INFO) << "Stored: " << stored_bytes / kMB << " MB, payload: "
+      << raw_bytes / kMB << " MB (ratio " << raw_bytes / stored_bytes << ").";
+  LOG(INFO) << "Read and parse: " << read_time / 1000 << " ms ("
+      << stored_bytes / kMB / (read_time / 1e6) << " MB/s stored).";
+  LOG(INFO) << "Decompress: " << decompress_time / 1000 << " ms ("
+      << raw_bytes / kMB / (decompress_time / 1e6) << " MB/s payload).";
+  LOG(INFO) << "Per record: " << read_time / count << " us read, "
+      << decompress_time / count << " us decompress.";
+  return 0;
+}
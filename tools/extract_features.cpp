@@ -1,24 +1,377 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/thread.hpp"
+#include "gflags/gflags.h"
 #include "google/protobuf/text_format.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/compression.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 using caffe::Blob;
+using caffe::BlobProtoVector;
+using caffe::BlockingQueue;
 using caffe::Caffe;
 using caffe::Datum;
+using caffe::Datum_Compression;
+using caffe::DatumCodec;
 using caffe::Net;
 using std::string;
 namespace db = caffe::db;
 
+DEFINE_string(compression, "none",
+    "Optional: Compress each feature datum with {none, lz4, zstd}");
+DEFINE_int32(compression_level, 0,
+    "Optional: Compression level; 0 is the codec default");
+DEFINE_bool(fp16, false,
+    "Optional: Write half precision features (raw and npy formats only)");
+DEFINE_string(pca, "",
+    "Optional: For each feature blob, a BlobProtoVector file holding the "
+    "mean (dim) and the principal components (k x dim) to project the "
+    "features on, separated by ','; an empty name keeps a blob as it is");
+DEFINE_int32(shard_rows, 1000000,
+    "Optional: Number of features per .npy shard");
+DEFINE_int32(queue_size, 4,
+    "Optional: Number of batches the forward may run ahead of the writes");
+
+// Converts a float to IEEE half precision, rounding to nearest even.
+static uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const int float_exponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+  if (float_exponent == 0xff) {  // Inf or NaN
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+  const int exponent = float_exponent - 127 + 15;
+  if (exponent >= 0x1f) {
+    return sign | 0x7c00;
+  }
+  int shift = 13;
+  uint32_t half = exponent << 10;
+  if (exponent <= 0) {
+    // Subnormal, or zero past 2^-25.
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    shift = 14 - exponent;
+    half = 0;
+  }
+  half |= mantissa >> shift;
+  const uint32_t rest = mantissa & ((1u << shift) - 1);
+  const uint32_t halfway = 1u << (shift - 1);
+  // A carry out of the mantissa correctly rounds up the exponent.
+  if (rest > halfway || (rest == halfway && (half & 1))) {
+    ++half;
+  }
+  return sign | half;
+}
+
+// Projects features on principal components read from a BlobProtoVector
+// holding their mean and the components, one per row.
+template <typename Dtype>
+class PCAProjection {
+ public:
+  PCAProjection(const string& filename, int input_dim) {
+    BlobProtoVector proto;
+    caffe::ReadProtoFromBinaryFileOrDie(filename, &proto);
+    CHECK_EQ(proto.blobs_size(), 2)
+        << filename << " must hold the mean and the principal components";
+    mean_.FromProto(proto.blobs(0));
+    components_.FromProto(proto.blobs(1));
+    CHECK_EQ(mean_.count(), input_dim)
+        << "The PCA of " << filename << " does not match the features";
+    CHECK_EQ(components_.count() % input_dim, 0)
+        << "The PCA of " << filename << " does not match the features";
+  }
+
+  int dim() const { return components_.count() / mean_.count(); }
+
+  void Project(const Blob<Dtype>& features, Blob<Dtype>* projected) {
+    const int num = features.num();
+    const int input_dim = mean_.count();
+    CHECK_EQ(features.count(1), input_dim);
+    std::vector<int> shape(2, num);
+    shape[1] = input_dim;
+    centered_.Reshape(shape);
+    Dtype* centered = centered_.mutable_cpu_data();
+    for (int n = 0; n < num; ++n) {
+      caffe::caffe_sub(input_dim, features.cpu_data() + n * input_dim,
+          mean_.cpu_data(), centered + n * input_dim);
+    }
+    shape[1] = dim();
+    projected->Reshape(shape);
+    caffe::caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, num, dim(),
+        input_dim, 1., centered, components_.cpu_data(), 0.,
+        projected->mutable_cpu_data());
+  }
+
+ private:
+  Blob<Dtype> mean_, components_, centered_;
+};
+
+// Writes batches of features, one item per row.
+template <typename Dtype>
+class FeatureWriter {
+ public:
+  FeatureWriter() : rows_(0) {}
+  virtual ~FeatureWriter() {}
+
+  void set_pca(boost::shared_ptr<PCAProjection<Dtype> > pca) { pca_ = pca; }
+  int64_t rows() const { return rows_; }
+
+  void Write(const Blob<Dtype>& features) {
+    if (pca_) {
+      pca_->Project(features, &projected_);
+      WriteRows(projected_);
+    } else {
+      WriteRows(features);
+    }
+    rows_ += features.num();
+  }
+  virtual void Close() = 0;
+
+ protected:
+  // Writes the rows following the rows_ already written.
+  virtual void WriteRows(const Blob<Dtype>& features) = 0;
+
+  boost::shared_ptr<PCAProjection<Dtype> > pca_;
+  Blob<Dtype> projected_;
+  int64_t rows_;
+};
+
+// Writes each feature as a Datum with float_data, keyed by its index.
+template <typename Dtype>
+class DBFeatureWriter : public FeatureWriter<Dtype> {
+ public:
+  DBFeatureWriter(const string& name, const string& db_type,
+      size_t db_size_estimate, Datum_Compression compression)
+      : name_(name), db_(db::GetDB(db_type)),
+        db_size_estimate_(db_size_estimate), compression_(compression) {
+    db_->Open(name, db::NEW);
+  }
+
+  virtual void Close() {
+    if (txn_) {
+      txn_->Commit();
+      txn_.reset();
+    }
+    db_->Close();
+  }
+
+ protected:
+  virtual void WriteRows(const Blob<Dtype>& features) {
+    const int dim_features = features.count(1);
+    for (int n = 0; n < features.num(); ++n) {
+      // The transactions are made on the writing thread, as LMDB requires.
+      // Keys are written in ascending order, so bulk load.
+      if (!txn_) {
+        txn_.reset(db_->NewBulkTransaction(db_size_estimate_));
+      }
+      datum_.Clear();
+      datum_.set_height(features.height());
+      datum_.set_width(features.width());
+      datum_.set_channels(features.channels());
+      const Dtype* feature_data = features.cpu_data() + features.offset(n);
+      for (int d = 0; d < dim_features; ++d) {
+        datum_.add_float_data(feature_data[d]);
+      }
+      codec_.Compress(compression_, FLAGS_compression_level, &datum_);
+      const int64_t index = this->rows_ + n;
+      string out;
+      CHECK(datum_.SerializeToString(&out));
+      txn_->Put(caffe::format_int(index, 10), out);
+      if ((index + 1) % 1000 == 0) {
+        txn_->Commit();
+        txn_.reset();
+        LOG(ERROR)<< "Extracted features of " << index + 1 <<
+            " query images to " << name_;
+      }
+    }
+  }
+
+  const string name_;
+  boost::shared_ptr<db::DB> db_;
+  boost::shared_ptr<db::Transaction> txn_;
+  const size_t db_size_estimate_;
+  const Datum_Compression compression_;
+  DatumCodec codec_;
+  Datum datum_;
+};
+
+// Base of the writers of dense row-major matrices of float32, or float16
+// with --fp16, in host (little-endian) byte order.
+template <typename Dtype>
+class MatrixFeatureWriter : public FeatureWriter<Dtype> {
+ protected:
+  explicit MatrixFeatureWriter(int dim) : dim_(dim) {}
+
+  const char* dtype() const { return FLAGS_fp16 ? "float16" : "float32"; }
+
+  void WriteMatrix(const Dtype* data, int num, FILE* file) {
+    const size_t count = static_cast<size_t>(num) * dim_;
+    size_t written;
+    if (FLAGS_fp16) {
+      half_.resize(count);
+      for (size_t i = 0; i < count; ++i) {
+        half_[i] = FloatToHalf(data[i]);
+      }
+      written = fwrite(&half_[0], sizeof(uint16_t), count, file);
+    } else {
+      float_.resize(count);
+      for (size_t i = 0; i < count; ++i) {
+        float_[i] = data[i];
+      }
+      written = fwrite(&float_[0], sizeof(float), count, file);
+    }
+    CHECK_EQ(written, count) << "Cannot write the features";
+  }
+
+  const int dim_;
+  std::vector<uint16_t> half_;
+  std::vector<float> float_;
+};
+
+// Writes one headerless matrix, to memory-map, and its shape and type in
+// NAME.shape.
+template <typename Dtype>
+class RawFeatureWriter : public MatrixFeatureWriter<Dtype> {
+ public:
+  RawFeatureWriter(const string& name, int dim)
+      : MatrixFeatureWriter<Dtype>(dim), name_(name),
+        file_(fopen(name.c_str(), "wb")) {
+    CHECK(file_) << "Cannot create " << name;
+  }
+
+  virtual void Close() {
+    CHECK_EQ(fclose(file_), 0) << "Cannot write " << name_;
+    std::ofstream shape((name_ + ".shape").c_str());
+    shape << this->rows_ << " " << this->dim_ << " " << this->dtype() << "\n";
+    CHECK(shape.good()) << "Cannot write " << name_ << ".shape";
+  }
+
+ protected:
+  virtual void WriteRows(const Blob<Dtype>& features) {
+    CHECK_EQ(features.count(1), this->dim_);
+    this->WriteMatrix(features.cpu_data(), features.num(), file_);
+  }
+
+  const string name_;
+  FILE* file_;
+};
+
+// Writes NAME_00000.npy, NAME_00001.npy, ... of --shard_rows rows each.
+template <typename Dtype>
+class NpyFeatureWriter : public MatrixFeatureWriter<Dtype> {
+ public:
+  NpyFeatureWriter(const string& name, int dim)
+      : MatrixFeatureWriter<Dtype>(dim), name_(name), file_(NULL), shard_(0),
+        shard_rows_(0) {
+    CHECK_GT(FLAGS_shard_rows, 0);
+  }
+
+  virtual void Close() {
+    if (file_) {
+      CloseShard();
+    }
+  }
+
+ protected:
+  virtual void WriteRows(const Blob<Dtype>& features) {
+    CHECK_EQ(features.count(1), this->dim_);
+    for (int n = 0; n < features.num(); ) {
+      if (!file_) {
+        const string shard_name = name_ + "_" + caffe::format_int(shard_, 5) +
+            ".npy";
+        file_ = fopen(shard_name.c_str(), "wb");
+        CHECK(file_) << "Cannot create " << shard_name;
+        WriteHeader();
+      }
+      const int rows = std::min(features.num() - n,
+          FLAGS_shard_rows - shard_rows_);
+      this->WriteMatrix(features.cpu_data() + features.offset(n), rows,
+          file_);
+      shard_rows_ += rows;
+      n += rows;
+      if (shard_rows_ == FLAGS_shard_rows) {
+        CloseShard();
+      }
+    }
+  }
+
+  // The header is padded to a fixed size, so that it can be written again
+  // with the number of rows once the shard is complete.
+  void WriteHeader() {
+    const size_t kHeaderSize = 128;
+    std::ostringstream dict;
+    dict << "{'descr': '" << (FLAGS_fp16 ? "<f2" : "<f4")
+        << "', 'fortran_order': False, 'shape': (" << shard_rows_ << ", "
+        << this->dim_ << "), }";
+    // Magic string, version 1.0, little-endian header length, and the
+    // dictionary padded with spaces and ending with a newline.
+    string header("\x93NUMPY\x01\x00", 8);
+    const size_t dict_size = kHeaderSize - header.size() - 2;
+    header += static_cast<char>(dict_size & 0xff);
+    header += static_cast<char>(dict_size >> 8);
+    string padded = dict.str();
+    CHECK_LT(padded.size(), dict_size);
+    padded.append(dict_size - padded.size() - 1, ' ');
+    header += padded + "\n";
+    CHECK_EQ(fwrite(header.data(), 1, header.size(), file_), header.size())
+        << "Cannot write the features";
+  }
+
+  void CloseShard() {
+    CHECK_EQ(fseek(file_, 0, SEEK_SET), 0);
+    WriteHeader();
+    CHECK_EQ(fclose(file_), 0) << "Cannot write the features";
+    file_ = NULL;
+    ++shard_;
+    shard_rows_ = 0;
+  }
+
+  const string name_;
+  FILE* file_;
+  int shard_;
+  int shard_rows_;
+};
+
+// Writer thread: writes the buffers the forward filled, and hands them back,
+// until it gets -1.
+template <typename Dtype>
+static void WriteFeatures(
+    std::vector<boost::shared_ptr<FeatureWriter<Dtype> > >* writers,
+    std::vector<std::vector<boost::shared_ptr<Blob<Dtype> > > >* buffers,
+    BlockingQueue<int>* full_buffers, BlockingQueue<int>* free_buffers) {
+  for (int b = full_buffers->pop(); b >= 0; b = full_buffers->pop()) {
+    for (int i = 0; i < writers->size(); ++i) {
+      (*writers)[i]->Write(*(*buffers)[b][i]);
+    }
+    free_buffers->push(b);
+  }
+  for (int i = 0; i < writers->size(); ++i) {
+    (*writers)[i]->Close();
+  }
+}
+
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv);
 
@@ -30,6 +383,14 @@ int main(int argc, char** argv) {
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  string compression_name = boost::to_upper_copy(FLAGS_compression);
+  Datum_Compression compression;
+  CHECK(caffe::Datum_Compression_Parse(compression_name, &compression))
+      << "Unknown compression " << FLAGS_compression;
   const int num_required_args = 7;
   if (argc < num_required_args) {
     LOG(ERROR)<<
@@ -38,7 +399,11 @@ int feature_extraction_pipeline(int argc, char** argv) {
     "Usage: extract_features  pretrained_net_param"
     "  feature_extraction_proto_file  extract_feature_blob_name1[,name2,...]"
     "  save_feature_dataset_name1[,name2,...]  num_mini_batches  db_type"
-    "  [CPU/GPU] [DEVICE_ID=0]\n"
+    "  [CPU/GPU] [DEVICE_ID=0] [--compression={lz4,zstd}] [--fp16]"
+    "  [--pca=pca1[,pca2,...]] [--shard_rows=N]\n"
+    "db_type is leveldb or lmdb for Datums, raw for a matrix of float32"
+    " features to memory-map, with its shape in dataset_name.shape, or npy for"
+    " shards dataset_name_00000.npy, ... of such a matrix.\n"
     "Note: you can extract multiple features in one pass by specifying"
     " multiple feature blob names and dataset names separated by ','."
     " The names cannot contain white space characters and the number of blobs"
@@ -118,64 +483,79 @@ int feature_extraction_pipeline(int argc, char** argv) {
 
   int num_mini_batches = atoi(argv[++arg_pos]);
 
-  std::vector<boost::shared_ptr<db::DB> > feature_dbs;
-  std::vector<boost::shared_ptr<db::Transaction> > txns;
+  std::vector<std::string> pca_names(num_features);
+  if (!FLAGS_pca.empty()) {
+    boost::split(pca_names, FLAGS_pca, boost::is_any_of(","));
+    CHECK_EQ(pca_names.size(), num_features)
+        << " --pca must name a file, or nothing, for each feature blob";
+  }
   const char* db_type = argv[++arg_pos];
+  const bool matrix_output =
+      strcmp(db_type, "raw") == 0 || strcmp(db_type, "npy") == 0;
+  CHECK(matrix_output || !FLAGS_fp16)
+      << " --fp16 applies to the raw and npy formats only";
+  std::vector<boost::shared_ptr<FeatureWriter<Dtype> > > writers;
   for (size_t i = 0; i < num_features; ++i) {
     LOG(INFO)<< "Opening dataset " << dataset_names[i];
-    boost::shared_ptr<db::DB> db(db::GetDB(db_type));
-    db->Open(dataset_names.at(i), db::NEW);
-    feature_dbs.push_back(db);
-    boost::shared_ptr<db::Transaction> txn(db->NewTransaction());
-    txns.push_back(txn);
+    const boost::shared_ptr<Blob<Dtype> > feature_blob =
+        feature_extraction_net->blob_by_name(blob_names[i]);
+    boost::shared_ptr<PCAProjection<Dtype> > pca;
+    int dim_features = feature_blob->count(1);
+    if (!pca_names[i].empty()) {
+      pca.reset(new PCAProjection<Dtype>(pca_names[i], dim_features));
+      dim_features = pca->dim();
+    }
+    FeatureWriter<Dtype>* writer;
+    if (strcmp(db_type, "raw") == 0) {
+      writer = new RawFeatureWriter<Dtype>(dataset_names[i], dim_features);
+    } else if (strcmp(db_type, "npy") == 0) {
+      writer = new NpyFeatureWriter<Dtype>(dataset_names[i], dim_features);
+    } else {
+      // Each unpacked float_data entry takes a tag byte and four bytes of
+      // payload.
+      const size_t db_size_estimate = static_cast<size_t>(num_mini_batches) *
+          feature_blob->num() * (dim_features * 5 + 32);
+      writer = new DBFeatureWriter<Dtype>(dataset_names[i], db_type,
+          db_size_estimate, compression);
+    }
+    writer->set_pca(pca);
+    writers.push_back(boost::shared_ptr<FeatureWriter<Dtype> >(writer));
   }
 
   LOG(ERROR)<< "Extracting Features";
 
-  Datum datum;
-  std::vector<int> image_indices(num_features, 0);
+  // The forward runs on this thread, the writes on another, through
+  // queue_size buffers of the feature blobs.
+  std::vector<std::vector<boost::shared_ptr<Blob<Dtype> > > > buffers(
+      FLAGS_queue_size);
+  BlockingQueue<int> free_buffers, full_buffers;
+  for (int b = 0; b < buffers.size(); ++b) {
+    for (size_t i = 0; i < num_features; ++i) {
+      buffers[b].push_back(boost::shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+    free_buffers.push(b);
+  }
+  boost::thread writer_thread(&WriteFeatures<Dtype>, &writers, &buffers,
+      &full_buffers, &free_buffers);
   for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index) {
-    feature_extraction_net->Forward();
+    // Only the layers the feature blobs depend on run.
+    feature_extraction_net->ForwardBlobs(blob_names);
+    const int b = free_buffers.pop("Waiting for the features to be written");
     for (int i = 0; i < num_features; ++i) {
       const boost::shared_ptr<Blob<Dtype> > feature_blob =
-        feature_extraction_net->blob_by_name(blob_names[i]);
-      int batch_size = feature_blob->num();
-      int dim_features = feature_blob->count() / batch_size;
-      const Dtype* feature_blob_data;
-      for (int n = 0; n < batch_size; ++n) {
-        datum.set_height(feature_blob->height());
-        datum.set_width(feature_blob->width());
-        datum.set_channels(feature_blob->channels());
-        datum.clear_data();
-        datum.clear_float_data();
-        feature_blob_data = feature_blob->cpu_data() +
-            feature_blob->offset(n);
-        for (int d = 0; d < dim_features; ++d) {
-          datum.add_float_data(feature_blob_data[d]);
-        }
-        string key_str = caffe::format_int(image_indices[i], 10);
-
-        string out;
-        CHECK(datum.SerializeToString(&out));
-        txns.at(i)->Put(key_str, out);
-        ++image_indices[i];
-        if (image_indices[i] % 1000 == 0) {
-          txns.at(i)->Commit();
-          txns.at(i).reset(feature_dbs.at(i)->NewTransaction());
-          LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
-              " query images for feature blob " << blob_names[i];
-        }
-      }  // for (int n = 0; n < batch_size; ++n)
-    }  // for (int i = 0; i < num_features; ++i)
-  }  // for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index)
-  // write the last batch
-  for (int i = 0; i < num_features; ++i) {
-    if (image_indices[i] % 1000 != 0) {
-      txns.at(i)->Commit();
+          feature_extraction_net->blob_by_name(blob_names[i]);
+      // Copy to host memory here, so that the writer only reads it.
+      buffers[b][i]->Reshape(feature_blob->shape());
+      caffe::caffe_copy(feature_blob->count(), feature_blob->cpu_data(),
+          buffers[b][i]->mutable_cpu_data());
     }
-    LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
+    full_buffers.push(b);
+  }
+  full_buffers.push(-1);
+  writer_thread.join();
+  for (int i = 0; i < num_features; ++i) {
+    LOG(ERROR)<< "Extracted features of " << writers[i]->rows() <<
         " query images for feature blob " << blob_names[i];
-    feature_dbs.at(i)->Close();
   }
 
   LOG(ERROR)<< "Successfully extracted the features!";